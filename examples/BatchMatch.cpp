@@ -0,0 +1,71 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+#include "Configs.h"
+#include "feature_pipeline.h"
+#include "misc.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<overlap(0:all pairs)>] [<output>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    int overlap = 0;
+    if (argc > 2) { overlap = atoi(argv[2]); }
+    string outputUrl = "batch_matches.txt";
+    if (argc > 3) { outputUrl = argv[3]; }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // all pairs, or each image with its `overlap` successors
+    vector<pair<size_t, size_t>> imagePairs;
+    for (size_t i = 0; i < imagePaths.size(); ++i) {
+        size_t end = overlap > 0 ? min(imagePaths.size(), i + 1 + overlap)
+                                 : imagePaths.size();
+        for (size_t j = i + 1; j < end; ++j) {
+            imagePairs.emplace_back(i, j);
+        }
+    }
+    cout << "#Images: " << imagePaths.size()
+        << ", #Pairs: " << imagePairs.size() << "\n";
+
+    // decode, extract, match and verify run concurrently
+    FeaturePipelineOptions options;
+    FeaturePipeline pipeline(options, imagePaths, imagePairs);
+    pipeline.Start();
+
+    FILE *ofp = fopen(outputUrl.c_str(), "w");
+    ImagePairResult result;
+    while (pipeline.Next(&result)) {
+        cout << imagePaths[result.image_idx1] << " <-> "
+            << imagePaths[result.image_idx2] << ": "
+            << result.matches.size() << " matches, "
+            << result.inlier_matches.size() << " inliers\n";
+        if (ofp) {
+            fprintf(ofp, "%s %s %d %d\n",
+                imagePaths[result.image_idx1].c_str(),
+                imagePaths[result.image_idx2].c_str(),
+                (int)result.matches.size(),
+                (int)result.inlier_matches.size());
+        }
+    }
+    if (ofp) { fclose(ofp); }
+
+    for (const PipelineStageStats &stats : pipeline.Stats()) {
+        printf("%-8s %2d threads, %5d items, %8.3f s busy\n",
+            stats.name.c_str(), stats.num_workers,
+            (int)stats.num_processed, stats.busy_seconds);
+    }
+
+    return 0;
+}
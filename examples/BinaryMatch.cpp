@@ -0,0 +1,98 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "feature_matching.h"
+#include "misc.h"
+
+using namespace std;
+
+static double MsSince(const chrono::steady_clock::time_point &start)
+{
+    return chrono::duration<double, milli>(
+        chrono::steady_clock::now() - start).count();
+}
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<max-distance>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    SiftMatchOptions matchOptions;
+    if (argc > 2) { matchOptions.max_distance = atof(argv[2]); }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // both pipelines share the keypoint detection
+    SiftOptions sift_options;
+    vector<FeatureDescriptors> siftDescriptors;
+    vector<BinaryFeatureDescriptors> binaryDescriptors;
+    double siftExtractMs = 0, binaryExtractMs = 0;
+    for (const string &imagePath : imagePaths) {
+        Bitmap bitmap;
+        if (!bitmap.Read(imagePath, false)) {
+            cout << "Error reading '" << imagePath << "'\n";
+            continue;
+        }
+        FeatureKeypoints keypoints;
+        FeatureDescriptors sift;
+        BinaryFeatureDescriptors binary;
+        auto start = chrono::steady_clock::now();
+        bool success = ExtractSiftFeaturesCPU(bitmap, keypoints, sift,
+                                              sift_options);
+        siftExtractMs += MsSince(start);
+        start = chrono::steady_clock::now();
+        success = ExtractBinaryFeaturesCPU(bitmap, keypoints, binary,
+                                           sift_options) && success;
+        binaryExtractMs += MsSince(start);
+        if (!success) {
+            cout << "Error extracting features of '" << imagePath << "'\n";
+            continue;
+        }
+        siftDescriptors.push_back(move(sift));
+        binaryDescriptors.push_back(move(binary));
+    }
+
+    double siftMatchMs = 0, binaryMatchMs = 0;
+    size_t numSiftMatches = 0, numBinaryMatches = 0;
+    for (size_t i = 0; i < siftDescriptors.size(); ++i) {
+        for (size_t j = i + 1; j < siftDescriptors.size(); ++j) {
+            FeatureMatches siftMatches, binaryMatches;
+            auto start = chrono::steady_clock::now();
+            MatchSiftFeaturesCPU(matchOptions, siftDescriptors[i],
+                                 siftDescriptors[j], siftMatches);
+            siftMatchMs += MsSince(start);
+            start = chrono::steady_clock::now();
+            MatchBinaryFeaturesCPU(matchOptions, binaryDescriptors[i],
+                                   binaryDescriptors[j], binaryMatches);
+            binaryMatchMs += MsSince(start);
+            printf("%d-%d: sift %d, binary %d matches\n", (int)i, (int)j,
+                   (int)siftMatches.size(), (int)binaryMatches.size());
+            numSiftMatches += siftMatches.size();
+            numBinaryMatches += binaryMatches.size();
+        }
+    }
+
+    printf("SIFT:   extraction %.1f ms, matching %.1f ms, %d matches\n",
+        siftExtractMs, siftMatchMs, (int)numSiftMatches);
+    printf("binary: extraction %.1f ms (%.1fx), matching %.1f ms (%.1fx), "
+           "%d matches\n",
+        binaryExtractMs, siftExtractMs / max(binaryExtractMs, 1e-3),
+        binaryMatchMs, siftMatchMs / max(binaryMatchMs, 1e-3),
+        (int)numBinaryMatches);
+
+    return 0;
+}
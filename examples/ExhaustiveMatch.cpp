@@ -0,0 +1,65 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "match_database.h"
+#include "misc.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<budget(MB)>] [<output>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    double budgetMB = 1024;
+    if (argc > 2) { budgetMB = atof(argv[2]); }
+    string outputUrl = "exhaustive_matches.bin";
+    if (argc > 3) { outputUrl = argv[3]; }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // features are extracted once into the working directory, matching
+    // only reads the descriptors back block by block
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(imagePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+
+    ExhaustiveMatcherOptions options;
+    options.max_resident_bytes = static_cast<size_t>(budgetMB * 1024 * 1024);
+    BinaryFileDescriptorLoader loader(featurePaths);
+    MatchDatabase database;
+    ExhaustiveMatcherStats stats;
+    if (!MatchExhaustive(options, loader, &database, &stats)) {
+        cout << "Some descriptors failed to load\n";
+    }
+
+    printf("#Images: %d, #Blocks: %d, #Pairs: %d\n",
+        (int)featurePaths.size(), (int)stats.num_blocks, (int)stats.num_pairs);
+    printf("#Loads: %d (%.2f per image)\n", (int)stats.num_loads,
+        featurePaths.empty() ? 0.0
+                             : (double)stats.num_loads / featurePaths.size());
+
+    if (!database.Write(outputUrl)) {
+        cout << "Error writing '" << outputUrl << "'\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "fisher_encoder.h"
+#include "misc.h"
+
+using namespace std;
+
+template <typename Func>
+static double TimeMs( int repeats, Func func )
+{
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) { func(); }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(end - start).count() / repeats;
+}
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<num-clusters>] [<max-num-threads>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    FisherVectorOptions fisherOptions;
+    if (argc > 2) { fisherOptions.num_clusters = atoi(argv[2]); }
+    int maxNumThreads = max(1, (int)thread::hardware_concurrency());
+    if (argc > 3) { maxNumThreads = max(1, atoi(argv[3])); }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // features are extracted once into the working directory
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(imagePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+    BinaryFileDescriptorLoader loader(featurePaths);
+
+    // the mixture is fitted by the OpenMP code of VLFeat
+    FisherVectorEncoder encoder;
+    bool trained = false;
+    for (int numThreads = 1; numThreads <= maxNumThreads;
+         numThreads = numThreads < maxNumThreads
+                      ? min(2 * numThreads, maxNumThreads) : numThreads + 1) {
+        fisherOptions.num_threads = numThreads;
+        double trainMs = TimeMs(1, [&]() {
+            trained = encoder.Train(fisherOptions, loader);
+        });
+        if (!trained) {
+            cout << "Error training the Fisher vector encoder\n";
+            return 1;
+        }
+        printf("train: %d threads %.1f ms\n", numThreads, trainMs);
+    }
+    printf("#Images: %d, #Dimensions: %d\n", (int)featurePaths.size(),
+        encoder.NumDimensions());
+
+    // descriptors are loaded once, so that only the encoding is timed
+    vector<FeatureDescriptors> descriptors(featurePaths.size());
+    for (size_t i = 0; i < featurePaths.size(); ++i) {
+        loader.Load(i, &descriptors[i]);
+    }
+    struct MemoryLoader : public DescriptorLoader {
+        const vector<FeatureDescriptors> *descriptors;
+        size_t NumImages() const { return descriptors->size(); }
+        size_t NumBytes(const size_t idx) const {
+            return (*descriptors)[idx].size();
+        }
+        bool Load(const size_t idx, FeatureDescriptors *out) const {
+            *out = (*descriptors)[idx];
+            return true;
+        }
+    } memoryLoader;
+    memoryLoader.descriptors = &descriptors;
+
+    vector<Eigen::VectorXf> reference(featurePaths.size());
+    for (int numThreads = 1; numThreads <= maxNumThreads;
+         numThreads = numThreads < maxNumThreads
+                      ? min(2 * numThreads, maxNumThreads) : numThreads + 1) {
+        vector<Eigen::VectorXf> fishers(featurePaths.size());
+        double encodeMs = TimeMs(1, [&]() {
+            encoder.EncodeImages(memoryLoader, numThreads,
+                [&](size_t idx, const Eigen::VectorXf &fisher) {
+                    fishers[idx] = fisher;
+                });
+        });
+        if (numThreads == 1) {
+            reference = fishers;
+        } else if (fishers != reference) {
+            cout << "Mismatch between single- and multi-threaded encoding\n";
+            return 1;
+        }
+        const double imagesPerSecond =
+            1000.0 * featurePaths.size() / max(encodeMs, 1e-3);
+        printf("encode: %d threads %.1f ms, %.1f images/s, "
+               "%.1f images/s per core\n",
+               numThreads, encodeMs, imagesPerSecond,
+               imagesPerSecond / numThreads);
+    }
+
+    return 0;
+}
@@ -4,13 +4,12 @@
 #include <stdio.h>
 
 #include "Configs.h"
-#include "bitmap.h"
+#include "image_shift.h"
 
 using namespace std;
 
 int main ( int argc, char **argv )
 {
-    Bitmap input, output;
     if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
         cout << "Usage:\n\t" << argv[0] 
             << " <input-image> [<shift(0.0~1.0,+nPixel,-nPixel)>] [<output-image>]\n";
@@ -19,36 +18,22 @@ int main ( int argc, char **argv )
 
     string inputUrl  = CMAKE_SOURCE_DIR "/images/site1.jpg";
     if (argc > 1) {  inputUrl = argv[1]; }
-    if ( !input.Read(inputUrl, true) ) {
-        cout << "Error reading '" << inputUrl << "'\n";
-        return 1;
-    }
 
     double shift = 0.5;
     if (argc > 2) { shift = atof(argv[2]); }
-    if (shift > 1) {
-        // specify center pixel position
-        shift = shift / input.Width();
-        shift += 0.5;
-    } else if (shift < -1) {
-        // specify left pixel position
-        shift = (-shift) / input.Width();
-    }
-    while (shift < 0) { shift += 1.0; }
-    while (shift > 1) { shift -= 1.0; }
+    // 0~1: fraction, +nPixel: center pixel, -nPixel: left pixel
+    const ShiftMode mode = GuessShiftMode(shift);
+    if (mode == ShiftMode::LEFT_PIXEL) { shift = -shift; }
 
     string outputUrl = inputUrl + "_shifted.jpg";
     if (argc > 3) { outputUrl = argv[3]; }
 
-    output.Allocate(input.Width(), input.Height(), input.IsRGB());
-    const int lineBytes = (input.IsRGB() ? 3 : 1) * input.Width();
-    const int offset = (input.IsRGB() ? 3 : 1) * (int)(input.Width() * shift);
-    for (int i = 0; i < input.Height(); ++i) {
-        const uint8_t *line = input.GetScanline(i);
-        memcpy(output.GetScanline(i), line+offset, lineBytes-offset);
-        memcpy(output.GetScanline(i)+(lineBytes-offset), line, offset);
+    // streams strip by strip, memory is bounded by the strip size;
+    // JPEG is shifted losslessly if the offset is a multiple of the MCU width
+    if ( !ShiftImageFile(inputUrl, outputUrl, shift, mode) ) {
+        cout << "Error shifting '" << inputUrl << "' to '" << outputUrl << "'\n";
+        return 1;
     }
 
-    output.Write(outputUrl);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "descriptor_pca.h"
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "feature_matching.h"
+#include "misc.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<num-dimensions>] [<whiten>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    DescriptorPCAOptions pcaOptions;
+    if (argc > 2) { pcaOptions.num_dimensions = atoi(argv[2]); }
+    if (argc > 3) { pcaOptions.whiten = atoi(argv[3]) != 0; }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // full features are extracted once into the working directory, the
+    // images are kept for the reduced extraction below
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(imagePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+    vector<Bitmap> bitmaps(imagePaths.size());
+    for (size_t i = 0; i < imagePaths.size(); ++i) {
+        if (!featurePaths[i].empty() &&
+            !bitmaps[i].Read(imagePaths[i], false)) {
+            featurePaths[i].clear();
+        }
+    }
+    BinaryFileDescriptorLoader loader(featurePaths);
+
+    // the projection is learned from the full descriptors
+    DescriptorPCA pca;
+    if (!pca.Train(pcaOptions, loader)) {
+        cout << "Error training the descriptor PCA\n";
+        return 1;
+    }
+    pca.Write("descriptor_pca.bin");
+
+    // the reduced descriptors come straight out of the extraction
+    SiftOptions reducedOptions = sift_options;
+    reducedOptions.descriptor_pca = &pca;
+    vector<FeatureDescriptors> fullDescriptors(bitmaps.size());
+    vector<FeatureDescriptors> reducedDescriptors(bitmaps.size());
+    for (size_t i = 0; i < bitmaps.size(); ++i) {
+        if (featurePaths[i].empty()) { continue; }
+        FeatureKeypoints keypoints;
+        loader.Load(i, &fullDescriptors[i]);
+        ExtractSiftFeaturesCPU(bitmaps[i], keypoints, reducedDescriptors[i],
+                               reducedOptions);
+    }
+
+    SiftMatchOptions matchOptions;
+    SiftMatchOptions reducedMatchOptions;
+    reducedMatchOptions.reduced_descriptors = true;
+    double fullMs = 0, reducedMs = 0;
+    size_t numFullMatches = 0, numReducedMatches = 0, numCommonMatches = 0;
+    for (size_t i = 0; i < bitmaps.size(); ++i) {
+        for (size_t j = i + 1; j < bitmaps.size(); ++j) {
+            if (featurePaths[i].empty() || featurePaths[j].empty()) {
+                continue;
+            }
+            FeatureMatches fullMatches, reducedMatches;
+            auto start = chrono::steady_clock::now();
+            MatchSiftFeaturesCPU(matchOptions, fullDescriptors[i],
+                                 fullDescriptors[j], fullMatches);
+            auto middle = chrono::steady_clock::now();
+            MatchSiftFeaturesCPU(reducedMatchOptions, reducedDescriptors[i],
+                                 reducedDescriptors[j], reducedMatches);
+            auto end = chrono::steady_clock::now();
+            fullMs += chrono::duration<double, milli>(middle - start).count();
+            reducedMs += chrono::duration<double, milli>(end - middle).count();
+
+            set<pair<int, int>> fullSet;
+            for (const auto &match : fullMatches) {
+                fullSet.emplace(match.point2D_idx1, match.point2D_idx2);
+            }
+            for (const auto &match : reducedMatches) {
+                numCommonMatches += fullSet.count(
+                    make_pair(match.point2D_idx1, match.point2D_idx2));
+            }
+            numFullMatches += fullMatches.size();
+            numReducedMatches += reducedMatches.size();
+        }
+    }
+
+    printf("128-D: %d matches in %.1f ms\n", (int)numFullMatches, fullMs);
+    printf("%d-D: %d matches in %.1f ms (%.1fx), %d common (%.1f%%)\n",
+        pca.NumDimensions(), (int)numReducedMatches, reducedMs,
+        fullMs / max(reducedMs, 1e-3), (int)numCommonMatches,
+        100.0 * numCommonMatches / max<size_t>(numFullMatches, 1));
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "feature_matching.h"
+#include "misc.h"
+#include "product_quantizer.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<num-subspaces>] [<num-rerank-candidates>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    ProductQuantizerOptions pqOptions;
+    if (argc > 2) { pqOptions.num_subspaces = atoi(argv[2]); }
+    int numRerankCandidates = 4;
+    if (argc > 3) { numRerankCandidates = atoi(argv[3]); }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // features are extracted once into the working directory
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(imagePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+    BinaryFileDescriptorLoader loader(featurePaths);
+
+    ProductQuantizer quantizer;
+    if (!quantizer.Train(pqOptions, loader)) {
+        cout << "Error training the product quantizer\n";
+        return 1;
+    }
+
+    // the codes are stored next to the feature files, with the extension .pq
+    size_t rawBytes = 0, codeBytes = 0;
+    for (const string &featurePath : featurePaths) {
+        FeatureKeypoints keypoints;
+        FeatureDescriptors descriptors;
+        FeatureCodes codes;
+        if (!ReadFeaturesFromBinaryFile(featurePath, &keypoints,
+                                        &descriptors)) {
+            continue;
+        }
+        quantizer.Encode(descriptors, &codes);
+        string codePath = featurePath.substr(0, featurePath.size() - 5) + ".pq";
+        if (!WriteFeaturesToBinaryFile(codePath, keypoints, codes)) {
+            cout << "Error writing '" << codePath << "'\n";
+            return 1;
+        }
+        rawBytes += descriptors.size();
+        codeBytes += codes.size();
+    }
+    printf("#Images: %d, descriptors: %d bytes, codes: %d bytes (%.1fx)\n",
+        (int)featurePaths.size(), (int)rawBytes, (int)codeBytes,
+        (double)rawBytes / max<size_t>(codeBytes, 1));
+
+    // every image is matched against the codes of the other images
+    SiftMatchOptions matchOptions;
+    for (size_t i = 0; i < featurePaths.size(); ++i) {
+        for (size_t j = i + 1; j < featurePaths.size(); ++j) {
+            FeatureDescriptors descriptors1, descriptors2;
+            FeatureCodes codes2;
+            if (!loader.Load(i, &descriptors1) ||
+                !loader.Load(j, &descriptors2)) {
+                continue;
+            }
+            quantizer.Encode(descriptors2, &codes2);
+
+            FeatureMatches exactMatches, pqMatches, rerankMatches;
+            MatchSiftFeaturesCPU(matchOptions, descriptors1, descriptors2,
+                                 exactMatches);
+            MatchProductQuantizedFeatures(matchOptions, quantizer,
+                                          descriptors1, codes2, nullptr, 0,
+                                          &pqMatches);
+            MatchProductQuantizedFeatures(matchOptions, quantizer,
+                                          descriptors1, codes2, &descriptors2,
+                                          numRerankCandidates,
+                                          &rerankMatches);
+
+            set<pair<int, int>> exactSet;
+            for (const auto &match : exactMatches) {
+                exactSet.emplace(match.point2D_idx1, match.point2D_idx2);
+            }
+            int pqCommon = 0, rerankCommon = 0;
+            for (const auto &match : pqMatches) {
+                pqCommon += (int)exactSet.count(
+                    make_pair(match.point2D_idx1, match.point2D_idx2));
+            }
+            for (const auto &match : rerankMatches) {
+                rerankCommon += (int)exactSet.count(
+                    make_pair(match.point2D_idx1, match.point2D_idx2));
+            }
+            printf("%d-%d: exact %d, pq %d (%d common), "
+                   "re-ranked %d (%d common)\n",
+                   (int)i, (int)j, (int)exactMatches.size(),
+                   (int)pqMatches.size(), pqCommon,
+                   (int)rerankMatches.size(), rerankCommon);
+        }
+    }
+
+    return 0;
+}
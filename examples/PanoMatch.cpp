@@ -0,0 +1,112 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "pano_matching.h"
+
+using namespace std;
+
+const static BitmapColor<uint8_t> red(255, 0, 0);
+const static BitmapColor<uint8_t> yellow(255, 255, 0);
+const static BitmapColor<uint8_t> green(0, 255, 0);
+const static BitmapColor<uint8_t> white(255, 255, 255);
+const static BitmapColor<uint8_t> blue(0, 0, 255);
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <pano1> <pano2> [<output>] [<max-angle(degrees)>]\n";
+        return -1;
+    }
+
+    Bitmap img1, img2;
+    string imgurl1 = CMAKE_SOURCE_DIR "/images/site1.jpg";
+    string imgurl2 = CMAKE_SOURCE_DIR "/images/site2.jpg";
+    string imgurl3 = "pano_matched.jpg";
+    if (argc > 1) { imgurl1 = argv[1]; }
+    if (argc > 2) { imgurl2 = argv[2]; }
+    if (argc > 3) { imgurl3 = argv[3]; }
+
+    PanoMatchOptions match_options;
+    if (argc > 4) { match_options.max_angular_distance = atof(argv[4]); }
+
+    if ( !img1.Read(imgurl1, true) ) {
+        cout << "Error reading image '" << imgurl1 << "'\n";
+        return 1;
+    }
+    if ( !img2.Read(imgurl2, true) ) {
+        cout << "Error reading image '" << imgurl2 << "'\n";
+        return 1;
+    }
+
+    // seam padding, polar bands skipped, seam duplicates removed
+    PanoFeatures features1, features2;
+    if ( !ExtractPanoFeatures(img1, PanoFeatureOptions(), &features1) ||
+         !ExtractPanoFeatures(img2, PanoFeatureOptions(), &features2) ) {
+        cout << "Feature extraction error\n";
+        return 2;
+    }
+    cout << "#FeaturePoints: " << features1.keypoints.size() << ", "
+        << features2.keypoints.size() << "\n";
+
+    // coarse rotation from large-scale features, then guided matching
+    if ( !EstimatePanoRotation(features1, features2, match_options,
+                               &match_options.rotation) ) {
+        cout << "Rotation estimation failed, matching exhaustively\n";
+        match_options.max_angular_distance = 180.0;
+    }
+    FeatureMatches matches;
+    vector<float> weights;
+    MatchPanoFeatures(features1, features2, match_options, &matches, &weights);
+    cout << "#matches: " << matches.size() << "\n";
+
+    img1.DrawPoints(features1.keypoints, blue);
+    img2.DrawPoints(features2.keypoints, green);
+
+    Bitmap img12;
+    img12.Allocate(
+        max(img1.Width(),img2.Width()),
+        img1.Height()+img2.Height(), img1.IsRGB()
+    );
+    for (int i = 0; i < img1.Height(); ++i) {
+        memcpy(img12.GetScanline(i), img1.GetScanline(i),
+               (img1.IsRGB() ? 3 : 1) * img1.Width());
+    }
+    for (int i = 0; i < img2.Height(); ++i) {
+        memcpy(img12.GetScanline(i+img1.Height()), img2.GetScanline(i),
+               (img2.IsRGB() ? 3 : 1) * img2.Width());
+    }
+
+    FILE *ofp = fopen("pano_matches.txt", "w");
+    if (ofp) {
+        fprintf(ofp, "a: %s, b: %s\n", imgurl1.c_str(), imgurl2.c_str());
+    }
+    for (size_t i = 0; i < matches.size(); ++i) {
+        const FeatureKeypoint &kp1 = features1.keypoints[matches[i].point2D_idx1];
+        const FeatureKeypoint &kp2 = features2.keypoints[matches[i].point2D_idx2];
+        int x0 = kp1.x, y0 = kp1.y;
+        int x1 = kp2.x, y1 = kp2.y;
+        if (ofp) {
+            fprintf(ofp,
+                "%lf, %lf <-> %lf, %lf, %f\n",
+                (double)kp1.x/img1.Width(), (double)kp1.y/img1.Height(),
+                (double)kp2.x/img2.Width(), (double)kp2.y/img2.Height(),
+                weights[i]
+            );
+        }
+        // downweighted polar matches in yellow
+        y1 += img1.Height();
+        img12.DrawLine(x0, y0, x1, y1, weights[i] < 1 ? yellow : red);
+        img12.DrawPoint(x0, y0, white);
+        img12.DrawPoint(x1, y1, white);
+    }
+    if (ofp) { fclose(ofp); }
+    img12.Write(imgurl3);
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "match_database.h"
+#include "misc.h"
+#include "vocabulary_tree.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<num-neighbors>] [<output>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    int numNeighbors = 20;
+    if (argc > 2) { numNeighbors = atoi(argv[2]); }
+    string outputUrl = "retrieval_matches.bin";
+    if (argc > 3) { outputUrl = argv[3]; }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // features are extracted once into the working directory
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(imagePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+    BinaryFileDescriptorLoader loader(featurePaths);
+
+    // only the retrieved candidates are matched
+    ImageRetrievalOptions retrievalOptions;
+    retrievalOptions.num_neighbors = numNeighbors;
+    vector<pair<size_t, size_t>> imagePairs;
+    if (!RetrieveImagePairs(retrievalOptions, loader, &imagePairs)) {
+        cout << "Error building the vocabulary tree\n";
+        return 1;
+    }
+    const int numImages = (int)featurePaths.size();
+    printf("#Images: %d, #Candidate pairs: %d of %d\n", numImages,
+        (int)imagePairs.size(), numImages * max(numImages - 1, 0) / 2);
+
+    ExhaustiveMatcherOptions matchOptions;
+    MatchDatabase database;
+    ExhaustiveMatcherStats stats;
+    if (!MatchImagePairs(matchOptions, loader, imagePairs, &database,
+                         &stats)) {
+        cout << "Some descriptors failed to load\n";
+    }
+    printf("#Matched pairs: %d, #Loads: %d\n", (int)stats.num_pairs,
+        (int)stats.num_loads);
+
+    if (!database.Write(outputUrl)) {
+        cout << "Error writing '" << outputUrl << "'\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "match_database.h"
+#include "misc.h"
+#include "sequential_matcher.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <frame-dir> [<overlap>] [<loop-period(0:off)>] [<output>]\n";
+        return -1;
+    }
+
+    string frameDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { frameDir = argv[1]; }
+    int overlap = 10;
+    if (argc > 2) { overlap = atoi(argv[2]); }
+    int loopPeriod = 10;
+    if (argc > 3) { loopPeriod = atoi(argv[3]); }
+    string outputUrl = "sequential_matches.bin";
+    if (argc > 4) { outputUrl = argv[4]; }
+
+    // frames are ordered by file name
+    vector<string> framePaths = GetImageFileList(frameDir);
+
+    // features are extracted once into the working directory
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(framePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+
+    SequentialMatcherOptions options;
+    options.overlap = overlap;
+    options.loop_detection_period = loopPeriod;
+    BinaryFileDescriptorLoader loader(featurePaths);
+    MeanDescriptorLoopDetector loopDetector;
+    MatchDatabase database;
+    SequentialMatcherStats stats;
+    if (!MatchSequential(options, loader,
+                         loopPeriod > 0 ? &loopDetector : nullptr,
+                         &database, &stats)) {
+        cout << "Some descriptors failed to load\n";
+    }
+
+    printf("#Frames: %d, #Pairs: %d (%d loop closures), #Loads: %d\n",
+        (int)featurePaths.size(), (int)stats.num_pairs,
+        (int)stats.num_loop_pairs, (int)stats.num_loads);
+
+    if (!database.Write(outputUrl)) {
+        cout << "Error writing '" << outputUrl << "'\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -6,6 +6,7 @@
 
 #include "Configs.h"
 #include "bitmap.h"
+#include "bitmap_loader.h"
 #include "feature.h"
 #include "feature_extraction.h"
 #include "feature_matching.h"
@@ -29,22 +30,36 @@ int main ( int argc, char **argv )
     string imgurl3 = "matched.jpg";
     if (argc > 1) { imgurl1 = argv[1]; }
     if (argc > 2) { imgurl2 = argv[2]; }
-    if ( !img1.Read(imgurl1, true) ) {
+
+    // Decode the second image while extracting features from the first.
+    BitmapLoaderOptions loader_options;
+    loader_options.num_threads = 2;
+    BitmapLoader loader(loader_options);
+    loader.Submit(imgurl1);
+    loader.Submit(imgurl2);
+    loader.Finish();
+
+    FeatureKeypoints keypoints1, keypoints2;
+    FeatureDescriptors descriptors1, descriptors2;
+    SiftOptions sift_options;
+
+    LoadedBitmap loaded;
+    if ( !loader.Next(&loaded) || !loaded.success ) {
         cout << "Error reading image '" << imgurl1 << "'\n";
         return 1;
     }
-    if ( !img2.Read(imgurl2, true) ) {
+    img1 = std::move(loaded.bitmap);
+    if ( !ExtractSiftFeaturesCPU(img1, keypoints1, descriptors1, sift_options) ) {
+        cout << "Feature extraction error\n";
+        return 2;
+    }
+
+    if ( !loader.Next(&loaded) || !loaded.success ) {
         cout << "Error reading image '" << imgurl2 << "'\n";
         return 1;
     }
-
-    FeatureKeypoints keypoints1, keypoints2;
-    FeatureDescriptors descriptors1, descriptors2;
-    SiftOptions sift_options;
-    if (
-        !ExtractSiftFeaturesCPU(img1, keypoints1, descriptors1, sift_options) ||
-        !ExtractSiftFeaturesCPU(img2, keypoints2, descriptors2, sift_options)
-    ) {
+    img2 = std::move(loaded.bitmap);
+    if ( !ExtractSiftFeaturesCPU(img2, keypoints2, descriptors2, sift_options) ) {
         cout << "Feature extraction error\n";
         return 2;
     }
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "minibatch_kmeans.h"
+#include "misc.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<num-clusters>] [<num-epochs>] [<checkpoint>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    MiniBatchKMeansOptions kmeansOptions;
+    kmeansOptions.num_clusters = 256;
+    kmeansOptions.batch_size = 10000;
+    if (argc > 2) { kmeansOptions.num_clusters = atoi(argv[2]); }
+    if (argc > 3) { kmeansOptions.num_epochs = atoi(argv[3]); }
+    kmeansOptions.checkpoint_path = "kmeans_checkpoint.bin";
+    if (argc > 4) { kmeansOptions.checkpoint_path = argv[4]; }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // features are extracted once into the working directory
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(imagePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+    BinaryFileDescriptorLoader loader(featurePaths);
+
+    // descriptors are streamed from the feature files batch by batch, an
+    // interrupted run continues from the checkpoint when started again
+    MiniBatchKMeans kmeans;
+    MiniBatchKMeansStats stats;
+    if (!kmeans.Train(kmeansOptions, loader, &stats)) {
+        cout << "Error training the codebook\n";
+        return 1;
+    }
+
+    printf("#Clusters: %d, #Batches: %d, #Descriptors: %d\n",
+        kmeans.NumClusters(), (int)stats.num_batches,
+        (int)stats.num_descriptors);
+    if (stats.num_descriptors > 0) {
+        printf("MSE of last batch: %.1f, distances computed: %.1f%%\n",
+            stats.mean_squared_error,
+            100.0 * stats.num_distance_computations /
+                ((double)stats.num_descriptors * kmeans.NumClusters()));
+    }
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "image_layout.h"
+
+using namespace std;
+
+// The per-pixel implementation of Bitmap::ConvertToColMajorArray before it
+// was replaced by the tiled kernels.
+static vector<uint8_t> NaiveColMajorArray( const Bitmap &bitmap )
+{
+    const int width = bitmap.Width();
+    const int height = bitmap.Height();
+    const int channels = bitmap.Channels();
+    FIBITMAP *data = const_cast<FIBITMAP*>(bitmap.Data());
+    vector<uint8_t> array(width * height * channels);
+    size_t i = 0;
+    for (int d = 0; d < channels; ++d) {
+        for (int x = 0; x < width; ++x) {
+            for (int y = 0; y < height; ++y) {
+                const uint8_t *line =
+                    FreeImage_GetScanLine(data, height - 1 - y);
+                array[i++] = line[x * channels + d];
+            }
+        }
+    }
+    return array;
+}
+
+template <typename Func>
+static double TimeMs( int repeats, Func func )
+{
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) { func(); }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(end - start).count() / repeats;
+}
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " [<input-image>] [<repeats>] [<num-threads>]\n";
+        return -1;
+    }
+
+    string inputUrl = CMAKE_SOURCE_DIR "/images/site1.jpg";
+    if (argc > 1) { inputUrl = argv[1]; }
+    int repeats = 10;
+    if (argc > 2) { repeats = max(1, atoi(argv[2])); }
+    int numThreads = -1;
+    if (argc > 3) { numThreads = atoi(argv[3]); }
+
+    for (int asRgb = 0; asRgb < 2; ++asRgb) {
+        Bitmap bitmap;
+        if ( !bitmap.Read(inputUrl, asRgb != 0) ) {
+            cout << "Error reading '" << inputUrl << "'\n";
+            return 1;
+        }
+        const int width = bitmap.Width();
+        const int height = bitmap.Height();
+        const int channels = bitmap.Channels();
+        const uint8_t *topLine =
+            FreeImage_GetScanLine(bitmap.Data(), height - 1);
+        const ptrdiff_t stride = -static_cast<ptrdiff_t>(bitmap.ScanWidth());
+
+        vector<uint8_t> naive, tiled(width * height * channels);
+        double naiveMs = TimeMs(repeats, [&]() {
+            naive = NaiveColMajorArray(bitmap);
+        });
+        double singleMs = TimeMs(repeats, [&]() {
+            InterleavedToPlanarColMajor(topLine, stride, width, height,
+                                        channels, tiled.data(), 1);
+        });
+        double multiMs = TimeMs(repeats, [&]() {
+            InterleavedToPlanarColMajor(topLine, stride, width, height,
+                                        channels, tiled.data(), numThreads);
+        });
+
+        if (naive != tiled || naive != bitmap.ConvertToColMajorArray()) {
+            cout << "Mismatch between naive and tiled conversion\n";
+            return 1;
+        }
+
+        printf("%dx%dx%d col-major: naive %.2f ms, tiled %.2f ms (%.1fx), "
+               "threaded %.2f ms (%.1fx)\n",
+               width, height, channels, naiveMs, singleMs,
+               naiveMs / singleMs, multiMs, naiveMs / multiMs);
+    }
+
+    return 0;
+}
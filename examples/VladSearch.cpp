@@ -0,0 +1,89 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Configs.h"
+#include "bitmap.h"
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "misc.h"
+#include "vlad_index.h"
+
+using namespace std;
+
+int main ( int argc, char **argv )
+{
+    if (argc > 1 && (strcmp(argv[1],"-h")==0||strcmp(argv[1],"--help")==0)) {
+        cout << "Usage:\n\t" << argv[0]
+            << " <image-dir> [<num-neighbors>] [<index>]\n";
+        return -1;
+    }
+
+    string imageDir = CMAKE_SOURCE_DIR "/images";
+    if (argc > 1) { imageDir = argv[1]; }
+    int numNeighbors = 5;
+    if (argc > 2) { numNeighbors = atoi(argv[2]); }
+    string indexUrl = "vlad_index.bin";
+    if (argc > 3) { indexUrl = argv[3]; }
+
+    vector<string> imagePaths = GetImageFileList(imageDir);
+
+    // features are extracted once into the working directory
+    SiftOptions sift_options;
+    vector<string> featurePaths;
+    if (!ExtractFeaturesToBinaryFiles(imagePaths, sift_options, ".",
+                                      &featurePaths)) {
+        cout << "Some images failed to extract and are skipped\n";
+    }
+    BinaryFileDescriptorLoader loader(featurePaths);
+
+    // the codebook and the PCA are trained on the images themselves
+    VladOptions vladOptions;
+    VladEncoder encoder;
+    if (!encoder.Train(vladOptions, loader)) {
+        cout << "Error training the VLAD encoder\n";
+        return 1;
+    }
+
+    VladIndexWriter writer;
+    if (!writer.Open(indexUrl, encoder.NumDimensions())) {
+        cout << "Error writing '" << indexUrl << "'\n";
+        return 1;
+    }
+    FeatureDescriptors descriptors;
+    Eigen::VectorXf vlad;
+    for (size_t i = 0; i < featurePaths.size(); ++i) {
+        if (!loader.Load(i, &descriptors)) { continue; }
+        encoder.Encode(descriptors, &vlad);
+        writer.Add((uint32_t)i, vlad);
+    }
+    if (!writer.Close()) {
+        cout << "Error writing '" << indexUrl << "'\n";
+        return 1;
+    }
+
+    // the index is memory-mapped, queries scan it in parallel
+    VladIndex index;
+    if (!index.Open(indexUrl)) {
+        cout << "Error reading '" << indexUrl << "'\n";
+        return 1;
+    }
+    printf("#Images: %d, #Dimensions: %d\n", (int)index.NumVectors(),
+        index.NumDimensions());
+    vector<pair<uint32_t, float>> results;
+    for (size_t i = 0; i < index.NumVectors(); ++i) {
+        index.Search(index.Vector(i), numNeighbors + 1, -1, &results);
+        cout << imagePaths[index.ImageId(i)] << ":\n";
+        for (const auto &result : results) {
+            if (result.first == index.ImageId(i)) { continue; }
+            printf("    %.3f %s\n", result.second,
+                imagePaths[result.first].c_str());
+        }
+    }
+
+    return 0;
+}
@@ -2,35 +2,59 @@
 
 #include <unordered_map>
 #include <algorithm> 
+#include <cstring>
 #include <utility> 
 
-#include "VLFeat/imopv.h"
+#include "image_filter.h"
+#include "image_layout.h"
+#include "mapped_image.h"
 #include "misc.h"
 
 Bitmap::Bitmap()
     : data_(nullptr, &FreeImage_Unload), width_(0), height_(0), channels_(0) {}
 
-Bitmap::Bitmap(const Bitmap& other) : Bitmap() {
-  SetPtr(FreeImage_Clone(data_.get()));
+Bitmap::Bitmap(const Bitmap& other) : Bitmap() { *this = other; }
+
+Bitmap::Bitmap(Bitmap&& other) : Bitmap() { *this = std::move(other); }
+
+Bitmap& Bitmap::operator=(const Bitmap& other) {
+  if (this != &other) {
+    *this = other.Clone();
+  }
+  return *this;
+}
+
+Bitmap& Bitmap::operator=(Bitmap&& other) {
+  if (this != &other) {
+    data_ = std::move(other.data_);
+    buffer_ = std::move(other.buffer_);
+    width_ = other.width_;
+    height_ = other.height_;
+    channels_ = other.channels_;
+    other.width_ = 0;
+    other.height_ = 0;
+    other.channels_ = 0;
+  }
+  return *this;
 }
 
 Bitmap::Bitmap(FIBITMAP* data) : Bitmap() { SetPtr(data); }
 
 bool Bitmap::Allocate(const int width, const int height, const bool as_rgb) {
-  FIBITMAP* data = nullptr;
-  width_ = width;
-  height_ = height;
+  bool success;
   if (as_rgb) {
     const int kNumBitsPerPixel = 24;
-    data = FreeImage_Allocate(width, height, kNumBitsPerPixel);
-    channels_ = 3;
+    success = AllocatePooled(FIT_BITMAP, width, height, kNumBitsPerPixel, 3);
   } else {
     const int kNumBitsPerPixel = 8;
-    data = FreeImage_Allocate(width, height, kNumBitsPerPixel);
-    channels_ = 1;
+    success = AllocatePooled(FIT_BITMAP, width, height, kNumBitsPerPixel, 1);
   }
-  data_ = FIBitmapPtr(data, &FreeImage_Unload);
-  return data != nullptr;
+  if (success) {
+    // Recycled buffers contain old pixels, while FreeImage_Allocate returns
+    // zero-initialized bitmaps.
+    std::memset(buffer_.Data(), 0, buffer_.Size());
+  }
+  return success;
 }
 
 std::vector<uint8_t> Bitmap::ConvertToRawBits() const {
@@ -45,6 +69,7 @@ std::vector<uint8_t> Bitmap::ConvertToRawBits() const {
 }
 
 std::vector<uint8_t> Bitmap::ConvertToRowMajorArray() const {
+  CHECK(!IsHighBitDepth());
   std::vector<uint8_t> array(width_ * height_ * channels_);
   size_t i = 0;
   for (int y = 0; y < height_; ++y) {
@@ -60,23 +85,64 @@ std::vector<uint8_t> Bitmap::ConvertToRowMajorArray() const {
 }
 
 std::vector<uint8_t> Bitmap::ConvertToColMajorArray() const {
+  CHECK(!IsHighBitDepth());
   std::vector<uint8_t> array(width_ * height_ * channels_);
-  size_t i = 0;
-  for (int d = 0; d < channels_; ++d) {
-    for (int x = 0; x < width_; ++x) {
-      for (int y = 0; y < height_; ++y) {
-        const uint8_t* line =
-            FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
-        array[i] = line[x * channels_ + d];
-        i += 1;
+  if (array.empty()) {
+    return array;
+  }
+  // Scanlines are stored bottom-up, so walk them from the top row backwards.
+  const uint8_t* top_line = FreeImage_GetScanLine(data_.get(), height_ - 1);
+  InterleavedToPlanarColMajor(top_line, -static_cast<ptrdiff_t>(ScanWidth()),
+                              width_, height_, channels_, array.data());
+  return array;
+}
+
+void Bitmap::ConvertScanlineToFloat(const int y, float* values) const {
+  CHECK_GE(y, 0);
+  CHECK_LT(y, height_);
+
+  const uint8_t* line = FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
+  const size_t num_values = static_cast<size_t>(width_) * channels_;
+
+  switch (Type()) {
+    case FIT_BITMAP:
+      if (IsRGB()) {
+        for (int x = 0; x < width_; ++x) {
+          values[3 * x] = line[3 * x + FI_RGBA_RED] / 255.0f;
+          values[3 * x + 1] = line[3 * x + FI_RGBA_GREEN] / 255.0f;
+          values[3 * x + 2] = line[3 * x + FI_RGBA_BLUE] / 255.0f;
+        }
+      } else {
+        for (size_t i = 0; i < num_values; ++i) {
+          values[i] = line[i] / 255.0f;
+        }
       }
+      break;
+    case FIT_UINT16:
+    case FIT_RGB16: {
+      // FIRGB16 pixels are stored in RGB order on all platforms.
+      const uint16_t* line16 = reinterpret_cast<const uint16_t*>(line);
+      for (size_t i = 0; i < num_values; ++i) {
+        values[i] = line16[i] / 65535.0f;
+      }
+      break;
     }
+    case FIT_FLOAT:
+    case FIT_RGBF:
+      std::memcpy(values, line, num_values * sizeof(float));
+      break;
+    default:
+      std::fill(values, values + num_values, 0.0f);
+      break;
   }
-  return array;
 }
 
 bool Bitmap::GetPixel(const int x, const int y,
                       BitmapColor<uint8_t>* color) const {
+  if (IsHighBitDepth()) {
+    return false;
+  }
+
   if (x < 0 || x >= width_ || y < 0 || y >= height_) {
     return false;
   }
@@ -98,6 +164,10 @@ bool Bitmap::GetPixel(const int x, const int y,
 
 bool Bitmap::SetPixel(const int x, const int y,
                       const BitmapColor<uint8_t>& color) {
+  if (IsHighBitDepth()) {
+    return false;
+  }
+
   if (x < 0 || x >= width_ || y < 0 || y >= height_) {
     return false;
   }
@@ -170,6 +240,10 @@ uint8_t *Bitmap::GetScanline(const int y) {
 }
 
 void Bitmap::Fill(const BitmapColor<uint8_t>& color) {
+  if (IsHighBitDepth()) {
+    return;
+  }
+
   for (int y = 0; y < height_; ++y) {
     uint8_t* line = FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
     for (int x = 0; x < width_; ++x) {
@@ -193,6 +267,10 @@ bool Bitmap::InterpolateNearestNeighbor(const double x, const double y,
 
 bool Bitmap::InterpolateBilinear(const double x, const double y,
                                  BitmapColor<float>* color) const {
+  if (IsHighBitDepth()) {
+    return false;
+  }
+
   // FreeImage's coordinate system origin is in the lower left of the image.
   const double inv_y = height_ - 1 - y;
 
@@ -249,40 +327,63 @@ bool Bitmap::InterpolateBilinear(const double x, const double y,
   return false;
 }
 
-bool Bitmap::Read(const std::string& path, const bool as_rgb) {
-    // check file exists
-
+bool Bitmap::Read(const std::string& path, const bool as_rgb,
+                  const bool keep_bit_depth) {
   const FREE_IMAGE_FORMAT format = FreeImage_GetFileType(path.c_str(), 0);
 
   if (format == FIF_UNKNOWN) {
     return false;
   }
 
-  FIBITMAP* fi_bitmap = FreeImage_Load(format, path.c_str());
-  data_ = FIBitmapPtr(fi_bitmap, &FreeImage_Unload);
+  // Binary PGM and PPM images are copied from a memory mapping of the file,
+  // which avoids FreeImage's intermediate decode and conversions.
+  if (format == FIF_PGMRAW || format == FIF_PPMRAW) {
+    MappedImage mapped;
+    if (mapped.Open(path) &&
+        (!keep_bit_depth || mapped.View().bytes_per_value == 1)) {
+      return mapped.ToBitmap(this, as_rgb);
+    }
+  }
+
+  return SetDecodedPtr(FreeImage_Load(format, path.c_str()), as_rgb,
+                       keep_bit_depth);
+}
 
-  const FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(fi_bitmap);
+bool Bitmap::ReadFromMemory(const uint8_t* data, const size_t size,
+                            const bool as_rgb, const bool keep_bit_depth) {
+  // FreeImage only reads from the stream, so wrapping the const buffer does
+  // not copy it and does not modify it.
+  std::unique_ptr<FIMEMORY, decltype(&FreeImage_CloseMemory)> stream(
+      FreeImage_OpenMemory(const_cast<BYTE*>(data),
+                           static_cast<DWORD>(size)),
+      &FreeImage_CloseMemory);
+  if (!stream) {
+    return false;
+  }
 
-  const bool is_grey =
-      color_type == FIC_MINISBLACK && FreeImage_GetBPP(fi_bitmap) == 8;
-  const bool is_rgb =
-      color_type == FIC_RGB && FreeImage_GetBPP(fi_bitmap) == 24;
+  const FREE_IMAGE_FORMAT format =
+      FreeImage_GetFileTypeFromMemory(stream.get(), 0);
 
-  if (!is_rgb && as_rgb) {
-    FIBITMAP* converted_bitmap = FreeImage_ConvertTo24Bits(fi_bitmap);
-    data_ = FIBitmapPtr(converted_bitmap, &FreeImage_Unload);
-  } else if (!is_grey && !as_rgb) {
-    FIBITMAP* converted_bitmap = FreeImage_ConvertToGreyscale(fi_bitmap);
-    data_ = FIBitmapPtr(converted_bitmap, &FreeImage_Unload);
+  if (format == FIF_UNKNOWN) {
+    return false;
   }
 
-  width_ = FreeImage_GetWidth(data_.get());
-  height_ = FreeImage_GetHeight(data_.get());
-  channels_ = as_rgb ? 3 : 1;
+  return SetDecodedPtr(FreeImage_LoadFromMemory(format, stream.get()), as_rgb,
+                       keep_bit_depth);
+}
 
-  return true;
+namespace {
+
+int GetSaveFlags(const FREE_IMAGE_FORMAT format, const int flags) {
+  if (format == FIF_JPEG && flags == 0) {
+    // Use superb JPEG quality by default to avoid artifacts.
+    return JPEG_QUALITYSUPERB;
+  }
+  return flags;
 }
 
+}  // namespace
+
 bool Bitmap::Write(const std::string& path, const FREE_IMAGE_FORMAT format,
                    const int flags) const {
   FREE_IMAGE_FORMAT save_format;
@@ -292,11 +393,7 @@ bool Bitmap::Write(const std::string& path, const FREE_IMAGE_FORMAT format,
     save_format = format;
   }
 
-  int save_flags = flags;
-  if (save_format == FIF_JPEG && flags == 0) {
-    // Use superb JPEG quality by default to avoid artifacts.
-    save_flags = JPEG_QUALITYSUPERB;
-  }
+  const int save_flags = GetSaveFlags(save_format, flags);
 
   bool success = false;
   if (save_flags == 0) {
@@ -309,32 +406,59 @@ bool Bitmap::Write(const std::string& path, const FREE_IMAGE_FORMAT format,
   return success;
 }
 
-void Bitmap::Smooth(const float sigma_x, const float sigma_y) {
-  std::vector<float> array(width_ * height_);
-  std::vector<float> array_smoothed(width_ * height_);
-  for (int d = 0; d < channels_; ++d) {
-    size_t i = 0;
-    for (int y = 0; y < height_; ++y) {
-      const uint8_t* line = FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
-      for (int x = 0; x < width_; ++x) {
-        array[i] = line[x * channels_ + d];
-        i += 1;
-      }
-    }
+bool Bitmap::WriteToMemory(std::vector<uint8_t>* buffer,
+                           const FREE_IMAGE_FORMAT format,
+                           const int flags) const {
+  CHECK_NOTNULL(buffer);
 
-    vl_imsmooth_f(array_smoothed.data(), width_, array.data(), width_, height_,
-                  width_, sigma_x, sigma_y);
+  EncodedBitmap encoded;
+  if (!WriteToMemory(&encoded, format, flags)) {
+    return false;
+  }
 
-    i = 0;
-    for (int y = 0; y < height_; ++y) {
-      uint8_t* line = FreeImage_GetScanLine(data_.get(), height_ - 1 - y);
-      for (int x = 0; x < width_; ++x) {
-        line[x * channels_ + d] =
-            TruncateCast<float, uint8_t>(array_smoothed[i]);
-        i += 1;
-      }
-    }
+  buffer->assign(encoded.Data(), encoded.Data() + encoded.Size());
+
+  return true;
+}
+
+bool Bitmap::WriteToMemory(EncodedBitmap* encoded,
+                           const FREE_IMAGE_FORMAT format,
+                           const int flags) const {
+  CHECK_NOTNULL(encoded);
+
+  encoded->stream_.reset(FreeImage_OpenMemory());
+  encoded->data_ = nullptr;
+  encoded->size_ = 0;
+
+  if (!encoded->stream_ || format == FIF_UNKNOWN) {
+    return false;
+  }
+
+  if (!FreeImage_SaveToMemory(format, data_.get(), encoded->stream_.get(),
+                              GetSaveFlags(format, flags))) {
+    return false;
+  }
+
+  BYTE* data = nullptr;
+  DWORD size = 0;
+  if (!FreeImage_AcquireMemory(encoded->stream_.get(), &data, &size)) {
+    return false;
   }
+
+  encoded->data_ = data;
+  encoded->size_ = size;
+
+  return true;
+}
+
+void Bitmap::Smooth(const float sigma_x, const float sigma_y,
+                    const SmoothOptions& options) {
+  if (IsHighBitDepth()) {
+    return;
+  }
+
+  SmoothImage(FreeImage_GetBits(data_.get()), width_, height_, channels_,
+              ScanWidth(), sigma_x, sigma_y, options);
 }
 
 void Bitmap::Rescale(const int new_width, const int new_height,
@@ -342,30 +466,142 @@ void Bitmap::Rescale(const int new_width, const int new_height,
   SetPtr(FreeImage_Rescale(data_.get(), new_width, new_height, filter));
 }
 
-Bitmap Bitmap::Clone() const { return Bitmap(FreeImage_Clone(data_.get())); }
+Bitmap Bitmap::Clone() const {
+  Bitmap clone;
+  if (!data_) {
+    return clone;
+  }
+
+  if (!clone.AllocatePooled(FreeImage_GetImageType(data_.get()), width_,
+                            height_, BitsPerPixel(), channels_)) {
+    return Bitmap(FreeImage_Clone(data_.get()));
+  }
+
+  const size_t line_size =
+      std::min(ScanWidth(), FreeImage_GetPitch(clone.data_.get()));
+  for (int y = 0; y < height_; ++y) {
+    std::memcpy(FreeImage_GetScanLine(clone.data_.get(), y),
+                FreeImage_GetScanLine(data_.get(), y), line_size);
+  }
+
+  return clone;
+}
 
 Bitmap Bitmap::CloneAsGrey() const {
   if (IsGrey()) {
     return Clone();
-  } else {
+  }
+
+  if (Type() == FIT_RGB16) {
+    return Bitmap(FreeImage_ConvertToUINT16(data_.get()));
+  } else if (Type() == FIT_RGBF) {
+    return Bitmap(FreeImage_ConvertToFloat(data_.get()));
+  }
+
+  Bitmap grey;
+  if (!IsRGB() || BitsPerPixel() != 24 ||
+      !grey.AllocatePooled(FIT_BITMAP, width_, height_, 8, 1)) {
     return Bitmap(FreeImage_ConvertToGreyscale(data_.get()));
   }
+
+  // Same Rec. 709 luma weights and rounding as FreeImage_ConvertToGreyscale.
+  for (int y = 0; y < height_; ++y) {
+    const uint8_t* line = FreeImage_GetScanLine(data_.get(), y);
+    uint8_t* grey_line = FreeImage_GetScanLine(grey.data_.get(), y);
+    for (int x = 0; x < width_; ++x) {
+      const uint8_t* pixel = &line[3 * x];
+      grey_line[x] = static_cast<uint8_t>(0.2126f * pixel[FI_RGBA_RED] +
+                                          0.7152f * pixel[FI_RGBA_GREEN] +
+                                          0.0722f * pixel[FI_RGBA_BLUE] +
+                                          0.5f);
+    }
+  }
+
+  return grey;
 }
 
 Bitmap Bitmap::CloneAsRGB() const {
   if (IsRGB()) {
     return Clone();
-  } else {
+  }
+
+  if (Type() == FIT_UINT16) {
+    return Bitmap(FreeImage_ConvertToRGB16(data_.get()));
+  } else if (Type() == FIT_FLOAT) {
+    return Bitmap(FreeImage_ConvertToRGBF(data_.get()));
+  }
+
+  Bitmap rgb;
+  if (!IsGrey() || BitsPerPixel() != 8 ||
+      !rgb.AllocatePooled(FIT_BITMAP, width_, height_, 24, 3)) {
     return Bitmap(FreeImage_ConvertTo24Bits(data_.get()));
   }
+
+  for (int y = 0; y < height_; ++y) {
+    const uint8_t* line = FreeImage_GetScanLine(data_.get(), y);
+    uint8_t* rgb_line = FreeImage_GetScanLine(rgb.data_.get(), y);
+    for (int x = 0; x < width_; ++x) {
+      rgb_line[3 * x + FI_RGBA_RED] = line[x];
+      rgb_line[3 * x + FI_RGBA_GREEN] = line[x];
+      rgb_line[3 * x + FI_RGBA_BLUE] = line[x];
+    }
+  }
+
+  return rgb;
+}
+
+namespace {
+
+// Convert a 16-bit or float image to the natively supported grey or RGB type
+// of the same precision. Returns the input if no conversion is necessary and
+// null if the pixel type has no high bit-depth equivalent.
+FIBITMAP* ConvertToHighBitDepth(FIBITMAP* data, const bool as_rgb) {
+  const FREE_IMAGE_TYPE type = FreeImage_GetImageType(data);
+  switch (type) {
+    case FIT_UINT16:
+    case FIT_RGB16:
+    case FIT_RGBA16:
+      if (as_rgb) {
+        return type == FIT_RGB16 ? data : FreeImage_ConvertToRGB16(data);
+      } else {
+        return type == FIT_UINT16 ? data : FreeImage_ConvertToUINT16(data);
+      }
+    case FIT_FLOAT:
+    case FIT_RGBF:
+    case FIT_RGBAF:
+      if (as_rgb) {
+        return type == FIT_RGBF ? data : FreeImage_ConvertToRGBF(data);
+      } else {
+        return type == FIT_FLOAT ? data : FreeImage_ConvertToFloat(data);
+      }
+    default:
+      return nullptr;
+  }
 }
 
+}  // namespace
+
 void Bitmap::SetPtr(FIBITMAP* data) {
   data_ = FIBitmapPtr(data, &FreeImage_Unload);
+  buffer_.Reset();
 
   width_ = FreeImage_GetWidth(data);
   height_ = FreeImage_GetHeight(data);
 
+  const FREE_IMAGE_TYPE type = FreeImage_GetImageType(data);
+  if (type != FIT_BITMAP) {
+    const bool is_rgb = type == FIT_RGB16 || type == FIT_RGBA16 ||
+                        type == FIT_RGBF || type == FIT_RGBAF;
+    FIBITMAP* data_converted = ConvertToHighBitDepth(data, is_rgb);
+    if (data_converted != nullptr) {
+      if (data_converted != data) {
+        data_ = FIBitmapPtr(data_converted, &FreeImage_Unload);
+      }
+      channels_ = is_rgb ? 3 : 1;
+      return;
+    }
+  }
+
   const FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(data);
 
   const bool is_grey =
@@ -381,6 +617,81 @@ void Bitmap::SetPtr(FIBITMAP* data) {
   }
 }
 
+bool Bitmap::SetDecodedPtr(FIBITMAP* data, const bool as_rgb,
+                           const bool keep_bit_depth) {
+  if (data == nullptr) {
+    return false;
+  }
+
+  data_ = FIBitmapPtr(data, &FreeImage_Unload);
+  buffer_.Reset();
+
+  FIBITMAP* high_bit_depth_data = nullptr;
+  if (keep_bit_depth && FreeImage_GetImageType(data) != FIT_BITMAP) {
+    high_bit_depth_data = ConvertToHighBitDepth(data, as_rgb);
+  }
+
+  if (high_bit_depth_data != nullptr) {
+    if (high_bit_depth_data != data) {
+      data_ = FIBitmapPtr(high_bit_depth_data, &FreeImage_Unload);
+    }
+  } else {
+    const FREE_IMAGE_COLOR_TYPE color_type = FreeImage_GetColorType(data);
+
+    const bool is_grey =
+        color_type == FIC_MINISBLACK && FreeImage_GetBPP(data) == 8;
+    const bool is_rgb =
+        color_type == FIC_RGB && FreeImage_GetBPP(data) == 24;
+
+    if (!is_rgb && as_rgb) {
+      FIBITMAP* converted_bitmap = FreeImage_ConvertTo24Bits(data);
+      data_ = FIBitmapPtr(converted_bitmap, &FreeImage_Unload);
+    } else if (!is_grey && !as_rgb) {
+      FIBITMAP* converted_bitmap = FreeImage_ConvertToGreyscale(data);
+      data_ = FIBitmapPtr(converted_bitmap, &FreeImage_Unload);
+    }
+  }
+
+  if (!data_) {
+    return false;
+  }
+
+  width_ = FreeImage_GetWidth(data_.get());
+  height_ = FreeImage_GetHeight(data_.get());
+  channels_ = as_rgb ? 3 : 1;
+
+  return true;
+}
+
+bool Bitmap::AllocatePooled(const FREE_IMAGE_TYPE type, const int width,
+                            const int height, const unsigned int bpp,
+                            const int channels) {
+  // Same 32-bit scanline alignment as FreeImage_Allocate.
+  const int pitch = ((width * bpp + 31) / 32) * 4;
+
+  PooledBuffer buffer = BufferPool::Global().Acquire(
+      static_cast<size_t>(pitch) * static_cast<size_t>(height));
+
+  const BOOL kCopySource = FALSE;
+  FIBITMAP* data = FreeImage_ConvertFromRawBitsEx(
+      kCopySource, buffer.Data(), type, width, height, pitch, bpp,
+      FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+  if (data == nullptr) {
+    return false;
+  }
+
+  data_ = FIBitmapPtr(data, &FreeImage_Unload);
+  buffer_ = std::move(buffer);
+  width_ = width;
+  height_ = height;
+  channels_ = channels;
+
+  return true;
+}
+
+EncodedBitmap::EncodedBitmap()
+    : stream_(nullptr, &FreeImage_CloseMemory), data_(nullptr), size_(0) {}
+
 float JetColormap::Red(const float gray) { return Base(gray - 0.25f); }
 
 float JetColormap::Green(const float gray) { return Base(gray); }
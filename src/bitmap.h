@@ -16,6 +16,8 @@
 #include <FreeImage.h>
 
 #include "feature.h"
+#include "image_filter.h"
+#include "memory_pool.h"
 
 // Templated bitmap color class.
 template <typename T>
@@ -38,11 +40,22 @@ struct BitmapColor {
   T b;
 };
 
-// Wrapper class around FreeImage bitmaps.
+class EncodedBitmap;
+
+// Wrapper class around FreeImage bitmaps. Besides standard 8-bit grey and
+// 24-bit RGB bitmaps, the class can carry 16-bit (FIT_UINT16, FIT_RGB16) and
+// 32-bit float (FIT_FLOAT, FIT_RGBF) images, see `Read`. The per-pixel 8-bit
+// accessors only operate on standard bitmaps. Pixel buffers of bitmaps created by
+// `Allocate` and the `Clone*` methods are drawn from `BufferPool::Global()`
+// and returned to it on destruction.
 class Bitmap {
  public:
   Bitmap();
   Bitmap(const Bitmap& other);
+  Bitmap(Bitmap&& other);
+
+  Bitmap& operator=(const Bitmap& other);
+  Bitmap& operator=(Bitmap&& other);
 
   // Create bitmap object from existing FreeImage bitmap object. Note that
   // this class takes ownership of the object.
@@ -60,9 +73,16 @@ class Bitmap {
   inline int Height() const;
   inline int Channels() const;
 
-  // Number of bits per pixel. This is 8 for grey and 24 for RGB image.
+  // Number of bits per pixel. This is 8 for grey and 24 for RGB image, or
+  // e.g. 16 and 48 for 16-bit grey and RGB images.
   inline unsigned int BitsPerPixel() const;
 
+  // FreeImage pixel type, i.e. FIT_BITMAP for standard 8-bit images.
+  inline FREE_IMAGE_TYPE Type() const;
+
+  // Check whether the pixels are 16-bit or float instead of 8-bit.
+  inline bool IsHighBitDepth() const;
+
   // Scan width of bitmap which differs from the actual image width to achieve
   // 32 bit aligned memory. Also known as pitch or stride.
   inline unsigned int ScanWidth() const;
@@ -76,6 +96,11 @@ class Bitmap {
   std::vector<uint8_t> ConvertToRowMajorArray() const;
   std::vector<uint8_t> ConvertToColMajorArray() const;
 
+  // Convert the y-th scanline, where the 0-th scanline is at the top, to
+  // `Width() * Channels()` float values in RGB order. 8-bit and 16-bit values
+  // are scaled to [0, 1], float values are copied unchanged.
+  void ConvertScanlineToFloat(const int y, float* values) const;
+
   // Manipulate individual pixels. For grayscale images, only the red element
   // of the RGB color is used.
   bool GetPixel(const int x, const int y, BitmapColor<uint8_t>* color) const;
@@ -97,8 +122,19 @@ class Bitmap {
   bool InterpolateBilinear(const double x, const double y,
                            BitmapColor<float>* color) const;
 
-  // Read bitmap at given path and convert to grey- or colorscale.
-  bool Read(const std::string& path, const bool as_rgb = true);
+  // Read bitmap at given path and convert to grey- or colorscale. If
+  // `keep_bit_depth` is true, 16-bit and float images keep their pixel type
+  // (FIT_UINT16/FIT_RGB16 or FIT_FLOAT/FIT_RGBF) instead of being quantized
+  // to 8 bits.
+  bool Read(const std::string& path, const bool as_rgb = true,
+            const bool keep_bit_depth = false);
+
+  // Decode an encoded image (e.g. the contents of a JPEG file) from memory
+  // and convert to grey- or colorscale. The caller's buffer is borrowed for
+  // the duration of the call and is not copied.
+  bool ReadFromMemory(const uint8_t* data, const size_t size,
+                      const bool as_rgb = true,
+                      const bool keep_bit_depth = false);
 
   // Write image to file. Flags can be used to set e.g. the JPEG quality.
   // Consult the FreeImage documentation for all available flags.
@@ -106,8 +142,22 @@ class Bitmap {
              const FREE_IMAGE_FORMAT format = FIF_UNKNOWN,
              const int flags = 0) const;
 
-  // Smooth the image using a Gaussian kernel.
-  void Smooth(const float sigma_x, const float sigma_y);
+  // Encode image in the given format and copy the result into the buffer.
+  bool WriteToMemory(std::vector<uint8_t>* buffer,
+                     const FREE_IMAGE_FORMAT format,
+                     const int flags = 0) const;
+
+  // Encode image in the given format into a memory stream owned by `encoded`,
+  // which exposes the encoded bytes without an additional copy.
+  bool WriteToMemory(EncodedBitmap* encoded,
+                     const FREE_IMAGE_FORMAT format,
+                     const int flags = 0) const;
+
+  // Smooth the image using a Gaussian kernel. All channels are filtered in a
+  // single pass over the interleaved pixels, split over multiple threads.
+  // Only 8-bit images are supported.
+  void Smooth(const float sigma_x, const float sigma_y,
+              const SmoothOptions& options = SmoothOptions());
 
   // Rescale image to the new dimensions.
   void Rescale(const int new_width, const int new_height,
@@ -123,12 +173,47 @@ class Bitmap {
 
   void SetPtr(FIBITMAP* data);
 
+  // Allocate a bitmap whose pixels live in a buffer from the global pool.
+  // The contents of the pixels are undefined.
+  bool AllocatePooled(const FREE_IMAGE_TYPE type, const int width,
+                      const int height, const unsigned int bpp,
+                      const int channels);
+
+  // Take ownership of a freshly decoded bitmap and convert it to grey- or
+  // colorscale. Returns false if the bitmap is null.
+  bool SetDecodedPtr(FIBITMAP* data, const bool as_rgb,
+                     const bool keep_bit_depth);
+
+  // Declared before `data_`, so that the FreeImage header referencing the
+  // pooled pixels is destroyed before the pixels are returned to the pool.
+  PooledBuffer buffer_;
   FIBitmapPtr data_;
   int width_;
   int height_;
   int channels_;
 };
 
+// Encoded image data (e.g. a JPEG file) held in a FreeImage memory stream.
+// The bytes stay valid until the object is destroyed or reused.
+class EncodedBitmap {
+ public:
+  EncodedBitmap();
+
+  // Pointer to and size of the encoded bytes.
+  inline const uint8_t* Data() const;
+  inline size_t Size() const;
+
+ private:
+  friend class Bitmap;
+
+  typedef std::unique_ptr<FIMEMORY, decltype(&FreeImage_CloseMemory)>
+      FIMemoryPtr;
+
+  FIMemoryPtr stream_;
+  uint8_t* data_;
+  size_t size_;
+};
+
 // Jet colormap inspired by Matlab. Grayvalues are expected in the range [0, 1]
 // and are converted to RGB values in the same range.
 class JetColormap {
@@ -204,6 +289,14 @@ unsigned int Bitmap::BitsPerPixel() const {
   return FreeImage_GetBPP(data_.get());
 }
 
+FREE_IMAGE_TYPE Bitmap::Type() const {
+  return FreeImage_GetImageType(data_.get());
+}
+
+bool Bitmap::IsHighBitDepth() const {
+  return data_ && FreeImage_GetImageType(data_.get()) != FIT_BITMAP;
+}
+
 unsigned int Bitmap::ScanWidth() const {
   return FreeImage_GetPitch(data_.get());
 }
@@ -212,4 +305,8 @@ bool Bitmap::IsRGB() const { return channels_ == 3; }
 
 bool Bitmap::IsGrey() const { return channels_ == 1; }
 
+const uint8_t* EncodedBitmap::Data() const { return data_; }
+
+size_t EncodedBitmap::Size() const { return size_; }
+
 #endif  // COLMAP_SRC_UTIL_BITMAP_H_
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include "bitmap_loader.h"
+
+#include <algorithm>
+
+#include "image_info.h"
+#include "misc.h"
+#include "threading.h"
+
+BitmapLoader::BitmapLoader(const BitmapLoaderOptions& options)
+    : options_(options),
+      num_submitted_(0),
+      num_delivered_(0),
+      next_index_(0),
+      num_reserved_(0),
+      num_reserved_bytes_(0),
+      finished_(false),
+      stopped_(false) {
+  const int num_threads = GetEffectiveNumThreads(options_.num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(&BitmapLoader::WorkerFunc, this);
+  }
+}
+
+BitmapLoader::~BitmapLoader() { Stop(); }
+
+size_t BitmapLoader::Submit(const std::string& path) {
+  size_t index;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    CHECK(!finished_);
+    index = num_submitted_;
+    num_submitted_ += 1;
+    Task task;
+    task.index = index;
+    task.path = path;
+    tasks_.push_back(task);
+  }
+  task_condition_.notify_one();
+  return index;
+}
+
+void BitmapLoader::Finish() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_ = true;
+  }
+  task_condition_.notify_all();
+  ready_condition_.notify_all();
+}
+
+bool BitmapLoader::Next(LoadedBitmap* loaded) {
+  CHECK_NOTNULL(loaded);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto HasReady = [this]() {
+    return options_.in_order ? ready_.count(next_index_) > 0
+                             : !ready_order_.empty();
+  };
+
+  ready_condition_.wait(lock, [&]() {
+    return stopped_ || HasReady() ||
+           (finished_ && num_delivered_ == num_submitted_);
+  });
+
+  if (stopped_ || !HasReady()) {
+    return false;
+  }
+
+  size_t index;
+  if (options_.in_order) {
+    index = next_index_;
+    next_index_ += 1;
+  } else {
+    index = ready_order_.front();
+    ready_order_.pop_front();
+  }
+
+  auto ready_it = ready_.find(index);
+  *loaded = std::move(ready_it->second);
+  ready_.erase(ready_it);
+
+  auto reserved_it = reserved_bytes_.find(index);
+  if (reserved_it != reserved_bytes_.end()) {
+    num_reserved_bytes_ -= reserved_it->second;
+    reserved_bytes_.erase(reserved_it);
+  }
+
+  num_reserved_ -= 1;
+  num_delivered_ += 1;
+
+  lock.unlock();
+
+  task_condition_.notify_all();
+  reserve_condition_.notify_all();
+
+  return true;
+}
+
+void BitmapLoader::Stop() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopped_) {
+      return;
+    }
+    stopped_ = true;
+    tasks_.clear();
+  }
+
+  task_condition_.notify_all();
+  ready_condition_.notify_all();
+  reserve_condition_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+
+  ready_.clear();
+  ready_order_.clear();
+  reserved_bytes_.clear();
+}
+
+size_t BitmapLoader::NumReservedBytes() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return num_reserved_bytes_;
+}
+
+bool BitmapLoader::CanReserve(const size_t index,
+                              const size_t num_bytes) const {
+  // The next image in submission order must always be allowed to proceed,
+  // since the consumer may be waiting for it while later images hold the
+  // memory budget.
+  return num_reserved_bytes_ == 0 ||
+         num_reserved_bytes_ + num_bytes <= options_.max_prefetched_bytes ||
+         (options_.in_order && index == next_index_);
+}
+
+void BitmapLoader::WorkerFunc() {
+  const size_t max_num_prefetched =
+      static_cast<size_t>(std::max(1, options_.max_num_prefetched));
+
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_condition_.wait(lock, [&]() {
+        return stopped_ || (finished_ && tasks_.empty()) ||
+               (!tasks_.empty() && num_reserved_ < max_num_prefetched);
+      });
+      if (stopped_ || tasks_.empty()) {
+        return;
+      }
+      task = tasks_.front();
+      tasks_.pop_front();
+      num_reserved_ += 1;
+    }
+
+    if (options_.max_prefetched_bytes > 0) {
+      const ImageInfo info = ProbeImage(task.path);
+      size_t bytes_per_channel = 1;
+      if (options_.keep_bit_depth && info.type != FIT_BITMAP &&
+          info.channels > 0) {
+        bytes_per_channel = info.bits_per_pixel / 8 / info.channels;
+      }
+      const size_t num_bytes = static_cast<size_t>(info.width) *
+                               static_cast<size_t>(info.height) *
+                               (options_.as_rgb ? 3 : 1) * bytes_per_channel;
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      reserve_condition_.wait(lock, [&]() {
+        return stopped_ || CanReserve(task.index, num_bytes);
+      });
+      if (stopped_) {
+        return;
+      }
+      num_reserved_bytes_ += num_bytes;
+      reserved_bytes_.emplace(task.index, num_bytes);
+    }
+
+    LoadedBitmap loaded;
+    loaded.index = task.index;
+    loaded.path = task.path;
+    loaded.success = loaded.bitmap.Read(task.path, options_.as_rgb,
+                                        options_.keep_bit_depth);
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stopped_) {
+        return;
+      }
+      ready_.emplace(task.index, std::move(loaded));
+      if (!options_.in_order) {
+        ready_order_.push_back(task.index);
+      }
+    }
+
+    ready_condition_.notify_all();
+  }
+}
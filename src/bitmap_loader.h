@@ -0,0 +1,122 @@
+#ifndef COLMAP_SRC_UTIL_BITMAP_LOADER_H_
+#define COLMAP_SRC_UTIL_BITMAP_LOADER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bitmap.h"
+
+struct BitmapLoaderOptions {
+  // Number of decoder threads. If `num_threads <= 0`, all hardware threads
+  // are used.
+  int num_threads = -1;
+
+  // Maximum number of images that are being decoded or are decoded and wait
+  // to be consumed.
+  int max_num_prefetched = 8;
+
+  // Maximum number of bytes of decoded pixel data held by the loader. The
+  // size of an image is estimated from its header before decoding. A value
+  // of 0 disables the limit. A single image larger than the limit is still
+  // loaded, but never concurrently with other images.
+  size_t max_prefetched_bytes = 1024 * 1024 * 1024;
+
+  // Whether to convert the images to RGB or greyscale.
+  bool as_rgb = true;
+
+  // Whether to keep 16-bit and float images at their native precision.
+  bool keep_bit_depth = false;
+
+  // Whether to deliver the images in submission order. Otherwise, images are
+  // delivered as soon as they are decoded.
+  bool in_order = true;
+};
+
+struct LoadedBitmap {
+  // Index of the image in the order of submission.
+  size_t index = 0;
+
+  std::string path;
+  Bitmap bitmap;
+
+  // Whether the image was decoded successfully.
+  bool success = false;
+};
+
+// Decodes a queue of images on a pool of worker threads and keeps a bounded
+// number of decoded images ready, so that decoding overlaps with the
+// processing of already decoded images:
+//
+//    BitmapLoader loader(options);
+//    for (const auto& path : paths) {
+//      loader.Submit(path);
+//    }
+//    loader.Finish();
+//
+//    LoadedBitmap loaded;
+//    while (loader.Next(&loaded)) {
+//      // Process `loaded.bitmap`, while the next images are being decoded.
+//    }
+//
+class BitmapLoader {
+ public:
+  explicit BitmapLoader(const BitmapLoaderOptions& options);
+  ~BitmapLoader();
+
+  // Queue an image for decoding and return its submission index.
+  size_t Submit(const std::string& path);
+
+  // Signal that no more images will be submitted.
+  void Finish();
+
+  // Block until the next image is available. Returns false once all
+  // submitted images were delivered and `Finish` was called, or after the
+  // loader was stopped.
+  bool Next(LoadedBitmap* loaded);
+
+  // Stop all workers and discard pending and undelivered images.
+  void Stop();
+
+  // Number of bytes currently reserved for decoded images.
+  size_t NumReservedBytes();
+
+ private:
+  struct Task {
+    size_t index;
+    std::string path;
+  };
+
+  void WorkerFunc();
+
+  // Whether an image of the given estimated size may start decoding.
+  bool CanReserve(const size_t index, const size_t num_bytes) const;
+
+  const BitmapLoaderOptions options_;
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable task_condition_;
+  std::condition_variable ready_condition_;
+  std::condition_variable reserve_condition_;
+
+  std::deque<Task> tasks_;
+  std::map<size_t, LoadedBitmap> ready_;
+  std::deque<size_t> ready_order_;
+  std::map<size_t, size_t> reserved_bytes_;
+
+  size_t num_submitted_;
+  size_t num_delivered_;
+  size_t next_index_;
+  size_t num_reserved_;
+  size_t num_reserved_bytes_;
+  bool finished_;
+  bool stopped_;
+};
+
+#endif  // COLMAP_SRC_UTIL_BITMAP_LOADER_H_
@@ -0,0 +1,222 @@
+#ifndef COLMAP_SRC_UTIL_BOUNDED_QUEUE_H_
+#define COLMAP_SRC_UTIL_BOUNDED_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// Bounded multi-producer multi-consumer queue on a ring buffer, in which
+// producers and consumers synchronize only through atomic sequence numbers
+// per slot, see Dmitry Vyukov's "Bounded MPMC queue". `TryPush` and `TryPop`
+// are lock-free. `Push` blocks while the queue is full, which applies
+// backpressure to producers, and `Pop` blocks while it is empty:
+//
+//    BoundedQueue<int> queue(16);
+//    std::thread producer([&]() {
+//      for (int i = 0; i < 100; ++i) {
+//        queue.Push(i);
+//      }
+//      queue.Close();
+//    });
+//    int value;
+//    while (queue.Pop(&value)) {
+//      // Process `value`.
+//    }
+//    producer.join();
+//
+template <typename T>
+class BoundedQueue {
+ public:
+  // The capacity is rounded up to the next power of two.
+  explicit BoundedQueue(const size_t capacity);
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  inline size_t Capacity() const;
+
+  // Approximate number of queued items.
+  size_t Size() const;
+
+  // Try to enqueue or dequeue an item without blocking.
+  bool TryPush(T&& item);
+  bool TryPop(T* item);
+
+  // Enqueue an item, waiting while the queue is full. Returns false if the
+  // queue was closed, in which case the item is dropped.
+  bool Push(T item);
+
+  // Dequeue an item, waiting while the queue is empty. Returns false once the
+  // queue is closed and all items were dequeued.
+  bool Pop(T* item);
+
+  // Signal that no more items will be pushed. Waiting producers and
+  // consumers return once the remaining items were dequeued.
+  void Close();
+  bool IsClosed() const;
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  // Exponential backoff of waiting threads, from spinning over yielding to
+  // sleeping, so that idle stages do not occupy a core.
+  static void Backoff(int* num_waits);
+
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Producers and consumers on separate cache lines.
+  alignas(64) std::atomic<size_t> push_pos_;
+  alignas(64) std::atomic<size_t> pop_pos_;
+  alignas(64) std::atomic<bool> closed_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+namespace internal {
+
+inline size_t NextPowerOfTwo(const size_t value) {
+  size_t power = 1;
+  while (power < value) {
+    power *= 2;
+  }
+  return power;
+}
+
+}  // namespace internal
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(const size_t capacity)
+    : mask_(internal::NextPowerOfTwo(std::max<size_t>(2, capacity)) - 1),
+      slots_(new Slot[mask_ + 1]),
+      push_pos_(0),
+      pop_pos_(0),
+      closed_(false) {
+  for (size_t i = 0; i <= mask_; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+size_t BoundedQueue<T>::Capacity() const {
+  return mask_ + 1;
+}
+
+template <typename T>
+size_t BoundedQueue<T>::Size() const {
+  const size_t pop_pos = pop_pos_.load(std::memory_order_relaxed);
+  const size_t push_pos = push_pos_.load(std::memory_order_relaxed);
+  return push_pos > pop_pos ? push_pos - pop_pos : 0;
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPush(T&& item) {
+  size_t pos = push_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot& slot = slots_[pos & mask_];
+    const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    const ptrdiff_t diff =
+        static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos);
+    if (diff == 0) {
+      // The slot is free, try to claim it.
+      if (push_pos_.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        slot.item = std::move(item);
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // The slot still holds an item from the previous round, i.e. full.
+      return false;
+    } else {
+      pos = push_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T>
+bool BoundedQueue<T>::TryPop(T* item) {
+  size_t pos = pop_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot& slot = slots_[pos & mask_];
+    const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    const ptrdiff_t diff =
+        static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos + 1);
+    if (diff == 0) {
+      // The slot holds an item, try to claim it.
+      if (pop_pos_.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+        *item = std::move(slot.item);
+        slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      // The slot has not been written yet, i.e. empty.
+      return false;
+    } else {
+      pos = pop_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T>
+bool BoundedQueue<T>::Push(T item) {
+  int num_waits = 0;
+  while (!IsClosed()) {
+    if (TryPush(std::move(item))) {
+      return true;
+    }
+    Backoff(&num_waits);
+  }
+  return false;
+}
+
+template <typename T>
+bool BoundedQueue<T>::Pop(T* item) {
+  int num_waits = 0;
+  while (true) {
+    if (TryPop(item)) {
+      return true;
+    }
+    // Items pushed before closing must still be dequeued.
+    if (IsClosed()) {
+      return TryPop(item);
+    }
+    Backoff(&num_waits);
+  }
+}
+
+template <typename T>
+void BoundedQueue<T>::Close() {
+  closed_.store(true, std::memory_order_release);
+}
+
+template <typename T>
+bool BoundedQueue<T>::IsClosed() const {
+  return closed_.load(std::memory_order_acquire);
+}
+
+template <typename T>
+void BoundedQueue<T>::Backoff(int* num_waits) {
+  const int kNumSpins = 16;
+  const int kNumYields = 64;
+  if (*num_waits < kNumSpins) {
+    // Busy wait for items that are about to arrive.
+  } else if (*num_waits < kNumSpins + kNumYields) {
+    std::this_thread::yield();
+  } else {
+    const int exponent = std::min(10, *num_waits - kNumSpins - kNumYields);
+    std::this_thread::sleep_for(std::chrono::microseconds(1 << exponent));
+  }
+  *num_waits += 1;
+}
+
+#endif  // COLMAP_SRC_UTIL_BOUNDED_QUEUE_H_
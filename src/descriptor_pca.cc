@@ -0,0 +1,194 @@
+#include "descriptor_pca.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <random>
+
+#include <Eigen/Eigenvalues>
+
+#include "misc.h"
+#include "threading.h"
+
+bool DescriptorPCA::Train(const DescriptorPCAOptions& options,
+                          const DescriptorLoader& loader) {
+  mean_.resize(0);
+  projection_.resize(0, 0);
+
+  const size_t num_images = loader.NumImages();
+  const size_t num_train_images =
+      std::min(num_images, options.max_num_training_images);
+  if (num_train_images == 0 || options.num_dimensions <= 0) {
+    return false;
+  }
+
+  // Sample the same number of descriptors from every image.
+  const size_t max_num_samples = std::max<size_t>(
+      1, options.max_num_training_descriptors / num_train_images);
+  std::vector<FeatureDescriptors> samples(num_train_images);
+  ParallelForRange(
+      0, num_train_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        for (size_t i = begin; i < end; ++i) {
+          const size_t image_idx = i * num_images / num_train_images;
+          if (!loader.Load(image_idx, &descriptors)) {
+            continue;
+          }
+          std::vector<FeatureDescriptors::Index> rows(descriptors.rows());
+          std::iota(rows.begin(), rows.end(), 0);
+          std::mt19937 random_engine(static_cast<unsigned>(i));
+          std::shuffle(rows.begin(), rows.end(), random_engine);
+          rows.resize(std::min(rows.size(), max_num_samples));
+          samples[i].resize(rows.size(), descriptors.cols());
+          for (size_t j = 0; j < rows.size(); ++j) {
+            samples[i].row(j) = descriptors.row(rows[j]);
+          }
+        }
+      });
+
+  Eigen::DenseIndex num_samples = 0;
+  Eigen::DenseIndex dim = 0;
+  for (const auto& image_samples : samples) {
+    num_samples += image_samples.rows();
+    dim = std::max(dim, image_samples.cols());
+  }
+  Eigen::MatrixXf training_descriptors(num_samples, dim);
+  num_samples = 0;
+  for (const auto& image_samples : samples) {
+    if (image_samples.cols() == dim) {
+      training_descriptors.middleRows(num_samples, image_samples.rows()) =
+          image_samples.cast<float>();
+      num_samples += image_samples.rows();
+    }
+  }
+  training_descriptors.conservativeResize(num_samples, dim);
+  samples.clear();
+  if (num_samples <= dim || options.num_dimensions > dim) {
+    return false;
+  }
+
+  const Eigen::VectorXf mean =
+      training_descriptors.colwise().mean().transpose();
+  training_descriptors.rowwise() -= mean.transpose();
+  const Eigen::MatrixXf covariance =
+      training_descriptors.transpose() * training_descriptors /
+      static_cast<float>(num_samples);
+  const Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> eigen_solver(
+      covariance);
+
+  // Eigenvalues are in increasing order.
+  const Eigen::VectorXf variances =
+      eigen_solver.eigenvalues().tail(options.num_dimensions).reverse();
+  projection_ = eigen_solver.eigenvectors()
+                    .rightCols(options.num_dimensions)
+                    .rowwise()
+                    .reverse()
+                    .transpose();
+  if (options.whiten) {
+    const float mean_variance = variances.mean();
+    for (int i = 0; i < options.num_dimensions; ++i) {
+      projection_.row(i) *=
+          std::sqrt(mean_variance / std::max(variances(i), 1e-6f));
+    }
+  }
+  mean_ = mean;
+
+  return true;
+}
+
+bool DescriptorPCA::IsTrained() const { return projection_.size() > 0; }
+
+int DescriptorPCA::NumDimensions() const {
+  return static_cast<int>(projection_.rows());
+}
+
+int DescriptorPCA::InputDimension() const {
+  return static_cast<int>(projection_.cols());
+}
+
+uint64_t DescriptorPCA::Hash() const {
+  const uint64_t shape[2] = {static_cast<uint64_t>(projection_.rows()),
+                             static_cast<uint64_t>(projection_.cols())};
+  uint64_t hash = HashBytes(shape, sizeof(shape));
+  hash = HashBytes(mean_.data(), mean_.size() * sizeof(float), hash);
+  return HashBytes(projection_.data(), projection_.size() * sizeof(float),
+                   hash);
+}
+
+FeatureDescriptors DescriptorPCA::Project(
+    const Eigen::MatrixXf& descriptors) const {
+  // The same linear scaling as `FeatureDescriptorsToUnsignedByte`.
+  return ProjectScaled(512.0f * descriptors);
+}
+
+FeatureDescriptors DescriptorPCA::Project(
+    const FeatureDescriptors& descriptors) const {
+  return ProjectScaled(descriptors.cast<float>());
+}
+
+bool DescriptorPCA::Write(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  const uint32_t header[2] = {static_cast<uint32_t>(projection_.rows()),
+                              static_cast<uint32_t>(projection_.cols())};
+  const size_t num_values = static_cast<size_t>(projection_.size());
+  bool success =
+      fwrite(header, sizeof(uint32_t), 2, file) == 2 &&
+      fwrite(mean_.data(), sizeof(float), mean_.size(), file) ==
+          static_cast<size_t>(mean_.size()) &&
+      fwrite(projection_.data(), sizeof(float), num_values, file) ==
+          num_values;
+  success = fclose(file) == 0 && success;
+  return success;
+}
+
+bool DescriptorPCA::Read(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  uint32_t header[2];
+  bool success = fread(header, sizeof(uint32_t), 2, file) == 2;
+  if (success) {
+    mean_.resize(header[1]);
+    projection_.resize(header[0], header[1]);
+    const size_t num_values = static_cast<size_t>(projection_.size());
+    success = fread(mean_.data(), sizeof(float), mean_.size(), file) ==
+                  static_cast<size_t>(mean_.size()) &&
+              fread(projection_.data(), sizeof(float), num_values, file) ==
+                  num_values;
+  }
+  fclose(file);
+
+  if (!success) {
+    mean_.resize(0);
+    projection_.resize(0, 0);
+  }
+  return success;
+}
+
+FeatureDescriptors DescriptorPCA::ProjectScaled(
+    const Eigen::MatrixXf& descriptors) const {
+  FeatureDescriptors reduced_descriptors(descriptors.rows(),
+                                         projection_.rows());
+  if (descriptors.cols() != mean_.size()) {
+    reduced_descriptors.resize(0, projection_.rows());
+    return reduced_descriptors;
+  }
+
+  const Eigen::MatrixXf components =
+      (descriptors.rowwise() - mean_.transpose()) * projection_.transpose();
+  for (Eigen::DenseIndex i = 0; i < components.rows(); ++i) {
+    for (Eigen::DenseIndex j = 0; j < components.cols(); ++j) {
+      reduced_descriptors(i, j) = static_cast<uint8_t>(std::min(
+          255.0f, std::max(0.0f, std::round(components(i, j) + 128.0f))));
+    }
+  }
+  return reduced_descriptors;
+}
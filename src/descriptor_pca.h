@@ -0,0 +1,88 @@
+#ifndef COLMAP_SRC_BASE_DESCRIPTOR_PCA_H_
+#define COLMAP_SRC_BASE_DESCRIPTOR_PCA_H_
+
+#include <cstdint>
+#include <string>
+
+#include <Eigen/Core>
+
+#include "exhaustive_matcher.h"
+#include "feature.h"
+
+struct DescriptorPCAOptions {
+  // Dimension of the reduced descriptors, e.g. 32 or 64.
+  int num_dimensions = 64;
+
+  // Whether to whiten the principal components, where all components are
+  // scaled to their mean variance, so that distances keep their scale.
+  // Without whitening, the distances of the reduced descriptors are closer
+  // to those of the full descriptors, but the leading components are
+  // clipped more often.
+  bool whiten = false;
+
+  // Maximum number of images to train on and maximum number of descriptors
+  // sampled from them.
+  size_t max_num_training_images = 1000;
+  size_t max_num_training_descriptors = 200000;
+
+  // Number of threads to load the training images. If `num_threads <= 0`,
+  // the number of hardware threads is used.
+  int num_threads = -1;
+};
+
+// Reduces SIFT descriptors to their principal components, which are stored
+// as unsigned bytes with an offset of 128, in the units of the unsigned byte
+// representation of `FeatureDescriptorsToUnsignedByte`. Components beyond
+// +/-127 are clipped, which whitening makes rare. `MatchSiftFeaturesCPU`
+// matches the reduced descriptors by their distances, which approximate the
+// distances of the full descriptors, if `SiftMatchOptions::reduced_descriptors`
+// is set.
+class DescriptorPCA {
+ public:
+  // Train the projection on a uniform subset of the unsigned byte
+  // descriptors of the images.
+  bool Train(const DescriptorPCAOptions& options,
+             const DescriptorLoader& loader);
+
+  bool IsTrained() const;
+  int NumDimensions() const;
+
+  // Dimension of the descriptors that are projected, i.e. 128 for SIFT.
+  int InputDimension() const;
+
+  // Hash of the mean and the projection, which identifies the reduced
+  // descriptors, e.g. of cached feature files.
+  uint64_t Hash() const;
+
+  // Project normalized floating point descriptors, e.g. inside the feature
+  // extraction before the conversion to unsigned bytes. Thread-safe.
+  FeatureDescriptors Project(const Eigen::MatrixXf& descriptors) const;
+
+  // Project unsigned byte descriptors, e.g. of previously extracted
+  // features. Thread-safe.
+  FeatureDescriptors Project(const FeatureDescriptors& descriptors) const;
+
+  // The file format is:
+  //
+  //    uint32 NUM_DIMENSIONS uint32 DIM
+  //    DIM x float MEAN
+  //    NUM_DIMENSIONS x DIM x float PROJECTION
+  //
+  // with values stored in the byte order of the host.
+  bool Write(const std::string& path) const;
+  bool Read(const std::string& path);
+
+ private:
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor>
+      RowMajorMatrixXf;
+
+  // Project descriptors in unsigned byte units, one per row.
+  FeatureDescriptors ProjectScaled(const Eigen::MatrixXf& descriptors) const;
+
+  Eigen::VectorXf mean_;
+  // Principal components, one per row, scaled by the whitening.
+  RowMajorMatrixXf projection_;
+};
+
+#endif  // COLMAP_SRC_BASE_DESCRIPTOR_PCA_H_
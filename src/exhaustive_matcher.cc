@@ -0,0 +1,260 @@
+#include "exhaustive_matcher.h"
+
+#include <algorithm>
+#include <future>
+#include <unordered_set>
+#include <utility>
+
+#include "threading.h"
+
+namespace {
+
+struct DescriptorBlock {
+  size_t block_idx = 0;
+  std::vector<size_t> image_idxs;
+  std::vector<FeatureDescriptors> descriptors;
+  std::vector<bool> loaded;
+};
+
+DescriptorBlock LoadBlock(const DescriptorLoader& loader,
+                          const size_t block_idx,
+                          const std::vector<size_t>& image_idxs) {
+  DescriptorBlock block;
+  block.block_idx = block_idx;
+  block.image_idxs = image_idxs;
+  block.descriptors.resize(image_idxs.size());
+  block.loaded.resize(image_idxs.size(), false);
+  for (size_t i = 0; i < image_idxs.size(); ++i) {
+    block.loaded[i] = loader.Load(image_idxs[i], &block.descriptors[i]);
+  }
+  return block;
+}
+
+void AccumulateLoadStats(const DescriptorBlock& block,
+                         ExhaustiveMatcherStats* stats) {
+  stats->num_loads += block.image_idxs.size();
+  stats->num_failed_loads +=
+      std::count(block.loaded.begin(), block.loaded.end(), false);
+}
+
+// Match the given pairs of block-local image indices in parallel.
+void MatchBlockPairs(const ExhaustiveMatcherOptions& options,
+                     const DescriptorBlock& block1,
+                     const DescriptorBlock& block2,
+                     const std::vector<std::pair<size_t, size_t>>& pairs,
+                     MatchDatabase* database) {
+  ParallelForRange(
+      0, pairs.size(), options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureMatches matches;
+        for (size_t i = begin; i < end; ++i) {
+          const size_t idx1 = pairs[i].first;
+          const size_t idx2 = pairs[i].second;
+          matches.clear();
+          MatchSiftFeaturesCPU(options.match_options,
+                               block1.descriptors[idx1],
+                               block2.descriptors[idx2], matches);
+          database->Add(block1.image_idxs[idx1], block2.image_idxs[idx2],
+                        matches);
+        }
+      });
+}
+
+uint64_t PairId(const size_t image_idx1, const size_t image_idx2) {
+  const uint64_t min_idx = std::min(image_idx1, image_idx2);
+  const uint64_t max_idx = std::max(image_idx1, image_idx2);
+  return (min_idx << 32) | max_idx;
+}
+
+// Match the pairs of all blocks, or only the given pairs if `image_pair_ids`
+// is not null. Block pairs without any pair to match are not loaded.
+bool MatchBlocks(const ExhaustiveMatcherOptions& options,
+                 const DescriptorLoader& loader,
+                 const std::unordered_set<uint64_t>* image_pair_ids,
+                 MatchDatabase* database, ExhaustiveMatcherStats* stats) {
+  const std::vector<std::vector<size_t>> blocks =
+      PartitionImagesIntoBlocks(options, loader);
+
+  ExhaustiveMatcherStats local_stats;
+  local_stats.num_blocks = blocks.size();
+
+  // Which block pairs contain any pair to match.
+  std::vector<std::vector<bool>> block_pairs(
+      blocks.size(),
+      std::vector<bool>(blocks.size(), image_pair_ids == nullptr));
+  if (image_pair_ids != nullptr) {
+    std::vector<size_t> image_block_idxs(loader.NumImages());
+    for (size_t block_idx = 0; block_idx < blocks.size(); ++block_idx) {
+      for (const size_t image_idx : blocks[block_idx]) {
+        image_block_idxs[image_idx] = block_idx;
+      }
+    }
+    for (const uint64_t pair_id : *image_pair_ids) {
+      const size_t image_idx1 = static_cast<size_t>(pair_id >> 32);
+      const size_t image_idx2 = static_cast<size_t>(pair_id & 0xFFFFFFFF);
+      if (image_idx2 < image_block_idxs.size()) {
+        block_pairs[image_block_idxs[image_idx1]]
+                   [image_block_idxs[image_idx2]] = true;
+      }
+    }
+  }
+
+  const auto LoadBlockAsync = [&](const size_t block_idx) {
+    return std::async(options.prefetch ? std::launch::async
+                                       : std::launch::deferred,
+                      LoadBlock, std::cref(loader), block_idx,
+                      std::cref(blocks[block_idx]));
+  };
+
+  // Pairs of block-local indices, skipping images that failed to load.
+  const auto CollectPairs = [image_pair_ids](const DescriptorBlock& block1,
+                                             const DescriptorBlock& block2,
+                                             const bool same_block) {
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (size_t i = 0; i < block1.image_idxs.size(); ++i) {
+      if (!block1.loaded[i]) {
+        continue;
+      }
+      for (size_t j = same_block ? i + 1 : 0; j < block2.image_idxs.size();
+           ++j) {
+        if (block2.loaded[j] &&
+            (image_pair_ids == nullptr ||
+             image_pair_ids->count(PairId(block1.image_idxs[i],
+                                          block2.image_idxs[j])) > 0)) {
+          pairs.emplace_back(i, j);
+        }
+      }
+    }
+    return pairs;
+  };
+
+  DescriptorBlock fixed_block;
+  bool fixed_block_loaded = false;
+  for (size_t fixed_idx = 0; fixed_idx < blocks.size(); ++fixed_idx) {
+    // Sweep the later blocks in reverse order, so that the last swept block
+    // is the next fixed block.
+    std::vector<size_t> swept_idxs;
+    for (size_t swept_idx = blocks.size() - 1; swept_idx > fixed_idx;
+         --swept_idx) {
+      if (block_pairs[fixed_idx][swept_idx]) {
+        swept_idxs.push_back(swept_idx);
+      }
+    }
+
+    if (swept_idxs.empty() && !block_pairs[fixed_idx][fixed_idx]) {
+      fixed_block_loaded = false;
+      continue;
+    }
+
+    std::future<DescriptorBlock> next_block;
+    if (!swept_idxs.empty()) {
+      next_block = LoadBlockAsync(swept_idxs[0]);
+    }
+
+    if (!fixed_block_loaded) {
+      fixed_block = LoadBlock(loader, fixed_idx, blocks[fixed_idx]);
+      AccumulateLoadStats(fixed_block, &local_stats);
+    }
+
+    std::vector<std::pair<size_t, size_t>> pairs =
+        CollectPairs(fixed_block, fixed_block, true);
+    MatchBlockPairs(options, fixed_block, fixed_block, pairs, database);
+    local_stats.num_pairs += pairs.size();
+
+    DescriptorBlock swept_block;
+    for (size_t i = 0; i < swept_idxs.size(); ++i) {
+      swept_block = next_block.get();
+      AccumulateLoadStats(swept_block, &local_stats);
+      if (i + 1 < swept_idxs.size()) {
+        next_block = LoadBlockAsync(swept_idxs[i + 1]);
+      }
+
+      pairs = CollectPairs(fixed_block, swept_block, false);
+      MatchBlockPairs(options, fixed_block, swept_block, pairs, database);
+      local_stats.num_pairs += pairs.size();
+    }
+
+    fixed_block_loaded = !swept_idxs.empty() &&
+                         swept_block.block_idx == fixed_idx + 1;
+    if (fixed_block_loaded) {
+      fixed_block = std::move(swept_block);
+    }
+  }
+
+  if (stats != nullptr) {
+    *stats = local_stats;
+  }
+
+  return local_stats.num_failed_loads == 0;
+}
+
+}  // namespace
+
+BinaryFileDescriptorLoader::BinaryFileDescriptorLoader(
+    const std::vector<std::string>& paths)
+    : paths_(paths), num_bytes_(paths.size(), 0) {
+  for (size_t i = 0; i < paths_.size(); ++i) {
+    size_t num_features;
+    size_t dim;
+    if (ReadBinaryFeatureFileHeader(paths_[i], &num_features, &dim)) {
+      num_bytes_[i] = num_features * dim;
+    }
+  }
+}
+
+size_t BinaryFileDescriptorLoader::NumImages() const { return paths_.size(); }
+
+size_t BinaryFileDescriptorLoader::NumBytes(const size_t image_idx) const {
+  return num_bytes_[image_idx];
+}
+
+bool BinaryFileDescriptorLoader::Load(const size_t image_idx,
+                                      FeatureDescriptors* descriptors) const {
+  return ReadDescriptorsFromBinaryFile(paths_[image_idx], descriptors);
+}
+
+std::vector<std::vector<size_t>> PartitionImagesIntoBlocks(
+    const ExhaustiveMatcherOptions& options, const DescriptorLoader& loader) {
+  const size_t max_block_bytes = std::max<size_t>(
+      1, options.max_resident_bytes / 3);
+
+  std::vector<std::vector<size_t>> blocks;
+  size_t block_bytes = 0;
+  for (size_t image_idx = 0; image_idx < loader.NumImages(); ++image_idx) {
+    const size_t num_bytes = loader.NumBytes(image_idx);
+    bool new_block = blocks.empty();
+    if (!new_block && options.block_size > 0) {
+      new_block =
+          blocks.back().size() >= static_cast<size_t>(options.block_size);
+    } else if (!new_block) {
+      new_block = block_bytes + num_bytes > max_block_bytes;
+    }
+    if (new_block) {
+      blocks.emplace_back();
+      block_bytes = 0;
+    }
+    blocks.back().push_back(image_idx);
+    block_bytes += num_bytes;
+  }
+
+  return blocks;
+}
+
+bool MatchExhaustive(const ExhaustiveMatcherOptions& options,
+                     const DescriptorLoader& loader, MatchDatabase* database,
+                     ExhaustiveMatcherStats* stats) {
+  return MatchBlocks(options, loader, nullptr, database, stats);
+}
+
+bool MatchImagePairs(const ExhaustiveMatcherOptions& options,
+                     const DescriptorLoader& loader,
+                     const std::vector<std::pair<size_t, size_t>>& image_pairs,
+                     MatchDatabase* database, ExhaustiveMatcherStats* stats) {
+  std::unordered_set<uint64_t> image_pair_ids;
+  for (const auto& image_pair : image_pairs) {
+    if (image_pair.first != image_pair.second) {
+      image_pair_ids.insert(PairId(image_pair.first, image_pair.second));
+    }
+  }
+  return MatchBlocks(options, loader, &image_pair_ids, database, stats);
+}
@@ -0,0 +1,100 @@
+#ifndef COLMAP_SRC_BASE_EXHAUSTIVE_MATCHER_H_
+#define COLMAP_SRC_BASE_EXHAUSTIVE_MATCHER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "feature.h"
+#include "feature_matching.h"
+#include "match_database.h"
+
+// Source of the descriptors of an image set for the exhaustive matcher.
+// `Load` is called concurrently for different images.
+class DescriptorLoader {
+ public:
+  virtual ~DescriptorLoader() = default;
+
+  virtual size_t NumImages() const = 0;
+
+  // Memory of the descriptors of an image in bytes, used to size the blocks.
+  virtual size_t NumBytes(const size_t image_idx) const = 0;
+
+  virtual bool Load(const size_t image_idx,
+                    FeatureDescriptors* descriptors) const = 0;
+};
+
+// Loads the descriptors from binary feature files, see
+// `WriteFeaturesToBinaryFile`. Only the file headers are read on
+// construction. Images with an unreadable header have zero bytes and fail
+// to load.
+class BinaryFileDescriptorLoader : public DescriptorLoader {
+ public:
+  explicit BinaryFileDescriptorLoader(const std::vector<std::string>& paths);
+
+  size_t NumImages() const override;
+  size_t NumBytes(const size_t image_idx) const override;
+  bool Load(const size_t image_idx,
+            FeatureDescriptors* descriptors) const override;
+
+ private:
+  std::vector<std::string> paths_;
+  std::vector<size_t> num_bytes_;
+};
+
+struct ExhaustiveMatcherOptions {
+  // Maximum memory in bytes of the descriptors held in memory at once. Up to
+  // three blocks are resident: the fixed block, the swept block and the
+  // prefetched next block. A single image larger than a third of the budget
+  // forms its own block.
+  size_t max_resident_bytes = static_cast<size_t>(1) << 30;
+
+  // Number of images per block, overriding the memory budget if positive.
+  int block_size = -1;
+
+  // Number of threads to match pairs. If `num_threads <= 0`, the number of
+  // hardware threads is used.
+  int num_threads = -1;
+
+  // Whether to load the next block while matching the current one.
+  bool prefetch = true;
+
+  SiftMatchOptions match_options;
+};
+
+struct ExhaustiveMatcherStats {
+  size_t num_blocks = 0;
+
+  // Number of descriptor sets loaded, including failed loads.
+  size_t num_loads = 0;
+  size_t num_failed_loads = 0;
+
+  // Number of matched pairs, excluding pairs with a failed image.
+  size_t num_pairs = 0;
+};
+
+// Partition the images into consecutive blocks within the memory budget.
+std::vector<std::vector<size_t>> PartitionImagesIntoBlocks(
+    const ExhaustiveMatcherOptions& options, const DescriptorLoader& loader);
+
+// Match all image pairs and add the matches to the database. One block of
+// descriptors stays resident while all later blocks are swept in reverse
+// order. The last swept block becomes the next resident block, so that with
+// `B` blocks every descriptor set is loaded at most `B` times and on average
+// about `B / 2` times, instead of once per pair. The pairs of a block pair
+// are matched in parallel. Returns false if any descriptor set failed to
+// load, in which case the pairs of all other images are still matched.
+bool MatchExhaustive(const ExhaustiveMatcherOptions& options,
+                     const DescriptorLoader& loader, MatchDatabase* database,
+                     ExhaustiveMatcherStats* stats = nullptr);
+
+// Match only the given image pairs, e.g. the candidates of image retrieval,
+// with the same block-wise loading. Block pairs without any of the image
+// pairs are skipped.
+bool MatchImagePairs(const ExhaustiveMatcherOptions& options,
+                     const DescriptorLoader& loader,
+                     const std::vector<std::pair<size_t, size_t>>& image_pairs,
+                     MatchDatabase* database,
+                     ExhaustiveMatcherStats* stats = nullptr);
+
+#endif  // COLMAP_SRC_BASE_EXHAUSTIVE_MATCHER_H_
@@ -1,7 +1,129 @@
 #include "feature.h"
 
+#include <cstdio>
+
 #include "misc.h"
 
+namespace {
+
+const size_t kNumKeypointValues = 4;
+
+bool ReadHeader(FILE* file, size_t* num_features, size_t* dim) {
+  uint32_t header[2];
+  if (fread(header, sizeof(uint32_t), 2, file) != 2) {
+    return false;
+  }
+  *num_features = header[0];
+  *dim = header[1];
+  return true;
+}
+
+bool ReadDescriptors(FILE* file, const size_t num_features, const size_t dim,
+                     FeatureDescriptors* descriptors) {
+  descriptors->resize(num_features, dim);
+  const size_t num_values = num_features * dim;
+  return fread(descriptors->data(), 1, num_values, file) == num_values;
+}
+
+}  // namespace
+
+bool WriteFeaturesToBinaryFile(const std::string& path,
+                               const FeatureKeypoints& keypoints,
+                               const FeatureDescriptors& descriptors) {
+  CHECK_EQ(keypoints.size(), descriptors.rows());
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  const uint32_t header[2] = {static_cast<uint32_t>(keypoints.size()),
+                              static_cast<uint32_t>(descriptors.cols())};
+  std::vector<float> keypoint_values;
+  keypoint_values.reserve(keypoints.size() * kNumKeypointValues);
+  for (const auto& keypoint : keypoints) {
+    keypoint_values.push_back(keypoint.x);
+    keypoint_values.push_back(keypoint.y);
+    keypoint_values.push_back(keypoint.scale);
+    keypoint_values.push_back(keypoint.orientation);
+  }
+  const size_t num_values = descriptors.size();
+
+  bool success =
+      fwrite(header, sizeof(uint32_t), 2, file) == 2 &&
+      fwrite(keypoint_values.data(), sizeof(float), keypoint_values.size(),
+             file) == keypoint_values.size() &&
+      fwrite(descriptors.data(), 1, num_values, file) == num_values;
+  success = fclose(file) == 0 && success;
+  return success;
+}
+
+bool ReadFeaturesFromBinaryFile(const std::string& path,
+                                FeatureKeypoints* keypoints,
+                                FeatureDescriptors* descriptors) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  size_t num_features;
+  size_t dim;
+  std::vector<float> keypoint_values;
+  bool success = ReadHeader(file, &num_features, &dim);
+  if (success) {
+    keypoint_values.resize(num_features * kNumKeypointValues);
+    success = fread(keypoint_values.data(), sizeof(float),
+                    keypoint_values.size(),
+                    file) == keypoint_values.size() &&
+              ReadDescriptors(file, num_features, dim, descriptors);
+  }
+  fclose(file);
+  if (!success) {
+    return false;
+  }
+
+  keypoints->resize(num_features);
+  for (size_t i = 0; i < num_features; ++i) {
+    const float* values = &keypoint_values[i * kNumKeypointValues];
+    (*keypoints)[i].x = values[0];
+    (*keypoints)[i].y = values[1];
+    (*keypoints)[i].scale = values[2];
+    (*keypoints)[i].orientation = values[3];
+  }
+  return true;
+}
+
+bool ReadDescriptorsFromBinaryFile(const std::string& path,
+                                   FeatureDescriptors* descriptors) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  size_t num_features;
+  size_t dim;
+  const bool success =
+      ReadHeader(file, &num_features, &dim) &&
+      fseek(file,
+            static_cast<long>(num_features * kNumKeypointValues *
+                              sizeof(float)),
+            SEEK_CUR) == 0 &&
+      ReadDescriptors(file, num_features, dim, descriptors);
+  fclose(file);
+  return success;
+}
+
+bool ReadBinaryFeatureFileHeader(const std::string& path,
+                                 size_t* num_features, size_t* dim) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool success = ReadHeader(file, num_features, dim);
+  fclose(file);
+  return success;
+}
+
 std::vector<Eigen::Vector2d> FeatureKeypointsToPointsVector(
     const FeatureKeypoints& keypoints) {
   std::vector<Eigen::Vector2d> points(keypoints.size());
@@ -1,6 +1,8 @@
 #ifndef COLMAP_SRC_BASE_FEATURE_H_
 #define COLMAP_SRC_BASE_FEATURE_H_
 
+#include <limits>
+#include <string>
 #include <vector>
 #include <Eigen/Core>
 
@@ -21,6 +23,9 @@ typedef std::vector<FeatureKeypoint> FeatureKeypoints;
 typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
     FeatureDescriptors;
 
+// Binary descriptors with one bit per test, packed into the bytes of each row.
+typedef FeatureDescriptors BinaryFeatureDescriptors;
+
 // Ϊĸʽ
 // Load keypoints and descriptors from text file in the following format:
 //
@@ -40,6 +45,25 @@ typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
 //    0.32 0.12 1.23 1.0 1 2 3 4
 //
 
+// Read and write keypoints and descriptors in a binary format, which is much
+// faster to parse and allows to read the descriptors without the keypoints:
+//
+//    uint32 NUM_FEATURES, uint32 DIM
+//    NUM_FEATURES x (float X, float Y, float SCALE, float ORIENTATION)
+//    NUM_FEATURES x DIM x uint8 descriptor values
+//
+// All values are stored in the byte order of the host.
+bool WriteFeaturesToBinaryFile(const std::string& path,
+                               const FeatureKeypoints& keypoints,
+                               const FeatureDescriptors& descriptors);
+bool ReadFeaturesFromBinaryFile(const std::string& path,
+                                FeatureKeypoints* keypoints,
+                                FeatureDescriptors* descriptors);
+bool ReadDescriptorsFromBinaryFile(const std::string& path,
+                                   FeatureDescriptors* descriptors);
+bool ReadBinaryFeatureFileHeader(const std::string& path,
+                                 size_t* num_features, size_t* dim);
+
 // Index per image, i.e. determines maximum number of 2D points per image.
 typedef uint32_t point2D_t;
 const point2D_t kInvalidPoint2DIdx = std::numeric_limits<point2D_t>::max();
@@ -1,10 +1,18 @@
 #include "feature_extraction.h"
 
+#include <array>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
+#include <functional>
+#include <random>
 
 #include "VLFeat/sift.h"
 #include "feature.h"
 #include "bitmap.h"
+#include "descriptor_pca.h"
+#include "image_pyramid.h"
+#include "memory_pool.h"
 #include "misc.h"
 
 void ScaleBitmap(const int max_image_size, double* scale_x, double* scale_y,
@@ -22,23 +30,133 @@ void ScaleBitmap(const int max_image_size, double* scale_x, double* scale_y,
     *scale_x = static_cast<double>(new_width) / bitmap->Width();
     *scale_y = static_cast<double>(new_height) / bitmap->Height();
 
-    bitmap->Rescale(new_width, new_height);
+    // Area reduction followed by Lanczos resampling avoids the aliasing of
+    // the bilinear FreeImage filter for large reduction factors.
+    Bitmap scaled_bitmap;
+    if (ResizeImage(*bitmap, new_width, new_height, &scaled_bitmap)) {
+      *bitmap = std::move(scaled_bitmap);
+    } else {
+      bitmap->Rescale(new_width, new_height);
+    }
   } else {
     *scale_x = 1.0;
     *scale_y = 1.0;
   }
 }
 
-bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
-                            FeatureKeypoints &keypoints,
-                            FeatureDescriptors &descriptors,
-                            const SiftOptions &options )
-{
-  Bitmap scaled_bitmap = bitmap.CloneAsGrey();
-  double scale_x;
-  double scale_y;
-  ScaleBitmap(options.max_image_size, &scale_x, &scale_y, &scaled_bitmap);
+namespace {
+
+// Compute the descriptor of `descriptor_dim` bytes of a keypoint of the
+// current octave of the SIFT filter for the given orientation.
+typedef std::function<void(VlSiftFilt*, const VlSiftKeypoint&, const double,
+                           uint8_t*)>
+    DescriptorFunc;
+
+// Number of bytes of the SIFT descriptors, or 0 if the PCA of the options
+// cannot reduce them, i.e. it is not trained on 128-D SIFT descriptors.
+int SiftDescriptorDim(const SiftOptions& options) {
+  if (options.descriptor_pca == nullptr) {
+    return 128;
+  }
+  if (!options.descriptor_pca->IsTrained() ||
+      options.descriptor_pca->InputDimension() != 128) {
+    return 0;
+  }
+  return options.descriptor_pca->NumDimensions();
+}
+
+DescriptorFunc SiftDescriptorFunc(const SiftOptions& options) {
+  return [&options](VlSiftFilt* sift, const VlSiftKeypoint& keypoint,
+                    const double angle, uint8_t* descriptor) {
+    Eigen::MatrixXf desc(1, 128);
+    vl_sift_calc_keypoint_descriptor(sift, desc.data(), &keypoint, angle);
+    if (options.normalization == SiftOptions::Normalization::L2) {
+      desc = L2NormalizeFeatureDescriptors(desc);
+    } else if (options.normalization == SiftOptions::Normalization::L1_ROOT) {
+      desc = L1RootNormalizeFeatureDescriptors(desc);
+    }
+    if (options.descriptor_pca != nullptr) {
+      const int dim = options.descriptor_pca->NumDimensions();
+      Eigen::Map<FeatureDescriptors>(descriptor, 1, dim) =
+          options.descriptor_pca->Project(desc);
+    } else {
+      Eigen::Map<FeatureDescriptors>(descriptor, 1, 128) =
+          FeatureDescriptorsToUnsignedByte(desc);
+    }
+  };
+}
+
+// Pairs of test locations of the binary descriptor in the unit disk, drawn
+// from an isotropic Gaussian as in the BRIEF paper. The raw output of
+// std::mt19937 is specified by the standard, so that the pattern and thus
+// the descriptors are the same on every platform.
+const std::vector<std::array<float, 4>>& BinaryTestPattern() {
+  static const std::vector<std::array<float, 4>> pattern = []() {
+    const float kSigma = 0.4f;
+    std::mt19937 random_engine(0);
+    const auto Gaussian = [&random_engine, kSigma]() {
+      const double u1 = (random_engine() + 0.5) / 4294967296.0;
+      const double u2 = (random_engine() + 0.5) / 4294967296.0;
+      const double value = std::sqrt(-2 * std::log(u1)) *
+                           std::cos(2 * M_PI * u2) * kSigma;
+      return static_cast<float>(std::min(1.0, std::max(-1.0, value)));
+    };
+    std::vector<std::array<float, 4>> tests(8 * kNumBinaryDescriptorBytes);
+    for (auto& test : tests) {
+      for (auto& coordinate : test) {
+        coordinate = Gaussian();
+      }
+    }
+    return tests;
+  }();
+  return pattern;
+}
 
+DescriptorFunc BinaryDescriptorFunc() {
+  const std::vector<std::array<float, 4>>& pattern = BinaryTestPattern();
+  return [&pattern](VlSiftFilt* sift, const VlSiftKeypoint& keypoint,
+                    const double angle, uint8_t* descriptor) {
+    // The smoothed image of the scale space level of the keypoint, in which
+    // the keypoint has a scale of `keypoint.sigma / 2^o`.
+    const vl_sift_pix* level = vl_sift_get_octave(sift, keypoint.is);
+    const int width = vl_sift_get_octave_width(sift);
+    const int height = vl_sift_get_octave_height(sift);
+    const float octave_scale = std::ldexp(1.0f, -keypoint.o);
+    const float x = keypoint.x * octave_scale;
+    const float y = keypoint.y * octave_scale;
+    const float radius =
+        kBinaryDescriptorRadius * keypoint.sigma * octave_scale;
+    const float cos_angle = radius * static_cast<float>(std::cos(angle));
+    const float sin_angle = radius * static_cast<float>(std::sin(angle));
+
+    const auto Intensity = [&](const float u, const float v) {
+      const int px = static_cast<int>(
+          std::floor(x + cos_angle * u - sin_angle * v + 0.5f));
+      const int py = static_cast<int>(
+          std::floor(y + sin_angle * u + cos_angle * v + 0.5f));
+      return level[std::min(height - 1, std::max(0, py)) * width +
+                   std::min(width - 1, std::max(0, px))];
+    };
+
+    std::fill(descriptor, descriptor + kNumBinaryDescriptorBytes, 0);
+    for (size_t i = 0; i < pattern.size(); ++i) {
+      const auto& test = pattern[i];
+      if (Intensity(test[0], test[1]) < Intensity(test[2], test[3])) {
+        descriptor[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+      }
+    }
+  };
+}
+
+// Extract features from a greyscale image, whose rows are converted to floats
+// in the range [0, 1] by `convert_row`. The image was scaled by the given
+// factors from the original image, to which the keypoints are mapped back.
+bool ExtractFeaturesFromRows(
+    const int width, const int height,
+    const std::function<void(const int, float*)>& convert_row,
+    const double scale_x, const double scale_y, const int descriptor_dim,
+    const DescriptorFunc& compute_descriptor, FeatureKeypoints& keypoints,
+    FeatureDescriptors& descriptors, const SiftOptions& options) {
   //////////////////////////////////////////////////////////////////////////////
   // Extract features
   //////////////////////////////////////////////////////////////////////////////
@@ -49,7 +167,7 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
 
   // Setup SIFT extractor.
   std::unique_ptr<VlSiftFilt, void (*)(VlSiftFilt*)> sift(
-      vl_sift_new(scaled_bitmap.Width(), scaled_bitmap.Height(),
+      vl_sift_new(width, height,
                   options.num_octaves, options.octave_resolution,
                   options.first_octave),
       &vl_sift_delete);
@@ -67,13 +185,13 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
   bool first_octave = true;
   while (true) {
     if (first_octave) {
-      const std::vector<uint8_t> data_uint8 =
-          scaled_bitmap.ConvertToRowMajorArray();
-      std::vector<float> data_float(data_uint8.size());
-      for (size_t i = 0; i < data_uint8.size(); ++i) {
-        data_float[i] = static_cast<float>(data_uint8[i]) / 255.0f;
+      PooledBuffer data_float_buffer = BufferPool::Global().Acquire(
+          static_cast<size_t>(width) * height * sizeof(float));
+      float* data_float = data_float_buffer.DataAs<float>();
+      for (int y = 0; y < height; ++y) {
+        convert_row(y, data_float + static_cast<size_t>(y) * width);
       }
-      if (vl_sift_process_first_octave(sift.get(), data_float.data())) {
+      if (vl_sift_process_first_octave(sift.get(), data_float)) {
         break;
       }
       first_octave = false;
@@ -101,7 +219,8 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
         if (i > 0) {
           // Resize containers of previous DOG level.
           level_keypoints.back().resize(level_idx);
-          level_descriptors.back().conservativeResize(level_idx, 128);
+          level_descriptors.back().conservativeResize(level_idx,
+                                                      descriptor_dim);
         }
 
         // Add containers for new DOG level.
@@ -110,7 +229,7 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
         level_keypoints.emplace_back(options.max_num_orientations *
                                      num_keypoints);
         level_descriptors.emplace_back(
-            options.max_num_orientations * num_keypoints, 128);
+            options.max_num_orientations * num_keypoints, descriptor_dim);
       }
 
       level_num_features.back() += 1;
@@ -145,17 +264,9 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
           level_keypoints.back()[level_idx].scale *= inv_scale_xy;
         }
 
-        Eigen::MatrixXf desc(1, 128);
-        vl_sift_calc_keypoint_descriptor(sift.get(), desc.data(),
-                                         &vl_keypoints[i], angles[o]);
-        if (options.normalization == SiftOptions::Normalization::L2) {
-          desc = L2NormalizeFeatureDescriptors(desc);
-        } else if (options.normalization ==
-                   SiftOptions::Normalization::L1_ROOT) {
-          desc = L1RootNormalizeFeatureDescriptors(desc);
-        }
-        level_descriptors.back().row(level_idx) =
-            FeatureDescriptorsToUnsignedByte(desc);
+        compute_descriptor(sift.get(), vl_keypoints[i], angles[o],
+                           level_descriptors.back().data() +
+                               level_idx * descriptor_dim);
 
         level_idx += 1;
       }
@@ -163,7 +274,7 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
 
     // Resize containers for last DOG level in octave.
     level_keypoints.back().resize(level_idx);
-    level_descriptors.back().conservativeResize(level_idx, 128);
+    level_descriptors.back().conservativeResize(level_idx, descriptor_dim);
   }
 
   // Determine how many DOG levels to keep to satisfy max_num_features option.
@@ -182,7 +293,7 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
   // Extract the features to be kept.
   size_t k = 0;
   keypoints.resize(num_features_with_orientations);
-  descriptors.resize(num_features_with_orientations, 128);
+  descriptors.resize(num_features_with_orientations, descriptor_dim);
   for (size_t i = first_level_to_keep; i < level_keypoints.size(); ++i) {
     for (size_t j = 0; j < level_keypoints[i].size(); ++j) {
       keypoints[k] = level_keypoints[i][j];
@@ -192,4 +303,169 @@ bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
   }
 
   return true;
-}
\ No newline at end of file
+}
+
+// Name of the cached feature file of an image, which contains a hash of the
+// image path and of all options that change the extracted features.
+std::string FeatureFileName(const std::string& image_path,
+                            const SiftOptions& options) {
+  uint64_t hash = HashBytes(image_path.data(), image_path.size());
+  const int int_options[6] = {options.max_image_size,
+                              options.max_num_features,
+                              options.first_octave,
+                              options.num_octaves,
+                              options.octave_resolution,
+                              options.max_num_orientations};
+  hash = HashBytes(int_options, sizeof(int_options), hash);
+  const double double_options[2] = {options.peak_threshold,
+                                    options.edge_threshold};
+  hash = HashBytes(double_options, sizeof(double_options), hash);
+  const int flag_options[3] = {options.upright,
+                               options.darkness_adaptivity,
+                               static_cast<int>(options.normalization)};
+  hash = HashBytes(flag_options, sizeof(flag_options), hash);
+  if (options.descriptor_pca != nullptr) {
+    const uint64_t pca_hash = options.descriptor_pca->Hash();
+    hash = HashBytes(&pca_hash, sizeof(pca_hash), hash);
+  }
+
+  char hash_string[17];
+  snprintf(hash_string, sizeof(hash_string), "%016llx",
+           static_cast<unsigned long long>(hash));
+  return GetPathBaseName(image_path) + "." + hash_string + ".feat";
+}
+
+}  // namespace
+
+bool ExtractSiftFeaturesCPU( const Bitmap& bitmap,
+                            FeatureKeypoints &keypoints,
+                            FeatureDescriptors &descriptors,
+                            const SiftOptions &options )
+{
+  const int descriptor_dim = SiftDescriptorDim(options);
+  if (descriptor_dim <= 0) {
+    return false;
+  }
+
+  Bitmap scaled_bitmap = bitmap.CloneAsGrey();
+  double scale_x;
+  double scale_y;
+  ScaleBitmap(options.max_image_size, &scale_x, &scale_y, &scaled_bitmap);
+
+  return ExtractFeaturesFromRows(
+      scaled_bitmap.Width(), scaled_bitmap.Height(),
+      [&](const int y, float* row) {
+        scaled_bitmap.ConvertScanlineToFloat(y, row);
+      },
+      scale_x, scale_y, descriptor_dim, SiftDescriptorFunc(options),
+      keypoints, descriptors, options);
+}
+
+bool ExtractSiftFeaturesCPU( const ImageView& view,
+                            FeatureKeypoints &keypoints,
+                            FeatureDescriptors &descriptors,
+                            const SiftOptions &options )
+{
+  if (!view.IsValid() || (view.channels != 1 && view.channels != 3)) {
+    return false;
+  }
+
+  // Images that must be down-scaled are converted to a bitmap first.
+  if (view.width > options.max_image_size ||
+      view.height > options.max_image_size) {
+    Bitmap bitmap;
+    if (!bitmap.Allocate(view.width, view.height, false)) {
+      return false;
+    }
+    std::vector<float> row(static_cast<size_t>(view.width) * view.channels);
+    for (int y = 0; y < view.height; ++y) {
+      view.ConvertRowToFloat(y, row.data());
+      uint8_t* line = FreeImage_GetScanLine(bitmap.Data(), view.height - 1 - y);
+      for (int x = 0; x < view.width; ++x) {
+        const float* pixel = &row[x * view.channels];
+        const float value = view.channels == 1
+                                ? pixel[0]
+                                : 0.2126f * pixel[0] + 0.7152f * pixel[1] +
+                                      0.0722f * pixel[2];
+        line[x] = static_cast<uint8_t>(255.0f * value + 0.5f);
+      }
+    }
+    return ExtractSiftFeaturesCPU(bitmap, keypoints, descriptors, options);
+  }
+
+  // Otherwise, rows are converted straight from the view, so that pixels of
+  // memory-mapped images are read exactly once.
+  std::vector<float> rgb_row;
+  if (view.channels == 3) {
+    rgb_row.resize(static_cast<size_t>(view.width) * 3);
+  }
+  const int descriptor_dim = SiftDescriptorDim(options);
+  if (descriptor_dim <= 0) {
+    return false;
+  }
+  return ExtractFeaturesFromRows(
+      view.width, view.height,
+      [&](const int y, float* row) {
+        if (view.channels == 1) {
+          view.ConvertRowToFloat(y, row);
+          return;
+        }
+        view.ConvertRowToFloat(y, rgb_row.data());
+        for (int x = 0; x < view.width; ++x) {
+          row[x] = 0.2126f * rgb_row[3 * x] + 0.7152f * rgb_row[3 * x + 1] +
+                   0.0722f * rgb_row[3 * x + 2];
+        }
+      },
+      1.0, 1.0, descriptor_dim, SiftDescriptorFunc(options), keypoints,
+      descriptors, options);
+}
+
+bool ExtractBinaryFeaturesCPU( const Bitmap& bitmap,
+                              FeatureKeypoints &keypoints,
+                              BinaryFeatureDescriptors &descriptors,
+                              const SiftOptions &options )
+{
+  Bitmap scaled_bitmap = bitmap.CloneAsGrey();
+  double scale_x;
+  double scale_y;
+  ScaleBitmap(options.max_image_size, &scale_x, &scale_y, &scaled_bitmap);
+
+  return ExtractFeaturesFromRows(
+      scaled_bitmap.Width(), scaled_bitmap.Height(),
+      [&](const int y, float* row) {
+        scaled_bitmap.ConvertScanlineToFloat(y, row);
+      },
+      scale_x, scale_y, kNumBinaryDescriptorBytes, BinaryDescriptorFunc(),
+      keypoints, descriptors, options);
+}
+
+bool ExtractFeaturesToBinaryFiles( const std::vector<std::string>& image_paths,
+                                  const SiftOptions& options,
+                                  const std::string& output_dir,
+                                  std::vector<std::string>* feature_paths )
+{
+  bool success = true;
+  feature_paths->clear();
+  feature_paths->reserve(image_paths.size());
+  for (const std::string& image_path : image_paths) {
+    const std::string feature_path =
+        JoinPaths(output_dir, FeatureFileName(image_path, options));
+    size_t num_features;
+    size_t dim;
+    if (!ReadBinaryFeatureFileHeader(feature_path, &num_features, &dim)) {
+      Bitmap bitmap;
+      FeatureKeypoints keypoints;
+      FeatureDescriptors descriptors;
+      if (!bitmap.Read(image_path, false) ||
+          !ExtractSiftFeaturesCPU(bitmap, keypoints, descriptors, options) ||
+          !WriteFeaturesToBinaryFile(feature_path, keypoints, descriptors)) {
+        feature_paths->emplace_back();
+        success = false;
+        continue;
+      }
+    }
+    feature_paths->push_back(feature_path);
+  }
+
+  return success;
+}
@@ -6,16 +6,58 @@
 
 #include "bitmap.h"
 #include "feature.h"
+#include "mapped_image.h"
 #include "misc.h"
 
+class DescriptorPCA;
 struct SiftOptions;
 
-// Extract SIFT features for the given image on the CPU.
+// Extract SIFT features for the given image on the CPU. 16-bit and float
+// images are used at their full precision, where float intensities are
+// expected to be in the range [0, 1].
 bool ExtractSiftFeaturesCPU( const Bitmap &bitmap, 
                             FeatureKeypoints &keypoints,
                             FeatureDescriptors &descriptors,
                             const SiftOptions &sift_options );
 
+// Extract SIFT features directly from the pixels of an image view, e.g. of a
+// memory-mapped PGM file, without decoding or copying the image first.
+bool ExtractSiftFeaturesCPU( const ImageView &view,
+                            FeatureKeypoints &keypoints,
+                            FeatureDescriptors &descriptors,
+                            const SiftOptions &sift_options );
+
+// Extract binary features, which share the keypoints of the SIFT features,
+// but whose descriptors are oriented BRIEF tests, i.e. intensity comparisons
+// of pairs of pixels around the keypoint, on the smoothed image of the scale
+// space level of the keypoint. These are much faster to compute and to match
+// by `MatchBinaryFeaturesCPU`, but less distinctive than SIFT descriptors.
+// The descriptor options, e.g. `descriptor_pca`, are ignored.
+bool ExtractBinaryFeaturesCPU( const Bitmap &bitmap,
+                              FeatureKeypoints &keypoints,
+                              BinaryFeatureDescriptors &descriptors,
+                              const SiftOptions &sift_options );
+
+// Extract SIFT features of the images into binary feature files in the output
+// directory, see `WriteFeaturesToBinaryFile`. The files are named after the
+// image and a hash of the image path and the options, e.g.
+// "site1.jpg.0123456789abcdef.feat", so that existing feature files are only
+// reused for the same image and options instead of extracting them again.
+// The paths of the feature files are returned in the order of the images, so
+// that their indices are the image indices. The path is empty for images that
+// could not be read or extracted, in which case false is returned.
+bool ExtractFeaturesToBinaryFiles( const std::vector<std::string> &image_paths,
+                                  const SiftOptions &sift_options,
+                                  const std::string &output_dir,
+                                  std::vector<std::string> *feature_paths );
+
+// Number of bytes of the binary descriptors, i.e. 256 tests.
+const int kNumBinaryDescriptorBytes = 32;
+
+// Radius of the binary tests in units of the keypoint scale, which matches
+// the extent of the SIFT descriptor window.
+const float kBinaryDescriptorRadius = 6.0f;
+
 struct SiftOptions {
   // Maximum image size, otherwise image will be down-scaled.
   int max_image_size = 3200;
@@ -58,6 +100,11 @@ struct SiftOptions {
     L2,
   };
   Normalization normalization = Normalization::L1_ROOT;
+
+  // If not null, the normalized descriptors are reduced by the PCA to its
+  // number of dimensions, see `DescriptorPCA`. The extraction fails if the
+  // PCA is not trained on 128-D descriptors. The PCA is not owned.
+  const DescriptorPCA* descriptor_pca = nullptr;
 };
 
 #endif  // COLMAP_SRC_BASE_FEATURE_EXTRACTION_H_
\ No newline at end of file
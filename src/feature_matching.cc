@@ -1,8 +1,14 @@
 #include "feature_matching.h"
 
+#include <cstring>
 #include <fstream>
 #include <numeric>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAMMING_DISTANCE_DISPATCH
+#include <immintrin.h>
+#endif
+
 #include "misc.h"
 
 size_t FindBestMatchesOneWay(const Eigen::MatrixXi& dists,
@@ -59,21 +65,20 @@ size_t FindBestMatchesOneWay(const Eigen::MatrixXi& dists,
   return num_matches;
 }
 
+template <int kDim>
 Eigen::MatrixXi ComputeSiftDistanceMatrix(
     const FeatureKeypoints &keypoints1, 
     const FeatureKeypoints &keypoints2,
     const FeatureDescriptors &descriptors1,
-    const FeatureDescriptors &descriptors2,
+    const FeatureDescriptors &descriptors2, const bool reduced,
     const std::function<bool(float, float, float, float)>& guided_filter) {
   if (guided_filter != nullptr) {
-    CHECK_EQ(keypoints1->size(), descriptors1.rows());
-    CHECK_EQ(keypoints2->size(), descriptors2.rows());
+    CHECK_EQ(keypoints1.size(), descriptors1.rows());
+    CHECK_EQ(keypoints2.size(), descriptors2.rows());
   }
 
-  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors1_int =
-      descriptors1.cast<int>();
-  const Eigen::Matrix<int, Eigen::Dynamic, 128> descriptors2_int =
-      descriptors2.cast<int>();
+  const SiftDescriptorScorer<kDim> scorer(descriptors1, descriptors2,
+                                          reduced);
 
   Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dists(
       descriptors1.rows(), descriptors2.rows());
@@ -85,7 +90,7 @@ Eigen::MatrixXi ComputeSiftDistanceMatrix(
                         keypoints2[i2].x, keypoints2[i2].y)) {
         dists(i1, i2) = 0;
       } else {
-        dists(i1, i2) = descriptors1_int.row(i1).dot(descriptors2_int.row(i2));
+        dists(i1, i2) = scorer.Score(i1, i2);
       }
     }
   }
@@ -93,6 +98,131 @@ Eigen::MatrixXi ComputeSiftDistanceMatrix(
   return dists;
 }
 
+namespace {
+
+// Computes the Hamming distances of one descriptor to all rows of a matrix
+// of descriptors with `num_bytes` bytes each.
+typedef void (*HammingDistancesFunc)(const uint8_t* descriptor,
+                                     const uint8_t* descriptors,
+                                     const size_t num_descriptors,
+                                     const int num_bytes, int* distances);
+
+// Counts the bits in parallel within 64-bit words.
+inline int PopCount64(const uint64_t value) {
+  uint64_t count = value - ((value >> 1) & 0x5555555555555555ULL);
+  count = (count & 0x3333333333333333ULL) +
+          ((count >> 2) & 0x3333333333333333ULL);
+  count = (count + (count >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<int>((count * 0x0101010101010101ULL) >> 56);
+}
+
+void HammingDistancesGeneric(const uint8_t* descriptor,
+                             const uint8_t* descriptors,
+                             const size_t num_descriptors,
+                             const int num_bytes, int* distances) {
+  for (size_t k = 0; k < num_descriptors; ++k) {
+    const uint8_t* other = descriptors + k * num_bytes;
+    int distance = 0;
+    int i = 0;
+    for (; i + 8 <= num_bytes; i += 8) {
+      uint64_t word1;
+      uint64_t word2;
+      std::memcpy(&word1, descriptor + i, 8);
+      std::memcpy(&word2, other + i, 8);
+      distance += PopCount64(word1 ^ word2);
+    }
+    for (; i < num_bytes; ++i) {
+      distance += PopCount64(descriptor[i] ^ other[i]);
+    }
+    distances[k] = distance;
+  }
+}
+
+#ifdef HAMMING_DISTANCE_DISPATCH
+
+// The kernels are compiled for their instruction sets independent of the
+// compiler flags and selected at run time by `SelectHammingDistances`.
+
+__attribute__((target("popcnt"))) void HammingDistancesPopcnt(
+    const uint8_t* descriptor, const uint8_t* descriptors,
+    const size_t num_descriptors, const int num_bytes, int* distances) {
+  for (size_t k = 0; k < num_descriptors; ++k) {
+    const uint8_t* other = descriptors + k * num_bytes;
+    int distance = 0;
+    int i = 0;
+    for (; i + 8 <= num_bytes; i += 8) {
+      uint64_t word1;
+      uint64_t word2;
+      std::memcpy(&word1, descriptor + i, 8);
+      std::memcpy(&word2, other + i, 8);
+      distance += __builtin_popcountll(word1 ^ word2);
+    }
+    for (; i < num_bytes; ++i) {
+      distance += __builtin_popcount(descriptor[i] ^ other[i]);
+    }
+    distances[k] = distance;
+  }
+}
+
+// Looks up the bit counts of both nibbles of every byte and sums them up by
+// the absolute differences to zero.
+__attribute__((target("avx2,popcnt"))) void HammingDistancesAvx2(
+    const uint8_t* descriptor, const uint8_t* descriptors,
+    const size_t num_descriptors, const int num_bytes, int* distances) {
+  const __m256i lookup = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0F);
+  for (size_t k = 0; k < num_descriptors; ++k) {
+    const uint8_t* other = descriptors + k * num_bytes;
+    __m256i sums = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= num_bytes; i += 32) {
+      const __m256i bits = _mm256_xor_si256(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(descriptor + i)),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(other + i)));
+      const __m256i counts = _mm256_add_epi8(
+          _mm256_shuffle_epi8(lookup, _mm256_and_si256(bits, low_mask)),
+          _mm256_shuffle_epi8(
+              lookup,
+              _mm256_and_si256(_mm256_srli_epi16(bits, 4), low_mask)));
+      sums = _mm256_add_epi64(
+          sums, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+    }
+    int distance = static_cast<int>(
+        _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+        _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3));
+    for (; i + 8 <= num_bytes; i += 8) {
+      uint64_t word1;
+      uint64_t word2;
+      std::memcpy(&word1, descriptor + i, 8);
+      std::memcpy(&word2, other + i, 8);
+      distance += __builtin_popcountll(word1 ^ word2);
+    }
+    for (; i < num_bytes; ++i) {
+      distance += __builtin_popcount(descriptor[i] ^ other[i]);
+    }
+    distances[k] = distance;
+  }
+}
+
+#endif  // HAMMING_DISTANCE_DISPATCH
+
+HammingDistancesFunc SelectHammingDistances() {
+#ifdef HAMMING_DISTANCE_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    return &HammingDistancesAvx2;
+  }
+  if (__builtin_cpu_supports("popcnt")) {
+    return &HammingDistancesPopcnt;
+  }
+#endif
+  return &HammingDistancesGeneric;
+}
+
+}  // namespace
+
 void FindBestMatches(const Eigen::MatrixXi& dists, const float max_ratio,
                      const float max_distance, const bool cross_check,
                      FeatureMatches &matches) {
@@ -133,12 +263,73 @@ void MatchSiftFeaturesCPU(const SiftMatchOptions& match_options,
                           const FeatureDescriptors& descriptors1,
                           const FeatureDescriptors& descriptors2,
                           FeatureMatches &matches) {
-  const Eigen::MatrixXi dists = ComputeSiftDistanceMatrix(
-      FeatureKeypoints(), FeatureKeypoints(),
-      descriptors1, descriptors2, nullptr);
+  matches.clear();
+  const bool reduced = match_options.reduced_descriptors;
+  if (descriptors1.cols() != descriptors2.cols() ||
+      (!reduced && descriptors1.cols() != 128)) {
+    return;
+  }
+
+  // Fixed dimensions let Eigen unroll and vectorize the dot products.
+  Eigen::MatrixXi dists;
+  switch (descriptors1.cols()) {
+    case 128:
+      dists = ComputeSiftDistanceMatrix<128>(
+          FeatureKeypoints(), FeatureKeypoints(),
+          descriptors1, descriptors2, reduced, nullptr);
+      break;
+    case 64:
+      dists = ComputeSiftDistanceMatrix<64>(
+          FeatureKeypoints(), FeatureKeypoints(),
+          descriptors1, descriptors2, reduced, nullptr);
+      break;
+    case 32:
+      dists = ComputeSiftDistanceMatrix<32>(
+          FeatureKeypoints(), FeatureKeypoints(),
+          descriptors1, descriptors2, reduced, nullptr);
+      break;
+    default:
+      dists = ComputeSiftDistanceMatrix<Eigen::Dynamic>(
+          FeatureKeypoints(), FeatureKeypoints(),
+          descriptors1, descriptors2, reduced, nullptr);
+      break;
+  }
 
   FindBestMatches(dists, match_options.max_ratio, match_options.max_distance,
                   match_options.cross_check, matches);
 }
 
+void MatchBinaryFeaturesCPU(const SiftMatchOptions& match_options,
+                            const BinaryFeatureDescriptors& descriptors1,
+                            const BinaryFeatureDescriptors& descriptors2,
+                            FeatureMatches &matches) {
+  matches.clear();
+  if (descriptors1.cols() != descriptors2.cols()) {
+    return;
+  }
+
+  const int num_bytes = static_cast<int>(descriptors1.cols());
+  const int64_t num_bits = 8 * static_cast<int64_t>(num_bytes);
+  const int64_t kSquaredNorm = 512 * 512;
 
+  static const HammingDistancesFunc hamming_distances =
+      SelectHammingDistances();
+
+  // The bits are the signs of vectors with entries of +/-1, whose dot
+  // product is num_bits - 2 * hamming_distance, scaled to a norm of 512.
+  Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> dists(
+      descriptors1.rows(), descriptors2.rows());
+  for (FeatureDescriptors::Index i1 = 0; i1 < descriptors1.rows(); ++i1) {
+    int* row = dists.data() + i1 * descriptors2.rows();
+    hamming_distances(descriptors1.data() + i1 * num_bytes,
+                      descriptors2.data(), descriptors2.rows(), num_bytes,
+                      row);
+    for (FeatureDescriptors::Index i2 = 0; i2 < descriptors2.rows(); ++i2) {
+      row[i2] = static_cast<int>(kSquaredNorm * (num_bits - 2 * row[i2]) /
+                                 num_bits);
+    }
+  }
+
+  FindBestMatches(dists, match_options.max_ratio, match_options.max_distance,
+                  match_options.cross_check, matches);
+}
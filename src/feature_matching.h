@@ -10,13 +10,36 @@
 
 struct SiftMatchOptions;
 
-// Match the given SIFT features on the CPU.
+// Match the given SIFT features on the CPU. Descriptors reduced by
+// `DescriptorPCA` are matched in their reduced dimension, if
+// `SiftMatchOptions::reduced_descriptors` is set.
 void MatchSiftFeaturesCPU(const SiftMatchOptions& match_options,
                           const FeatureDescriptors& descriptors1,
                           const FeatureDescriptors& descriptors2,
                           FeatureMatches &matches);
 
+// Match the given binary features, see `ExtractBinaryFeaturesCPU`, by their
+// Hamming distances. The distances are converted to the angles between the
+// descriptors as vectors of +/-1, so that the options have the same meaning
+// as for SIFT features, e.g. a `max_distance` of 0.7 corresponds to 30 of 256
+// differing bits.
+void MatchBinaryFeaturesCPU(const SiftMatchOptions& match_options,
+                            const BinaryFeatureDescriptors& descriptors1,
+                            const BinaryFeatureDescriptors& descriptors2,
+                            FeatureMatches &matches);
+
+// Find the matches that pass the distance and ratio tests in a matrix of
+// descriptor dot products, where SIFT descriptors have a norm of 512.
+void FindBestMatches(const Eigen::MatrixXi& dists, const float max_ratio,
+                     const float max_distance, const bool cross_check,
+                     FeatureMatches &matches);
+
 struct SiftMatchOptions {
+  // Whether the descriptors were reduced by `DescriptorPCA`. Otherwise, they
+  // must be 128-D SIFT descriptors, and descriptors of any other dimension,
+  // e.g. binary descriptors, have no matches.
+  bool reduced_descriptors = false;
+
   // Maximum distance ratio between first and second best match.
   double max_ratio = 0.8;
 
@@ -55,4 +78,60 @@ struct SiftMatchOptions {
   bool guided_matching = false;
 };
 
+// Scores pairs of SIFT descriptors by their dot products, as expected by
+// `FindBestMatches`. Descriptors reduced by `DescriptorPCA` have an offset of
+// 128 and are scored by their squared distances, converted to the dot
+// products of descriptors with a norm of 512, i.e. 512^2 - |x - y|^2 / 2.
+// A fixed dimension `kDim` lets Eigen unroll and vectorize the products.
+template <int kDim>
+class SiftDescriptorScorer {
+ public:
+  SiftDescriptorScorer(const FeatureDescriptors& descriptors1,
+                       const FeatureDescriptors& descriptors2,
+                       const bool reduced);
+
+  inline int Score(const Eigen::DenseIndex idx1,
+                   const Eigen::DenseIndex idx2) const;
+
+ private:
+  typedef Eigen::Matrix<int, Eigen::Dynamic, kDim, Eigen::RowMajor>
+      IntDescriptors;
+
+  bool reduced_;
+  IntDescriptors descriptors1_;
+  IntDescriptors descriptors2_;
+  Eigen::VectorXi half_squared_norms1_;
+  Eigen::VectorXi half_squared_norms2_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template <int kDim>
+SiftDescriptorScorer<kDim>::SiftDescriptorScorer(
+    const FeatureDescriptors& descriptors1,
+    const FeatureDescriptors& descriptors2, const bool reduced)
+    : reduced_(reduced),
+      descriptors1_(descriptors1.cast<int>()),
+      descriptors2_(descriptors2.cast<int>()) {
+  if (reduced_) {
+    descriptors1_.array() -= 128;
+    descriptors2_.array() -= 128;
+    half_squared_norms1_ = descriptors1_.rowwise().squaredNorm() / 2;
+    half_squared_norms2_ = descriptors2_.rowwise().squaredNorm() / 2;
+  }
+}
+
+template <int kDim>
+int SiftDescriptorScorer<kDim>::Score(const Eigen::DenseIndex idx1,
+                                      const Eigen::DenseIndex idx2) const {
+  const int dot = descriptors1_.row(idx1).dot(descriptors2_.row(idx2));
+  if (reduced_) {
+    return dot + 512 * 512 - half_squared_norms1_(idx1) -
+           half_squared_norms2_(idx2);
+  }
+  return dot;
+}
+
 #endif  // COLMAP_SRC_BASE_FEATURE_MATCHING_H_
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "feature_pipeline.h"
+
+#include "two_view_geometry.h"
+
+FeaturePipeline::FeaturePipeline(
+    const FeaturePipelineOptions& options,
+    const std::vector<std::string>& image_paths,
+    const std::vector<std::pair<size_t, size_t>>& image_pairs)
+    : options_(options),
+      image_paths_(image_paths),
+      image_pairs_(image_pairs),
+      image_pair_idxs_(image_paths.size()),
+      features_(image_paths.size()),
+      // All image indices are queued upfront.
+      image_queue_(image_paths.size()),
+      decoded_queue_(options.queue_capacity),
+      pair_queue_(options.queue_capacity),
+      matched_queue_(options.queue_capacity),
+      result_queue_(options.queue_capacity) {
+  for (size_t i = 0; i < image_pairs_.size(); ++i) {
+    image_pair_idxs_[image_pairs_[i].first].push_back(i);
+    if (image_pairs_[i].second != image_pairs_[i].first) {
+      image_pair_idxs_[image_pairs_[i].second].push_back(i);
+    }
+  }
+
+  pipeline_.AddStage<size_t, DecodedImage>(
+      "decode", options_.num_decode_threads, &image_queue_, &decoded_queue_,
+      [this](size_t& image_idx, BoundedQueue<DecodedImage>* output) {
+        Decode(image_idx, output);
+      });
+  pipeline_.AddStage<DecodedImage, ImagePairResult>(
+      "extract", options_.num_extraction_threads, &decoded_queue_,
+      &pair_queue_,
+      [this](DecodedImage& image, BoundedQueue<ImagePairResult>* output) {
+        Extract(image, output);
+      });
+  pipeline_.AddStage<ImagePairResult, ImagePairResult>(
+      "match", options_.num_matching_threads, &pair_queue_, &matched_queue_,
+      [this](ImagePairResult& result, BoundedQueue<ImagePairResult>* output) {
+        Match(result, output);
+      });
+  pipeline_.AddStage<ImagePairResult, ImagePairResult>(
+      "verify", options_.num_verification_threads, &matched_queue_,
+      &result_queue_,
+      [this](ImagePairResult& result, BoundedQueue<ImagePairResult>* output) {
+        Verify(result, output);
+      });
+}
+
+FeaturePipeline::~FeaturePipeline() { Stop(); }
+
+void FeaturePipeline::Start() {
+  for (size_t image_idx = 0; image_idx < image_paths_.size(); ++image_idx) {
+    image_queue_.Push(image_idx);
+  }
+  image_queue_.Close();
+  pipeline_.Start();
+}
+
+bool FeaturePipeline::Next(ImagePairResult* result) {
+  if (result_queue_.Pop(result)) {
+    return true;
+  }
+  pipeline_.Wait();
+  return false;
+}
+
+void FeaturePipeline::Stop() { pipeline_.Stop(); }
+
+bool FeaturePipeline::HasFeatures(const size_t image_idx) const {
+  return features_.at(image_idx).success;
+}
+
+const FeatureKeypoints& FeaturePipeline::Keypoints(
+    const size_t image_idx) const {
+  return features_.at(image_idx).keypoints;
+}
+
+const FeatureDescriptors& FeaturePipeline::Descriptors(
+    const size_t image_idx) const {
+  return features_.at(image_idx).descriptors;
+}
+
+std::vector<PipelineStageStats> FeaturePipeline::Stats() const {
+  return pipeline_.Stats();
+}
+
+void FeaturePipeline::Decode(size_t& image_idx,
+                             BoundedQueue<DecodedImage>* output) {
+  DecodedImage image;
+  image.image_idx = image_idx;
+  // The extraction works on grey images, which need a third of the memory.
+  image.success = image.bitmap.Read(image_paths_[image_idx], false);
+  output->Push(std::move(image));
+}
+
+void FeaturePipeline::Extract(DecodedImage& image,
+                              BoundedQueue<ImagePairResult>* output) {
+  FeatureKeypoints keypoints;
+  FeatureDescriptors descriptors;
+  const bool success =
+      image.success && ExtractSiftFeaturesCPU(image.bitmap, keypoints,
+                                              descriptors,
+                                              options_.sift_options);
+  // Release the pixels before blocking on the output queue.
+  image.bitmap = Bitmap();
+
+  // Collect the pairs whose other image is already done. The image finishing
+  // last schedules the pair, so that every pair is matched exactly once.
+  std::vector<ImagePairResult> ready_pairs;
+  {
+    std::unique_lock<std::mutex> lock(features_mutex_);
+    ImageFeatures& features = features_[image.image_idx];
+    features.keypoints = std::move(keypoints);
+    features.descriptors = std::move(descriptors);
+    features.success = success;
+    features.done = true;
+    for (const size_t pair_idx : image_pair_idxs_[image.image_idx]) {
+      const auto& image_pair = image_pairs_[pair_idx];
+      if (features_[image_pair.first].done &&
+          features_[image_pair.second].done) {
+        ImagePairResult result;
+        result.image_idx1 = image_pair.first;
+        result.image_idx2 = image_pair.second;
+        ready_pairs.push_back(std::move(result));
+      }
+    }
+  }
+
+  for (auto& result : ready_pairs) {
+    output->Push(std::move(result));
+  }
+}
+
+void FeaturePipeline::Match(ImagePairResult& result,
+                            BoundedQueue<ImagePairResult>* output) {
+  // Features are not modified after they are done, so that they can be read
+  // without holding the lock.
+  const ImageFeatures& features1 = features_[result.image_idx1];
+  const ImageFeatures& features2 = features_[result.image_idx2];
+  if (features1.success && features2.success) {
+    MatchSiftFeaturesCPU(options_.match_options, features1.descriptors,
+                         features2.descriptors, result.matches);
+  }
+  output->Push(std::move(result));
+}
+
+void FeaturePipeline::Verify(ImagePairResult& result,
+                             BoundedQueue<ImagePairResult>* output) {
+  if (options_.verify_matches) {
+    result.verified = VerifyFeatureMatches(
+        features_[result.image_idx1].keypoints,
+        features_[result.image_idx2].keypoints, result.matches,
+        options_.match_options, &result.inlier_matches, &result.F);
+  }
+  output->Push(std::move(result));
+}
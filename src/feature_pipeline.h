@@ -0,0 +1,127 @@
+#ifndef COLMAP_SRC_BASE_FEATURE_PIPELINE_H_
+#define COLMAP_SRC_BASE_FEATURE_PIPELINE_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "bitmap.h"
+#include "bounded_queue.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "feature_matching.h"
+#include "pipeline.h"
+
+struct FeaturePipelineOptions {
+  // Number of worker threads per stage. If `num_threads <= 0`, the number of
+  // hardware threads is used.
+  int num_decode_threads = 2;
+  int num_extraction_threads = -1;
+  int num_matching_threads = 2;
+  int num_verification_threads = 1;
+
+  // Capacity of the queues between the stages. Decoded images are the
+  // largest items, so at most about `queue_capacity + num_decode_threads +
+  // num_extraction_threads` images are held in memory.
+  int queue_capacity = 4;
+
+  SiftOptions sift_options;
+  SiftMatchOptions match_options;
+
+  // Whether to geometrically verify the matches of every pair.
+  bool verify_matches = true;
+};
+
+struct ImagePairResult {
+  size_t image_idx1 = 0;
+  size_t image_idx2 = 0;
+
+  FeatureMatches matches;
+
+  // Matches consistent with the fundamental matrix `F`, if verified.
+  bool verified = false;
+  FeatureMatches inlier_matches;
+  Eigen::Matrix3d F = Eigen::Matrix3d::Zero();
+};
+
+// Decodes images, extracts their SIFT features, matches image pairs and
+// verifies the matches in concurrent stages connected by bounded queues:
+//
+//    FeaturePipeline pipeline(options, image_paths, image_pairs);
+//    pipeline.Start();
+//    ImagePairResult result;
+//    while (pipeline.Next(&result)) {
+//      // Process `result`, while later pairs are being processed.
+//    }
+//
+// A pair is matched as soon as the features of both images are extracted,
+// so that matching overlaps with the decoding and extraction of later
+// images. The features of all images are kept until the pipeline is
+// destroyed.
+class FeaturePipeline {
+ public:
+  FeaturePipeline(const FeaturePipelineOptions& options,
+                  const std::vector<std::string>& image_paths,
+                  const std::vector<std::pair<size_t, size_t>>& image_pairs);
+  ~FeaturePipeline();
+
+  void Start();
+
+  // Block until the next pair is finished. Pairs are delivered in the order
+  // of completion. Returns false after the last pair.
+  bool Next(ImagePairResult* result);
+
+  // Stop all stages and discard pending pairs.
+  void Stop();
+
+  // Whether the features of an image were extracted successfully. Only valid
+  // after the image was used in a delivered pair or all pairs were delivered.
+  bool HasFeatures(const size_t image_idx) const;
+  const FeatureKeypoints& Keypoints(const size_t image_idx) const;
+  const FeatureDescriptors& Descriptors(const size_t image_idx) const;
+
+  std::vector<PipelineStageStats> Stats() const;
+
+ private:
+  struct DecodedImage {
+    size_t image_idx = 0;
+    Bitmap bitmap;
+    bool success = false;
+  };
+
+  struct ImageFeatures {
+    bool done = false;
+    bool success = false;
+    FeatureKeypoints keypoints;
+    FeatureDescriptors descriptors;
+  };
+
+  void Decode(size_t& image_idx, BoundedQueue<DecodedImage>* output);
+  void Extract(DecodedImage& image, BoundedQueue<ImagePairResult>* output);
+  void Match(ImagePairResult& result, BoundedQueue<ImagePairResult>* output);
+  void Verify(ImagePairResult& result, BoundedQueue<ImagePairResult>* output);
+
+  const FeaturePipelineOptions options_;
+  const std::vector<std::string> image_paths_;
+  const std::vector<std::pair<size_t, size_t>> image_pairs_;
+
+  // Indices of the pairs per image.
+  std::vector<std::vector<size_t>> image_pair_idxs_;
+
+  std::mutex features_mutex_;
+  std::vector<ImageFeatures> features_;
+
+  BoundedQueue<size_t> image_queue_;
+  BoundedQueue<DecodedImage> decoded_queue_;
+  BoundedQueue<ImagePairResult> pair_queue_;
+  BoundedQueue<ImagePairResult> matched_queue_;
+  BoundedQueue<ImagePairResult> result_queue_;
+
+  Pipeline pipeline_;
+};
+
+#endif  // COLMAP_SRC_BASE_FEATURE_PIPELINE_H_
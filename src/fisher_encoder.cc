@@ -0,0 +1,249 @@
+#include "fisher_encoder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <numeric>
+#include <random>
+
+#include <Eigen/Eigenvalues>
+
+#include "VLFeat/fisher.h"
+#include "VLFeat/gmm.h"
+#include "threading.h"
+
+namespace {
+
+// Set the number of threads of VLFeat for the lifetime of the object. Note
+// that the number is global to VLFeat.
+class ScopedVlNumThreads {
+ public:
+  explicit ScopedVlNumThreads(const int num_threads)
+      : prev_num_threads_(vl_get_max_threads()) {
+    vl_set_num_threads(num_threads);
+  }
+  ~ScopedVlNumThreads() { vl_set_num_threads(prev_num_threads_); }
+
+ private:
+  const vl_size prev_num_threads_;
+};
+
+template <typename Matrix>
+bool WriteMatrix(FILE* file, const Matrix& matrix) {
+  const size_t size = static_cast<size_t>(matrix.size());
+  return fwrite(matrix.data(), sizeof(float), size, file) == size;
+}
+
+template <typename Matrix>
+bool ReadMatrix(FILE* file, Matrix* matrix) {
+  const size_t size = static_cast<size_t>(matrix->size());
+  return fread(matrix->data(), sizeof(float), size, file) == size;
+}
+
+}  // namespace
+
+bool FisherVectorEncoder::Train(const FisherVectorOptions& options,
+                                const DescriptorLoader& loader) {
+  pca_mean_.resize(0);
+  pca_basis_.resize(0, 0);
+  means_.resize(0, 0);
+  covariances_.resize(0, 0);
+  priors_.resize(0);
+
+  const size_t num_images = loader.NumImages();
+  const size_t num_train_images =
+      std::min(num_images, options.max_num_training_images);
+  if (num_train_images == 0 || options.num_clusters <= 0 ||
+      options.num_descriptor_dimensions <= 0) {
+    return false;
+  }
+
+  // Sample the same number of RootSIFT descriptors from every image.
+  const size_t max_num_samples = std::max<size_t>(
+      1, options.max_num_training_descriptors / num_train_images);
+  std::vector<RowMajorMatrixXf> samples(num_train_images);
+  ParallelForRange(
+      0, num_train_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        for (size_t i = begin; i < end; ++i) {
+          const size_t image_idx = i * num_images / num_train_images;
+          if (!loader.Load(image_idx, &descriptors) ||
+              descriptors.rows() == 0) {
+            continue;
+          }
+          const Eigen::MatrixXf root_descriptors =
+              L1RootNormalizeFeatureDescriptors(descriptors.cast<float>());
+          std::vector<Eigen::DenseIndex> rows(root_descriptors.rows());
+          std::iota(rows.begin(), rows.end(), 0);
+          std::mt19937 random_engine(static_cast<unsigned>(i));
+          std::shuffle(rows.begin(), rows.end(), random_engine);
+          rows.resize(std::min(rows.size(), max_num_samples));
+          samples[i].resize(rows.size(), root_descriptors.cols());
+          for (size_t j = 0; j < rows.size(); ++j) {
+            samples[i].row(j) = root_descriptors.row(rows[j]);
+          }
+        }
+      });
+
+  Eigen::DenseIndex num_samples = 0;
+  Eigen::DenseIndex dim = 0;
+  for (const auto& image_samples : samples) {
+    num_samples += image_samples.rows();
+    dim = std::max(dim, image_samples.cols());
+  }
+  RowMajorMatrixXf training_descriptors(num_samples, dim);
+  num_samples = 0;
+  for (const auto& image_samples : samples) {
+    if (image_samples.cols() == dim) {
+      training_descriptors.middleRows(num_samples, image_samples.rows()) =
+          image_samples;
+      num_samples += image_samples.rows();
+    }
+  }
+  training_descriptors.conservativeResize(num_samples, dim);
+  samples.clear();
+  if (num_samples < options.num_clusters) {
+    return false;
+  }
+
+  // PCA of the descriptors.
+  const Eigen::DenseIndex num_dimensions =
+      std::min<Eigen::DenseIndex>(options.num_descriptor_dimensions, dim);
+  pca_mean_ = training_descriptors.colwise().mean().transpose();
+  training_descriptors.rowwise() -= pca_mean_.transpose();
+  const Eigen::MatrixXf covariance =
+      training_descriptors.transpose() * training_descriptors /
+      static_cast<float>(num_samples);
+  const Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> eigen_solver(
+      covariance);
+  // Eigenvalues are in increasing order.
+  pca_basis_ = eigen_solver.eigenvectors()
+                   .rightCols(num_dimensions)
+                   .rowwise()
+                   .reverse()
+                   .transpose();
+  const RowMajorMatrixXf projected_descriptors =
+      training_descriptors * pca_basis_.transpose();
+
+  ScopedVlNumThreads vl_num_threads(
+      GetEffectiveNumThreads(options.num_threads));
+  VlGMM* gmm = vl_gmm_new(VL_TYPE_FLOAT, num_dimensions, options.num_clusters);
+  vl_gmm_set_initialization(gmm, VlGMMKMeans);
+  vl_gmm_set_max_num_iterations(gmm, options.max_num_iterations);
+  vl_gmm_cluster(gmm, projected_descriptors.data(), num_samples);
+  means_ = Eigen::Map<const RowMajorMatrixXf>(
+      static_cast<const float*>(vl_gmm_get_means(gmm)), options.num_clusters,
+      num_dimensions);
+  covariances_ = Eigen::Map<const RowMajorMatrixXf>(
+      static_cast<const float*>(vl_gmm_get_covariances(gmm)),
+      options.num_clusters, num_dimensions);
+  priors_ = Eigen::Map<const Eigen::VectorXf>(
+      static_cast<const float*>(vl_gmm_get_priors(gmm)),
+      options.num_clusters);
+  vl_gmm_delete(gmm);
+
+  return true;
+}
+
+bool FisherVectorEncoder::IsTrained() const { return means_.size() > 0; }
+
+int FisherVectorEncoder::NumDimensions() const {
+  return static_cast<int>(2 * means_.size());
+}
+
+void FisherVectorEncoder::Encode(const FeatureDescriptors& descriptors,
+                                 Eigen::VectorXf* vector) const {
+  vector->setZero(NumDimensions());
+  if (descriptors.rows() == 0 || descriptors.cols() != pca_mean_.size()) {
+    return;
+  }
+
+  const RowMajorMatrixXf projected_descriptors =
+      ProjectDescriptors(descriptors);
+  vl_fisher_encode(vector->data(), VL_TYPE_FLOAT, means_.data(),
+                   means_.cols(), means_.rows(), covariances_.data(),
+                   priors_.data(), projected_descriptors.data(),
+                   projected_descriptors.rows(), VL_FISHER_FLAG_IMPROVED);
+}
+
+bool FisherVectorEncoder::EncodeImages(
+    const DescriptorLoader& loader, const int num_threads,
+    const std::function<void(size_t, const Eigen::VectorXf&)>& callback)
+    const {
+  ScopedVlNumThreads vl_num_threads(1);
+
+  std::mutex mutex;
+  bool success = true;
+  ParallelForRange(
+      0, loader.NumImages(), num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        Eigen::VectorXf vector;
+        for (size_t image_idx = begin; image_idx < end; ++image_idx) {
+          const bool loaded = loader.Load(image_idx, &descriptors);
+          if (loaded) {
+            Encode(descriptors, &vector);
+          }
+          std::unique_lock<std::mutex> lock(mutex);
+          if (loaded) {
+            callback(image_idx, vector);
+          } else {
+            success = false;
+          }
+        }
+      });
+
+  return success;
+}
+
+bool FisherVectorEncoder::Write(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  const uint32_t header[3] = {static_cast<uint32_t>(pca_basis_.cols()),
+                              static_cast<uint32_t>(pca_basis_.rows()),
+                              static_cast<uint32_t>(means_.rows())};
+  bool success = fwrite(header, sizeof(uint32_t), 3, file) == 3 &&
+                 WriteMatrix(file, pca_mean_) &&
+                 WriteMatrix(file, pca_basis_) && WriteMatrix(file, means_) &&
+                 WriteMatrix(file, covariances_) && WriteMatrix(file, priors_);
+  success = fclose(file) == 0 && success;
+  return success;
+}
+
+bool FisherVectorEncoder::Read(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  uint32_t header[3];
+  bool success = fread(header, sizeof(uint32_t), 3, file) == 3;
+  if (success) {
+    pca_mean_.resize(header[0]);
+    pca_basis_.resize(header[1], header[0]);
+    means_.resize(header[2], header[1]);
+    covariances_.resize(header[2], header[1]);
+    priors_.resize(header[2]);
+    success = ReadMatrix(file, &pca_mean_) && ReadMatrix(file, &pca_basis_) &&
+              ReadMatrix(file, &means_) && ReadMatrix(file, &covariances_) &&
+              ReadMatrix(file, &priors_);
+  }
+  fclose(file);
+
+  if (!success) {
+    means_.resize(0, 0);
+  }
+  return success;
+}
+
+FisherVectorEncoder::RowMajorMatrixXf FisherVectorEncoder::ProjectDescriptors(
+    const FeatureDescriptors& descriptors) const {
+  RowMajorMatrixXf root_descriptors =
+      L1RootNormalizeFeatureDescriptors(descriptors.cast<float>());
+  root_descriptors.rowwise() -= pca_mean_.transpose();
+  return root_descriptors * pca_basis_.transpose();
+}
@@ -0,0 +1,86 @@
+#ifndef COLMAP_SRC_BASE_FISHER_ENCODER_H_
+#define COLMAP_SRC_BASE_FISHER_ENCODER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "exhaustive_matcher.h"
+#include "feature.h"
+
+struct FisherVectorOptions {
+  // Number of Gaussians of the mixture model.
+  int num_clusters = 64;
+
+  // Dimension of the PCA-reduced descriptors the mixture is fitted to, which
+  // decorrelates them for the diagonal covariances of the mixture.
+  int num_descriptor_dimensions = 64;
+
+  // Maximum number of images to train on and maximum number of descriptors
+  // sampled from them.
+  size_t max_num_training_images = 1000;
+  size_t max_num_training_descriptors = 200000;
+
+  int max_num_iterations = 100;
+
+  // Number of threads to load the training images, to fit the mixture with
+  // the OpenMP code of VLFeat and to encode images. If `num_threads <= 0`,
+  // the number of hardware threads is used.
+  int num_threads = -1;
+};
+
+// Encodes the descriptors of an image into an improved Fisher vector, see
+// "Improving the Fisher Kernel for Large-Scale Image Classification",
+// Perronnin et al., ECCV 2010. The RootSIFT descriptors are reduced by PCA
+// and the gradients of the Gaussian mixture with respect to its means and
+// variances are square-rooted and L2-normalized, which yields unit vectors
+// of dimension `2 * num_clusters * num_descriptor_dimensions`.
+class FisherVectorEncoder {
+ public:
+  // Train the PCA and the mixture on a uniform subset of the images.
+  bool Train(const FisherVectorOptions& options,
+             const DescriptorLoader& loader);
+
+  bool IsTrained() const;
+  int NumDimensions() const;
+
+  // Encode the descriptors, where an image without descriptors is encoded
+  // as zero vector. Thread-safe.
+  void Encode(const FeatureDescriptors& descriptors,
+              Eigen::VectorXf* vector) const;
+
+  // Encode all images on `num_threads` threads, one image per thread at a
+  // time, and pass the vectors of the successfully loaded images to the
+  // callback, which is called by one thread at a time. VLFeat is limited to
+  // one thread meanwhile, since parallelizing over images scales better
+  // than parallelizing within an image. Returns false if any image failed
+  // to load.
+  bool EncodeImages(
+      const DescriptorLoader& loader, const int num_threads,
+      const std::function<void(size_t, const Eigen::VectorXf&)>& callback)
+      const;
+
+  bool Write(const std::string& path) const;
+  bool Read(const std::string& path);
+
+ private:
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor>
+      RowMajorMatrixXf;
+
+  // RootSIFT descriptors projected by the PCA, one per row.
+  RowMajorMatrixXf ProjectDescriptors(
+      const FeatureDescriptors& descriptors) const;
+
+  Eigen::VectorXf pca_mean_;
+  RowMajorMatrixXf pca_basis_;
+
+  // Means and diagonal covariances of the Gaussians, one per row.
+  RowMajorMatrixXf means_;
+  RowMajorMatrixXf covariances_;
+  Eigen::VectorXf priors_;
+};
+
+#endif  // COLMAP_SRC_BASE_FISHER_ENCODER_H_
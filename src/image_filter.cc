@@ -0,0 +1,307 @@
+#include "image_filter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "memory_pool.h"
+#include "misc.h"
+#include "threading.h"
+
+namespace {
+
+// Fixed-point kernel weights sum to 2^kWeightBits. The horizontal pass stores
+// its result with kWeightBits - kIntermediateShift fractional bits, so that
+// 8-bit inputs fit into signed 16-bit intermediates.
+const int kWeightBits = 10;
+const int kIntermediateShift = 4;
+const int kOutputShift = 2 * kWeightBits - kIntermediateShift;
+
+// Minimum number of rows processed per thread.
+const size_t kMinRowsPerThread = 16;
+
+std::vector<int16_t> QuantizeKernel(const std::vector<float>& kernel) {
+  std::vector<int16_t> quantized(kernel.size());
+  int sum = 0;
+  for (size_t i = 0; i < kernel.size(); ++i) {
+    quantized[i] =
+        static_cast<int16_t>(std::round(kernel[i] * (1 << kWeightBits)));
+    sum += quantized[i];
+  }
+  // Compensate the rounding error in the center tap, so that flat image
+  // regions are preserved exactly.
+  quantized[kernel.size() / 2] += (1 << kWeightBits) - sum;
+  return quantized;
+}
+
+// Copy an interleaved row into a buffer padded by `radius` pixels on both
+// sides, replicating the border pixels.
+template <typename T>
+void PadRow(const uint8_t* row, const int width, const int channels,
+            const int radius, T* padded) {
+  for (int x = -radius; x < width + radius; ++x) {
+    const int xx = std::min(std::max(x, 0), width - 1);
+    const uint8_t* pixel = row + xx * channels;
+    T* padded_pixel = padded + (x + radius) * channels;
+    for (int c = 0; c < channels; ++c) {
+      padded_pixel[c] = static_cast<T>(pixel[c]);
+    }
+  }
+}
+
+// Horizontal pass: the taps of a pixel are `channels` values apart in the
+// padded row, so consecutive outputs read consecutive inputs for every tap,
+// independent of the number of channels.
+void ConvolveRowFloat(const float* padded, const std::vector<float>& kernel,
+                      const int channels, const size_t num_values,
+                      float* output) {
+  const int kernel_size = static_cast<int>(kernel.size());
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 8 <= num_values; i += 8) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int j = 0; j < kernel_size; ++j) {
+      const __m128 weight = _mm_set1_ps(kernel[j]);
+      const float* input = padded + i + j * channels;
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(weight, _mm_loadu_ps(input)));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(weight, _mm_loadu_ps(input + 4)));
+    }
+    _mm_storeu_ps(output + i, acc0);
+    _mm_storeu_ps(output + i + 4, acc1);
+  }
+#endif
+  for (; i < num_values; ++i) {
+    float acc = 0.0f;
+    for (int j = 0; j < kernel_size; ++j) {
+      acc += kernel[j] * padded[i + j * channels];
+    }
+    output[i] = acc;
+  }
+}
+
+// Vertical pass: `rows[j]` is the horizontally filtered row for tap j.
+void ConvolveColumnsFloat(const float* const* rows,
+                          const std::vector<float>& kernel,
+                          const size_t num_values, uint8_t* output) {
+  const int kernel_size = static_cast<int>(kernel.size());
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 8 <= num_values; i += 8) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (int j = 0; j < kernel_size; ++j) {
+      const __m128 weight = _mm_set1_ps(kernel[j]);
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(weight, _mm_loadu_ps(rows[j] + i)));
+      acc1 =
+          _mm_add_ps(acc1, _mm_mul_ps(weight, _mm_loadu_ps(rows[j] + i + 4)));
+    }
+    // Truncate like the scalar path and saturate to [0, 255].
+    const __m128i values16 = _mm_packs_epi32(_mm_cvttps_epi32(acc0),
+                                             _mm_cvttps_epi32(acc1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i),
+                     _mm_packus_epi16(values16, values16));
+  }
+#endif
+  for (; i < num_values; ++i) {
+    float acc = 0.0f;
+    for (int j = 0; j < kernel_size; ++j) {
+      acc += kernel[j] * rows[j][i];
+    }
+    output[i] = TruncateCast<float, uint8_t>(acc);
+  }
+}
+
+void ConvolveRowFixed(const int16_t* padded, const std::vector<int16_t>& kernel,
+                      const int channels, const size_t num_values,
+                      int16_t* output) {
+  const int kernel_size = static_cast<int>(kernel.size());
+  const int kRound = 1 << (kIntermediateShift - 1);
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i round = _mm_set1_epi32(kRound);
+  for (; i + 8 <= num_values; i += 8) {
+    __m128i acc_lo = _mm_setzero_si128();
+    __m128i acc_hi = _mm_setzero_si128();
+    int j = 0;
+    // Multiply-add two taps at once by interleaving their inputs.
+    for (; j + 1 < kernel_size; j += 2) {
+      const __m128i a = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(padded + i + j * channels));
+      const __m128i b = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(padded + i + (j + 1) * channels));
+      const __m128i weights =
+          _mm_set1_epi32(static_cast<uint16_t>(kernel[j]) |
+                         (static_cast<int>(kernel[j + 1]) << 16));
+      acc_lo = _mm_add_epi32(acc_lo,
+                             _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+      acc_hi = _mm_add_epi32(acc_hi,
+                             _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+    }
+    if (j < kernel_size) {
+      const __m128i a = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(padded + i + j * channels));
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i weights =
+          _mm_set1_epi32(static_cast<uint16_t>(kernel[j]));
+      acc_lo = _mm_add_epi32(
+          acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), weights));
+      acc_hi = _mm_add_epi32(
+          acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), weights));
+    }
+    acc_lo = _mm_srai_epi32(_mm_add_epi32(acc_lo, round), kIntermediateShift);
+    acc_hi = _mm_srai_epi32(_mm_add_epi32(acc_hi, round), kIntermediateShift);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i),
+                     _mm_packs_epi32(acc_lo, acc_hi));
+  }
+#endif
+  for (; i < num_values; ++i) {
+    int acc = 0;
+    for (int j = 0; j < kernel_size; ++j) {
+      acc += kernel[j] * padded[i + j * channels];
+    }
+    output[i] = static_cast<int16_t>((acc + kRound) >> kIntermediateShift);
+  }
+}
+
+void ConvolveColumnsFixed(const int16_t* const* rows,
+                          const std::vector<int16_t>& kernel,
+                          const size_t num_values, uint8_t* output) {
+  const int kernel_size = static_cast<int>(kernel.size());
+  const int kRound = 1 << (kOutputShift - 1);
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i round = _mm_set1_epi32(kRound);
+  for (; i + 8 <= num_values; i += 8) {
+    __m128i acc_lo = _mm_setzero_si128();
+    __m128i acc_hi = _mm_setzero_si128();
+    int j = 0;
+    for (; j + 1 < kernel_size; j += 2) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j] + i));
+      const __m128i b =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j + 1] + i));
+      const __m128i weights =
+          _mm_set1_epi32(static_cast<uint16_t>(kernel[j]) |
+                         (static_cast<int>(kernel[j + 1]) << 16));
+      acc_lo = _mm_add_epi32(acc_lo,
+                             _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+      acc_hi = _mm_add_epi32(acc_hi,
+                             _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+    }
+    if (j < kernel_size) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[j] + i));
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i weights =
+          _mm_set1_epi32(static_cast<uint16_t>(kernel[j]));
+      acc_lo = _mm_add_epi32(
+          acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), weights));
+      acc_hi = _mm_add_epi32(
+          acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), weights));
+    }
+    acc_lo = _mm_srai_epi32(_mm_add_epi32(acc_lo, round), kOutputShift);
+    acc_hi = _mm_srai_epi32(_mm_add_epi32(acc_hi, round), kOutputShift);
+    const __m128i values16 = _mm_packs_epi32(acc_lo, acc_hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i),
+                     _mm_packus_epi16(values16, values16));
+  }
+#endif
+  for (; i < num_values; ++i) {
+    int acc = 0;
+    for (int j = 0; j < kernel_size; ++j) {
+      acc += kernel[j] * rows[j][i];
+    }
+    output[i] = TruncateCast<int, uint8_t>((acc + kRound) >> kOutputShift);
+  }
+}
+
+// Separable filtering in two phases over all rows: the horizontal pass
+// writes to an intermediate image, from which the vertical pass writes the
+// result back in place.
+template <typename T, typename K, typename RowFunc, typename ColumnsFunc>
+void SmoothImageSeparable(uint8_t* data, const int width, const int height,
+                          const int channels, const size_t stride,
+                          const std::vector<K>& kernel_x,
+                          const std::vector<K>& kernel_y,
+                          const int num_threads, RowFunc ConvolveRow,
+                          ColumnsFunc ConvolveColumns) {
+  const size_t num_values = static_cast<size_t>(width) * channels;
+  const int radius_x = static_cast<int>(kernel_x.size()) / 2;
+  const int radius_y = static_cast<int>(kernel_y.size()) / 2;
+
+  PooledBuffer intermediate_buffer =
+      BufferPool::Global().Acquire(num_values * height * sizeof(T));
+  T* intermediate = intermediate_buffer.DataAs<T>();
+
+  ParallelForRange(
+      0, height, num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        std::vector<T> padded((width + 2 * radius_x) * channels);
+        for (size_t y = begin; y < end; ++y) {
+          PadRow(data + y * stride, width, channels, radius_x, padded.data());
+          ConvolveRow(padded.data(), kernel_x, channels, num_values,
+                      intermediate + y * num_values);
+        }
+      });
+
+  ParallelForRange(
+      0, height, num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        std::vector<const T*> rows(kernel_y.size());
+        for (size_t y = begin; y < end; ++y) {
+          for (size_t j = 0; j < kernel_y.size(); ++j) {
+            const int yy = std::min(
+                std::max(static_cast<int>(y + j) - radius_y, 0), height - 1);
+            rows[j] = intermediate + yy * num_values;
+          }
+          ConvolveColumns(rows.data(), kernel_y, num_values,
+                          data + y * stride);
+        }
+      });
+}
+
+}  // namespace
+
+std::vector<float> ComputeGaussianKernel(const float sigma) {
+  const int radius = static_cast<int>(std::ceil(3.0 * sigma));
+  std::vector<float> kernel(2 * radius + 1);
+  double mass = 1.0;
+  kernel[radius] = 1.0f;
+  for (int i = 1; i <= radius; ++i) {
+    const double x = static_cast<double>(i) / sigma;
+    const double g = std::exp(-0.5 * x * x);
+    mass += 2.0 * g;
+    kernel[radius - i] = static_cast<float>(g);
+    kernel[radius + i] = static_cast<float>(g);
+  }
+  for (auto& weight : kernel) {
+    weight = static_cast<float>(weight / mass);
+  }
+  return kernel;
+}
+
+void SmoothImage(uint8_t* data, const int width, const int height,
+                 const int channels, const size_t stride, const float sigma_x,
+                 const float sigma_y, const SmoothOptions& options) {
+  if (width <= 0 || height <= 0 || channels <= 0) {
+    return;
+  }
+
+  const std::vector<float> kernel_x = ComputeGaussianKernel(sigma_x);
+  const std::vector<float> kernel_y = ComputeGaussianKernel(sigma_y);
+
+  if (options.fixed_point) {
+    SmoothImageSeparable<int16_t>(
+        data, width, height, channels, stride, QuantizeKernel(kernel_x),
+        QuantizeKernel(kernel_y), options.num_threads, ConvolveRowFixed,
+        ConvolveColumnsFixed);
+  } else {
+    SmoothImageSeparable<float>(data, width, height, channels, stride,
+                                kernel_x, kernel_y, options.num_threads,
+                                ConvolveRowFloat, ConvolveColumnsFloat);
+  }
+}
@@ -0,0 +1,31 @@
+#ifndef COLMAP_SRC_UTIL_IMAGE_FILTER_H_
+#define COLMAP_SRC_UTIL_IMAGE_FILTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SmoothOptions {
+  // Filter with 16-bit fixed-point weights instead of floats. This is faster
+  // and differs from the float result by at most one intensity level.
+  bool fixed_point = false;
+
+  // Number of threads over which the rows are split. If `num_threads <= 0`,
+  // all hardware threads are used.
+  int num_threads = -1;
+};
+
+// Normalized 1D Gaussian kernel with radius `ceil(3 * sigma)`, identical to
+// the kernel used by `vl_imsmooth_f`.
+std::vector<float> ComputeGaussianKernel(const float sigma);
+
+// Smooth an interleaved 8-bit image with `channels` values per pixel in place
+// using a separable Gaussian kernel. Rows are `stride` bytes apart. Borders
+// are padded by continuity as in `vl_imsmooth_f`. All channels are filtered
+// in the same pass without de-interleaving the image.
+void SmoothImage(uint8_t* data, const int width, const int height,
+                 const int channels, const size_t stride, const float sigma_x,
+                 const float sigma_y,
+                 const SmoothOptions& options = SmoothOptions());
+
+#endif  // COLMAP_SRC_UTIL_IMAGE_FILTER_H_
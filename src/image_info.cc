@@ -0,0 +1,113 @@
+#include "image_info.h"
+
+#include <atomic>
+#include <memory>
+
+#include "misc.h"
+#include "threading.h"
+
+ImageInfo ProbeImage(const std::string& path) {
+  ImageInfo info;
+  info.path = path;
+
+  const FREE_IMAGE_FORMAT format = FreeImage_GetFileType(path.c_str(), 0);
+  if (format == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(format)) {
+    return info;
+  }
+
+  // Plugins without header-only support ignore the flag and decode the full
+  // image, which is slower but yields the same information.
+  const int flags = FreeImage_FIFSupportsNoPixels(format) ? FIF_LOAD_NOPIXELS
+                                                          : 0;
+
+  std::unique_ptr<FIBITMAP, decltype(&FreeImage_Unload)> data(
+      FreeImage_Load(format, path.c_str(), flags), &FreeImage_Unload);
+  if (!data) {
+    return info;
+  }
+
+  info.format = format;
+  info.type = FreeImage_GetImageType(data.get());
+  info.width = FreeImage_GetWidth(data.get());
+  info.height = FreeImage_GetHeight(data.get());
+  info.channels = GetNumChannels(data.get());
+  info.bits_per_pixel = FreeImage_GetBPP(data.get());
+
+  return info;
+}
+
+std::vector<ImageInfo> ProbeImages(const std::vector<std::string>& paths,
+                                   const int num_threads) {
+  std::vector<ImageInfo> infos(paths.size());
+
+  // Header sizes and file system latencies vary a lot between files, so the
+  // work is distributed dynamically instead of in fixed chunks.
+  std::atomic<size_t> next_idx(0);
+  ParallelForRange(0, GetEffectiveNumThreads(num_threads), num_threads, 1,
+                   [&](const size_t, const size_t) {
+                     while (true) {
+                       const size_t idx = next_idx++;
+                       if (idx >= paths.size()) {
+                         break;
+                       }
+                       infos[idx] = ProbeImage(paths[idx]);
+                     }
+                   });
+
+  return infos;
+}
+
+std::vector<ImageInfo> ProbeImageDirectory(const std::string& path,
+                                           const int num_threads) {
+  // Filter by extension first to avoid opening unrelated files.
+  std::vector<std::string> image_paths;
+  for (const auto& file_path : GetFileList(path)) {
+    if (FreeImage_GetFIFFromFilename(file_path.c_str()) != FIF_UNKNOWN) {
+      image_paths.push_back(file_path);
+    }
+  }
+
+  std::vector<ImageInfo> infos = ProbeImages(image_paths, num_threads);
+  infos.erase(std::remove_if(infos.begin(), infos.end(),
+                             [](const ImageInfo& info) {
+                               return !info.IsValid();
+                             }),
+              infos.end());
+
+  return infos;
+}
+
+int GetNumChannels(FIBITMAP* data) {
+  switch (FreeImage_GetImageType(data)) {
+    case FIT_BITMAP:
+      switch (FreeImage_GetColorType(data)) {
+        case FIC_MINISWHITE:
+        case FIC_MINISBLACK:
+          return 1;
+        case FIC_PALETTE:
+        case FIC_RGB:
+          return 3;
+        case FIC_RGBALPHA:
+        case FIC_CMYK:
+          return 4;
+      }
+      return 0;
+    case FIT_UINT16:
+    case FIT_INT16:
+    case FIT_UINT32:
+    case FIT_INT32:
+    case FIT_FLOAT:
+    case FIT_DOUBLE:
+      return 1;
+    case FIT_COMPLEX:
+      return 2;
+    case FIT_RGB16:
+    case FIT_RGBF:
+      return 3;
+    case FIT_RGBA16:
+    case FIT_RGBAF:
+      return 4;
+    default:
+      return 0;
+  }
+}
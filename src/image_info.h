@@ -0,0 +1,70 @@
+#ifndef COLMAP_SRC_UTIL_IMAGE_INFO_H_
+#define COLMAP_SRC_UTIL_IMAGE_INFO_H_
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#endif
+#include <FreeImage.h>
+
+// Image properties that can be determined from the file header alone.
+struct ImageInfo {
+  std::string path;
+
+  // File format as detected from the file signature.
+  FREE_IMAGE_FORMAT format = FIF_UNKNOWN;
+
+  // Pixel type, e.g. FIT_BITMAP for standard 8-bit images or FIT_UINT16 for
+  // 16-bit greyscale images.
+  FREE_IMAGE_TYPE type = FIT_UNKNOWN;
+
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  unsigned int bits_per_pixel = 0;
+
+  // Whether the image could be probed successfully.
+  inline bool IsValid() const;
+
+  // Number of bytes needed to hold the decoded image in memory, not
+  // including the padding of the scanlines.
+  inline size_t NumBytes() const;
+};
+
+// Read the dimensions and pixel format of the image at the given path without
+// decoding the pixels. Formats whose FreeImage plugin does not support
+// header-only loading fall back to a full decode. Returns an invalid info
+// object if the file cannot be read.
+ImageInfo ProbeImage(const std::string& path);
+
+// Probe multiple images in parallel. The returned infos are in the same order
+// as the given paths. If `num_threads <= 0`, all hardware threads are used.
+std::vector<ImageInfo> ProbeImages(const std::vector<std::string>& paths,
+                                   const int num_threads = -1);
+
+// Probe all images with a known file extension in the given directory (not
+// recursive). Files that cannot be probed are omitted from the result.
+std::vector<ImageInfo> ProbeImageDirectory(const std::string& path,
+                                           const int num_threads = -1);
+
+// Number of color channels of a FreeImage bitmap, e.g. 1 for greyscale, 3 for
+// RGB and 4 for RGBA or CMYK images.
+int GetNumChannels(FIBITMAP* data);
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+bool ImageInfo::IsValid() const {
+  return format != FIF_UNKNOWN && width > 0 && height > 0;
+}
+
+size_t ImageInfo::NumBytes() const {
+  return static_cast<size_t>(width) * static_cast<size_t>(height) *
+         (bits_per_pixel / 8);
+}
+
+#endif  // COLMAP_SRC_UTIL_IMAGE_INFO_H_
@@ -0,0 +1,231 @@
+#include "image_layout.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "threading.h"
+
+namespace {
+
+// Tiles of 64x64 pixels fit into the L1 cache for up to four channels.
+const int kTileSize = 64;
+
+// Minimum number of tile columns or rows processed per thread.
+const size_t kMinTilesPerThread = 2;
+
+// Transpose an 8x8 block of bytes.
+inline void Transpose8x8(const uint8_t* src, const ptrdiff_t src_stride,
+                         uint8_t* dst, const ptrdiff_t dst_stride) {
+#ifdef __SSE2__
+  __m128i r[8];
+  for (int i = 0; i < 8; ++i) {
+    r[i] = _mm_loadl_epi64(
+        reinterpret_cast<const __m128i*>(src + i * src_stride));
+  }
+
+  // Interleave bytes, words and double words of neighboring rows, after
+  // which each 64-bit half holds one column of the block.
+  const __m128i t0 = _mm_unpacklo_epi8(r[0], r[1]);
+  const __m128i t1 = _mm_unpacklo_epi8(r[2], r[3]);
+  const __m128i t2 = _mm_unpacklo_epi8(r[4], r[5]);
+  const __m128i t3 = _mm_unpacklo_epi8(r[6], r[7]);
+
+  const __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+  const __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+  const __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+  const __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+
+  const __m128i c[4] = {
+      _mm_unpacklo_epi32(u0, u2), _mm_unpackhi_epi32(u0, u2),
+      _mm_unpacklo_epi32(u1, u3), _mm_unpackhi_epi32(u1, u3)};
+
+  for (int i = 0; i < 4; ++i) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + (2 * i) * dst_stride),
+                     c[i]);
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i*>(dst + (2 * i + 1) * dst_stride),
+        _mm_unpackhi_epi64(c[i], c[i]));
+  }
+#else
+  for (int y = 0; y < 8; ++y) {
+    for (int x = 0; x < 8; ++x) {
+      dst[x * dst_stride + y] = src[y * src_stride + x];
+    }
+  }
+#endif
+}
+
+// De-interleave one line with a compile-time number of channels, so that the
+// inner loop is fully unrolled. With SSE2, blocks of 32 pixels are loaded
+// into 2 * kChannels registers and de-interleaved by five rounds of byte
+// unpacking, after which registers 2 * c and 2 * c + 1 hold channel c.
+template <int kChannels>
+inline void DeinterleaveLine(const uint8_t* line, const int width,
+                             const size_t plane_size, uint8_t* dst) {
+  int x = 0;
+#ifdef __SSE2__
+  const int kNumRegisters = 2 * kChannels;
+  for (; x + 32 <= width; x += 32) {
+    __m128i v[kNumRegisters];
+    for (int i = 0; i < kNumRegisters; ++i) {
+      v[i] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(line + x * kChannels + 16 * i));
+    }
+    for (int round = 0; round < 5; ++round) {
+      __m128i t[kNumRegisters];
+      for (int i = 0; i < kChannels; ++i) {
+        t[2 * i] = _mm_unpacklo_epi8(v[i], v[i + kChannels]);
+        t[2 * i + 1] = _mm_unpackhi_epi8(v[i], v[i + kChannels]);
+      }
+      for (int i = 0; i < kNumRegisters; ++i) {
+        v[i] = t[i];
+      }
+    }
+    for (int c = 0; c < kChannels; ++c) {
+      uint8_t* dst_plane = dst + c * plane_size + x;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_plane), v[2 * c]);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_plane + 16),
+                       v[2 * c + 1]);
+    }
+  }
+#endif
+  for (; x < width; ++x) {
+    for (int c = 0; c < kChannels; ++c) {
+      dst[c * plane_size + x] = line[x * kChannels + c];
+    }
+  }
+}
+
+// De-interleave one line of `width` pixels into the lines at
+// `dst + c * plane_size` for each channel c.
+void DeinterleaveChannels(const uint8_t* line, const int width,
+                          const int channels, const size_t plane_size,
+                          uint8_t* dst) {
+  switch (channels) {
+    case 1:
+      std::memcpy(dst, line, width);
+      break;
+    case 3:
+      DeinterleaveLine<3>(line, width, plane_size, dst);
+      break;
+    case 4:
+      DeinterleaveLine<4>(line, width, plane_size, dst);
+      break;
+    default:
+      for (int x = 0; x < width; ++x) {
+        for (int c = 0; c < channels; ++c) {
+          dst[c * plane_size + x] = line[x * channels + c];
+        }
+      }
+      break;
+  }
+}
+
+// De-interleave the tile [x0, x1) x [y0, y1) into `tile`, which holds one
+// kTileSize x kTileSize plane per channel, and write the transposed planes to
+// `dst + c * dst_plane_size` with `dst_stride` bytes between output rows.
+void TransposeTile(const uint8_t* src, const ptrdiff_t src_stride,
+                   const int channels, const int x0, const int x1,
+                   const int y0, const int y1, uint8_t* dst,
+                   const ptrdiff_t dst_stride, const size_t dst_plane_size,
+                   uint8_t* tile) {
+  const int tile_width = x1 - x0;
+  const int tile_height = y1 - y0;
+  const size_t tile_plane_size = kTileSize * kTileSize;
+
+  for (int y = 0; y < tile_height; ++y) {
+    const uint8_t* line = src + (y0 + y) * src_stride + x0 * channels;
+    DeinterleaveChannels(line, tile_width, channels, tile_plane_size,
+                         tile + y * kTileSize);
+  }
+
+  for (int c = 0; c < channels; ++c) {
+    const uint8_t* plane = tile + c * tile_plane_size;
+    uint8_t* dst_plane = dst + c * dst_plane_size + x0 * dst_stride + y0;
+    for (int by = 0; by < tile_height; by += 8) {
+      for (int bx = 0; bx < tile_width; bx += 8) {
+        if (by + 8 <= tile_height && bx + 8 <= tile_width) {
+          Transpose8x8(plane + by * kTileSize + bx, kTileSize,
+                       dst_plane + bx * dst_stride + by, dst_stride);
+        } else {
+          const int block_height = std::min(8, tile_height - by);
+          const int block_width = std::min(8, tile_width - bx);
+          for (int y = 0; y < block_height; ++y) {
+            for (int x = 0; x < block_width; ++x) {
+              dst_plane[(bx + x) * dst_stride + by + y] =
+                  plane[(by + y) * kTileSize + bx + x];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void TransposeChannels(const uint8_t* src, const ptrdiff_t src_stride,
+                       const int width, const int height, const int channels,
+                       uint8_t* dst, const ptrdiff_t dst_stride,
+                       const size_t dst_plane_size, const int num_threads) {
+  if (width <= 0 || height <= 0 || channels <= 0) {
+    return;
+  }
+
+  // Threads work on disjoint ranges of tile columns, which correspond to
+  // disjoint ranges of output rows.
+  const int num_tile_cols = (width + kTileSize - 1) / kTileSize;
+  ParallelForRange(
+      0, num_tile_cols, num_threads, kMinTilesPerThread,
+      [&](const size_t begin, const size_t end) {
+        std::vector<uint8_t> tile(kTileSize * kTileSize * channels);
+        for (size_t tile_col = begin; tile_col < end; ++tile_col) {
+          const int x0 = static_cast<int>(tile_col) * kTileSize;
+          const int x1 = std::min(width, x0 + kTileSize);
+          for (int y0 = 0; y0 < height; y0 += kTileSize) {
+            const int y1 = std::min(height, y0 + kTileSize);
+            TransposeTile(src, src_stride, channels, x0, x1, y0, y1, dst,
+                          dst_stride, dst_plane_size, tile.data());
+          }
+        }
+      });
+}
+
+}  // namespace
+
+void TransposeImage(const uint8_t* src, const ptrdiff_t src_stride,
+                    const int width, const int height, uint8_t* dst,
+                    const ptrdiff_t dst_stride, const int num_threads) {
+  TransposeChannels(src, src_stride, width, height, 1, dst, dst_stride, 0,
+                    num_threads);
+}
+
+void InterleavedToPlanar(const uint8_t* src, const ptrdiff_t src_stride,
+                         const int width, const int height, const int channels,
+                         uint8_t* dst, const int num_threads) {
+  if (width <= 0 || height <= 0 || channels <= 0) {
+    return;
+  }
+
+  const size_t plane_size = static_cast<size_t>(width) * height;
+  ParallelForRange(
+      0, height, num_threads, kMinTilesPerThread * kTileSize,
+      [&](const size_t begin, const size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+          DeinterleaveChannels(
+              src + static_cast<ptrdiff_t>(y) * src_stride, width, channels,
+              plane_size, dst + y * width);
+        }
+      });
+}
+
+void InterleavedToPlanarColMajor(const uint8_t* src,
+                                 const ptrdiff_t src_stride, const int width,
+                                 const int height, const int channels,
+                                 uint8_t* dst, const int num_threads) {
+  TransposeChannels(src, src_stride, width, height, channels, dst, height,
+                    static_cast<size_t>(width) * height, num_threads);
+}
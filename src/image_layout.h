@@ -0,0 +1,37 @@
+#ifndef COLMAP_SRC_UTIL_IMAGE_LAYOUT_H_
+#define COLMAP_SRC_UTIL_IMAGE_LAYOUT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversions between memory layouts of 8-bit images. The source is given as
+// a pointer to its top row and the byte offset between consecutive rows,
+// which may be negative for bottom-up images such as FreeImage bitmaps.
+//
+// Pixels with 3 or 4 channels are de-interleaved with SSE2 byte unpacking.
+// The transposing conversions work on cache-resident tiles, where each tile
+// is first de-interleaved and then transposed with an SSE2 8x8 byte transpose
+// kernel. The rows or tiles are distributed over `num_threads` threads. If
+// `num_threads <= 0`, all hardware threads are used.
+
+// Transpose a single-channel image, i.e. `dst[x * dst_stride + y]` is set to
+// the pixel at column x and row y of the source.
+void TransposeImage(const uint8_t* src, const ptrdiff_t src_stride,
+                    const int width, const int height, uint8_t* dst,
+                    const ptrdiff_t dst_stride, const int num_threads = -1);
+
+// Convert interleaved pixels to separate channel planes in row-major order,
+// i.e. `dst[(c * height + y) * width + x]`.
+void InterleavedToPlanar(const uint8_t* src, const ptrdiff_t src_stride,
+                         const int width, const int height, const int channels,
+                         uint8_t* dst, const int num_threads = -1);
+
+// Convert interleaved pixels to separate channel planes in column-major
+// order, i.e. `dst[(c * width + x) * height + y]`, as expected by column-major
+// Eigen matrices of size height x width.
+void InterleavedToPlanarColMajor(const uint8_t* src,
+                                 const ptrdiff_t src_stride, const int width,
+                                 const int height, const int channels,
+                                 uint8_t* dst, const int num_threads = -1);
+
+#endif  // COLMAP_SRC_UTIL_IMAGE_LAYOUT_H_
@@ -0,0 +1,357 @@
+#include "image_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "memory_pool.h"
+#include "threading.h"
+
+namespace {
+
+const double kLanczosRadius = 3.0;
+const double kPi = 3.14159265358979323846;
+
+// Minimum number of rows processed per thread.
+const size_t kMinRowsPerThread = 16;
+
+// View of an interleaved 8-bit image given by its top row and the signed byte
+// offset between rows.
+struct ImagePlane {
+  const uint8_t* data = nullptr;
+  ptrdiff_t stride = 0;
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+};
+
+// Halved image of the cascade, stored top-down in a pooled buffer.
+struct HalvedLevel {
+  PooledBuffer buffer;
+  ImagePlane plane;
+  // Number of source pixels per pixel of this level.
+  int factor = 1;
+};
+
+double Lanczos(const double x) {
+  if (x == 0.0) {
+    return 1.0;
+  }
+  if (std::abs(x) >= kLanczosRadius) {
+    return 0.0;
+  }
+  const double pi_x = kPi * x;
+  return kLanczosRadius * std::sin(pi_x) * std::sin(pi_x / kLanczosRadius) /
+         (pi_x * pi_x);
+}
+
+// Filter taps of a 1D resampling, with indices clamped to the input range and
+// weights normalized to sum to one.
+struct Contributions {
+  int num_taps = 0;
+  std::vector<int> indices;
+  std::vector<float> weights;
+};
+
+// Taps for resampling `input_size` pixels of a level, which cover
+// `input_size * factor` source pixels, to `output_size` pixels that cover all
+// `source_size` source pixels.
+Contributions ComputeContributions(const int input_size, const int factor,
+                                   const int source_size,
+                                   const int output_size) {
+  const double scale =
+      static_cast<double>(source_size) / (static_cast<double>(output_size) *
+                                          factor);
+  const double filter_scale = std::max(1.0, scale);
+  const double radius = kLanczosRadius * filter_scale;
+
+  Contributions contribs;
+  contribs.num_taps = static_cast<int>(std::ceil(2 * radius)) + 1;
+  contribs.indices.resize(output_size * contribs.num_taps, 0);
+  contribs.weights.resize(output_size * contribs.num_taps, 0.0f);
+
+  std::vector<double> weights(contribs.num_taps);
+  for (int i = 0; i < output_size; ++i) {
+    // Center of the output pixel in level coordinates, where integer
+    // coordinates are pixel centers.
+    const double center = (i + 0.5) * scale - 0.5;
+    const int first = static_cast<int>(std::floor(center - radius)) + 1;
+    double sum = 0.0;
+    for (int j = 0; j < contribs.num_taps; ++j) {
+      weights[j] = Lanczos((first + j - center) / filter_scale);
+      sum += weights[j];
+    }
+    for (int j = 0; j < contribs.num_taps; ++j) {
+      const size_t idx = i * contribs.num_taps + j;
+      contribs.indices[idx] =
+          std::min(std::max(first + j, 0), input_size - 1);
+      contribs.weights[idx] = static_cast<float>(weights[j] / sum);
+    }
+  }
+
+  return contribs;
+}
+
+// Sum two rows into 16-bit values.
+void SumRows(const uint8_t* row0, const uint8_t* row1, const int num_values,
+             uint16_t* sums) {
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= num_values; i += 16) {
+    const __m128i v0 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i));
+    const __m128i v1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i),
+                     _mm_add_epi16(_mm_unpacklo_epi8(v0, zero),
+                                   _mm_unpacklo_epi8(v1, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8),
+                     _mm_add_epi16(_mm_unpackhi_epi8(v0, zero),
+                                   _mm_unpackhi_epi8(v1, zero)));
+  }
+#endif
+  for (; i < num_values; ++i) {
+    sums[i] = static_cast<uint16_t>(row0[i] + row1[i]);
+  }
+}
+
+// Average horizontal pixel pairs of summed rows with rounding.
+void AverageColumns(const uint16_t* sums, const int width, const int channels,
+                    uint8_t* output) {
+  int x = 0;
+#ifdef __SSE2__
+  if (channels == 1) {
+    const __m128i mask = _mm_set1_epi32(0xFFFF);
+    const __m128i round = _mm_set1_epi32(2);
+    for (; x + 8 <= width; x += 8) {
+      const __m128i v0 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2 * x));
+      const __m128i v1 =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2 * x + 8));
+      const __m128i s0 = _mm_srli_epi32(
+          _mm_add_epi32(_mm_add_epi32(_mm_and_si128(v0, mask),
+                                      _mm_srli_epi32(v0, 16)),
+                        round),
+          2);
+      const __m128i s1 = _mm_srli_epi32(
+          _mm_add_epi32(_mm_add_epi32(_mm_and_si128(v1, mask),
+                                      _mm_srli_epi32(v1, 16)),
+                        round),
+          2);
+      const __m128i packed = _mm_packs_epi32(s0, s1);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(output + x),
+                       _mm_packus_epi16(packed, packed));
+    }
+  }
+#endif
+  for (; x < width; ++x) {
+    const uint16_t* pair = sums + 2 * x * channels;
+    for (int c = 0; c < channels; ++c) {
+      output[x * channels + c] =
+          static_cast<uint8_t>((pair[c] + pair[channels + c] + 2) >> 2);
+    }
+  }
+}
+
+// Downscale by two with a 2x2 box filter, dropping the last row or column of
+// images with odd dimensions.
+void HalveImage(const ImagePlane& input, const int num_threads,
+                HalvedLevel* output) {
+  const int width = input.width / 2;
+  const int height = input.height / 2;
+  const int channels = input.channels;
+  const size_t stride = static_cast<size_t>(width) * channels;
+
+  output->buffer = BufferPool::Global().Acquire(stride * height);
+  output->plane.data = output->buffer.Data();
+  output->plane.stride = static_cast<ptrdiff_t>(stride);
+  output->plane.width = width;
+  output->plane.height = height;
+  output->plane.channels = channels;
+
+  uint8_t* data = output->buffer.Data();
+  ParallelForRange(
+      0, height, num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        std::vector<uint16_t> sums(2 * stride);
+        for (size_t y = begin; y < end; ++y) {
+          const uint8_t* row0 =
+              input.data + static_cast<ptrdiff_t>(2 * y) * input.stride;
+          SumRows(row0, row0 + input.stride, static_cast<int>(2 * stride),
+                  sums.data());
+          AverageColumns(sums.data(), width, channels, data + y * stride);
+        }
+      });
+}
+
+// Separable Lanczos resampling of a level into the output image.
+void ResampleLevel(const ImagePlane& input, const int factor,
+                   const int source_width, const int source_height,
+                   const int num_threads, uint8_t* output,
+                   const ptrdiff_t output_stride, const int output_width,
+                   const int output_height) {
+  const int channels = input.channels;
+
+  // Levels of the requested size are copied, since the Lanczos kernel is the
+  // identity for integer shifts.
+  if (input.width == output_width && input.height == output_height &&
+      factor * output_width == source_width &&
+      factor * output_height == source_height) {
+    ParallelForRange(
+        0, output_height, num_threads, kMinRowsPerThread,
+        [&](const size_t begin, const size_t end) {
+          for (size_t y = begin; y < end; ++y) {
+            const ptrdiff_t yy = static_cast<ptrdiff_t>(y);
+            std::memcpy(output + yy * output_stride,
+                        input.data + yy * input.stride,
+                        output_width * channels);
+          }
+        });
+    return;
+  }
+
+  const Contributions contribs_x = ComputeContributions(
+      input.width, factor, source_width, output_width);
+  const Contributions contribs_y = ComputeContributions(
+      input.height, factor, source_height, output_height);
+
+  // Horizontal pass over all rows of the level into a float buffer.
+  const size_t row_size = static_cast<size_t>(output_width) * channels;
+  PooledBuffer buffer =
+      BufferPool::Global().Acquire(row_size * input.height * sizeof(float));
+  float* rows = buffer.DataAs<float>();
+  ParallelForRange(
+      0, input.height, num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+          const uint8_t* line =
+              input.data + static_cast<ptrdiff_t>(y) * input.stride;
+          float* row = rows + y * row_size;
+          for (int x = 0; x < output_width; ++x) {
+            const int* indices = &contribs_x.indices[x * contribs_x.num_taps];
+            const float* weights =
+                &contribs_x.weights[x * contribs_x.num_taps];
+            for (int c = 0; c < channels; ++c) {
+              float sum = 0.0f;
+              for (int j = 0; j < contribs_x.num_taps; ++j) {
+                sum += weights[j] * line[indices[j] * channels + c];
+              }
+              row[x * channels + c] = sum;
+            }
+          }
+        }
+      });
+
+  // Vertical pass, where the innermost loop runs over consecutive values.
+  ParallelForRange(
+      0, output_height, num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        std::vector<float> sums(row_size);
+        for (size_t y = begin; y < end; ++y) {
+          const int* indices = &contribs_y.indices[y * contribs_y.num_taps];
+          const float* weights = &contribs_y.weights[y * contribs_y.num_taps];
+          std::fill(sums.begin(), sums.end(), 0.0f);
+          for (int j = 0; j < contribs_y.num_taps; ++j) {
+            const float* row = rows + indices[j] * row_size;
+            const float weight = weights[j];
+            for (size_t i = 0; i < row_size; ++i) {
+              sums[i] += weight * row[i];
+            }
+          }
+          uint8_t* line = output + static_cast<ptrdiff_t>(y) * output_stride;
+          for (size_t i = 0; i < row_size; ++i) {
+            line[i] = static_cast<uint8_t>(
+                std::min(255.0f, std::max(0.0f, sums[i] + 0.5f)));
+          }
+        }
+      });
+}
+
+}  // namespace
+
+PyramidLevelSize FitLevelSize(const int width, const int height,
+                              const int max_size) {
+  if (width <= max_size && height <= max_size) {
+    return PyramidLevelSize(width, height);
+  }
+  const double scale =
+      static_cast<double>(max_size) / std::max(width, height);
+  return PyramidLevelSize(static_cast<int>(width * scale),
+                          static_cast<int>(height * scale));
+}
+
+bool BuildImagePyramid(const Bitmap& bitmap,
+                       const std::vector<PyramidLevelSize>& sizes,
+                       std::vector<Bitmap>* levels,
+                       const PyramidOptions& options) {
+  if (bitmap.IsHighBitDepth() || bitmap.Width() <= 0 ||
+      bitmap.Height() <= 0) {
+    return false;
+  }
+  for (const auto& size : sizes) {
+    if (size.width <= 0 || size.height <= 0) {
+      return false;
+    }
+  }
+
+  // The first level is a view of the bitmap itself, whose scanlines are
+  // stored bottom-up.
+  std::vector<HalvedLevel> cascade(1);
+  FIBITMAP* data = const_cast<FIBITMAP*>(bitmap.Data());
+  cascade[0].plane.data = FreeImage_GetScanLine(data, bitmap.Height() - 1);
+  cascade[0].plane.stride = -static_cast<ptrdiff_t>(bitmap.ScanWidth());
+  cascade[0].plane.width = bitmap.Width();
+  cascade[0].plane.height = bitmap.Height();
+  cascade[0].plane.channels = bitmap.Channels();
+
+  levels->clear();
+  levels->resize(sizes.size());
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    const PyramidLevelSize& size = sizes[i];
+
+    // Find the smallest halved image that is not smaller than the level, and
+    // extend the cascade as needed.
+    size_t level_idx = 0;
+    while (true) {
+      // Copied, since extending the cascade may move its elements.
+      const ImagePlane plane = cascade[level_idx].plane;
+      if (plane.width / 2 < size.width || plane.height / 2 < size.height) {
+        break;
+      }
+      if (level_idx + 1 == cascade.size()) {
+        cascade.emplace_back();
+        HalveImage(plane, options.num_threads, &cascade.back());
+        cascade.back().factor = 2 * cascade[level_idx].factor;
+      }
+      level_idx += 1;
+    }
+
+    Bitmap& level = (*levels)[i];
+    if (!level.Allocate(size.width, size.height, bitmap.IsRGB())) {
+      return false;
+    }
+    ResampleLevel(cascade[level_idx].plane, cascade[level_idx].factor,
+                  bitmap.Width(), bitmap.Height(), options.num_threads,
+                  FreeImage_GetScanLine(level.Data(), size.height - 1),
+                  -static_cast<ptrdiff_t>(level.ScanWidth()), size.width,
+                  size.height);
+  }
+
+  return true;
+}
+
+bool ResizeImage(const Bitmap& bitmap, const int width, const int height,
+                 Bitmap* resized, const PyramidOptions& options) {
+  std::vector<Bitmap> levels;
+  if (!BuildImagePyramid(bitmap, {PyramidLevelSize(width, height)}, &levels,
+                         options)) {
+    return false;
+  }
+  *resized = std::move(levels[0]);
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef COLMAP_SRC_UTIL_IMAGE_PYRAMID_H_
+#define COLMAP_SRC_UTIL_IMAGE_PYRAMID_H_
+
+#include <vector>
+
+#include "bitmap.h"
+
+struct PyramidOptions {
+  // Number of threads over which the rows of each level are split. If
+  // `num_threads <= 0`, all hardware threads are used.
+  int num_threads = -1;
+};
+
+struct PyramidLevelSize {
+  PyramidLevelSize() : width(0), height(0) {}
+  PyramidLevelSize(const int width, const int height)
+      : width(width), height(height) {}
+
+  int width;
+  int height;
+};
+
+// Size that fits into a `max_size x max_size` square with the aspect ratio of
+// the image, rounded down as in the feature extraction.
+PyramidLevelSize FitLevelSize(const int width, const int height,
+                              const int max_size);
+
+// Downscale an 8-bit image to all requested sizes in a single cascade. The
+// image is repeatedly halved with a 2x2 box filter for as long as the halved
+// image is at least as large as the next requested size, and each level is
+// then produced from the nearest halved image with a separable Lanczos3
+// filter. The halved images are reused between levels, so that the cost is
+// about that of one full-resolution pass, instead of one for every level.
+// Levels are returned in the order of `sizes` and may also upscale.
+bool BuildImagePyramid(const Bitmap& bitmap,
+                       const std::vector<PyramidLevelSize>& sizes,
+                       std::vector<Bitmap>* levels,
+                       const PyramidOptions& options = PyramidOptions());
+
+// Resize a single image with the same cascade.
+bool ResizeImage(const Bitmap& bitmap, const int width, const int height,
+                 Bitmap* resized,
+                 const PyramidOptions& options = PyramidOptions());
+
+#endif  // COLMAP_SRC_UTIL_IMAGE_PYRAMID_H_
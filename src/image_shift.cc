@@ -0,0 +1,391 @@
+#include "image_shift.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef WITH_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#include <jerror.h>
+#endif
+
+#include "misc.h"
+#include "threading.h"
+
+namespace {
+
+template <int kChannels>
+struct Pixel {
+  uint8_t values[kChannels];
+};
+
+int GreatestCommonDivisor(int a, int b) {
+  while (b != 0) {
+    const int r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// Rotate the row left by `offset` pixels with the cycle (juggling) algorithm,
+// which moves every pixel exactly once and needs a single pixel of temporary
+// storage. The row is split into `gcd(width, offset)` cycles, in which pixel
+// `j` receives pixel `j + offset` modulo `width`.
+template <int kChannels>
+void RotateRow(uint8_t* data, const int width, const int offset) {
+  typedef Pixel<kChannels> PixelType;
+  PixelType* row = reinterpret_cast<PixelType*>(data);
+  const int num_cycles = GreatestCommonDivisor(width, offset);
+  for (int start = 0; start < num_cycles; ++start) {
+    const PixelType first = row[start];
+    int j = start;
+    while (true) {
+      int k = j + offset;
+      if (k >= width) {
+        k -= width;
+      }
+      if (k == start) {
+        break;
+      }
+      row[j] = row[k];
+      j = k;
+    }
+    row[j] = first;
+  }
+}
+
+template <int kChannels>
+void ShiftRows(uint8_t* data, const ptrdiff_t stride, const int width,
+               const int height, const int offset, const int num_threads) {
+  ParallelForRange(0, height, num_threads, 16,
+                   [&](const size_t begin, const size_t end) {
+                     for (size_t y = begin; y < end; ++y) {
+                       RotateRow<kChannels>(
+                           data + static_cast<ptrdiff_t>(y) * stride, width,
+                           offset);
+                     }
+                   });
+}
+
+#ifdef WITH_LIBJPEG
+
+struct JpegErrorManager {
+  jpeg_error_mgr manager;
+  jmp_buf jump_buffer;
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump_buffer, 1);
+}
+
+void JpegOutputMessage(j_common_ptr) {}
+
+// A premature end of the data is only a warning in libjpeg, but the shifted
+// image of a truncated file must not be reported as a success.
+void JpegEmitMessage(j_common_ptr cinfo, int msg_level) {
+  if (msg_level < 0 && cinfo->err->msg_code == JWRN_JPEG_EOF) {
+    JpegErrorExit(cinfo);
+  }
+}
+
+// Rotates the DCT coefficient blocks of a JPEG image. The coefficients of the
+// whole image are held in memory, which is still far less than the pixels.
+// Functions calling into libjpeg must not hold objects with destructors,
+// since errors return through longjmp.
+class JpegCoefficientShifter {
+ public:
+  ~JpegCoefficientShifter() {
+    if (dst_created_) {
+      jpeg_destroy_compress(&dst_);
+    }
+    if (src_created_) {
+      jpeg_destroy_decompress(&src_);
+    }
+    if (dst_file_ != nullptr) {
+      fclose(dst_file_);
+    }
+    if (src_file_ != nullptr) {
+      fclose(src_file_);
+    }
+  }
+
+  bool Shift(const std::string& input_path, const std::string& output_path,
+             const double shift, const ShiftMode mode,
+             const bool round_offset) {
+    src_file_ = fopen(input_path.c_str(), "rb");
+    if (src_file_ == nullptr || !ReadHeader()) {
+      return false;
+    }
+
+    const int width = static_cast<int>(src_.image_width);
+    if (width % mcu_width_ != 0) {
+      return false;
+    }
+    int offset = ComputeShiftOffset(width, shift, mode);
+    if (offset % mcu_width_ != 0) {
+      if (!round_offset) {
+        return false;
+      }
+      offset = (offset + mcu_width_ / 2) / mcu_width_ * mcu_width_ % width;
+    }
+
+    if (!RotateBlocks(offset / mcu_width_)) {
+      return false;
+    }
+
+    dst_file_ = fopen(output_path.c_str(), "wb");
+    if (dst_file_ == nullptr || !WriteCoefficients()) {
+      return false;
+    }
+
+    const bool success = ferror(dst_file_) == 0 && fclose(dst_file_) == 0;
+    dst_file_ = nullptr;
+    return success;
+  }
+
+ private:
+  bool ReadHeader() {
+    src_.err = jpeg_std_error(&error_.manager);
+    error_.manager.error_exit = &JpegErrorExit;
+    error_.manager.output_message = &JpegOutputMessage;
+    error_.manager.emit_message = &JpegEmitMessage;
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+
+    jpeg_create_decompress(&src_);
+    src_created_ = true;
+    jpeg_stdio_src(&src_, src_file_);
+    // Keep metadata, e.g. the XMP panorama description.
+    jpeg_save_markers(&src_, JPEG_COM, 0xFFFF);
+    for (int i = 0; i < 16; ++i) {
+      jpeg_save_markers(&src_, JPEG_APP0 + i, 0xFFFF);
+    }
+    if (jpeg_read_header(&src_, TRUE) != JPEG_HEADER_OK) {
+      return false;
+    }
+
+    // The MCU contains `max_h_samp_factor` blocks of each full-resolution
+    // component in horizontal direction.
+#if JPEG_LIB_VERSION >= 80
+    mcu_width_ = src_.max_h_samp_factor * src_.block_size;
+#else
+    mcu_width_ = src_.max_h_samp_factor * DCTSIZE;
+#endif
+    return true;
+  }
+
+  bool RotateBlocks(const int num_mcus) {
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+
+    coefficients_ = jpeg_read_coefficients(&src_);
+    for (int c = 0; c < src_.num_components; ++c) {
+      const jpeg_component_info& component = src_.comp_info[c];
+      const int num_blocks = static_cast<int>(component.width_in_blocks);
+      const int offset = num_mcus * component.h_samp_factor;
+      if (offset == 0) {
+        continue;
+      }
+      // Padding rows at the bottom are rotated along, as they are encoded.
+      const int num_rows =
+          (component.height_in_blocks + component.v_samp_factor - 1) /
+          component.v_samp_factor * component.v_samp_factor;
+      blocks_.resize(static_cast<size_t>(num_blocks) * DCTSIZE2);
+      for (int y = 0; y < num_rows; ++y) {
+        JBLOCKARRAY rows = (*src_.mem->access_virt_barray)(
+            reinterpret_cast<j_common_ptr>(&src_), coefficients_[c], y, 1,
+            TRUE);
+        std::memcpy(blocks_.data(), rows[0] + offset,
+                    (num_blocks - offset) * sizeof(JBLOCK));
+        std::memcpy(blocks_.data() + (num_blocks - offset) * DCTSIZE2,
+                    rows[0], offset * sizeof(JBLOCK));
+        std::memcpy(rows[0], blocks_.data(), num_blocks * sizeof(JBLOCK));
+      }
+    }
+    return true;
+  }
+
+  bool WriteCoefficients() {
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+
+    dst_.err = &error_.manager;
+    jpeg_create_compress(&dst_);
+    dst_created_ = true;
+    jpeg_copy_critical_parameters(&src_, &dst_);
+    if (src_.progressive_mode) {
+      jpeg_simple_progression(&dst_);
+    }
+    jpeg_stdio_dest(&dst_, dst_file_);
+    jpeg_write_coefficients(&dst_, coefficients_);
+
+    for (jpeg_saved_marker_ptr marker = src_.marker_list; marker != nullptr;
+         marker = marker->next) {
+      // The JFIF and Adobe markers are already written by libjpeg.
+      if (dst_.write_JFIF_header && marker->marker == JPEG_APP0 &&
+          marker->data_length >= 5 &&
+          std::memcmp(marker->data, "JFIF", 5) == 0) {
+        continue;
+      }
+      if (dst_.write_Adobe_marker && marker->marker == JPEG_APP0 + 14 &&
+          marker->data_length >= 5 &&
+          std::memcmp(marker->data, "Adobe", 5) == 0) {
+        continue;
+      }
+      jpeg_write_marker(&dst_, marker->marker, marker->data,
+                        marker->data_length);
+    }
+
+    jpeg_finish_compress(&dst_);
+    jpeg_finish_decompress(&src_);
+    return true;
+  }
+
+  FILE* src_file_ = nullptr;
+  FILE* dst_file_ = nullptr;
+  bool src_created_ = false;
+  bool dst_created_ = false;
+  jpeg_decompress_struct src_;
+  jpeg_compress_struct dst_;
+  JpegErrorManager error_;
+  jvirt_barray_ptr* coefficients_ = nullptr;
+  int mcu_width_ = 0;
+  std::vector<JCOEF> blocks_;
+};
+
+#endif  // WITH_LIBJPEG
+
+bool IsJpegPath(const std::string& path) {
+  return HasFileExtension(path, ".jpg") || HasFileExtension(path, ".jpeg");
+}
+
+}  // namespace
+
+ShiftMode GuessShiftMode(const double shift) {
+  if (shift > 1) {
+    return ShiftMode::CENTER_PIXEL;
+  } else if (shift < -1) {
+    return ShiftMode::LEFT_PIXEL;
+  } else {
+    return ShiftMode::FRACTION;
+  }
+}
+
+int ComputeShiftOffset(const int width, const double shift,
+                       const ShiftMode mode) {
+  if (width <= 0) {
+    return 0;
+  }
+
+  double offset = 0;
+  switch (mode) {
+    case ShiftMode::FRACTION:
+      offset = shift * width;
+      break;
+    case ShiftMode::CENTER_PIXEL:
+      offset = shift + 0.5 * width;
+      break;
+    case ShiftMode::LEFT_PIXEL:
+      offset = shift;
+      break;
+  }
+
+  const int64_t column = static_cast<int64_t>(std::floor(offset)) % width;
+  return static_cast<int>(column < 0 ? column + width : column);
+}
+
+void ShiftImageRows(uint8_t* data, const ptrdiff_t stride, const int width,
+                    const int height, const int channels, const int offset,
+                    const int num_threads) {
+  if (width <= 0 || height <= 0 || offset <= 0 || offset >= width) {
+    return;
+  }
+
+  switch (channels) {
+    case 1:
+      ShiftRows<1>(data, stride, width, height, offset, num_threads);
+      break;
+    case 2:
+      ShiftRows<2>(data, stride, width, height, offset, num_threads);
+      break;
+    case 3:
+      ShiftRows<3>(data, stride, width, height, offset, num_threads);
+      break;
+    case 4:
+      ShiftRows<4>(data, stride, width, height, offset, num_threads);
+      break;
+  }
+}
+
+bool ShiftBitmap(const int offset, Bitmap* bitmap, const int num_threads) {
+  if (bitmap->IsHighBitDepth()) {
+    return false;
+  }
+
+  // Rows are shifted independently, so their order in memory is irrelevant.
+  const int channels = bitmap->BitsPerPixel() / 8;
+  ShiftImageRows(FreeImage_GetScanLine(bitmap->Data(), 0),
+                 bitmap->ScanWidth(), bitmap->Width(), bitmap->Height(),
+                 channels, ComputeShiftOffset(bitmap->Width(), offset,
+                                              ShiftMode::LEFT_PIXEL),
+                 num_threads);
+  return true;
+}
+
+bool ShiftJpegLossless(const std::string& input_path,
+                       const std::string& output_path, const double shift,
+                       const ShiftMode mode, const bool round_offset) {
+#ifdef WITH_LIBJPEG
+  JpegCoefficientShifter shifter;
+  return shifter.Shift(input_path, output_path, shift, mode, round_offset);
+#else
+  return false;
+#endif
+}
+
+bool ShiftImageFile(const std::string& input_path,
+                    const std::string& output_path, const double shift,
+                    const ShiftMode mode, const ImageShiftOptions& options) {
+  if (options.lossless_jpeg && IsJpegPath(output_path) &&
+      ShiftJpegLossless(input_path, output_path, shift, mode,
+                        options.round_jpeg_offset)) {
+    return true;
+  }
+
+  StripReader reader;
+  if (!reader.Open(input_path, options.reader_options)) {
+    return false;
+  }
+
+  StripWriter writer;
+  if (!writer.Open(output_path, reader.Width(), reader.Height(),
+                   reader.Channels(), options.writer_options)) {
+    return false;
+  }
+
+  const int offset = ComputeShiftOffset(reader.Width(), shift, mode);
+  const ptrdiff_t stride =
+      static_cast<ptrdiff_t>(reader.Width()) * reader.Channels();
+
+  ImageStrip strip;
+  while (reader.Next(&strip)) {
+    ShiftImageRows(strip.data.data(), stride, strip.width, strip.height,
+                   strip.channels, offset, options.num_threads);
+    if (!writer.Write(strip)) {
+      writer.Abort();
+      return false;
+    }
+  }
+
+  if (reader.Failed() || reader.NextRow() != reader.Height()) {
+    writer.Abort();
+    return false;
+  }
+  return writer.Close();
+}
@@ -0,0 +1,85 @@
+#ifndef COLMAP_SRC_UTIL_IMAGE_SHIFT_H_
+#define COLMAP_SRC_UTIL_IMAGE_SHIFT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "bitmap.h"
+#include "strip_reader.h"
+#include "strip_writer.h"
+
+// Interpretation of the shift value of a horizontal wrap-around shift, e.g.
+// to re-center an equirectangular panorama.
+enum class ShiftMode {
+  // Fraction of the width in the range [0, 1], by which the image is shifted
+  // to the left.
+  FRACTION,
+  // Column that is moved to the center of the image.
+  CENTER_PIXEL,
+  // Column that is moved to the left border of the image.
+  LEFT_PIXEL,
+};
+
+struct ImageShiftOptions {
+  // Options of the reader and writer of `ShiftImageFile`. Only the strips of
+  // the reader are kept in memory.
+  StripReaderOptions reader_options;
+  StripWriterOptions writer_options;
+
+  // The number of threads to shift rows in parallel.
+  int num_threads = -1;
+
+  // Shift JPEG images losslessly by moving their DCT coefficient blocks if
+  // the output is a JPEG image and the offset is a multiple of the MCU width,
+  // i.e. 8 or 16 pixels. Otherwise, the image is decoded and re-encoded.
+  bool lossless_jpeg = true;
+
+  // Round the offset to the nearest multiple of the MCU width, so that JPEG
+  // images are always shifted losslessly, if their width is a multiple of
+  // the MCU width as well.
+  bool round_jpeg_offset = false;
+};
+
+// Guess the mode from the command-line convention of the ImageShift tool,
+// where values in [-1, 1] are fractions, values larger than 1 are center
+// pixels and values smaller than -1 are negated left pixels.
+ShiftMode GuessShiftMode(const double shift);
+
+// Compute the column in the range [0, width) that is moved to the left
+// border, i.e. the number of columns by which the image is rotated left.
+int ComputeShiftOffset(const int width, const double shift,
+                       const ShiftMode mode);
+
+// Rotate the rows of an interleaved 8-bit image in place by `offset` columns
+// to the left, so that column `offset` becomes column 0. Rows are separated
+// by `stride` bytes and processed in parallel.
+void ShiftImageRows(uint8_t* data, const ptrdiff_t stride, const int width,
+                    const int height, const int channels, const int offset,
+                    const int num_threads = -1);
+
+// Shift the bitmap in place without allocating a second image. Only 8-bit
+// images are supported.
+bool ShiftBitmap(const int offset, Bitmap* bitmap,
+                 const int num_threads = -1);
+
+// Shift a JPEG image without decoding and re-encoding it, by rotating the rows
+// of DCT coefficient blocks of every component. This requires libjpeg at
+// build time and the image width to be a multiple of the MCU width. The
+// offset must be a multiple as well, or it is rounded to the nearest one if
+// `round_offset` is true. Returns false without creating the output if the
+// image cannot be shifted losslessly.
+bool ShiftJpegLossless(const std::string& input_path,
+                       const std::string& output_path, const double shift,
+                       const ShiftMode mode, const bool round_offset = false);
+
+// Shift an image file and write the result while streaming strips from the
+// reader to the writer, so that memory is bounded by the strip size for
+// formats that `StripReader` and `StripWriter` stream. JPEG images are first
+// tried to be shifted losslessly, see `ImageShiftOptions::lossless_jpeg`.
+bool ShiftImageFile(const std::string& input_path,
+                    const std::string& output_path, const double shift,
+                    const ShiftMode mode,
+                    const ImageShiftOptions& options = ImageShiftOptions());
+
+#endif  // COLMAP_SRC_UTIL_IMAGE_SHIFT_H_
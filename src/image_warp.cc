@@ -0,0 +1,372 @@
+#include "image_warp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "threading.h"
+
+namespace {
+
+// Number of output pixels whose source positions are generated and quantized
+// at once.
+const int kSpanSize = 256;
+
+// Source positions are quantized to 1/2^kNumFracBits pixel.
+const int kNumFracBits = 8;
+const int kFracScale = 1 << kNumFracBits;
+
+// Positions are clamped to this range before quantization to avoid integer
+// overflow. Non-finite positions end up outside the source image.
+const float kMaxCoord = static_cast<float>(1 << 22);
+
+const size_t kMinRowsPerThread = 8;
+
+struct SourceImage {
+  const uint8_t* data;
+  ptrdiff_t stride;
+  int width;
+  int height;
+  int channels;
+  BorderMode border_mode;
+  // Border color in memory order of the channels.
+  uint8_t border[4];
+};
+
+typedef std::function<void(const int x, const int y, const int num_pixels,
+                           float* xs, float* ys)>
+    CoordFunc;
+
+inline float ClampCoord(const float coord) {
+  // Written such that NaN is mapped to the lower bound, as in SSE.
+  const float lower = coord > -kMaxCoord ? coord : -kMaxCoord;
+  return lower < kMaxCoord ? lower : kMaxCoord;
+}
+
+void QuantizeCoords(const float* coords, const int num_coords,
+                    int32_t* integer, uint8_t* fraction) {
+  int i = 0;
+#ifdef __SSE2__
+  const __m128 scale = _mm_set1_ps(static_cast<float>(kFracScale));
+  const __m128 lower = _mm_set1_ps(-kMaxCoord);
+  const __m128 upper = _mm_set1_ps(kMaxCoord);
+  const __m128i mask = _mm_set1_epi32(kFracScale - 1);
+  for (; i + 4 <= num_coords; i += 4) {
+    const __m128 coord =
+        _mm_min_ps(_mm_max_ps(_mm_loadu_ps(coords + i), lower), upper);
+    const __m128i quantized = _mm_cvtps_epi32(_mm_mul_ps(coord, scale));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(integer + i),
+                     _mm_srai_epi32(quantized, kNumFracBits));
+    __m128i frac = _mm_and_si128(quantized, mask);
+    frac = _mm_packs_epi32(frac, frac);
+    frac = _mm_packus_epi16(frac, frac);
+    const int32_t packed = _mm_cvtsi128_si32(frac);
+    std::memcpy(fraction + i, &packed, sizeof(packed));
+  }
+#endif
+  for (; i < num_coords; ++i) {
+    const int32_t quantized = static_cast<int32_t>(
+        std::lrint(ClampCoord(coords[i]) * static_cast<float>(kFracScale)));
+    integer[i] = quantized >> kNumFracBits;
+    fraction[i] = static_cast<uint8_t>(quantized & (kFracScale - 1));
+  }
+}
+
+inline int WrapIndex(const int index, const int size) {
+  const int wrapped = index % size;
+  return wrapped < 0 ? wrapped + size : wrapped;
+}
+
+// Pointer to the pixel at (x, y) with the border mode applied.
+inline const uint8_t* GetBorderPixel(const SourceImage& src, int x, int y) {
+  switch (src.border_mode) {
+    case BorderMode::CONSTANT:
+      if (x < 0 || y < 0 || x >= src.width || y >= src.height) {
+        return src.border;
+      }
+      break;
+    case BorderMode::REPLICATE:
+      x = std::min(std::max(x, 0), src.width - 1);
+      y = std::min(std::max(y, 0), src.height - 1);
+      break;
+    case BorderMode::WRAP:
+      x = WrapIndex(x, src.width);
+      y = WrapIndex(y, src.height);
+      break;
+  }
+  return src.data + y * src.stride + x * src.channels;
+}
+
+template <int kChannels>
+void SampleSpan(const SourceImage& src, const int32_t* xs, const int32_t* ys,
+                const uint8_t* dxs, const uint8_t* dys, const int num_pixels,
+                uint8_t* dst) {
+  const int max_x = src.width - 2;
+  const int max_y = src.height - 2;
+  const int kRound = 1 << (2 * kNumFracBits - 1);
+  for (int i = 0; i < num_pixels; ++i) {
+    const int x = xs[i];
+    const int y = ys[i];
+    const uint8_t* p00;
+    const uint8_t* p01;
+    const uint8_t* p10;
+    const uint8_t* p11;
+    if (x >= 0 && y >= 0 && x <= max_x && y <= max_y) {
+      p00 = src.data + y * src.stride + x * kChannels;
+      p01 = p00 + kChannels;
+      p10 = p00 + src.stride;
+      p11 = p10 + kChannels;
+    } else {
+      p00 = GetBorderPixel(src, x, y);
+      p01 = GetBorderPixel(src, x + 1, y);
+      p10 = GetBorderPixel(src, x, y + 1);
+      p11 = GetBorderPixel(src, x + 1, y + 1);
+    }
+
+    const int dx = dxs[i];
+    const int dy = dys[i];
+    for (int c = 0; c < kChannels; ++c) {
+      const int top = (p00[c] << kNumFracBits) + (p01[c] - p00[c]) * dx;
+      const int bottom = (p10[c] << kNumFracBits) + (p11[c] - p10[c]) * dx;
+      dst[c] = static_cast<uint8_t>(
+          ((top << kNumFracBits) + (bottom - top) * dy + kRound) >>
+          (2 * kNumFracBits));
+    }
+    dst += kChannels;
+  }
+}
+
+typedef void (*SampleFunc)(const SourceImage&, const int32_t*, const int32_t*,
+                           const uint8_t*, const uint8_t*, const int,
+                           uint8_t*);
+
+SampleFunc GetSampleFunc(const int channels) {
+  switch (channels) {
+    case 1:
+      return &SampleSpan<1>;
+    case 2:
+      return &SampleSpan<2>;
+    case 3:
+      return &SampleSpan<3>;
+    case 4:
+      return &SampleSpan<4>;
+    default:
+      return nullptr;
+  }
+}
+
+void WarpRows(const SourceImage& src, const int width, const int height,
+              uint8_t* dst, const ptrdiff_t dst_stride, const int num_threads,
+              const CoordFunc& coord_func) {
+  const SampleFunc sample_func = GetSampleFunc(src.channels);
+  if (sample_func == nullptr) {
+    return;
+  }
+
+  ParallelForRange(
+      0, height, num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        float xs[kSpanSize];
+        float ys[kSpanSize];
+        int32_t ixs[kSpanSize];
+        int32_t iys[kSpanSize];
+        uint8_t dxs[kSpanSize];
+        uint8_t dys[kSpanSize];
+        for (size_t y = begin; y < end; ++y) {
+          uint8_t* dst_line = dst + static_cast<ptrdiff_t>(y) * dst_stride;
+          for (int x = 0; x < width; x += kSpanSize) {
+            const int num_pixels = std::min(kSpanSize, width - x);
+            coord_func(x, static_cast<int>(y), num_pixels, xs, ys);
+            QuantizeCoords(xs, num_pixels, ixs, dxs);
+            QuantizeCoords(ys, num_pixels, iys, dys);
+            sample_func(src, ixs, iys, dxs, dys, num_pixels,
+                        dst_line + x * src.channels);
+          }
+        }
+      });
+}
+
+void RemapRows(const SourceImage& src, const RemapTable& table, uint8_t* dst,
+               const ptrdiff_t dst_stride, const int num_threads) {
+  const SampleFunc sample_func = GetSampleFunc(src.channels);
+  if (sample_func == nullptr) {
+    return;
+  }
+
+  ParallelForRange(
+      0, table.height, num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+          const size_t offset = y * table.width;
+          sample_func(src, table.x.data() + offset, table.y.data() + offset,
+                      table.dx.data() + offset, table.dy.data() + offset,
+                      table.width,
+                      dst + static_cast<ptrdiff_t>(y) * dst_stride);
+        }
+      });
+}
+
+// Set up the source description and allocate the output bitmap.
+bool PrepareWarp(const Bitmap& src, const int width, const int height,
+                 const WarpOptions& options, Bitmap* dst,
+                 SourceImage* source) {
+  if (src.IsHighBitDepth() || src.Width() <= 0 || src.Height() <= 0 ||
+      width <= 0 || height <= 0 || dst == &src) {
+    return false;
+  }
+  if (!dst->Allocate(width, height, src.IsRGB())) {
+    return false;
+  }
+
+  FIBITMAP* data = const_cast<FIBITMAP*>(src.Data());
+  source->data = FreeImage_GetScanLine(data, src.Height() - 1);
+  source->stride = -static_cast<ptrdiff_t>(src.ScanWidth());
+  source->width = src.Width();
+  source->height = src.Height();
+  source->channels = src.Channels();
+  source->border_mode = options.border_mode;
+  if (src.IsRGB()) {
+    source->border[FI_RGBA_RED] = options.border_color.r;
+    source->border[FI_RGBA_GREEN] = options.border_color.g;
+    source->border[FI_RGBA_BLUE] = options.border_color.b;
+  } else {
+    source->border[0] = options.border_color.r;
+  }
+  return true;
+}
+
+uint8_t* GetTopLine(Bitmap* bitmap) {
+  return FreeImage_GetScanLine(bitmap->Data(), bitmap->Height() - 1);
+}
+
+}  // namespace
+
+void BuildRemapTable(const float* map_x, const float* map_y, const int width,
+                     const int height, RemapTable* table) {
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  table->width = width;
+  table->height = height;
+  table->x.resize(num_pixels);
+  table->y.resize(num_pixels);
+  table->dx.resize(num_pixels);
+  table->dy.resize(num_pixels);
+  QuantizeCoords(map_x, static_cast<int>(num_pixels), table->x.data(),
+                 table->dx.data());
+  QuantizeCoords(map_y, static_cast<int>(num_pixels), table->y.data(),
+                 table->dy.data());
+}
+
+void RemapImage(const uint8_t* src, const ptrdiff_t src_stride,
+                const int src_width, const int src_height, const int channels,
+                const RemapTable& table, uint8_t* dst,
+                const ptrdiff_t dst_stride, const WarpOptions& options) {
+  if (src_width <= 0 || src_height <= 0 || table.IsEmpty()) {
+    return;
+  }
+
+  SourceImage source;
+  source.data = src;
+  source.stride = src_stride;
+  source.width = src_width;
+  source.height = src_height;
+  source.channels = channels;
+  source.border_mode = options.border_mode;
+  source.border[0] = options.border_color.r;
+  source.border[1] = options.border_color.g;
+  source.border[2] = options.border_color.b;
+  source.border[3] = 0;
+
+  RemapRows(source, table, dst, dst_stride, options.num_threads);
+}
+
+bool Remap(const Bitmap& src, const std::vector<float>& map_x,
+           const std::vector<float>& map_y, const int width, const int height,
+           Bitmap* dst, const WarpOptions& options) {
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  if (map_x.size() != num_pixels || map_y.size() != num_pixels) {
+    return false;
+  }
+
+  SourceImage source;
+  if (!PrepareWarp(src, width, height, options, dst, &source)) {
+    return false;
+  }
+
+  WarpRows(source, width, height, GetTopLine(dst),
+           -static_cast<ptrdiff_t>(dst->ScanWidth()), options.num_threads,
+           [&](const int x, const int y, const int num_pixels, float* xs,
+               float* ys) {
+             const size_t offset = static_cast<size_t>(y) * width + x;
+             std::copy(map_x.begin() + offset,
+                       map_x.begin() + offset + num_pixels, xs);
+             std::copy(map_y.begin() + offset,
+                       map_y.begin() + offset + num_pixels, ys);
+           });
+  return true;
+}
+
+bool Remap(const Bitmap& src, const RemapTable& table, Bitmap* dst,
+           const WarpOptions& options) {
+  SourceImage source;
+  if (!PrepareWarp(src, table.width, table.height, options, dst, &source)) {
+    return false;
+  }
+
+  RemapRows(source, table, GetTopLine(dst),
+            -static_cast<ptrdiff_t>(dst->ScanWidth()), options.num_threads);
+  return true;
+}
+
+bool WarpAffine(const Bitmap& src, const Eigen::Matrix<double, 2, 3>& matrix,
+                const int width, const int height, Bitmap* dst,
+                const WarpOptions& options) {
+  SourceImage source;
+  if (!PrepareWarp(src, width, height, options, dst, &source)) {
+    return false;
+  }
+
+  WarpRows(source, width, height, GetTopLine(dst),
+           -static_cast<ptrdiff_t>(dst->ScanWidth()), options.num_threads,
+           [&](const int x, const int y, const int num_pixels, float* xs,
+               float* ys) {
+             const double x0 =
+                 matrix(0, 0) * x + matrix(0, 1) * y + matrix(0, 2);
+             const double y0 =
+                 matrix(1, 0) * x + matrix(1, 1) * y + matrix(1, 2);
+             for (int i = 0; i < num_pixels; ++i) {
+               xs[i] = static_cast<float>(x0 + i * matrix(0, 0));
+               ys[i] = static_cast<float>(y0 + i * matrix(1, 0));
+             }
+           });
+  return true;
+}
+
+bool WarpPerspective(const Bitmap& src, const Eigen::Matrix3d& matrix,
+                     const int width, const int height, Bitmap* dst,
+                     const WarpOptions& options) {
+  SourceImage source;
+  if (!PrepareWarp(src, width, height, options, dst, &source)) {
+    return false;
+  }
+
+  WarpRows(source, width, height, GetTopLine(dst),
+           -static_cast<ptrdiff_t>(dst->ScanWidth()), options.num_threads,
+           [&](const int x, const int y, const int num_pixels, float* xs,
+               float* ys) {
+             const Eigen::Vector3d start = matrix * Eigen::Vector3d(x, y, 1);
+             const Eigen::Vector3d step = matrix.col(0);
+             for (int i = 0; i < num_pixels; ++i) {
+               const Eigen::Vector3d point = start + i * step;
+               // Points at infinity yield non-finite positions, which are
+               // treated as outside the source image.
+               xs[i] = static_cast<float>(point(0) / point(2));
+               ys[i] = static_cast<float>(point(1) / point(2));
+             }
+           });
+  return true;
+}
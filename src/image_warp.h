@@ -0,0 +1,91 @@
+#ifndef COLMAP_SRC_UTIL_IMAGE_WARP_H_
+#define COLMAP_SRC_UTIL_IMAGE_WARP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "bitmap.h"
+
+// Bilinear resampling of 8-bit images. Coordinates follow the convention of
+// `Bitmap::InterpolateBilinear`: the origin is in the upper left, and integer
+// coordinates are pixel centers. Output pixels are generated in spans whose
+// source positions are quantized to 1/256 pixel and blended with fixed-point
+// weights, and the output rows are distributed over multiple threads.
+
+enum class BorderMode {
+  // Samples outside the source image take the border color.
+  CONSTANT,
+  // Samples outside the source image take the nearest edge pixel.
+  REPLICATE,
+  // The source image repeats periodically, e.g., for 360 degree panoramas.
+  WRAP,
+};
+
+struct WarpOptions {
+  BorderMode border_mode = BorderMode::CONSTANT;
+
+  // Color of samples outside the source image for `BorderMode::CONSTANT`.
+  BitmapColor<uint8_t> border_color;
+
+  // Number of threads over which the output rows are split. If
+  // `num_threads <= 0`, all hardware threads are used.
+  int num_threads = -1;
+};
+
+// Source positions of a remapping in quantized form, so that repeated
+// remappings with the same maps, e.g., when undistorting a sequence of images
+// from the same camera, skip the conversion of the float maps.
+struct RemapTable {
+  // Size of the output image.
+  int width = 0;
+  int height = 0;
+
+  // Integer source position of the upper left neighbor of each output pixel
+  // in row-major order.
+  std::vector<int32_t> x;
+  std::vector<int32_t> y;
+
+  // Sub-pixel offsets of the source positions in units of 1/256 pixel.
+  std::vector<uint8_t> dx;
+  std::vector<uint8_t> dy;
+
+  inline bool IsEmpty() const { return x.empty(); }
+};
+
+// Build a remap table from per-pixel source positions in row-major order.
+void BuildRemapTable(const float* map_x, const float* map_y, const int width,
+                     const int height, RemapTable* table);
+
+// Resample a raw interleaved image with `channels <= 4` values per pixel. The
+// images are given by a pointer to their top row and the signed byte offset
+// between consecutive rows. The output has the size of the table.
+void RemapImage(const uint8_t* src, const ptrdiff_t src_stride,
+                const int src_width, const int src_height, const int channels,
+                const RemapTable& table, uint8_t* dst,
+                const ptrdiff_t dst_stride,
+                const WarpOptions& options = WarpOptions());
+
+// Set each output pixel (x, y) to the source color at
+// (map_x[y * width + x], map_y[y * width + x]). The output has the same
+// number of channels as the source. Returns false for high bit depth images
+// or maps of the wrong size.
+bool Remap(const Bitmap& src, const std::vector<float>& map_x,
+           const std::vector<float>& map_y, const int width, const int height,
+           Bitmap* dst, const WarpOptions& options = WarpOptions());
+bool Remap(const Bitmap& src, const RemapTable& table, Bitmap* dst,
+           const WarpOptions& options = WarpOptions());
+
+// Warp the source image with a transformation that maps output pixel
+// coordinates to source pixel coordinates, i.e., the inverse of the
+// transformation from the source to the output image.
+bool WarpAffine(const Bitmap& src, const Eigen::Matrix<double, 2, 3>& matrix,
+                const int width, const int height, Bitmap* dst,
+                const WarpOptions& options = WarpOptions());
+bool WarpPerspective(const Bitmap& src, const Eigen::Matrix3d& matrix,
+                     const int width, const int height, Bitmap* dst,
+                     const WarpOptions& options = WarpOptions());
+
+#endif  // COLMAP_SRC_UTIL_IMAGE_WARP_H_
@@ -0,0 +1,337 @@
+#include "mapped_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "VLFeat/pgm.h"
+
+namespace {
+
+bool IsBlank(const uint8_t c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Parse the header of a binary PPM file, which follows the same grammar as
+// the PGM header parsed by `vl_pgm_extract_head`.
+bool ParsePpmHeader(const uint8_t* data, const size_t size, int* width,
+                    int* height, int* max_value, size_t* data_offset) {
+  if (size < 2 || data[0] != 'P' || data[1] != '6') {
+    return false;
+  }
+
+  size_t pos = 2;
+  int* values[3] = {width, height, max_value};
+  for (int i = 0; i < 3; ++i) {
+    // Skip blanks and comments, of which at least one is required.
+    const size_t begin = pos;
+    while (pos < size && (IsBlank(data[pos]) || data[pos] == '#')) {
+      if (data[pos] == '#') {
+        while (pos < size && data[pos] != '\n') {
+          pos += 1;
+        }
+      } else {
+        pos += 1;
+      }
+    }
+    if (pos == begin || pos >= size || data[pos] < '0' || data[pos] > '9') {
+      return false;
+    }
+    *values[i] = 0;
+    while (pos < size && data[pos] >= '0' && data[pos] <= '9') {
+      if (*values[i] > 100000000) {
+        return false;
+      }
+      *values[i] = 10 * *values[i] + (data[pos] - '0');
+      pos += 1;
+    }
+  }
+
+  // The header ends with a single blank.
+  if (pos >= size || !IsBlank(data[pos])) {
+    return false;
+  }
+  *data_offset = pos + 1;
+  return true;
+}
+
+uint8_t ScaleValue(const int value, const int max_value) {
+  return static_cast<uint8_t>(
+      (std::min(value, max_value) * 255 + max_value / 2) / max_value);
+}
+
+}  // namespace
+
+MappedFile::MappedFile()
+    : data_(nullptr),
+      size_(0)
+#ifdef _WIN32
+      ,
+      file_handle_(nullptr),
+      mapping_handle_(nullptr)
+#endif
+{
+}
+
+MappedFile::MappedFile(MappedFile&& other) : MappedFile() {
+  *this = std::move(other);
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+  if (this != &other) {
+    Close();
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+#ifdef _WIN32
+    std::swap(file_handle_, other.file_handle_);
+    std::swap(mapping_handle_, other.mapping_handle_);
+#endif
+  }
+  return *this;
+}
+
+bool MappedFile::Open(const std::string& path) {
+  Close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    CloseHandle(file);
+    return false;
+  }
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == nullptr) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  file_handle_ = file;
+  mapping_handle_ = mapping;
+  data_ = static_cast<uint8_t*>(data);
+  size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  const size_t size = static_cast<size_t>(file_stat.st_size);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after closing the descriptor.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(data);
+  size_ = size;
+#endif
+
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ == nullptr) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(data_);
+  CloseHandle(static_cast<HANDLE>(mapping_handle_));
+  CloseHandle(static_cast<HANDLE>(file_handle_));
+  file_handle_ = nullptr;
+  mapping_handle_ = nullptr;
+#else
+  munmap(data_, size_);
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+void MappedFile::Prefetch(const size_t offset, const size_t num_bytes) const {
+#ifndef _WIN32
+  if (data_ == nullptr || offset >= size_) {
+    return;
+  }
+  // The advised range must start at a page boundary.
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t begin = offset - offset % page_size;
+  const size_t end = std::min(size_, offset + num_bytes);
+  madvise(data_ + begin, end - begin, MADV_WILLNEED);
+#endif
+}
+
+void ImageView::ConvertRowToFloat(const int y, float* values) const {
+  const uint8_t* row = Row(y);
+  const size_t num_values = static_cast<size_t>(width) * channels;
+  // Divide instead of multiplying with the reciprocal to produce the same
+  // values as Bitmap::ConvertScanlineToFloat.
+  const float max = static_cast<float>(max_value);
+  if (bytes_per_value == 1) {
+    for (size_t i = 0; i < num_values; ++i) {
+      values[i] = std::min(1.0f, row[i] / max);
+    }
+  } else {
+    for (size_t i = 0; i < num_values; ++i) {
+      values[i] = std::min(1.0f, ((row[2 * i] << 8) | row[2 * i + 1]) / max);
+    }
+  }
+}
+
+bool MappedImage::Open(const std::string& path) {
+  Close();
+
+  if (!file_.Open(path)) {
+    return false;
+  }
+  const uint8_t* data = file_.Data();
+  const size_t size = file_.Size();
+  if (size < 2 || data[0] != 'P') {
+    Close();
+    return false;
+  }
+
+  int width = 0;
+  int height = 0;
+  int max_value = 0;
+  size_t data_offset = 0;
+  int channels;
+  if (data[1] == '5') {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      Close();
+      return false;
+    }
+    VlPgmImage pgm;
+    const bool success = vl_pgm_extract_head(file, &pgm) == 0 && pgm.is_raw;
+    const long offset = ftell(file);
+    fclose(file);
+    if (!success || offset < 0) {
+      Close();
+      return false;
+    }
+    width = static_cast<int>(pgm.width);
+    height = static_cast<int>(pgm.height);
+    max_value = static_cast<int>(pgm.max_value);
+    data_offset = static_cast<size_t>(offset);
+    channels = 1;
+  } else if (data[1] == '6') {
+    if (!ParsePpmHeader(data, size, &width, &height, &max_value,
+                        &data_offset)) {
+      Close();
+      return false;
+    }
+    channels = 3;
+  } else {
+    Close();
+    return false;
+  }
+
+  if (width <= 0 || height <= 0 || max_value <= 0 || max_value > 65535) {
+    Close();
+    return false;
+  }
+
+  view_.data = data + data_offset;
+  view_.width = width;
+  view_.height = height;
+  view_.channels = channels;
+  view_.bytes_per_value = max_value > 255 ? 2 : 1;
+  view_.max_value = max_value;
+  view_.stride = static_cast<size_t>(width) * channels * view_.bytes_per_value;
+
+  // Reject truncated files instead of faulting on access.
+  if (data_offset + view_.stride * height > size) {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void MappedImage::Close() {
+  file_.Close();
+  view_ = ImageView();
+}
+
+void MappedImage::PrefetchRows(const int y, const int num_rows) const {
+  if (!view_.IsValid()) {
+    return;
+  }
+  file_.Prefetch(view_.Row(y) - file_.Data(), num_rows * view_.stride);
+}
+
+bool MappedImage::ToBitmap(Bitmap* bitmap, const bool as_rgb) const {
+  if (!view_.IsValid() ||
+      !bitmap->Allocate(view_.width, view_.height, as_rgb)) {
+    return false;
+  }
+
+  const bool direct = view_.bytes_per_value == 1 && view_.max_value == 255;
+  const int channels = view_.channels;
+  for (int y = 0; y < view_.height; ++y) {
+    const uint8_t* row = view_.Row(y);
+    uint8_t* line =
+        FreeImage_GetScanLine(bitmap->Data(), view_.height - 1 - y);
+
+    if (direct && channels == 1 && !as_rgb) {
+      std::memcpy(line, row, view_.width);
+      continue;
+    }
+
+    for (int x = 0; x < view_.width; ++x) {
+      uint8_t rgb[3];
+      for (int c = 0; c < channels; ++c) {
+        const size_t idx = static_cast<size_t>(x) * channels + c;
+        rgb[c] = direct ? row[idx]
+                        : view_.bytes_per_value == 1
+                              ? ScaleValue(row[idx], view_.max_value)
+                              : ScaleValue((row[2 * idx] << 8) |
+                                               row[2 * idx + 1],
+                                           view_.max_value);
+      }
+      if (channels == 1) {
+        rgb[1] = rgb[2] = rgb[0];
+      }
+
+      if (as_rgb) {
+        line[3 * x + FI_RGBA_RED] = rgb[0];
+        line[3 * x + FI_RGBA_GREEN] = rgb[1];
+        line[3 * x + FI_RGBA_BLUE] = rgb[2];
+      } else if (channels == 1) {
+        line[x] = rgb[0];
+      } else {
+        line[x] = static_cast<uint8_t>(0.2126f * rgb[0] + 0.7152f * rgb[1] +
+                                       0.0722f * rgb[2] + 0.5f);
+      }
+    }
+  }
+
+  return true;
+}
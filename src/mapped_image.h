@@ -0,0 +1,108 @@
+#ifndef COLMAP_SRC_UTIL_MAPPED_IMAGE_H_
+#define COLMAP_SRC_UTIL_MAPPED_IMAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "bitmap.h"
+
+// Read-only memory mapping of a complete file.
+class MappedFile {
+ public:
+  MappedFile();
+  MappedFile(MappedFile&& other);
+  ~MappedFile();
+
+  MappedFile& operator=(MappedFile&& other);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const std::string& path);
+  void Close();
+
+  inline bool IsOpen() const;
+  inline const uint8_t* Data() const;
+  inline size_t Size() const;
+
+  // Ask the operating system to page in the given byte range ahead of use.
+  void Prefetch(const size_t offset, const size_t num_bytes) const;
+
+ private:
+  uint8_t* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_handle_;
+  void* mapping_handle_;
+#endif
+};
+
+// Non-owning view of interleaved pixels with rows stored top-down. 16-bit
+// values are stored big-endian, as in PGM and PPM files.
+struct ImageView {
+  const uint8_t* data = nullptr;
+
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+
+  // Number of bytes per value, i.e. 1 or 2.
+  int bytes_per_value = 1;
+
+  // Maximum value of a pixel, e.g. 255 for 8-bit images.
+  int max_value = 255;
+
+  // Number of bytes between the starts of consecutive rows.
+  size_t stride = 0;
+
+  inline bool IsValid() const;
+  inline const uint8_t* Row(const int y) const;
+
+  // Convert the y-th row to `width * channels` floats in the range [0, 1].
+  void ConvertRowToFloat(const int y, float* values) const;
+};
+
+// Binary PGM or PPM image that is memory-mapped instead of decoded, so that
+// opening costs only the header parsing and pixels are paged in lazily when
+// rows are first accessed. The header of PGM files is parsed with VLFeat's
+// PGM module.
+class MappedImage {
+ public:
+  bool Open(const std::string& path);
+  void Close();
+
+  inline const ImageView& View() const;
+
+  // Page in the given rows ahead of their use.
+  void PrefetchRows(const int y, const int num_rows) const;
+
+  // Copy the pixels into a bitmap. 16-bit values are reduced to 8 bits.
+  bool ToBitmap(Bitmap* bitmap, const bool as_rgb) const;
+
+ private:
+  MappedFile file_;
+  ImageView view_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+bool MappedFile::IsOpen() const { return data_ != nullptr; }
+
+const uint8_t* MappedFile::Data() const { return data_; }
+
+size_t MappedFile::Size() const { return size_; }
+
+bool ImageView::IsValid() const {
+  return data != nullptr && width > 0 && height > 0 && channels > 0;
+}
+
+const uint8_t* ImageView::Row(const int y) const {
+  return data + static_cast<size_t>(y) * stride;
+}
+
+const ImageView& MappedImage::View() const { return view_; }
+
+#endif  // COLMAP_SRC_UTIL_MAPPED_IMAGE_H_
@@ -0,0 +1,145 @@
+#include "match_database.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+void SwapMatches(FeatureMatches* matches) {
+  for (auto& match : *matches) {
+    std::swap(match.point2D_idx1, match.point2D_idx2);
+  }
+}
+
+}  // namespace
+
+void MatchDatabase::Add(const size_t image_idx1, const size_t image_idx2,
+                        const FeatureMatches& matches) {
+  FeatureMatches stored_matches = matches;
+  if (image_idx1 > image_idx2) {
+    SwapMatches(&stored_matches);
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  matches_[PairId(image_idx1, image_idx2)].swap(stored_matches);
+}
+
+bool MatchDatabase::Exists(const size_t image_idx1,
+                           const size_t image_idx2) const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return matches_.count(PairId(image_idx1, image_idx2)) > 0;
+}
+
+bool MatchDatabase::Get(const size_t image_idx1, const size_t image_idx2,
+                        FeatureMatches* matches) const {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const auto it = matches_.find(PairId(image_idx1, image_idx2));
+    if (it == matches_.end()) {
+      return false;
+    }
+    *matches = it->second;
+  }
+  if (image_idx1 > image_idx2) {
+    SwapMatches(matches);
+  }
+  return true;
+}
+
+size_t MatchDatabase::NumPairs() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return matches_.size();
+}
+
+std::vector<std::pair<size_t, size_t>> MatchDatabase::Pairs() const {
+  std::vector<std::pair<size_t, size_t>> pairs;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pairs.reserve(matches_.size());
+    for (const auto& pair : matches_) {
+      pairs.emplace_back(static_cast<size_t>(pair.first >> 32),
+                         static_cast<size_t>(pair.first & 0xFFFFFFFF));
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+  return pairs;
+}
+
+void MatchDatabase::Clear() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  matches_.clear();
+}
+
+bool MatchDatabase::Write(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  const std::vector<std::pair<size_t, size_t>> pairs = Pairs();
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  const uint32_t num_pairs = static_cast<uint32_t>(pairs.size());
+  bool success = fwrite(&num_pairs, sizeof(uint32_t), 1, file) == 1;
+  for (size_t i = 0; i < pairs.size() && success; ++i) {
+    const FeatureMatches& matches =
+        matches_.at(PairId(pairs[i].first, pairs[i].second));
+    const uint32_t header[3] = {static_cast<uint32_t>(pairs[i].first),
+                                static_cast<uint32_t>(pairs[i].second),
+                                static_cast<uint32_t>(matches.size())};
+    success = fwrite(header, sizeof(uint32_t), 3, file) == 3;
+    for (size_t j = 0; j < matches.size() && success; ++j) {
+      const uint32_t idxs[2] = {matches[j].point2D_idx1,
+                                matches[j].point2D_idx2};
+      success = fwrite(idxs, sizeof(uint32_t), 2, file) == 2;
+    }
+  }
+
+  success = fclose(file) == 0 && success;
+  return success;
+}
+
+bool MatchDatabase::Read(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  std::unordered_map<uint64_t, FeatureMatches> matches;
+  uint32_t num_pairs = 0;
+  bool success = fread(&num_pairs, sizeof(uint32_t), 1, file) == 1;
+  for (uint32_t i = 0; i < num_pairs && success; ++i) {
+    uint32_t header[3];
+    success = fread(header, sizeof(uint32_t), 3, file) == 3;
+    if (!success) {
+      break;
+    }
+    std::vector<uint32_t> idxs(2 * static_cast<size_t>(header[2]));
+    success = fread(idxs.data(), sizeof(uint32_t), idxs.size(), file) ==
+              idxs.size();
+    FeatureMatches& pair_matches = matches[PairId(header[0], header[1])];
+    pair_matches.resize(header[2]);
+    for (size_t j = 0; j < pair_matches.size() && success; ++j) {
+      pair_matches[j].point2D_idx1 = idxs[2 * j];
+      pair_matches[j].point2D_idx2 = idxs[2 * j + 1];
+    }
+    if (header[0] > header[1]) {
+      SwapMatches(&pair_matches);
+    }
+  }
+  fclose(file);
+
+  if (!success) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  matches_.swap(matches);
+  return true;
+}
+
+uint64_t MatchDatabase::PairId(const size_t image_idx1,
+                               const size_t image_idx2) {
+  const uint64_t min_idx = std::min(image_idx1, image_idx2);
+  const uint64_t max_idx = std::max(image_idx1, image_idx2);
+  return (min_idx << 32) | max_idx;
+}
@@ -0,0 +1,53 @@
+#ifndef COLMAP_SRC_BASE_MATCH_DATABASE_H_
+#define COLMAP_SRC_BASE_MATCH_DATABASE_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "feature.h"
+
+// Thread-safe store of the feature matches between image pairs. Pairs are
+// unordered, i.e. the matches of `(j, i)` are the swapped matches of `(i, j)`.
+//
+// The binary file format is:
+//
+//    uint32 NUM_PAIRS
+//    uint32 IMAGE_IDX1 uint32 IMAGE_IDX2 uint32 NUM_MATCHES
+//    NUM_MATCHES x (uint32 POINT2D_IDX1, uint32 POINT2D_IDX2)
+//    ...
+//
+// with the pairs sorted by their image indices.
+class MatchDatabase {
+ public:
+  // Set the matches of a pair, overwriting existing matches.
+  void Add(const size_t image_idx1, const size_t image_idx2,
+           const FeatureMatches& matches);
+
+  bool Exists(const size_t image_idx1, const size_t image_idx2) const;
+
+  // Get the matches of a pair, where `point2D_idx1` refers to `image_idx1`.
+  // Returns false if the pair does not exist.
+  bool Get(const size_t image_idx1, const size_t image_idx2,
+           FeatureMatches* matches) const;
+
+  size_t NumPairs() const;
+
+  // All pairs as `(image_idx1, image_idx2)` with `image_idx1 < image_idx2`.
+  std::vector<std::pair<size_t, size_t>> Pairs() const;
+
+  void Clear();
+
+  bool Write(const std::string& path) const;
+  bool Read(const std::string& path);
+
+ private:
+  static uint64_t PairId(const size_t image_idx1, const size_t image_idx2);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<uint64_t, FeatureMatches> matches_;
+};
+
+#endif  // COLMAP_SRC_BASE_MATCH_DATABASE_H_
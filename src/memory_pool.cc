@@ -0,0 +1,173 @@
+#include "memory_pool.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+
+uint8_t* AlignedAlloc(const size_t num_bytes) {
+#ifdef _WIN32
+  void* data = _aligned_malloc(num_bytes, BufferPool::kAlignment);
+#else
+  void* data = nullptr;
+  if (posix_memalign(&data, BufferPool::kAlignment, num_bytes) != 0) {
+    data = nullptr;
+  }
+#endif
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+  return static_cast<uint8_t*>(data);
+}
+
+void AlignedFree(uint8_t* data) {
+#ifdef _WIN32
+  _aligned_free(data);
+#else
+  free(data);
+#endif
+}
+
+}  // namespace
+
+PooledBuffer::PooledBuffer()
+    : pool_(nullptr), data_(nullptr), size_(0), capacity_(0) {}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) : PooledBuffer() {
+  *this = std::move(other);
+}
+
+PooledBuffer::~PooledBuffer() { Reset(); }
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) {
+  if (this != &other) {
+    Reset();
+    pool_ = other.pool_;
+    data_ = other.data_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+  }
+  return *this;
+}
+
+void PooledBuffer::Reset() {
+  if (data_ != nullptr) {
+    pool_->Release(data_, capacity_);
+  }
+  pool_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+  capacity_ = 0;
+}
+
+BufferPool::BufferPool(const size_t max_bytes_held)
+    : max_bytes_held_(max_bytes_held) {}
+
+BufferPool::~BufferPool() { Clear(); }
+
+BufferPool& BufferPool::Global() {
+  // Intentionally leaked, so that buffers released during static destruction
+  // still find a valid pool.
+  static BufferPool* pool = new BufferPool();
+  return *pool;
+}
+
+PooledBuffer BufferPool::Acquire(const size_t num_bytes) {
+  PooledBuffer buffer;
+  buffer.pool_ = this;
+  buffer.size_ = num_bytes;
+  buffer.capacity_ = SizeClass(num_bytes);
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stats_.num_bytes_in_use += buffer.capacity_;
+    auto it = free_buffers_.find(buffer.capacity_);
+    if (it != free_buffers_.end() && !it->second.empty()) {
+      buffer.data_ = it->second.back();
+      it->second.pop_back();
+      stats_.num_bytes_held -= buffer.capacity_;
+      stats_.num_hits += 1;
+      return buffer;
+    }
+    stats_.num_misses += 1;
+  }
+
+  try {
+    buffer.data_ = AlignedAlloc(buffer.capacity_);
+  } catch (...) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stats_.num_bytes_in_use -= buffer.capacity_;
+    buffer.pool_ = nullptr;
+    throw;
+  }
+
+  return buffer;
+}
+
+BufferPoolStats BufferPool::Stats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void BufferPool::SetMaxBytesHeld(const size_t max_bytes_held) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  max_bytes_held_ = max_bytes_held;
+  TrimLocked(max_bytes_held_);
+}
+
+void BufferPool::Clear() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  TrimLocked(0);
+}
+
+size_t BufferPool::SizeClass(const size_t num_bytes) {
+  if (num_bytes <= kMinSizeClass) {
+    return kMinSizeClass;
+  }
+
+  // Find the power of two below the request and round up to the next
+  // quarter step in [2^k, 2^(k+1)], which bounds the wasted memory to 25%.
+  size_t base = kMinSizeClass;
+  while (base * 2 < num_bytes) {
+    base *= 2;
+  }
+  const size_t step = base / 4;
+  return base + ((num_bytes - base + step - 1) / step) * step;
+}
+
+void BufferPool::Release(uint8_t* data, const size_t capacity) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stats_.num_bytes_in_use -= capacity;
+    if (stats_.num_bytes_held + capacity <= max_bytes_held_) {
+      free_buffers_[capacity].push_back(data);
+      stats_.num_bytes_held += capacity;
+      return;
+    }
+  }
+
+  AlignedFree(data);
+}
+
+void BufferPool::TrimLocked(const size_t max_bytes_held) {
+  // Free the largest buffers first, since they are the most expensive to
+  // keep around and the least likely to be reused by other image sizes.
+  auto it = free_buffers_.end();
+  while (stats_.num_bytes_held > max_bytes_held &&
+         it != free_buffers_.begin()) {
+    --it;
+    while (!it->second.empty() && stats_.num_bytes_held > max_bytes_held) {
+      AlignedFree(it->second.back());
+      it->second.pop_back();
+      stats_.num_bytes_held -= it->first;
+    }
+  }
+}
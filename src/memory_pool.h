@@ -0,0 +1,134 @@
+#ifndef COLMAP_SRC_UTIL_MEMORY_POOL_H_
+#define COLMAP_SRC_UTIL_MEMORY_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+class BufferPool;
+
+// Move-only handle to a buffer drawn from a buffer pool. The buffer is
+// returned to the pool when the handle is destroyed or reset.
+class PooledBuffer {
+ public:
+  PooledBuffer();
+  PooledBuffer(PooledBuffer&& other);
+  ~PooledBuffer();
+
+  PooledBuffer& operator=(PooledBuffer&& other);
+
+  PooledBuffer(const PooledBuffer&) = delete;
+  PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+  // Pointer to the buffer, aligned to `BufferPool::kAlignment` bytes.
+  inline uint8_t* Data();
+  inline const uint8_t* Data() const;
+
+  template <typename T>
+  inline T* DataAs();
+  template <typename T>
+  inline const T* DataAs() const;
+
+  // Requested and actually allocated number of bytes.
+  inline size_t Size() const;
+  inline size_t Capacity() const;
+
+  inline bool IsEmpty() const;
+
+  // Return the buffer to its pool.
+  void Reset();
+
+ private:
+  friend class BufferPool;
+
+  BufferPool* pool_;
+  uint8_t* data_;
+  size_t size_;
+  size_t capacity_;
+};
+
+struct BufferPoolStats {
+  // Number of requests served from a cached buffer.
+  size_t num_hits = 0;
+
+  // Number of requests that required a new allocation.
+  size_t num_misses = 0;
+
+  // Number of bytes of idle buffers cached by the pool.
+  size_t num_bytes_held = 0;
+
+  // Number of bytes of buffers currently handed out by the pool.
+  size_t num_bytes_in_use = 0;
+};
+
+// Thread-safe pool of large, aligned buffers. Requests are rounded up to one
+// of four size classes per power of two, so that buffers for images of
+// similar size are recycled instead of being allocated and page-faulted in
+// for every image.
+class BufferPool {
+ public:
+  static const size_t kAlignment = 64;
+  static const size_t kMinSizeClass = 4096;
+
+  // Idle buffers beyond `max_bytes_held` are freed instead of being cached.
+  explicit BufferPool(const size_t max_bytes_held = 512 * 1024 * 1024);
+  ~BufferPool();
+
+  // Process-wide pool used by Bitmap and the feature extraction buffers.
+  static BufferPool& Global();
+
+  // Acquire a buffer of at least `num_bytes` bytes. The contents of the
+  // buffer are undefined.
+  PooledBuffer Acquire(const size_t num_bytes);
+
+  BufferPoolStats Stats() const;
+
+  // Change the maximum number of cached bytes and free idle buffers if the
+  // pool currently holds more.
+  void SetMaxBytesHeld(const size_t max_bytes_held);
+
+  // Free all idle buffers.
+  void Clear();
+
+  // Size class of a request, i.e. the capacity of the buffer that serves it.
+  static size_t SizeClass(const size_t num_bytes);
+
+ private:
+  friend class PooledBuffer;
+
+  void Release(uint8_t* data, const size_t capacity);
+  void TrimLocked(const size_t max_bytes_held);
+
+  mutable std::mutex mutex_;
+  std::map<size_t, std::vector<uint8_t*>> free_buffers_;
+  size_t max_bytes_held_;
+  BufferPoolStats stats_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+uint8_t* PooledBuffer::Data() { return data_; }
+
+const uint8_t* PooledBuffer::Data() const { return data_; }
+
+template <typename T>
+T* PooledBuffer::DataAs() {
+  return reinterpret_cast<T*>(data_);
+}
+
+template <typename T>
+const T* PooledBuffer::DataAs() const {
+  return reinterpret_cast<const T*>(data_);
+}
+
+size_t PooledBuffer::Size() const { return size_; }
+
+size_t PooledBuffer::Capacity() const { return capacity_; }
+
+bool PooledBuffer::IsEmpty() const { return data_ == nullptr; }
+
+#endif  // COLMAP_SRC_UTIL_MEMORY_POOL_H_
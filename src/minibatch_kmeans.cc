@@ -0,0 +1,497 @@
+#include "minibatch_kmeans.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <random>
+
+#include "threading.h"
+
+namespace {
+
+struct DescriptorBatch {
+  std::vector<float> descriptors;
+  size_t num_descriptors = 0;
+  int dim = 0;
+  // Position after the last image of the batch in the image order.
+  uint64_t end = 0;
+  size_t num_failed_loads = 0;
+};
+
+// Load whole images from the given position of the image order until the
+// batch holds at least `min_num_descriptors` descriptors of dimension `dim`,
+// or of the dimension of the first loaded image if `dim <= 0`.
+DescriptorBatch LoadBatch(const DescriptorLoader& loader,
+                          const std::vector<size_t>& image_order,
+                          const uint64_t begin,
+                          const size_t min_num_descriptors, const int dim,
+                          const int max_num_descriptors_per_image,
+                          const uint32_t seed, const uint64_t epoch) {
+  DescriptorBatch batch;
+  batch.dim = dim;
+  batch.end = begin;
+  FeatureDescriptors descriptors;
+  std::vector<FeatureDescriptors::Index> rows;
+  while (batch.end < image_order.size() &&
+         batch.num_descriptors < min_num_descriptors) {
+    const size_t image_idx = image_order[batch.end];
+    batch.end += 1;
+    if (!loader.Load(image_idx, &descriptors)) {
+      batch.num_failed_loads += 1;
+      continue;
+    }
+    if (descriptors.rows() == 0) {
+      continue;
+    }
+    if (batch.dim <= 0) {
+      batch.dim = static_cast<int>(descriptors.cols());
+    } else if (descriptors.cols() != batch.dim) {
+      batch.num_failed_loads += 1;
+      continue;
+    }
+
+    rows.resize(descriptors.rows());
+    std::iota(rows.begin(), rows.end(), 0);
+    if (max_num_descriptors_per_image > 0 &&
+        rows.size() > static_cast<size_t>(max_num_descriptors_per_image)) {
+      std::seed_seq seed_seq = {seed, static_cast<uint32_t>(epoch),
+                                static_cast<uint32_t>(image_idx)};
+      std::mt19937 random_engine(seed_seq);
+      std::shuffle(rows.begin(), rows.end(), random_engine);
+      rows.resize(max_num_descriptors_per_image);
+    }
+
+    batch.descriptors.resize((batch.num_descriptors + rows.size()) *
+                             batch.dim);
+    float* batch_row =
+        batch.descriptors.data() + batch.num_descriptors * batch.dim;
+    for (const auto row : rows) {
+      const uint8_t* descriptor = descriptors.data() + row * batch.dim;
+      std::copy(descriptor, descriptor + batch.dim, batch_row);
+      batch_row += batch.dim;
+    }
+    batch.num_descriptors += rows.size();
+  }
+  return batch;
+}
+
+// Seed the centers by k-means++, see "k-means++: The Advantages of Careful
+// Seeding", Arthur and Vassilvitskii, SODA 2007. The random generator is
+// private, so that the seeding neither depends on nor changes the state of
+// other users of a global generator.
+MiniBatchKMeans::RowMajorMatrixXf SeedCentersPlusPlus(
+    const DescriptorBatch& batch, const int num_clusters,
+    const uint32_t seed, const int num_threads) {
+  const Eigen::Map<const MiniBatchKMeans::RowMajorMatrixXf> descriptors(
+      batch.descriptors.data(), batch.num_descriptors, batch.dim);
+  MiniBatchKMeans::RowMajorMatrixXf centers(num_clusters, batch.dim);
+  std::vector<float> min_squared_distances(
+      batch.num_descriptors, std::numeric_limits<float>::max());
+
+  std::mt19937 random_engine(seed);
+  std::uniform_real_distribution<double> uniform_distribution(0, 1);
+  size_t idx = random_engine() % batch.num_descriptors;
+  for (int k = 0; k < num_clusters; ++k) {
+    centers.row(k) = descriptors.row(idx);
+    if (k + 1 == num_clusters) {
+      break;
+    }
+
+    ParallelForRange(
+        0, batch.num_descriptors, num_threads, 1024,
+        [&](const size_t begin, const size_t end) {
+          for (size_t i = begin; i < end; ++i) {
+            min_squared_distances[i] =
+                std::min(min_squared_distances[i],
+                         (descriptors.row(i) - centers.row(k)).squaredNorm());
+          }
+        });
+
+    // Draw the next center with a probability proportional to the squared
+    // distance to its nearest center, summed in a fixed order.
+    const double sum = std::accumulate(min_squared_distances.begin(),
+                                       min_squared_distances.end(), 0.0);
+    double threshold = uniform_distribution(random_engine) * sum;
+    idx = 0;
+    while (idx + 1 < batch.num_descriptors &&
+           threshold >= min_squared_distances[idx]) {
+      threshold -= min_squared_distances[idx];
+      idx += 1;
+    }
+  }
+
+  return centers;
+}
+
+}  // namespace
+
+MiniBatchKMeans::MiniBatchKMeans()
+    : num_images_(0), seed_(0), epoch_(0), next_image_(0), num_batches_(0) {}
+
+bool MiniBatchKMeans::Train(const MiniBatchKMeansOptions& options,
+                            const DescriptorLoader& loader,
+                            MiniBatchKMeansStats* stats) {
+  MiniBatchKMeansStats local_stats;
+  if (stats != nullptr) {
+    *stats = local_stats;
+  }
+
+  const size_t num_images = loader.NumImages();
+  if (num_images == 0 || options.num_clusters <= 0 ||
+      options.batch_size == 0 ||
+      num_images > std::numeric_limits<uint32_t>::max()) {
+    return false;
+  }
+
+  center_distances_.resize(0, 0);
+  half_min_center_distances_.resize(0);
+
+  bool resume = false;
+  if (!options.checkpoint_path.empty()) {
+    FILE* file = fopen(options.checkpoint_path.c_str(), "rb");
+    if (file != nullptr) {
+      fclose(file);
+      resume = true;
+    }
+  }
+
+  if (resume) {
+    if (!Read(options.checkpoint_path) || num_images_ != num_images ||
+        seed_ != options.seed || NumClusters() != options.num_clusters) {
+      return false;
+    }
+  } else {
+    centers_.resize(0, 0);
+    counts_.clear();
+    num_images_ = static_cast<uint32_t>(num_images);
+    seed_ = options.seed;
+    epoch_ = 0;
+    next_image_ = 0;
+    num_batches_ = 0;
+  }
+
+  const auto LoadBatchAsync = [&](const std::vector<size_t>& image_order,
+                                  const uint64_t begin) {
+    const size_t min_num_descriptors =
+        centers_.size() == 0
+            ? std::max<size_t>(options.batch_size, options.num_clusters)
+            : options.batch_size;
+    return std::async(std::launch::async, LoadBatch, std::cref(loader),
+                      std::cref(image_order), begin, min_num_descriptors,
+                      NumDimensions(), options.max_num_descriptors_per_image,
+                      seed_, epoch_);
+  };
+
+  std::vector<int> cluster_idxs;
+  std::vector<size_t> cluster_offsets;
+  std::vector<size_t> cluster_descriptor_idxs;
+  std::mutex mutex;
+
+  while (epoch_ < static_cast<uint64_t>(options.num_epochs)) {
+    const std::vector<size_t> image_order = ImageOrder(epoch_);
+    std::future<DescriptorBatch> next_batch =
+        LoadBatchAsync(image_order, next_image_);
+    while (next_image_ < num_images_) {
+      DescriptorBatch batch = next_batch.get();
+      local_stats.num_failed_loads += batch.num_failed_loads;
+
+      if (centers_.size() == 0) {
+        if (batch.num_descriptors <
+            static_cast<size_t>(options.num_clusters)) {
+          return false;
+        }
+        centers_ = SeedCentersPlusPlus(batch, options.num_clusters, seed_,
+                                       options.num_threads);
+        counts_.assign(options.num_clusters, 0);
+      }
+
+      // Only the centers are needed from here on, so the next batch can be
+      // loaded while this batch is processed.
+      if (batch.end < num_images_) {
+        next_batch = LoadBatchAsync(image_order, batch.end);
+      }
+
+      if (options.elkan_pruning) {
+        ComputeCenterDistances(
+            options.num_clusters <= options.max_num_elkan_clusters,
+            options.num_threads);
+      }
+
+      // Assign the descriptors to their nearest centers.
+      cluster_idxs.resize(batch.num_descriptors);
+      double sum_squared_errors = 0;
+      ParallelForRange(
+          0, batch.num_descriptors, options.num_threads, 256,
+          [&](const size_t begin, const size_t end) {
+            size_t num_distance_computations = 0;
+            double chunk_sum_squared_errors = 0;
+            for (size_t i = begin; i < end; ++i) {
+              chunk_sum_squared_errors += AssignDescriptor(
+                  batch.descriptors.data() + i * batch.dim, &cluster_idxs[i],
+                  &num_distance_computations);
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            local_stats.num_distance_computations +=
+                num_distance_computations;
+            sum_squared_errors += chunk_sum_squared_errors;
+          });
+
+      // Move every center towards its descriptors in batch order, where the
+      // centers are independent and updated in parallel.
+      cluster_offsets.assign(options.num_clusters + 1, 0);
+      for (const int cluster_idx : cluster_idxs) {
+        cluster_offsets[cluster_idx + 1] += 1;
+      }
+      std::partial_sum(cluster_offsets.begin(), cluster_offsets.end(),
+                       cluster_offsets.begin());
+      cluster_descriptor_idxs.resize(batch.num_descriptors);
+      std::vector<size_t> cluster_ends(cluster_offsets.begin(),
+                                       cluster_offsets.end() - 1);
+      for (size_t i = 0; i < batch.num_descriptors; ++i) {
+        cluster_descriptor_idxs[cluster_ends[cluster_idxs[i]]++] = i;
+      }
+      ParallelForRange(
+          0, options.num_clusters, options.num_threads, 64,
+          [&](const size_t begin, const size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+              for (size_t j = cluster_offsets[k]; j < cluster_offsets[k + 1];
+                   ++j) {
+                counts_[k] += 1;
+                const float learning_rate = 1.0f / counts_[k];
+                const Eigen::Map<const Eigen::RowVectorXf> descriptor(
+                    batch.descriptors.data() +
+                        cluster_descriptor_idxs[j] * batch.dim,
+                    batch.dim);
+                centers_.row(k) +=
+                    learning_rate * (descriptor - centers_.row(k));
+              }
+            }
+          });
+
+      next_image_ = batch.end;
+      num_batches_ += 1;
+      local_stats.num_batches += 1;
+      local_stats.num_descriptors += batch.num_descriptors;
+      local_stats.mean_squared_error =
+          sum_squared_errors / std::max<size_t>(1, batch.num_descriptors);
+
+      const bool end_of_epoch = next_image_ >= num_images_;
+      if (end_of_epoch) {
+        epoch_ += 1;
+        next_image_ = 0;
+      }
+
+      if (!options.checkpoint_path.empty() && options.checkpoint_period > 0 &&
+          num_batches_ % options.checkpoint_period == 0 &&
+          !Write(options.checkpoint_path)) {
+        return false;
+      }
+
+      if (end_of_epoch) {
+        break;
+      }
+    }
+  }
+
+  if (options.elkan_pruning && centers_.size() > 0) {
+    ComputeCenterDistances(
+        options.num_clusters <= options.max_num_elkan_clusters,
+        options.num_threads);
+  }
+
+  if (stats != nullptr) {
+    *stats = local_stats;
+  }
+
+  if (!options.checkpoint_path.empty() && !Write(options.checkpoint_path)) {
+    return false;
+  }
+
+  return centers_.size() > 0 && local_stats.num_failed_loads == 0;
+}
+
+int MiniBatchKMeans::NumClusters() const {
+  return static_cast<int>(centers_.rows());
+}
+
+int MiniBatchKMeans::NumDimensions() const {
+  return static_cast<int>(centers_.cols());
+}
+
+const MiniBatchKMeans::RowMajorMatrixXf& MiniBatchKMeans::Centers() const {
+  return centers_;
+}
+
+void MiniBatchKMeans::Quantize(const FeatureDescriptors& descriptors,
+                               std::vector<int>* cluster_idxs) const {
+  cluster_idxs->clear();
+  if (centers_.size() == 0 || descriptors.cols() != centers_.cols()) {
+    return;
+  }
+
+  cluster_idxs->resize(descriptors.rows());
+  Eigen::VectorXf descriptor(descriptors.cols());
+  size_t num_distance_computations = 0;
+  for (FeatureDescriptors::Index i = 0; i < descriptors.rows(); ++i) {
+    descriptor = descriptors.row(i).transpose().cast<float>();
+    AssignDescriptor(descriptor.data(), &(*cluster_idxs)[i],
+                     &num_distance_computations);
+  }
+}
+
+bool MiniBatchKMeans::Write(const std::string& path) const {
+  const std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  const uint32_t header32[4] = {static_cast<uint32_t>(centers_.rows()),
+                                static_cast<uint32_t>(centers_.cols()),
+                                num_images_, seed_};
+  const uint64_t header64[3] = {epoch_, next_image_, num_batches_};
+  const size_t num_values = static_cast<size_t>(centers_.size());
+  bool success =
+      fwrite(header32, sizeof(uint32_t), 4, file) == 4 &&
+      fwrite(header64, sizeof(uint64_t), 3, file) == 3 &&
+      fwrite(counts_.data(), sizeof(uint64_t), counts_.size(), file) ==
+          counts_.size() &&
+      fwrite(centers_.data(), sizeof(float), num_values, file) == num_values;
+  success = fclose(file) == 0 && success;
+
+  return success && std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+bool MiniBatchKMeans::Read(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  uint32_t header32[4];
+  uint64_t header64[3];
+  bool success = fread(header32, sizeof(uint32_t), 4, file) == 4 &&
+                 fread(header64, sizeof(uint64_t), 3, file) == 3;
+  if (success) {
+    centers_.resize(header32[0], header32[1]);
+    counts_.resize(header32[0]);
+    num_images_ = header32[2];
+    seed_ = header32[3];
+    epoch_ = header64[0];
+    next_image_ = header64[1];
+    num_batches_ = header64[2];
+    const size_t num_values = static_cast<size_t>(centers_.size());
+    success =
+        fread(counts_.data(), sizeof(uint64_t), counts_.size(), file) ==
+            counts_.size() &&
+        fread(centers_.data(), sizeof(float), num_values, file) == num_values;
+  }
+  fclose(file);
+
+  center_distances_.resize(0, 0);
+  half_min_center_distances_.resize(0);
+  if (!success) {
+    centers_.resize(0, 0);
+    counts_.clear();
+  }
+  return success;
+}
+
+void MiniBatchKMeans::ComputeCenterDistances(const bool all_distances,
+                                             const int num_threads) {
+  const Eigen::DenseIndex num_clusters = centers_.rows();
+  if (all_distances) {
+    center_distances_.resize(num_clusters, num_clusters);
+  } else {
+    center_distances_.resize(0, 0);
+  }
+  half_min_center_distances_.resize(num_clusters);
+
+  // The squared distances |c_k|^2 + |c_l|^2 - 2 c_k^T c_l are computed by
+  // matrix products of blocks of centers, so that only a block of products
+  // is kept in memory. They are reduced by a bound on their rounding error,
+  // so that the pruning remains exact.
+  const Eigen::VectorXf squared_norms = centers_.rowwise().squaredNorm();
+  const float kRelativeError = 1e-5f;
+  const Eigen::DenseIndex kBlockSize = 256;
+  RowMajorMatrixXf products;
+  for (Eigen::DenseIndex block_begin = 0; block_begin < num_clusters;
+       block_begin += kBlockSize) {
+    const Eigen::DenseIndex block_size =
+        std::min(kBlockSize, num_clusters - block_begin);
+    products.noalias() =
+        centers_.middleRows(block_begin, block_size) * centers_.transpose();
+    ParallelForRange(
+        0, block_size, num_threads, 16,
+        [&](const size_t begin, const size_t end) {
+          for (size_t i = begin; i < end; ++i) {
+            const Eigen::DenseIndex k = block_begin + i;
+            float min_distance = std::numeric_limits<float>::max();
+            for (Eigen::DenseIndex l = 0; l < num_clusters; ++l) {
+              const float squared_norm_sum =
+                  squared_norms(k) + squared_norms(l);
+              const float distance = std::sqrt(std::max(
+                  0.0f, (1 - kRelativeError) * squared_norm_sum -
+                            2 * products(i, l)));
+              if (all_distances) {
+                center_distances_(k, l) = distance;
+              }
+              if (l != k) {
+                min_distance = std::min(min_distance, distance);
+              }
+            }
+            half_min_center_distances_(k) = 0.5f * min_distance;
+          }
+        });
+  }
+}
+
+float MiniBatchKMeans::AssignDescriptor(
+    const float* descriptor, int* cluster_idx,
+    size_t* num_distance_computations) const {
+  const Eigen::DenseIndex num_clusters = centers_.rows();
+  const Eigen::Map<const Eigen::RowVectorXf> x(descriptor, centers_.cols());
+  const bool prune = half_min_center_distances_.size() == num_clusters;
+  const bool prune_elkan = center_distances_.rows() == num_clusters;
+
+  int best_idx = 0;
+  float best_squared_distance = (x - centers_.row(0)).squaredNorm();
+  float best_distance = std::sqrt(best_squared_distance);
+  *num_distance_computations += 1;
+  for (Eigen::DenseIndex k = 1; k < num_clusters; ++k) {
+    if (prune) {
+      // No center is closer than the best center, if the descriptor lies
+      // within half the distance to its nearest other center.
+      if (best_distance <= half_min_center_distances_(best_idx)) {
+        break;
+      }
+      // d(x, c_k) >= d(c_best, c_k) - d(x, c_best) >= d(x, c_best).
+      if (prune_elkan && center_distances_(best_idx, k) >= 2 * best_distance) {
+        continue;
+      }
+    }
+    const float squared_distance = (x - centers_.row(k)).squaredNorm();
+    *num_distance_computations += 1;
+    if (squared_distance < best_squared_distance) {
+      best_idx = static_cast<int>(k);
+      best_squared_distance = squared_distance;
+      best_distance = std::sqrt(squared_distance);
+    }
+  }
+
+  *cluster_idx = best_idx;
+  return best_squared_distance;
+}
+
+std::vector<size_t> MiniBatchKMeans::ImageOrder(const size_t epoch) const {
+  std::vector<size_t> image_order(num_images_);
+  std::iota(image_order.begin(), image_order.end(), 0);
+  std::seed_seq seed_seq = {seed_, static_cast<uint32_t>(epoch)};
+  std::mt19937 random_engine(seed_seq);
+  std::shuffle(image_order.begin(), image_order.end(), random_engine);
+  return image_order;
+}
@@ -0,0 +1,139 @@
+#ifndef COLMAP_SRC_BASE_MINIBATCH_KMEANS_H_
+#define COLMAP_SRC_BASE_MINIBATCH_KMEANS_H_
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "exhaustive_matcher.h"
+#include "feature.h"
+
+struct MiniBatchKMeansOptions {
+  // Number of clusters of the codebook.
+  int num_clusters = 10000;
+
+  // Minimum number of descriptors per mini-batch. Batches consist of whole
+  // images and the first batch holds at least `num_clusters` descriptors,
+  // since it also seeds the centers by k-means++.
+  size_t batch_size = 100000;
+
+  // Number of passes over all images, each in a different random order.
+  int num_epochs = 1;
+
+  // Maximum number of descriptors randomly sampled from every image. If
+  // `max_num_descriptors_per_image <= 0`, all descriptors are used.
+  int max_num_descriptors_per_image = -1;
+
+  // Prune distance computations by the triangle inequality on the distances
+  // between centers, see "Using the Triangle Inequality to Accelerate
+  // k-Means", Elkan, ICML 2003. The center distances are recomputed for
+  // every batch and take `4 * num_clusters^2` bytes, so that above
+  // `max_num_elkan_clusters` only the half distance of every center to its
+  // nearest other center is kept, see "Making k-means even faster", Hamerly,
+  // SDM 2010, which prunes less.
+  bool elkan_pruning = true;
+  int max_num_elkan_clusters = 4096;
+
+  // Seed of the image order and of the descriptor sampling.
+  unsigned int seed = 0;
+
+  // If not empty, the state is written to this file every
+  // `checkpoint_period` batches and after the last batch. If the file
+  // exists, training resumes from it.
+  std::string checkpoint_path;
+  int checkpoint_period = 10;
+
+  // Number of threads to assign the descriptors of a batch. If
+  // `num_threads <= 0`, the number of hardware threads is used.
+  int num_threads = -1;
+};
+
+struct MiniBatchKMeansStats {
+  size_t num_batches = 0;
+  size_t num_descriptors = 0;
+  size_t num_failed_loads = 0;
+
+  // Number of descriptor-center distances computed, out of
+  // `num_descriptors * num_clusters` without pruning.
+  size_t num_distance_computations = 0;
+
+  // Mean squared distance of the descriptors of the last batch to their
+  // assigned centers before the update.
+  double mean_squared_error = 0;
+};
+
+// Streaming k-means over the descriptors of a set of images, see "Web-Scale
+// K-Means Clustering", Sculley, WWW 2010. Only the centers and one batch of
+// descriptors are kept in memory, while the next batch is loaded in the
+// background. Every descriptor moves its nearest center towards itself with
+// a learning rate of one over the number of descriptors assigned to the
+// center so far, so that a center is the running mean of its descriptors.
+class MiniBatchKMeans {
+ public:
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor>
+      RowMajorMatrixXf;
+
+  MiniBatchKMeans();
+
+  // Train the centers on all images of the loader. If the checkpoint of the
+  // options exists, training resumes from its state, which must have been
+  // written for the same number of images, clusters and seed. Returns false
+  // if the checkpoint cannot be read or written, if there are fewer
+  // descriptors than clusters or if any image failed to load. The stats
+  // only cover the batches processed by this call.
+  bool Train(const MiniBatchKMeansOptions& options,
+             const DescriptorLoader& loader, MiniBatchKMeansStats* stats);
+
+  int NumClusters() const;
+  int NumDimensions() const;
+
+  // Cluster centers, one per row.
+  const RowMajorMatrixXf& Centers() const;
+
+  // Assign every descriptor to its nearest center.
+  void Quantize(const FeatureDescriptors& descriptors,
+                std::vector<int>* cluster_idxs) const;
+
+  // Read and write the training state, where the file is written to a
+  // temporary file first and renamed, so that an interrupted write leaves
+  // the previous checkpoint intact. The file format is:
+  //
+  //    uint32 NUM_CLUSTERS uint32 DIM uint32 NUM_IMAGES uint32 SEED
+  //    uint64 EPOCH uint64 NEXT_IMAGE uint64 NUM_BATCHES
+  //    NUM_CLUSTERS x uint64 COUNT
+  //    NUM_CLUSTERS x DIM x float CENTER
+  //
+  // with values stored in the byte order of the host.
+  bool Write(const std::string& path) const;
+  bool Read(const std::string& path);
+
+ private:
+  void ComputeCenterDistances(const bool all_distances, const int num_threads);
+  float AssignDescriptor(const float* descriptor, int* cluster_idx,
+                         size_t* num_distance_computations) const;
+
+  // Images in the random order of the given epoch.
+  std::vector<size_t> ImageOrder(const size_t epoch) const;
+
+  RowMajorMatrixXf centers_;
+  std::vector<uint64_t> counts_;
+
+  // Distances between centers, if Elkan pruning is enabled for the number of
+  // clusters, and half the distance of every center to its nearest other
+  // center, if any pruning is enabled. Both are lower bounds of the exact
+  // distances.
+  RowMajorMatrixXf center_distances_;
+  Eigen::VectorXf half_min_center_distances_;
+
+  uint32_t num_images_;
+  uint32_t seed_;
+
+  // Position of the next batch in the image order of the current epoch.
+  uint64_t epoch_;
+  uint64_t next_image_;
+  uint64_t num_batches_;
+};
+
+#endif  // COLMAP_SRC_BASE_MINIBATCH_KMEANS_H_
@@ -0,0 +1,118 @@
+#include "misc.h"
+
+#include <cctype>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+uint64_t HashBytes(const void* data, const size_t num_bytes,
+                   const uint64_t hash) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t result = hash;
+  for (size_t i = 0; i < num_bytes; ++i) {
+    result = (result ^ bytes[i]) * 1099511628211ull;
+  }
+  return result;
+}
+
+std::string JoinPaths(const std::string& path1, const std::string& path2) {
+  if (path1.empty()) {
+    return path2;
+  }
+  if (path2.empty()) {
+    return path1;
+  }
+  const char last = path1[path1.size() - 1];
+  if (last == '/' || last == '\\') {
+    return path1 + path2;
+  }
+  return path1 + "/" + path2;
+}
+
+std::string GetPathBaseName(const std::string& path) {
+  const size_t separator = path.find_last_of("/\\");
+  if (separator == std::string::npos) {
+    return path;
+  }
+  return path.substr(separator + 1);
+}
+
+bool HasFileExtension(const std::string& file_name, const std::string& ext) {
+  if (ext.size() > file_name.size()) {
+    return false;
+  }
+  const size_t offset = file_name.size() - ext.size();
+  for (size_t i = 0; i < ext.size(); ++i) {
+    if (std::tolower(file_name[offset + i]) != std::tolower(ext[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ExistsDir(const std::string& path) {
+#ifdef _WIN32
+  const DWORD attributes = GetFileAttributesA(path.c_str());
+  return attributes != INVALID_FILE_ATTRIBUTES &&
+         (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+std::vector<std::string> GetFileList(const std::string& path) {
+  std::vector<std::string> file_list;
+
+#ifdef _WIN32
+  WIN32_FIND_DATAA find_data;
+  HANDLE handle = FindFirstFileA(JoinPaths(path, "*").c_str(), &find_data);
+  if (handle == INVALID_HANDLE_VALUE) {
+    return file_list;
+  }
+  do {
+    if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+      file_list.push_back(JoinPaths(path, find_data.cFileName));
+    }
+  } while (FindNextFileA(handle, &find_data));
+  FindClose(handle);
+#else
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return file_list;
+  }
+  while (struct dirent* entry = readdir(dir)) {
+    const std::string file_path = JoinPaths(path, entry->d_name);
+    struct stat info;
+    if (stat(file_path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+      file_list.push_back(file_path);
+    }
+  }
+  closedir(dir);
+#endif
+
+  std::sort(file_list.begin(), file_list.end());
+
+  return file_list;
+}
+
+std::vector<std::string> GetImageFileList(const std::string& path) {
+  std::vector<std::string> image_list;
+  for (const std::string& file_path : GetFileList(path)) {
+    if (HasFileExtension(file_path, ".jpg") ||
+        HasFileExtension(file_path, ".jpeg") ||
+        HasFileExtension(file_path, ".png") ||
+        HasFileExtension(file_path, ".pgm") ||
+        HasFileExtension(file_path, ".ppm") ||
+        HasFileExtension(file_path, ".tif") ||
+        HasFileExtension(file_path, ".tiff")) {
+      image_list.push_back(file_path);
+    }
+  }
+  return image_list;
+}
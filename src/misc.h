@@ -1,6 +1,13 @@
 #ifndef COLMAP_SRC_UTIL_MISC_H_
 #define COLMAP_SRC_UTIL_MISC_H_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
 #define CHECK(p)
 #define CHECK_EQ(a,b)
 #define CHECK_GE(a,b)
@@ -15,4 +22,30 @@ T2 TruncateCast(const T1 value) {
       std::max(static_cast<T1>(std::numeric_limits<T2>::min()), value));
 }
 
+// 64-bit FNV-1a hash of the bytes, where hashes of several values are chained
+// by passing the previous hash.
+uint64_t HashBytes(const void* data, const size_t num_bytes,
+                   const uint64_t hash = 14695981039346656037ull);
+
+// Join multiple paths into one path.
+std::string JoinPaths(const std::string& path1, const std::string& path2);
+
+// Return the file name of the path without the directory prefix.
+std::string GetPathBaseName(const std::string& path);
+
+// Check whether file name has the file extension (case insensitive).
+bool HasFileExtension(const std::string& file_name, const std::string& ext);
+
+// Check if the path points to an existing directory.
+bool ExistsDir(const std::string& path);
+
+// Return list of regular files in the given directory (non-recursive). The
+// returned paths are sorted and include the directory prefix.
+std::vector<std::string> GetFileList(const std::string& path);
+
+// Return the sorted list of images in the given directory (non-recursive),
+// i.e. the files with one of the extensions jpg, jpeg, png, pgm, ppm, tif or
+// tiff, compared case-insensitively.
+std::vector<std::string> GetImageFileList(const std::string& path);
+
 #endif  // COLMAP_SRC_UTIL_MISC_H_
\ No newline at end of file
@@ -0,0 +1,505 @@
+#include "pano_matching.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <random>
+
+#include <Eigen/Dense>
+
+#include "threading.h"
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+double DegToRad(const double deg) { return deg * kPi / 180.0; }
+
+// Latitude in degrees of the given row coordinate.
+double RowToLatitude(const double y, const int height) {
+  return 90.0 - 180.0 * y / height;
+}
+
+float AngleDifference(const float angle1, const float angle2) {
+  const float diff = std::fmod(std::abs(angle1 - angle2),
+                               static_cast<float>(2 * kPi));
+  return std::min(diff, static_cast<float>(2 * kPi) - diff);
+}
+
+// Copy rows [y0, y1) of the panorama into a new bitmap with `padding` columns
+// wrapped around from the opposite border on both sides.
+Bitmap PadPanorama(const Bitmap& bitmap, const int y0, const int y1,
+                   const int padding) {
+  const int width = bitmap.Width();
+  const int height = bitmap.Height();
+  const int padded_width = width + 2 * padding;
+  const int padded_height = y1 - y0;
+  const size_t pixel_size = bitmap.BitsPerPixel() / 8;
+
+  Bitmap padded(FreeImage_AllocateT(bitmap.Type(), padded_width,
+                                    padded_height, bitmap.BitsPerPixel()));
+  for (int y = y0; y < y1; ++y) {
+    const uint8_t* line = FreeImage_GetScanLine(
+        const_cast<FIBITMAP*>(bitmap.Data()), height - 1 - y);
+    uint8_t* padded_line =
+        FreeImage_GetScanLine(padded.Data(), padded_height - 1 - (y - y0));
+    std::memcpy(padded_line, line + (width - padding) * pixel_size,
+                padding * pixel_size);
+    std::memcpy(padded_line + padding * pixel_size, line, width * pixel_size);
+    std::memcpy(padded_line + (padding + width) * pixel_size, line,
+                padding * pixel_size);
+  }
+  return padded;
+}
+
+// Rotation that maps the points `points1` onto `points2` in the least-squares
+// sense, see "Least-Squares Fitting of Two 3-D Point Sets", Arun et al., 1987.
+Eigen::Matrix3d FitRotation(const std::vector<Eigen::Vector3d>& points1,
+                            const std::vector<Eigen::Vector3d>& points2,
+                            const std::vector<size_t>& idxs) {
+  Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+  for (const size_t idx : idxs) {
+    covariance += points1[idx] * points2[idx].transpose();
+  }
+  const Eigen::JacobiSVD<Eigen::Matrix3d> svd(
+      covariance, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  Eigen::Matrix3d sign = Eigen::Matrix3d::Identity();
+  sign(2, 2) = (svd.matrixV() * svd.matrixU().transpose()).determinant() < 0
+                   ? -1
+                   : 1;
+  return svd.matrixV() * sign * svd.matrixU().transpose();
+}
+
+// Indices of the features with the largest scales.
+std::vector<size_t> TopScaleFeatureIdxs(const FeatureKeypoints& keypoints,
+                                        const size_t num_features) {
+  std::vector<size_t> idxs(keypoints.size());
+  std::iota(idxs.begin(), idxs.end(), 0);
+  if (idxs.size() > num_features) {
+    std::partial_sort(idxs.begin(), idxs.begin() + num_features, idxs.end(),
+                      [&](const size_t idx1, const size_t idx2) {
+                        return keypoints[idx1].scale > keypoints[idx2].scale;
+                      });
+    idxs.resize(num_features);
+  }
+  return idxs;
+}
+
+FeatureDescriptors SelectDescriptors(const FeatureDescriptors& descriptors,
+                                     const std::vector<size_t>& idxs) {
+  FeatureDescriptors selected(idxs.size(), descriptors.cols());
+  for (size_t i = 0; i < idxs.size(); ++i) {
+    selected.row(i) = descriptors.row(idxs[i]);
+  }
+  return selected;
+}
+
+// Grid of bearings in latitude/longitude cells for radius queries.
+class BearingGrid {
+ public:
+  BearingGrid(const std::vector<Eigen::Vector3d>& bearings,
+              const double cell_size)
+      : bearings_(bearings) {
+    num_rows_ = std::max(1, static_cast<int>(std::ceil(kPi / cell_size)));
+    num_cols_ = std::max(1, static_cast<int>(std::ceil(2 * kPi / cell_size)));
+    cells_.resize(num_rows_ * num_cols_);
+    for (size_t i = 0; i < bearings.size(); ++i) {
+      double latitude;
+      double longitude;
+      ToSpherical(bearings[i], &latitude, &longitude);
+      cells_[Row(latitude) * num_cols_ + Col(longitude)].push_back(i);
+    }
+  }
+
+  // Call `func(idx)` for all bearings within `radius` of the given bearing.
+  template <typename Func>
+  void Query(const Eigen::Vector3d& bearing, const double radius,
+             const Func& func) const {
+    double latitude;
+    double longitude;
+    ToSpherical(bearing, &latitude, &longitude);
+    const double min_cos = std::cos(radius);
+
+    // The cap around the bearing spans all longitudes if it contains a pole.
+    int col0 = 0;
+    int col1 = num_cols_ - 1;
+    if (std::abs(latitude) + radius < kPi / 2) {
+      const double delta =
+          std::asin(std::min(1.0, std::sin(radius) / std::cos(latitude)));
+      col0 = Col(longitude - delta);
+      col1 = Col(longitude + delta);
+      if (col1 < col0) {
+        col1 += num_cols_;
+      }
+    }
+
+    const int row0 = Row(std::max(-kPi / 2, latitude - radius));
+    const int row1 = Row(std::min(kPi / 2, latitude + radius));
+    for (int row = row1; row <= row0; ++row) {
+      for (int col = col0; col <= col1; ++col) {
+        for (const size_t idx :
+             cells_[row * num_cols_ + col % num_cols_]) {
+          if (bearing.dot(bearings_[idx]) >= min_cos) {
+            func(idx);
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  static void ToSpherical(const Eigen::Vector3d& bearing, double* latitude,
+                          double* longitude) {
+    *latitude = std::asin(std::max(-1.0, std::min(1.0, -bearing.y())));
+    *longitude = std::atan2(bearing.x(), bearing.z());
+  }
+
+  // Rows are ordered from north to south as in the panorama.
+  int Row(const double latitude) const {
+    const int row = static_cast<int>((kPi / 2 - latitude) / kPi * num_rows_);
+    return std::max(0, std::min(num_rows_ - 1, row));
+  }
+
+  int Col(const double longitude) const {
+    const int col = static_cast<int>(
+        std::floor((longitude + kPi) / (2 * kPi) * num_cols_));
+    return ((col % num_cols_) + num_cols_) % num_cols_;
+  }
+
+  const std::vector<Eigen::Vector3d>& bearings_;
+  int num_rows_;
+  int num_cols_;
+  std::vector<std::vector<size_t>> cells_;
+};
+
+std::vector<Eigen::Vector3d> ComputeBearings(const PanoFeatures& features) {
+  std::vector<Eigen::Vector3d> bearings(features.keypoints.size());
+  for (size_t i = 0; i < bearings.size(); ++i) {
+    bearings[i] =
+        PanoPixelToBearing(features.keypoints[i].x, features.keypoints[i].y,
+                           features.width, features.height);
+  }
+  return bearings;
+}
+
+struct BestMatch {
+  int idx = -1;
+  int dist = 0;
+  int second_dist = 0;
+
+  void Update(const int other_idx, const int other_dist) {
+    if (other_dist > dist) {
+      second_dist = dist;
+      dist = other_dist;
+      idx = other_idx;
+    } else if (other_dist > second_dist) {
+      second_dist = other_dist;
+    }
+  }
+
+  // Apply the distance and ratio tests as in `MatchSiftFeaturesCPU`.
+  bool IsValid(const SiftMatchOptions& options) const {
+    // SIFT descriptor vectors are normalized to length 512.
+    const float kDistNorm = 1.0f / (512.0f * 512.0f);
+    if (idx == -1) {
+      return false;
+    }
+    const float dist_normed = std::acos(std::min(kDistNorm * dist, 1.0f));
+    const float second_dist_normed =
+        std::acos(std::min(kDistNorm * second_dist, 1.0f));
+    return dist_normed <= options.max_distance &&
+           dist_normed < options.max_ratio * second_dist_normed;
+  }
+};
+
+// Candidates and their descriptor similarities per feature in the first
+// panorama, collected in parallel.
+template <int kDim>
+std::vector<std::vector<std::pair<int, int>>> CollectMatchCandidates(
+    const PanoFeatures& features1, const PanoFeatures& features2,
+    const std::vector<Eigen::Vector3d>& bearings1,
+    const std::vector<Eigen::Vector3d>& bearings2,
+    const PanoMatchOptions& options) {
+  const SiftDescriptorScorer<kDim> scorer(
+      features1.descriptors, features2.descriptors,
+      options.match_options.reduced_descriptors);
+
+  const bool guided = options.max_angular_distance < 180.0;
+  const double radius = DegToRad(options.max_angular_distance);
+  const BearingGrid grid(bearings2, guided ? radius : kPi);
+  std::vector<std::vector<std::pair<int, int>>> candidates(bearings1.size());
+  ParallelForRange(
+      0, bearings1.size(), options.num_threads, 64,
+      [&](const size_t begin, const size_t end) {
+        for (size_t i1 = begin; i1 < end; ++i1) {
+          const auto AddCandidate = [&](const size_t i2) {
+            candidates[i1].emplace_back(static_cast<int>(i2),
+                                        scorer.Score(i1, i2));
+          };
+          if (guided) {
+            grid.Query(options.rotation * bearings1[i1], radius,
+                       AddCandidate);
+          } else {
+            for (size_t i2 = 0; i2 < bearings2.size(); ++i2) {
+              AddCandidate(i2);
+            }
+          }
+        }
+      });
+  return candidates;
+}
+
+}  // namespace
+
+Eigen::Vector3d PanoPixelToBearing(const double x, const double y,
+                                   const int width, const int height) {
+  const double longitude = 2 * kPi * x / width - kPi;
+  const double latitude = DegToRad(RowToLatitude(y, height));
+  return Eigen::Vector3d(std::cos(latitude) * std::sin(longitude),
+                         -std::sin(latitude),
+                         std::cos(latitude) * std::cos(longitude));
+}
+
+bool ExtractPanoFeatures(const Bitmap& bitmap,
+                         const PanoFeatureOptions& options,
+                         PanoFeatures* features) {
+  const int width = bitmap.Width();
+  const int height = bitmap.Height();
+  if (width <= 0 || height <= 0) {
+    return false;
+  }
+
+  const int padding = std::max(
+      0, std::min(width, static_cast<int>(options.seam_padding * width)));
+  const int y0 = std::max(
+      0, std::min(height / 2, static_cast<int>(std::floor(
+                                  (90.0 - options.skip_latitude) / 180.0 *
+                                  height))));
+  const int y1 = height - y0;
+
+  FeatureKeypoints padded_keypoints;
+  FeatureDescriptors padded_descriptors;
+  if (!ExtractSiftFeaturesCPU(PadPanorama(bitmap, y0, y1, padding),
+                              padded_keypoints, padded_descriptors,
+                              options.sift_options)) {
+    return false;
+  }
+
+  // Map the keypoints into the panorama and remember their distance to the
+  // border of the padded image, which decides among duplicates.
+  const int padded_width = width + 2 * padding;
+  FeatureKeypoints keypoints = padded_keypoints;
+  std::vector<float> border_dists(keypoints.size());
+  for (size_t i = 0; i < keypoints.size(); ++i) {
+    const float padded_x = keypoints[i].x;
+    border_dists[i] = std::min(padded_x, padded_width - padded_x);
+    float x = padded_x - padding;
+    if (x < 0) {
+      x += width;
+    } else if (x >= width) {
+      x -= width;
+    }
+    keypoints[i].x = x;
+    keypoints[i].y += y0;
+  }
+
+  // Features near the seam are detected twice, once on either side. Compare
+  // them with a sweep over their rows and keep the copy farther from the
+  // border of the padded image.
+  const float radius = static_cast<float>(options.duplicate_radius);
+  std::vector<size_t> seam_idxs;
+  for (size_t i = 0; i < keypoints.size(); ++i) {
+    if (keypoints[i].x < padding + radius ||
+        keypoints[i].x > width - padding - radius) {
+      seam_idxs.push_back(i);
+    }
+  }
+  std::sort(seam_idxs.begin(), seam_idxs.end(),
+            [&](const size_t idx1, const size_t idx2) {
+              return keypoints[idx1].y < keypoints[idx2].y;
+            });
+
+  std::vector<bool> is_duplicate(keypoints.size(), false);
+  for (size_t i = 0; i < seam_idxs.size(); ++i) {
+    const FeatureKeypoint& keypoint1 = keypoints[seam_idxs[i]];
+    for (size_t j = i + 1; j < seam_idxs.size(); ++j) {
+      const FeatureKeypoint& keypoint2 = keypoints[seam_idxs[j]];
+      if (keypoint2.y - keypoint1.y > radius) {
+        break;
+      }
+      float dx = std::abs(keypoint1.x - keypoint2.x);
+      dx = std::min(dx, width - dx);
+      const float scale_ratio = keypoint1.scale / keypoint2.scale;
+      if (dx > radius || scale_ratio > 1.2f || scale_ratio < 1 / 1.2f ||
+          AngleDifference(keypoint1.orientation, keypoint2.orientation) >
+              0.2f) {
+        continue;
+      }
+      if (border_dists[seam_idxs[i]] < border_dists[seam_idxs[j]]) {
+        is_duplicate[seam_idxs[i]] = true;
+      } else {
+        is_duplicate[seam_idxs[j]] = true;
+      }
+    }
+  }
+
+  const size_t num_features =
+      std::count(is_duplicate.begin(), is_duplicate.end(), false);
+  features->width = width;
+  features->height = height;
+  features->keypoints.clear();
+  features->keypoints.reserve(num_features);
+  features->descriptors.resize(num_features, padded_descriptors.cols());
+  features->weights.clear();
+  features->weights.reserve(num_features);
+  for (size_t i = 0; i < keypoints.size(); ++i) {
+    if (is_duplicate[i]) {
+      continue;
+    }
+    features->descriptors.row(features->keypoints.size()) =
+        padded_descriptors.row(i);
+    features->keypoints.push_back(keypoints[i]);
+    const double latitude = RowToLatitude(keypoints[i].y, height);
+    features->weights.push_back(std::abs(latitude) > options.polar_latitude
+                                    ? static_cast<float>(options.polar_weight)
+                                    : 1.0f);
+  }
+
+  return true;
+}
+
+bool EstimatePanoRotation(const PanoFeatures& features1,
+                          const PanoFeatures& features2,
+                          const PanoMatchOptions& options,
+                          Eigen::Matrix3d* rotation) {
+  const std::vector<size_t> idxs1 = TopScaleFeatureIdxs(
+      features1.keypoints, options.num_rotation_features);
+  const std::vector<size_t> idxs2 = TopScaleFeatureIdxs(
+      features2.keypoints, options.num_rotation_features);
+
+  FeatureMatches matches;
+  MatchSiftFeaturesCPU(options.match_options,
+                       SelectDescriptors(features1.descriptors, idxs1),
+                       SelectDescriptors(features2.descriptors, idxs2),
+                       matches);
+  const size_t min_num_inliers =
+      static_cast<size_t>(std::max(3, options.match_options.min_num_inliers));
+  if (matches.size() < min_num_inliers) {
+    return false;
+  }
+
+  std::vector<Eigen::Vector3d> bearings1(matches.size());
+  std::vector<Eigen::Vector3d> bearings2(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const FeatureKeypoint& keypoint1 =
+        features1.keypoints[idxs1[matches[i].point2D_idx1]];
+    const FeatureKeypoint& keypoint2 =
+        features2.keypoints[idxs2[matches[i].point2D_idx2]];
+    bearings1[i] = PanoPixelToBearing(keypoint1.x, keypoint1.y,
+                                      features1.width, features1.height);
+    bearings2[i] = PanoPixelToBearing(keypoint2.x, keypoint2.y,
+                                      features2.width, features2.height);
+  }
+
+  // Parallax between the panoramas leaves residuals, which are tolerated up
+  // to half of the guided search radius.
+  const double min_cos =
+      std::cos(DegToRad(std::min(90.0, options.max_angular_distance / 2)));
+  const auto FindInliers = [&](const Eigen::Matrix3d& R) {
+    std::vector<size_t> inlier_idxs;
+    for (size_t i = 0; i < matches.size(); ++i) {
+      if ((R * bearings1[i]).dot(bearings2[i]) >= min_cos) {
+        inlier_idxs.push_back(i);
+      }
+    }
+    return inlier_idxs;
+  };
+
+  std::mt19937 random_engine(0);
+  std::uniform_int_distribution<size_t> distribution(0, matches.size() - 1);
+  std::vector<size_t> best_inlier_idxs;
+  for (int trial = 0; trial < options.num_rotation_trials; ++trial) {
+    std::vector<size_t> sample_idxs(3);
+    for (size_t& idx : sample_idxs) {
+      idx = distribution(random_engine);
+    }
+    std::vector<size_t> inlier_idxs =
+        FindInliers(FitRotation(bearings1, bearings2, sample_idxs));
+    if (inlier_idxs.size() > best_inlier_idxs.size()) {
+      best_inlier_idxs.swap(inlier_idxs);
+    }
+  }
+
+  if (best_inlier_idxs.size() < min_num_inliers) {
+    return false;
+  }
+
+  *rotation = FitRotation(bearings1, bearings2, best_inlier_idxs);
+  return true;
+}
+
+void MatchPanoFeatures(const PanoFeatures& features1,
+                       const PanoFeatures& features2,
+                       const PanoMatchOptions& options,
+                       FeatureMatches* matches,
+                       std::vector<float>* match_weights) {
+  matches->clear();
+  if (match_weights != nullptr) {
+    match_weights->clear();
+  }
+
+  const size_t num_features1 = features1.keypoints.size();
+  const size_t num_features2 = features2.keypoints.size();
+  const std::vector<Eigen::Vector3d> bearings1 = ComputeBearings(features1);
+  const std::vector<Eigen::Vector3d> bearings2 = ComputeBearings(features2);
+
+  const bool reduced = options.match_options.reduced_descriptors;
+  const Eigen::DenseIndex dim = features1.descriptors.cols();
+  if (features2.descriptors.cols() != dim || (!reduced && dim != 128)) {
+    return;
+  }
+  const std::vector<std::vector<std::pair<int, int>>> candidates =
+      dim == 128 ? CollectMatchCandidates<128>(features1, features2, bearings1,
+                                               bearings2, options)
+                 : CollectMatchCandidates<Eigen::Dynamic>(
+                       features1, features2, bearings1, bearings2, options);
+
+  std::vector<BestMatch> best_matches12(num_features1);
+  std::vector<BestMatch> best_matches21(num_features2);
+  for (size_t i1 = 0; i1 < num_features1; ++i1) {
+    for (const auto& candidate : candidates[i1]) {
+      best_matches12[i1].Update(candidate.first, candidate.second);
+      best_matches21[candidate.first].Update(static_cast<int>(i1),
+                                             candidate.second);
+    }
+  }
+
+  const SiftMatchOptions& match_options = options.match_options;
+  for (size_t i1 = 0; i1 < num_features1; ++i1) {
+    if (matches->size() >=
+        static_cast<size_t>(match_options.max_num_matches)) {
+      break;
+    }
+    const BestMatch& best_match12 = best_matches12[i1];
+    if (!best_match12.IsValid(match_options)) {
+      continue;
+    }
+    if (match_options.cross_check) {
+      const BestMatch& best_match21 = best_matches21[best_match12.idx];
+      if (!best_match21.IsValid(match_options) ||
+          best_match21.idx != static_cast<int>(i1)) {
+        continue;
+      }
+    }
+
+    FeatureMatch match;
+    match.point2D_idx1 = static_cast<point2D_t>(i1);
+    match.point2D_idx2 = static_cast<point2D_t>(best_match12.idx);
+    matches->push_back(match);
+    if (match_weights != nullptr) {
+      match_weights->push_back(std::min(features1.weights[i1],
+                                        features2.weights[best_match12.idx]));
+    }
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef COLMAP_SRC_BASE_PANO_MATCHING_H_
+#define COLMAP_SRC_BASE_PANO_MATCHING_H_
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "bitmap.h"
+#include "feature.h"
+#include "feature_extraction.h"
+#include "feature_matching.h"
+
+// Feature extraction and matching for equirectangular panoramas, whose left
+// and right borders meet at the 0/360 degree seam and whose top and bottom
+// rows are stretched to the poles:
+//
+//    PanoFeatures features1, features2;
+//    ExtractPanoFeatures(bitmap1, PanoFeatureOptions(), &features1);
+//    ExtractPanoFeatures(bitmap2, PanoFeatureOptions(), &features2);
+//    PanoMatchOptions match_options;
+//    EstimatePanoRotation(features1, features2, match_options,
+//                         &match_options.rotation);
+//    FeatureMatches matches;
+//    MatchPanoFeatures(features1, features2, match_options, &matches);
+//
+
+struct PanoFeatureOptions {
+  SiftOptions sift_options;
+
+  // Width of the padding, as a fraction of the panorama width, that is
+  // wrapped around from the opposite border before extraction, so that
+  // features on the seam see their complete neighborhood.
+  double seam_padding = 0.05;
+
+  // Rows above this absolute latitude in degrees are not used for extraction,
+  // since they are heavily distorted and cost time for few useful features.
+  double skip_latitude = 80.0;
+
+  // Features above this absolute latitude in degrees get `polar_weight`
+  // instead of 1 as their weight.
+  double polar_latitude = 60.0;
+  double polar_weight = 0.5;
+
+  // Features that are detected twice, on the seam and in its padded copy, are
+  // merged if their positions differ by at most this many pixels.
+  double duplicate_radius = 1.5;
+};
+
+// Features of an equirectangular panorama with keypoints in the pixel
+// coordinates of the complete panorama.
+struct PanoFeatures {
+  int width = 0;
+  int height = 0;
+
+  FeatureKeypoints keypoints;
+  FeatureDescriptors descriptors;
+
+  // Weight per feature in the range [0, 1], which is lower in polar bands.
+  std::vector<float> weights;
+};
+
+struct PanoMatchOptions {
+  SiftMatchOptions match_options;
+
+  // Maximum angle in degrees between the bearing of a feature, rotated into
+  // the second panorama, and the bearings of its match candidates. Values of
+  // 180 or more evaluate all pairs of features.
+  double max_angular_distance = 20.0;
+
+  // Rotation of bearings from the first into the second panorama.
+  Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity();
+
+  // Number of the largest-scale features per panorama and the number of
+  // RANSAC trials used to estimate the rotation.
+  int num_rotation_features = 1024;
+  int num_rotation_trials = 500;
+
+  // The number of threads to evaluate match candidates.
+  int num_threads = -1;
+};
+
+// Convert pixel coordinates of an equirectangular panorama to a unit bearing
+// vector with x pointing right, y down and z forward, where the center of the
+// panorama looks forward.
+Eigen::Vector3d PanoPixelToBearing(const double x, const double y,
+                                   const int width, const int height);
+
+// Extract SIFT features from a panorama with wrap-around padding at the seam,
+// skipping the polar bands.
+bool ExtractPanoFeatures(const Bitmap& bitmap,
+                         const PanoFeatureOptions& options,
+                         PanoFeatures* features);
+
+// Estimate the rotation between two panoramas taken at nearby positions from
+// matches of their largest-scale features with RANSAC. Returns false if
+// fewer than `match_options.min_num_inliers` matches agree.
+bool EstimatePanoRotation(const PanoFeatures& features1,
+                          const PanoFeatures& features2,
+                          const PanoMatchOptions& options,
+                          Eigen::Matrix3d* rotation);
+
+// Match panorama features, only evaluating candidates whose bearings are
+// within `max_angular_distance` after rotating by `rotation`. The weight of a
+// match is the minimum of the weights of its features.
+void MatchPanoFeatures(const PanoFeatures& features1,
+                       const PanoFeatures& features2,
+                       const PanoMatchOptions& options,
+                       FeatureMatches* matches,
+                       std::vector<float>* match_weights = nullptr);
+
+#endif  // COLMAP_SRC_BASE_PANO_MATCHING_H_
@@ -0,0 +1,43 @@
+#include "pipeline.h"
+
+Pipeline::Pipeline() : stopped_(false) {}
+
+Pipeline::~Pipeline() { Stop(); }
+
+void Pipeline::Start() {
+  for (auto& stage : stages_) {
+    for (int i = 0; i < stage->stats.num_workers; ++i) {
+      workers_.emplace_back(stage->worker_func);
+    }
+  }
+}
+
+void Pipeline::Wait() {
+  for (auto& worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+}
+
+void Pipeline::Stop() {
+  stopped_ = true;
+  for (auto& stage : stages_) {
+    for (const auto& close_queue : stage->close_queues) {
+      close_queue();
+    }
+  }
+  Wait();
+}
+
+std::vector<PipelineStageStats> Pipeline::Stats() const {
+  std::vector<PipelineStageStats> stats;
+  stats.reserve(stages_.size());
+  for (const auto& stage : stages_) {
+    stats.push_back(stage->stats);
+    stats.back().num_processed = stage->num_processed;
+    stats.back().busy_seconds = 1e-9 * stage->busy_nanoseconds;
+  }
+  return stats;
+}
@@ -0,0 +1,169 @@
+#ifndef COLMAP_SRC_UTIL_PIPELINE_H_
+#define COLMAP_SRC_UTIL_PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "threading.h"
+
+struct PipelineStageStats {
+  std::string name;
+  int num_workers = 0;
+
+  // Number of input items processed by the stage.
+  size_t num_processed = 0;
+
+  // Accumulated time of all workers spent processing items, including the
+  // time blocked on a full output queue.
+  double busy_seconds = 0;
+};
+
+// Chain of stages that run concurrently on their own worker threads and pass
+// items through bounded queues. A full queue blocks the stages feeding it, so
+// that the number of items in flight, and thus memory, stays bounded:
+//
+//    BoundedQueue<std::string> paths(16);
+//    BoundedQueue<Bitmap> bitmaps(4);
+//    Pipeline pipeline;
+//    pipeline.AddStage<std::string, Bitmap>(
+//        "decode", 2, &paths, &bitmaps,
+//        [](std::string& path, BoundedQueue<Bitmap>* output) {
+//          Bitmap bitmap;
+//          if (bitmap.Read(path)) {
+//            output->Push(std::move(bitmap));
+//          }
+//        });
+//    pipeline.AddSink<Bitmap>("process", 1, &bitmaps,
+//                             [](Bitmap& bitmap) { /* Process bitmap */ });
+//    pipeline.Start();
+//    for (const auto& path : image_paths) {
+//      paths.Push(path);
+//    }
+//    paths.Close();
+//    pipeline.Wait();
+//
+// The queues are owned by the caller and must outlive the pipeline. The
+// output queue of a stage is closed after all its workers processed the last
+// item of the closed input queue, which shuts down the pipeline stage by
+// stage.
+class Pipeline {
+ public:
+  Pipeline();
+  ~Pipeline();
+
+  // Add a stage with `num_workers` threads, which call `func` for every item
+  // of `input`. The function pushes zero or more items to `output`. If
+  // `num_workers <= 0`, the number of hardware threads is used.
+  template <typename Input, typename Output>
+  void AddStage(const std::string& name, const int num_workers,
+                BoundedQueue<Input>* input, BoundedQueue<Output>* output,
+                const std::function<void(Input&, BoundedQueue<Output>*)>&
+                    func);
+
+  // Add a final stage without output queue.
+  template <typename Input>
+  void AddSink(const std::string& name, const int num_workers,
+               BoundedQueue<Input>* input,
+               const std::function<void(Input&)>& func);
+
+  // Start the workers of all stages.
+  void Start();
+
+  // Wait until all stages finished.
+  void Wait();
+
+  // Close all queues, so that the stages finish after their current items,
+  // and wait for the workers.
+  void Stop();
+
+  // Whether `Stop` was called.
+  inline bool IsStopped() const;
+
+  std::vector<PipelineStageStats> Stats() const;
+
+ private:
+  struct Stage {
+    PipelineStageStats stats;
+    std::function<void()> worker_func;
+    std::vector<std::function<void()>> close_queues;
+    std::atomic<size_t> num_processed;
+    std::atomic<int64_t> busy_nanoseconds;
+    std::atomic<int> num_active_workers;
+  };
+
+  template <typename Input>
+  void AddStageImpl(const std::string& name, const int num_workers,
+                    BoundedQueue<Input>* input,
+                    const std::function<void(Input&)>& func,
+                    const std::function<void()>& close_output);
+
+  std::vector<std::unique_ptr<Stage>> stages_;
+  std::vector<std::thread> workers_;
+  std::atomic<bool> stopped_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Input, typename Output>
+void Pipeline::AddStage(
+    const std::string& name, const int num_workers,
+    BoundedQueue<Input>* input, BoundedQueue<Output>* output,
+    const std::function<void(Input&, BoundedQueue<Output>*)>& func) {
+  AddStageImpl<Input>(name, num_workers, input,
+                      [func, output](Input& item) { func(item, output); },
+                      [output]() { output->Close(); });
+}
+
+template <typename Input>
+void Pipeline::AddSink(const std::string& name, const int num_workers,
+                       BoundedQueue<Input>* input,
+                       const std::function<void(Input&)>& func) {
+  AddStageImpl<Input>(name, num_workers, input, func, []() {});
+}
+
+template <typename Input>
+void Pipeline::AddStageImpl(const std::string& name, const int num_workers,
+                            BoundedQueue<Input>* input,
+                            const std::function<void(Input&)>& func,
+                            const std::function<void()>& close_output) {
+  std::unique_ptr<Stage> stage(new Stage());
+  stage->stats.name = name;
+  stage->stats.num_workers = GetEffectiveNumThreads(num_workers);
+  stage->num_processed = 0;
+  stage->busy_nanoseconds = 0;
+  stage->num_active_workers = stage->stats.num_workers;
+  stage->close_queues.push_back([input]() { input->Close(); });
+  stage->close_queues.push_back(close_output);
+
+  Stage* stage_ptr = stage.get();
+  stage->worker_func = [this, stage_ptr, input, func, close_output]() {
+    Input item;
+    while (!IsStopped() && input->Pop(&item)) {
+      const auto start_time = std::chrono::steady_clock::now();
+      func(item);
+      stage_ptr->busy_nanoseconds +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_time)
+              .count();
+      stage_ptr->num_processed += 1;
+    }
+    // The last worker to finish signals the end of input to the next stage.
+    if (--stage_ptr->num_active_workers == 0) {
+      close_output();
+    }
+  };
+
+  stages_.push_back(std::move(stage));
+}
+
+bool Pipeline::IsStopped() const { return stopped_; }
+
+#endif  // COLMAP_SRC_UTIL_PIPELINE_H_
@@ -0,0 +1,313 @@
+#include "product_quantizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include "VLFeat/kmeans.h"
+#include "threading.h"
+
+ProductQuantizer::ProductQuantizer() : num_subspaces_(0), subspace_dim_(0) {}
+
+bool ProductQuantizer::Train(const ProductQuantizerOptions& options,
+                             const DescriptorLoader& loader) {
+  num_subspaces_ = 0;
+  subspace_dim_ = 0;
+  centroids_.resize(0, 0);
+  centroid_squared_norms_.resize(0);
+
+  const size_t num_images = loader.NumImages();
+  const size_t num_train_images =
+      std::min(num_images, options.max_num_training_images);
+  if (num_train_images == 0 || options.num_subspaces <= 0) {
+    return false;
+  }
+
+  // Sample the same number of descriptors from every image.
+  const size_t max_num_samples = std::max<size_t>(
+      1, options.max_num_training_descriptors / num_train_images);
+  std::vector<FeatureDescriptors> samples(num_train_images);
+  ParallelForRange(
+      0, num_train_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        for (size_t i = begin; i < end; ++i) {
+          const size_t image_idx = i * num_images / num_train_images;
+          if (!loader.Load(image_idx, &descriptors)) {
+            continue;
+          }
+          std::vector<FeatureDescriptors::Index> rows(descriptors.rows());
+          std::iota(rows.begin(), rows.end(), 0);
+          std::mt19937 random_engine(static_cast<unsigned>(i));
+          std::shuffle(rows.begin(), rows.end(), random_engine);
+          rows.resize(std::min(rows.size(), max_num_samples));
+          samples[i].resize(rows.size(), descriptors.cols());
+          for (size_t j = 0; j < rows.size(); ++j) {
+            samples[i].row(j) = descriptors.row(rows[j]);
+          }
+        }
+      });
+
+  size_t num_samples = 0;
+  FeatureDescriptors::Index dim = 0;
+  for (const auto& image_samples : samples) {
+    num_samples += image_samples.rows();
+    dim = std::max(dim, image_samples.cols());
+  }
+  FeatureDescriptors training_descriptors(num_samples, dim);
+  num_samples = 0;
+  for (const auto& image_samples : samples) {
+    if (image_samples.cols() == dim) {
+      training_descriptors.middleRows(num_samples, image_samples.rows()) =
+          image_samples;
+      num_samples += image_samples.rows();
+    }
+  }
+  training_descriptors.conservativeResize(num_samples, dim);
+  samples.clear();
+  if (num_samples < static_cast<size_t>(kNumCentroids) ||
+      dim % options.num_subspaces != 0) {
+    return false;
+  }
+
+  const int subspace_dim = static_cast<int>(dim) / options.num_subspaces;
+  centroids_.resize(options.num_subspaces * kNumCentroids, subspace_dim);
+  RowMajorMatrixXf subvectors(num_samples, subspace_dim);
+  for (int m = 0; m < options.num_subspaces; ++m) {
+    subvectors = training_descriptors.middleCols(m * subspace_dim,
+                                                 subspace_dim)
+                     .cast<float>();
+    VlKMeans* kmeans = vl_kmeans_new(VL_TYPE_FLOAT, VlDistanceL2);
+    vl_kmeans_set_algorithm(kmeans, VlKMeansElkan);
+    vl_kmeans_set_initialization(kmeans, VlKMeansPlusPlus);
+    vl_kmeans_set_max_num_iterations(kmeans, options.max_num_iterations);
+    vl_kmeans_cluster(kmeans, subvectors.data(), subspace_dim, num_samples,
+                      kNumCentroids);
+    centroids_.middleRows(m * kNumCentroids, kNumCentroids) =
+        Eigen::Map<const RowMajorMatrixXf>(
+            static_cast<const float*>(vl_kmeans_get_centers(kmeans)),
+            kNumCentroids, subspace_dim);
+    vl_kmeans_delete(kmeans);
+  }
+
+  num_subspaces_ = options.num_subspaces;
+  subspace_dim_ = subspace_dim;
+  centroid_squared_norms_ = centroids_.rowwise().squaredNorm();
+
+  return true;
+}
+
+bool ProductQuantizer::IsTrained() const { return num_subspaces_ > 0; }
+
+int ProductQuantizer::NumSubspaces() const { return num_subspaces_; }
+
+int ProductQuantizer::NumDimensions() const {
+  return num_subspaces_ * subspace_dim_;
+}
+
+void ProductQuantizer::Encode(const FeatureDescriptors& descriptors,
+                              FeatureCodes* codes) const {
+  codes->resize(descriptors.rows(), num_subspaces_);
+  if (descriptors.rows() == 0 || descriptors.cols() != NumDimensions()) {
+    codes->resize(0, num_subspaces_);
+    return;
+  }
+
+  // The nearest centroid minimizes |c|^2 - 2 x^T c, which is computed for
+  // all subvectors of a subspace by one matrix product.
+  RowMajorMatrixXf subvectors;
+  Eigen::MatrixXf scores;
+  for (int m = 0; m < num_subspaces_; ++m) {
+    subvectors =
+        descriptors.middleCols(m * subspace_dim_, subspace_dim_).cast<float>();
+    scores.noalias() =
+        -2 * subvectors *
+        centroids_.middleRows(m * kNumCentroids, kNumCentroids).transpose();
+    scores.rowwise() +=
+        centroid_squared_norms_.segment(m * kNumCentroids, kNumCentroids)
+            .transpose();
+    for (Eigen::DenseIndex i = 0; i < scores.rows(); ++i) {
+      Eigen::DenseIndex centroid_idx;
+      scores.row(i).minCoeff(&centroid_idx);
+      (*codes)(i, m) = static_cast<uint8_t>(centroid_idx);
+    }
+  }
+}
+
+void ProductQuantizer::Decode(const FeatureCodes& codes,
+                              FeatureDescriptors* descriptors) const {
+  descriptors->resize(codes.rows(), NumDimensions());
+  for (FeatureCodes::Index i = 0; i < codes.rows(); ++i) {
+    for (int m = 0; m < num_subspaces_; ++m) {
+      const auto centroid = centroids_.row(m * kNumCentroids + codes(i, m));
+      for (int d = 0; d < subspace_dim_; ++d) {
+        (*descriptors)(i, m * subspace_dim_ + d) = static_cast<uint8_t>(
+            std::min(255.0f, std::max(0.0f, std::round(centroid(d)))));
+      }
+    }
+  }
+}
+
+void ProductQuantizer::ComputeDistanceTable(const uint8_t* descriptor,
+                                            float* table) const {
+  Eigen::RowVectorXf subvector(subspace_dim_);
+  for (int m = 0; m < num_subspaces_; ++m) {
+    for (int d = 0; d < subspace_dim_; ++d) {
+      subvector(d) = descriptor[m * subspace_dim_ + d];
+    }
+    Eigen::Map<Eigen::VectorXf>(table + m * kNumCentroids, kNumCentroids) =
+        (centroids_.middleRows(m * kNumCentroids, kNumCentroids).rowwise() -
+         subvector)
+            .rowwise()
+            .squaredNorm();
+  }
+}
+
+ProductQuantizer::RowMajorMatrixXf
+ProductQuantizer::ComputeAsymmetricDistances(
+    const FeatureDescriptors& descriptors, const FeatureCodes& codes) const {
+  RowMajorMatrixXf dists(descriptors.rows(), codes.rows());
+  if (descriptors.cols() != NumDimensions() ||
+      codes.cols() != num_subspaces_) {
+    dists.setConstant(std::numeric_limits<float>::max());
+    return dists;
+  }
+
+  std::vector<float> table(num_subspaces_ * kNumCentroids);
+  for (FeatureDescriptors::Index i = 0; i < descriptors.rows(); ++i) {
+    ComputeDistanceTable(descriptors.data() + i * descriptors.cols(),
+                         table.data());
+    for (FeatureCodes::Index j = 0; j < codes.rows(); ++j) {
+      const uint8_t* code = codes.data() + j * num_subspaces_;
+      const float* subspace_table = table.data();
+      float dist = 0;
+      for (int m = 0; m < num_subspaces_; ++m) {
+        dist += subspace_table[code[m]];
+        subspace_table += kNumCentroids;
+      }
+      dists(i, j) = dist;
+    }
+  }
+
+  return dists;
+}
+
+bool ProductQuantizer::Write(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  const uint32_t header[2] = {static_cast<uint32_t>(num_subspaces_),
+                              static_cast<uint32_t>(NumDimensions())};
+  const size_t num_values = static_cast<size_t>(centroids_.size());
+  bool success =
+      fwrite(header, sizeof(uint32_t), 2, file) == 2 &&
+      fwrite(centroids_.data(), sizeof(float), num_values, file) == num_values;
+  success = fclose(file) == 0 && success;
+  return success;
+}
+
+bool ProductQuantizer::Read(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  uint32_t header[2];
+  bool success = fread(header, sizeof(uint32_t), 2, file) == 2 &&
+                 header[0] > 0 && header[1] % header[0] == 0;
+  if (success) {
+    num_subspaces_ = static_cast<int>(header[0]);
+    subspace_dim_ = static_cast<int>(header[1] / header[0]);
+    centroids_.resize(num_subspaces_ * kNumCentroids, subspace_dim_);
+    const size_t num_values = static_cast<size_t>(centroids_.size());
+    success = fread(centroids_.data(), sizeof(float), num_values, file) ==
+              num_values;
+  }
+  fclose(file);
+
+  if (success) {
+    centroid_squared_norms_ = centroids_.rowwise().squaredNorm();
+  } else {
+    num_subspaces_ = 0;
+    subspace_dim_ = 0;
+    centroids_.resize(0, 0);
+  }
+  return success;
+}
+
+void MatchProductQuantizedFeatures(const SiftMatchOptions& match_options,
+                                   const ProductQuantizer& quantizer,
+                                   const FeatureDescriptors& descriptors1,
+                                   const FeatureCodes& codes2,
+                                   const FeatureDescriptors* descriptors2,
+                                   const int num_rerank_candidates,
+                                   FeatureMatches* matches) {
+  ProductQuantizer::RowMajorMatrixXf squared_dists =
+      quantizer.ComputeAsymmetricDistances(descriptors1, codes2);
+
+  if (descriptors2 != nullptr && num_rerank_candidates > 0 &&
+      descriptors2->rows() == codes2.rows() &&
+      descriptors2->cols() == descriptors1.cols()) {
+    // Collect the candidates of both matching directions before any
+    // distance is replaced by its exact value.
+    std::vector<std::pair<Eigen::DenseIndex, Eigen::DenseIndex>> candidates;
+    const auto CollectCandidates = [&](const Eigen::DenseIndex num_idxs,
+                                       const bool transpose) {
+      const Eigen::DenseIndex num_other_idxs =
+          transpose ? squared_dists.rows() : squared_dists.cols();
+      const Eigen::DenseIndex num_candidates = std::min<Eigen::DenseIndex>(
+          num_rerank_candidates, num_other_idxs);
+      std::vector<Eigen::DenseIndex> other_idxs(num_other_idxs);
+      for (Eigen::DenseIndex idx = 0; idx < num_idxs; ++idx) {
+        const auto Dist = [&](const Eigen::DenseIndex other_idx) {
+          return transpose ? squared_dists(other_idx, idx)
+                           : squared_dists(idx, other_idx);
+        };
+        std::iota(other_idxs.begin(), other_idxs.end(), 0);
+        std::nth_element(other_idxs.begin(),
+                         other_idxs.begin() + num_candidates - 1,
+                         other_idxs.end(),
+                         [&](const Eigen::DenseIndex idx1,
+                             const Eigen::DenseIndex idx2) {
+                           return Dist(idx1) < Dist(idx2);
+                         });
+        for (Eigen::DenseIndex k = 0; k < num_candidates; ++k) {
+          if (transpose) {
+            candidates.emplace_back(other_idxs[k], idx);
+          } else {
+            candidates.emplace_back(idx, other_idxs[k]);
+          }
+        }
+      }
+    };
+    if (squared_dists.size() > 0) {
+      CollectCandidates(squared_dists.rows(), false);
+      if (match_options.cross_check) {
+        CollectCandidates(squared_dists.cols(), true);
+      }
+    }
+
+    for (const auto& candidate : candidates) {
+      squared_dists(candidate.first, candidate.second) = static_cast<float>(
+          (descriptors1.row(candidate.first).cast<int>() -
+           descriptors2->row(candidate.second).cast<int>())
+              .squaredNorm());
+    }
+  }
+
+  // Convert the squared distances to the dot products of the SIFT matcher,
+  // i.e. x^T y = (|x|^2 + |y|^2 - |x - y|^2) / 2 with |x| = |y| = 512.
+  const float kSquaredNorm = 512.0f * 512.0f;
+  const Eigen::MatrixXi dists =
+      ((kSquaredNorm - 0.5f * squared_dists.array()).max(0.0f) + 0.5f)
+          .cast<int>()
+          .matrix();
+
+  FindBestMatches(dists, match_options.max_ratio, match_options.max_distance,
+                  match_options.cross_check, *matches);
+}
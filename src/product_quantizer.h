@@ -0,0 +1,113 @@
+#ifndef COLMAP_SRC_BASE_PRODUCT_QUANTIZER_H_
+#define COLMAP_SRC_BASE_PRODUCT_QUANTIZER_H_
+
+#include <string>
+
+#include <Eigen/Core>
+
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_matching.h"
+
+// Product quantization codes with one row of `NumSubspaces()` centroid
+// indices per descriptor. Codes have the same layout as descriptors, so that
+// they can be stored with `WriteFeaturesToBinaryFile` and loaded by
+// `BinaryFileDescriptorLoader`, where DIM is the number of subspaces.
+typedef FeatureDescriptors FeatureCodes;
+
+struct ProductQuantizerOptions {
+  // Number of subspaces and thus bytes per code, which must divide the
+  // descriptor dimension, e.g. 8 or 16 for 128-byte SIFT descriptors.
+  int num_subspaces = 16;
+
+  // Maximum number of images to train on and maximum number of descriptors
+  // sampled from them.
+  size_t max_num_training_images = 1000;
+  size_t max_num_training_descriptors = 100000;
+
+  int max_num_iterations = 25;
+
+  // Number of threads to load the training images. The k-means of the
+  // subspaces use the OpenMP threads of VLFeat. If `num_threads <= 0`, the
+  // number of hardware threads is used.
+  int num_threads = -1;
+};
+
+// Compresses descriptors by splitting them into subvectors, which are
+// quantized independently to one of 256 centroids of their subspace, see
+// "Product Quantization for Nearest Neighbor Search", Jegou et al., PAMI
+// 2011. The squared distance between a raw descriptor and a code is
+// approximated by the sum of the squared distances of the subvectors of the
+// descriptor to the centroids of the code, which are looked up in a
+// per-descriptor table.
+class ProductQuantizer {
+ public:
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor>
+      RowMajorMatrixXf;
+
+  static const int kNumCentroids = 256;
+
+  ProductQuantizer();
+
+  // Train the centroids of every subspace by k-means on a uniform subset of
+  // the descriptors of the images.
+  bool Train(const ProductQuantizerOptions& options,
+             const DescriptorLoader& loader);
+
+  bool IsTrained() const;
+  int NumSubspaces() const;
+  int NumDimensions() const;
+
+  // Quantize every subvector to its nearest centroid. Thread-safe.
+  void Encode(const FeatureDescriptors& descriptors,
+              FeatureCodes* codes) const;
+
+  // Reconstruct the descriptors from the centroids of the codes.
+  void Decode(const FeatureCodes& codes,
+              FeatureDescriptors* descriptors) const;
+
+  // Squared distances of the subvectors of the descriptor to all centroids
+  // of their subspace, stored as `NumSubspaces() x kNumCentroids` table.
+  void ComputeDistanceTable(const uint8_t* descriptor, float* table) const;
+
+  // Squared distances of the descriptors to the codes by table lookups, or
+  // the maximum float value if their dimensions do not match the quantizer.
+  RowMajorMatrixXf ComputeAsymmetricDistances(
+      const FeatureDescriptors& descriptors,
+      const FeatureCodes& codes) const;
+
+  // The file format is:
+  //
+  //    uint32 NUM_SUBSPACES uint32 DIM
+  //    NUM_SUBSPACES x 256 x (DIM / NUM_SUBSPACES) x float CENTROID
+  //
+  // with values stored in the byte order of the host.
+  bool Write(const std::string& path) const;
+  bool Read(const std::string& path);
+
+ private:
+  int num_subspaces_;
+  int subspace_dim_;
+
+  // Centroids of the subspaces, `kNumCentroids` consecutive rows per
+  // subspace, and their squared norms.
+  RowMajorMatrixXf centroids_;
+  Eigen::VectorXf centroid_squared_norms_;
+};
+
+// Match the raw descriptors of the first image against the codes of the
+// second image by their asymmetric distances, where the distance and ratio
+// tests of the options are applied as in `MatchSiftFeaturesCPU`. If the raw
+// descriptors of the second image are given, the `num_rerank_candidates`
+// nearest candidates by code distance of every descriptor in either image
+// are re-ranked by their exact distances.
+void MatchProductQuantizedFeatures(const SiftMatchOptions& match_options,
+                                   const ProductQuantizer& quantizer,
+                                   const FeatureDescriptors& descriptors1,
+                                   const FeatureCodes& codes2,
+                                   const FeatureDescriptors* descriptors2,
+                                   const int num_rerank_candidates,
+                                   FeatureMatches* matches);
+
+#endif  // COLMAP_SRC_BASE_PRODUCT_QUANTIZER_H_
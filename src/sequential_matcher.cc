@@ -0,0 +1,204 @@
+#include "sequential_matcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <utility>
+
+#include "threading.h"
+
+namespace {
+
+struct Frame {
+  size_t image_idx = 0;
+  bool loaded = false;
+  FeatureDescriptors descriptors;
+};
+
+Frame LoadFrame(const DescriptorLoader& loader, const size_t image_idx) {
+  Frame frame;
+  frame.image_idx = image_idx;
+  frame.loaded = loader.Load(image_idx, &frame.descriptors);
+  return frame;
+}
+
+}  // namespace
+
+MeanDescriptorLoopDetector::MeanDescriptorLoopDetector(
+    const double min_similarity)
+    : min_similarity_(min_similarity) {}
+
+void MeanDescriptorLoopDetector::Add(const size_t image_idx,
+                                     const FeatureDescriptors& descriptors) {
+  if (descriptors.rows() == 0) {
+    return;
+  }
+  image_idxs_.push_back(image_idx);
+  global_descriptors_.push_back(ComputeGlobalDescriptor(descriptors));
+  if (descriptor_sum_.size() == 0) {
+    descriptor_sum_ = global_descriptors_.back();
+  } else {
+    descriptor_sum_ += global_descriptors_.back();
+  }
+}
+
+void MeanDescriptorLoopDetector::Query(const FeatureDescriptors& descriptors,
+                                       const int max_num_images,
+                                       std::vector<size_t>* image_idxs) const {
+  image_idxs->clear();
+  if (descriptors.rows() == 0 || max_num_images <= 0 ||
+      global_descriptors_.empty()) {
+    return;
+  }
+
+  // Center the global descriptors on their mean, which removes the
+  // appearance common to all images of the sequence.
+  const Eigen::VectorXf mean =
+      descriptor_sum_ / std::max<size_t>(1, global_descriptors_.size());
+  const Eigen::VectorXf query =
+      (ComputeGlobalDescriptor(descriptors) - mean).normalized();
+
+  std::vector<std::pair<float, size_t>> scores;
+  for (size_t i = 0; i < global_descriptors_.size(); ++i) {
+    const Eigen::VectorXf centered = global_descriptors_[i] - mean;
+    const float norm = centered.norm();
+    if (norm == 0) {
+      continue;
+    }
+    const float similarity = centered.dot(query) / norm;
+    if (similarity >= min_similarity_) {
+      scores.emplace_back(similarity, image_idxs_[i]);
+    }
+  }
+
+  const size_t num_images =
+      std::min(scores.size(), static_cast<size_t>(max_num_images));
+  std::partial_sort(scores.begin(), scores.begin() + num_images, scores.end(),
+                    [](const std::pair<float, size_t>& score1,
+                       const std::pair<float, size_t>& score2) {
+                      return score1.first > score2.first;
+                    });
+  for (size_t i = 0; i < num_images; ++i) {
+    image_idxs->push_back(scores[i].second);
+  }
+}
+
+Eigen::VectorXf MeanDescriptorLoopDetector::ComputeGlobalDescriptor(
+    const FeatureDescriptors& descriptors) {
+  const Eigen::MatrixXf root_descriptors =
+      L1RootNormalizeFeatureDescriptors(descriptors.cast<float>());
+  Eigen::VectorXf global_descriptor =
+      root_descriptors.colwise().sum().transpose();
+  const float norm = global_descriptor.norm();
+  if (norm > 0) {
+    global_descriptor /= norm;
+  }
+  return global_descriptor;
+}
+
+bool MatchSequential(const SequentialMatcherOptions& options,
+                     const DescriptorLoader& loader,
+                     LoopClosureDetector* loop_detector,
+                     MatchDatabase* database,
+                     SequentialMatcherStats* stats) {
+  const size_t num_images = loader.NumImages();
+  const size_t overlap = static_cast<size_t>(std::max(0, options.overlap));
+
+  // The current frame and its `overlap` predecessors.
+  std::vector<Frame> window(overlap + 1);
+
+  SequentialMatcherStats local_stats;
+  std::atomic<size_t> num_loop_loads(0);
+  std::atomic<size_t> num_failed_loop_loads(0);
+
+  std::future<Frame> next_frame;
+  if (num_images > 0) {
+    next_frame = std::async(std::launch::async, LoadFrame, std::cref(loader),
+                            static_cast<size_t>(0));
+  }
+
+  std::vector<std::pair<const Frame*, size_t>> pairs;
+  std::vector<size_t> loop_image_idxs;
+  for (size_t image_idx = 0; image_idx < num_images; ++image_idx) {
+    Frame& frame = window[image_idx % window.size()];
+
+    // The oldest frame leaves the window and becomes a loop candidate.
+    if (loop_detector != nullptr && image_idx > overlap && frame.loaded) {
+      loop_detector->Add(frame.image_idx, frame.descriptors);
+    }
+
+    frame = next_frame.get();
+    local_stats.num_loads += 1;
+    if (image_idx + 1 < num_images) {
+      next_frame = std::async(std::launch::async, LoadFrame,
+                              std::cref(loader), image_idx + 1);
+    }
+
+    if (!frame.loaded) {
+      local_stats.num_failed_loads += 1;
+      continue;
+    }
+
+    // Pairs with a null frame are loop closures, whose descriptors are loaded
+    // by the matching thread.
+    pairs.clear();
+    for (size_t prev_idx = image_idx - std::min(image_idx, overlap);
+         prev_idx < image_idx; ++prev_idx) {
+      const Frame& prev_frame = window[prev_idx % window.size()];
+      if (prev_frame.loaded) {
+        pairs.emplace_back(&prev_frame, prev_idx);
+      }
+    }
+
+    if (loop_detector != nullptr && options.loop_detection_period > 0 &&
+        image_idx % options.loop_detection_period == 0) {
+      loop_detector->Query(frame.descriptors,
+                           options.loop_detection_num_images,
+                           &loop_image_idxs);
+      for (const size_t loop_image_idx : loop_image_idxs) {
+        if (loop_image_idx + overlap < image_idx &&
+            !database->Exists(loop_image_idx, image_idx)) {
+          pairs.emplace_back(nullptr, loop_image_idx);
+          local_stats.num_loop_pairs += 1;
+        }
+      }
+    }
+
+    ParallelForRange(
+        0, pairs.size(), options.num_threads, 1,
+        [&](const size_t begin, const size_t end) {
+          FeatureMatches matches;
+          Frame loop_frame;
+          for (size_t i = begin; i < end; ++i) {
+            const Frame* other_frame = pairs[i].first;
+            if (other_frame == nullptr) {
+              loop_frame = LoadFrame(loader, pairs[i].second);
+              num_loop_loads += 1;
+              if (!loop_frame.loaded) {
+                num_failed_loop_loads += 1;
+                continue;
+              }
+              other_frame = &loop_frame;
+            }
+            matches.clear();
+            MatchSiftFeaturesCPU(options.match_options,
+                                 other_frame->descriptors, frame.descriptors,
+                                 matches);
+            database->Add(other_frame->image_idx, image_idx, matches);
+          }
+        });
+
+    local_stats.num_pairs += pairs.size();
+  }
+
+  local_stats.num_loads += num_loop_loads;
+  local_stats.num_failed_loads += num_failed_loop_loads;
+  local_stats.num_pairs -= num_failed_loop_loads;
+  local_stats.num_loop_pairs -= num_failed_loop_loads;
+
+  if (stats != nullptr) {
+    *stats = local_stats;
+  }
+
+  return local_stats.num_failed_loads == 0;
+}
@@ -0,0 +1,94 @@
+#ifndef COLMAP_SRC_BASE_SEQUENTIAL_MATCHER_H_
+#define COLMAP_SRC_BASE_SEQUENTIAL_MATCHER_H_
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "feature_matching.h"
+#include "match_database.h"
+
+// Index of the global appearance of images that proposes loop closure
+// candidates for the sequential matcher. Images are only added once they
+// left the overlap window, so that all candidates are outside of it.
+class LoopClosureDetector {
+ public:
+  virtual ~LoopClosureDetector() = default;
+
+  virtual void Add(const size_t image_idx,
+                   const FeatureDescriptors& descriptors) = 0;
+
+  // Find up to `max_num_images` indexed images similar to the descriptors,
+  // ordered by decreasing similarity.
+  virtual void Query(const FeatureDescriptors& descriptors,
+                     const int max_num_images,
+                     std::vector<size_t>* image_idxs) const = 0;
+};
+
+// Loop closure detector with the L2-normalized mean of the RootSIFT
+// descriptors of an image as global descriptor and exhaustive search by the
+// cosine similarity of the descriptors centered on the mean of all indexed
+// images. Cheap and sufficient for short sequences with distinct places, but
+// less discriminative than retrieval with visual words.
+class MeanDescriptorLoopDetector : public LoopClosureDetector {
+ public:
+  explicit MeanDescriptorLoopDetector(const double min_similarity = 0.5);
+
+  void Add(const size_t image_idx,
+           const FeatureDescriptors& descriptors) override;
+  void Query(const FeatureDescriptors& descriptors, const int max_num_images,
+             std::vector<size_t>* image_idxs) const override;
+
+  static Eigen::VectorXf ComputeGlobalDescriptor(
+      const FeatureDescriptors& descriptors);
+
+ private:
+  const double min_similarity_;
+  std::vector<size_t> image_idxs_;
+  std::vector<Eigen::VectorXf> global_descriptors_;
+  Eigen::VectorXf descriptor_sum_;
+};
+
+struct SequentialMatcherOptions {
+  // Number of previous frames each frame is matched against.
+  int overlap = 10;
+
+  // Query the loop closure detector every `loop_detection_period` frames for
+  // up to `loop_detection_num_images` candidates.
+  int loop_detection_period = 10;
+  int loop_detection_num_images = 5;
+
+  // Number of threads to match pairs. If `num_threads <= 0`, the number of
+  // hardware threads is used.
+  int num_threads = -1;
+
+  SiftMatchOptions match_options;
+};
+
+struct SequentialMatcherStats {
+  // Number of descriptor sets loaded, including loop closure candidates and
+  // failed loads.
+  size_t num_loads = 0;
+  size_t num_failed_loads = 0;
+
+  // Number of matched pairs, including the loop closure pairs.
+  size_t num_pairs = 0;
+  size_t num_loop_pairs = 0;
+};
+
+// Match every frame of a sequence against its `overlap` predecessors, whose
+// descriptors are kept in a ring buffer, so that every frame is loaded once
+// and the number of pairs grows linearly with the sequence length. The next
+// frame is loaded while matching the current one. If a loop closure detector
+// is given, the frames that left the window are added to it and the detected
+// candidates are loaded and matched as well. Returns false if any
+// descriptor set failed to load.
+bool MatchSequential(const SequentialMatcherOptions& options,
+                     const DescriptorLoader& loader,
+                     LoopClosureDetector* loop_detector,
+                     MatchDatabase* database,
+                     SequentialMatcherStats* stats = nullptr);
+
+#endif  // COLMAP_SRC_BASE_SEQUENTIAL_MATCHER_H_
@@ -0,0 +1,1140 @@
+#include "strip_reader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#ifdef WITH_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#include <jerror.h>
+#endif
+
+#ifdef WITH_LIBPNG
+#include <png.h>
+#endif
+
+#ifdef WITH_LIBTIFF
+#include <tiffio.h>
+#endif
+
+class StripDecoder {
+ public:
+  virtual ~StripDecoder() {}
+
+  // Open the image, where `as_rgb` is a hint for the number of channels that
+  // the decoder should produce, if it can convert cheaply.
+  virtual bool Open(const std::string& path, const bool as_rgb) = 0;
+
+  // Decode the next rows with `Channels()` values per pixel in RGB order.
+  virtual bool ReadRows(const int num_rows, uint8_t* data) = 0;
+
+  virtual bool IsStreaming() const { return true; }
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+  int Channels() const { return channels_; }
+
+ protected:
+  int width_ = 0;
+  int height_ = 0;
+  int channels_ = 0;
+};
+
+namespace {
+
+enum class FileFormat { UNKNOWN, TIFF, PNM, JPEG, PNG };
+
+FileFormat DetectFileFormat(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return FileFormat::UNKNOWN;
+  }
+  uint8_t magic[4] = {0, 0, 0, 0};
+  const size_t num_read = fread(magic, 1, sizeof(magic), file);
+  fclose(file);
+  if (num_read < 2) {
+    return FileFormat::UNKNOWN;
+  }
+
+  if ((magic[0] == 'I' && magic[1] == 'I' && magic[3] == 0 &&
+       (magic[2] == 42 || magic[2] == 43)) ||
+      (magic[0] == 'M' && magic[1] == 'M' && magic[2] == 0 &&
+       (magic[3] == 42 || magic[3] == 43))) {
+    return FileFormat::TIFF;
+  }
+  if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6')) {
+    return FileFormat::PNM;
+  }
+  if (magic[0] == 0xFF && magic[1] == 0xD8) {
+    return FileFormat::JPEG;
+  }
+  if (magic[0] == 0x89 && magic[1] == 'P' && magic[2] == 'N' &&
+      magic[3] == 'G') {
+    return FileFormat::PNG;
+  }
+  return FileFormat::UNKNOWN;
+}
+
+bool SeekFile(FILE* file, const uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+  return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool ReadFileRange(FILE* file, const uint64_t offset, const size_t num_bytes,
+                   uint8_t* data) {
+  return SeekFile(file, offset) && fread(data, 1, num_bytes, file) == num_bytes;
+}
+
+uint8_t RGBToGrey(const uint8_t* rgb) {
+  return static_cast<uint8_t>(0.2126f * rgb[0] + 0.7152f * rgb[1] +
+                              0.0722f * rgb[2] + 0.5f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Binary PGM and PPM
+////////////////////////////////////////////////////////////////////////////////
+
+class PnmDecoder : public StripDecoder {
+ public:
+  ~PnmDecoder() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const bool /*as_rgb*/) override {
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+      return false;
+    }
+
+    char magic[2];
+    if (fread(magic, 1, 2, file_) != 2 || magic[0] != 'P' ||
+        (magic[1] != '5' && magic[1] != '6')) {
+      return false;
+    }
+    channels_ = magic[1] == '5' ? 1 : 3;
+
+    if (!ReadHeaderValue(&width_) || !ReadHeaderValue(&height_) ||
+        !ReadHeaderValue(&max_value_) || width_ <= 0 || height_ <= 0 ||
+        max_value_ <= 0 || max_value_ > 65535) {
+      return false;
+    }
+
+    bytes_per_value_ = max_value_ > 255 ? 2 : 1;
+    row_.resize(static_cast<size_t>(width_) * channels_ * bytes_per_value_);
+    return true;
+  }
+
+  bool ReadRows(const int num_rows, uint8_t* data) override {
+    const size_t num_values = static_cast<size_t>(width_) * channels_;
+    for (int y = 0; y < num_rows; ++y) {
+      uint8_t* output = data + y * num_values;
+      if (bytes_per_value_ == 1 && max_value_ == 255) {
+        if (fread(output, 1, num_values, file_) != num_values) {
+          return false;
+        }
+        continue;
+      }
+      if (fread(row_.data(), 1, row_.size(), file_) != row_.size()) {
+        return false;
+      }
+      for (size_t i = 0; i < num_values; ++i) {
+        const int value = bytes_per_value_ == 1
+                              ? row_[i]
+                              : (row_[2 * i] << 8) | row_[2 * i + 1];
+        output[i] = static_cast<uint8_t>(
+            (std::min(value, max_value_) * 255 + max_value_ / 2) / max_value_);
+      }
+    }
+    return true;
+  }
+
+ private:
+  // Read a decimal header value, skipping whitespace and comments. The single
+  // whitespace character after the value is consumed as well.
+  bool ReadHeaderValue(int* value) {
+    int c = fgetc(file_);
+    while (c != EOF) {
+      if (c == '#') {
+        while (c != EOF && c != '\n') {
+          c = fgetc(file_);
+        }
+      } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        c = fgetc(file_);
+      } else {
+        break;
+      }
+    }
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    *value = 0;
+    while (c >= '0' && c <= '9') {
+      if (*value > 100000000) {
+        return false;
+      }
+      *value = 10 * *value + (c - '0');
+      c = fgetc(file_);
+    }
+    return true;
+  }
+
+  FILE* file_ = nullptr;
+  int max_value_ = 0;
+  int bytes_per_value_ = 1;
+  std::vector<uint8_t> row_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Uncompressed TIFF and BigTIFF
+////////////////////////////////////////////////////////////////////////////////
+
+class TiffDecoder : public StripDecoder {
+ public:
+  ~TiffDecoder() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const bool /*as_rgb*/) override {
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+      return false;
+    }
+
+    uint8_t header[16];
+    if (fread(header, 1, 8, file_) != 8) {
+      return false;
+    }
+    big_endian_ = header[0] == 'M';
+    const uint16_t version = ToU16(header + 2);
+    uint64_t ifd_offset;
+    if (version == 42) {
+      big_tiff_ = false;
+      ifd_offset = ToU32(header + 4);
+    } else if (version == 43) {
+      big_tiff_ = true;
+      if (ToU16(header + 4) != 8 || fread(header + 8, 1, 8, file_) != 8) {
+        return false;
+      }
+      ifd_offset = ToU64(header + 8);
+    } else {
+      return false;
+    }
+
+    return ReadImageDirectory(ifd_offset);
+  }
+
+  bool ReadRows(const int num_rows, uint8_t* data) override {
+    const size_t row_size = static_cast<size_t>(width_) * channels_;
+    const size_t raw_row_size =
+        static_cast<size_t>(width_) * samples_ * bytes_per_sample_;
+
+    int rows_left = num_rows;
+    while (rows_left > 0) {
+      const int band_height = tiled_ ? tile_height_ : rows_per_strip_;
+      const int band = next_row_ / band_height;
+      const int band_row = next_row_ % band_height;
+      const int band_rows = std::min(rows_left, band_height - band_row);
+
+      raw_.resize(band_rows * raw_row_size);
+      if (tiled_) {
+        if (!ReadTileRows(band, band_row, band_rows, raw_row_size)) {
+          return false;
+        }
+      } else {
+        if (static_cast<size_t>(band) >= offsets_.size() ||
+            !ReadFileRange(file_, offsets_[band] + band_row * raw_row_size,
+                           raw_.size(), raw_.data())) {
+          return false;
+        }
+      }
+
+      for (int y = 0; y < band_rows; ++y) {
+        ConvertRow(raw_.data() + y * raw_row_size, data);
+        data += row_size;
+      }
+      next_row_ += band_rows;
+      rows_left -= band_rows;
+    }
+    return true;
+  }
+
+ private:
+  enum Tag {
+    kImageWidth = 256,
+    kImageLength = 257,
+    kBitsPerSample = 258,
+    kCompression = 259,
+    kPhotometric = 262,
+    kStripOffsets = 273,
+    kSamplesPerPixel = 277,
+    kRowsPerStrip = 278,
+    kPlanarConfig = 284,
+    kTileWidth = 322,
+    kTileLength = 323,
+    kTileOffsets = 324,
+  };
+
+  uint16_t ToU16(const uint8_t* b) const {
+    return big_endian_ ? static_cast<uint16_t>((b[0] << 8) | b[1])
+                       : static_cast<uint16_t>((b[1] << 8) | b[0]);
+  }
+
+  uint32_t ToU32(const uint8_t* b) const {
+    return big_endian_ ? (static_cast<uint32_t>(ToU16(b)) << 16) | ToU16(b + 2)
+                       : (static_cast<uint32_t>(ToU16(b + 2)) << 16) | ToU16(b);
+  }
+
+  uint64_t ToU64(const uint8_t* b) const {
+    return big_endian_ ? (static_cast<uint64_t>(ToU32(b)) << 32) | ToU32(b + 4)
+                       : (static_cast<uint64_t>(ToU32(b + 4)) << 32) | ToU32(b);
+  }
+
+  // Read the integer values of an IFD entry.
+  bool ReadEntryValues(const uint8_t* entry, std::vector<uint64_t>* values) {
+    const uint16_t type = ToU16(entry + 2);
+    const uint64_t count = big_tiff_ ? ToU64(entry + 4) : ToU32(entry + 4);
+    const uint8_t* inline_value = entry + (big_tiff_ ? 12 : 8);
+    const size_t inline_size = big_tiff_ ? 8 : 4;
+
+    size_t value_size;
+    switch (type) {
+      case 1:  // BYTE
+        value_size = 1;
+        break;
+      case 3:  // SHORT
+        value_size = 2;
+        break;
+      case 4:   // LONG
+      case 13:  // IFD
+        value_size = 4;
+        break;
+      case 16:  // LONG8
+      case 18:  // IFD8
+        value_size = 8;
+        break;
+      default:
+        return false;
+    }
+
+    // Limit the number of values to reject corrupt files early.
+    const uint64_t kMaxNumValues = 1 << 28;
+    if (count == 0 || count > kMaxNumValues) {
+      return false;
+    }
+
+    std::vector<uint8_t> buffer(count * value_size);
+    if (buffer.size() <= inline_size) {
+      std::memcpy(buffer.data(), inline_value, buffer.size());
+    } else {
+      const uint64_t offset =
+          big_tiff_ ? ToU64(inline_value) : ToU32(inline_value);
+      if (!ReadFileRange(file_, offset, buffer.size(), buffer.data())) {
+        return false;
+      }
+    }
+
+    values->resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      const uint8_t* value = buffer.data() + i * value_size;
+      switch (value_size) {
+        case 1:
+          (*values)[i] = value[0];
+          break;
+        case 2:
+          (*values)[i] = ToU16(value);
+          break;
+        case 4:
+          (*values)[i] = ToU32(value);
+          break;
+        default:
+          (*values)[i] = ToU64(value);
+          break;
+      }
+    }
+    return true;
+  }
+
+  bool ReadImageDirectory(const uint64_t offset) {
+    const size_t count_size = big_tiff_ ? 8 : 2;
+    const size_t entry_size = big_tiff_ ? 20 : 12;
+
+    uint8_t count_data[8];
+    if (!ReadFileRange(file_, offset, count_size, count_data)) {
+      return false;
+    }
+    const uint64_t num_entries =
+        big_tiff_ ? ToU64(count_data) : ToU16(count_data);
+    if (num_entries == 0 || num_entries > 4096) {
+      return false;
+    }
+    std::vector<uint8_t> entries(num_entries * entry_size);
+    if (fread(entries.data(), 1, entries.size(), file_) != entries.size()) {
+      return false;
+    }
+
+    int bits_per_sample = 1;
+    int compression = 1;
+    int planar_config = 1;
+    int tile_width = 0;
+    photometric_ = -1;
+    samples_ = 1;
+    rows_per_strip_ = 0;
+    tiled_ = false;
+
+    std::vector<uint64_t> values;
+    for (size_t i = 0; i < num_entries; ++i) {
+      const uint8_t* entry = entries.data() + i * entry_size;
+      const uint16_t tag = ToU16(entry);
+      switch (tag) {
+        case kImageWidth:
+        case kImageLength:
+        case kBitsPerSample:
+        case kCompression:
+        case kPhotometric:
+        case kStripOffsets:
+        case kSamplesPerPixel:
+        case kRowsPerStrip:
+        case kPlanarConfig:
+        case kTileWidth:
+        case kTileLength:
+        case kTileOffsets:
+          break;
+        default:
+          continue;
+      }
+
+      if (!ReadEntryValues(entry, &values)) {
+        return false;
+      }
+      const uint64_t value = values[0];
+      switch (tag) {
+        case kImageWidth:
+          width_ = static_cast<int>(std::min<uint64_t>(value, 1 << 30));
+          break;
+        case kImageLength:
+          height_ = static_cast<int>(std::min<uint64_t>(value, 1 << 30));
+          break;
+        case kBitsPerSample:
+          bits_per_sample = static_cast<int>(value);
+          for (const uint64_t bits : values) {
+            if (bits != value) {
+              return false;
+            }
+          }
+          break;
+        case kCompression:
+          compression = static_cast<int>(value);
+          break;
+        case kPhotometric:
+          photometric_ = static_cast<int>(value);
+          break;
+        case kStripOffsets:
+        case kTileOffsets:
+          offsets_ = values;
+          break;
+        case kSamplesPerPixel:
+          samples_ = static_cast<int>(value);
+          break;
+        case kRowsPerStrip:
+          rows_per_strip_ = static_cast<int>(
+              std::min<uint64_t>(value, std::numeric_limits<int>::max()));
+          break;
+        case kPlanarConfig:
+          planar_config = static_cast<int>(value);
+          break;
+        case kTileWidth:
+          tile_width = static_cast<int>(value);
+          tiled_ = true;
+          break;
+        case kTileLength:
+          tile_height_ = static_cast<int>(value);
+          break;
+      }
+    }
+
+    // Only uncompressed, interleaved 8-bit and 16-bit greyscale and RGB
+    // images are decoded natively.
+    if (compression != 1 || (planar_config != 1 && samples_ > 1) ||
+        (bits_per_sample != 8 && bits_per_sample != 16) || width_ <= 0 ||
+        height_ <= 0 || offsets_.empty()) {
+      return false;
+    }
+    if ((photometric_ == 0 || photometric_ == 1) && samples_ >= 1) {
+      channels_ = 1;
+    } else if (photometric_ == 2 && samples_ >= 3) {
+      channels_ = 3;
+    } else {
+      return false;
+    }
+    bytes_per_sample_ = bits_per_sample / 8;
+
+    if (tiled_) {
+      if (tile_width <= 0 || tile_height_ <= 0) {
+        return false;
+      }
+      tile_width_ = tile_width;
+      num_tiles_x_ = (width_ + tile_width_ - 1) / tile_width_;
+      const size_t num_tiles_y = (height_ + tile_height_ - 1) / tile_height_;
+      if (offsets_.size() < num_tiles_y * num_tiles_x_) {
+        return false;
+      }
+    } else {
+      if (rows_per_strip_ <= 0 || rows_per_strip_ > height_) {
+        rows_per_strip_ = height_;
+      }
+    }
+
+    next_row_ = 0;
+    return true;
+  }
+
+  // Assemble rows of a band of tiles into `raw_`.
+  bool ReadTileRows(const int band, const int band_row, const int num_rows,
+                    const size_t raw_row_size) {
+    const size_t pixel_size = static_cast<size_t>(samples_) * bytes_per_sample_;
+    const size_t tile_row_size = tile_width_ * pixel_size;
+    tile_rows_.resize(num_rows * tile_row_size);
+    for (int tile_x = 0; tile_x < num_tiles_x_; ++tile_x) {
+      const size_t tile_idx = static_cast<size_t>(band) * num_tiles_x_ + tile_x;
+      if (!ReadFileRange(file_, offsets_[tile_idx] + band_row * tile_row_size,
+                         tile_rows_.size(), tile_rows_.data())) {
+        return false;
+      }
+      const int x = tile_x * tile_width_;
+      const size_t copy_size = std::min(tile_width_, width_ - x) * pixel_size;
+      for (int y = 0; y < num_rows; ++y) {
+        std::memcpy(raw_.data() + y * raw_row_size + x * pixel_size,
+                    tile_rows_.data() + y * tile_row_size, copy_size);
+      }
+    }
+    return true;
+  }
+
+  void ConvertRow(const uint8_t* raw, uint8_t* row) const {
+    // The most significant byte of 16-bit samples is kept.
+    const int msb_offset = bytes_per_sample_ == 2 && !big_endian_ ? 1 : 0;
+    const size_t pixel_size = static_cast<size_t>(samples_) * bytes_per_sample_;
+    for (int x = 0; x < width_; ++x) {
+      const uint8_t* pixel = raw + x * pixel_size + msb_offset;
+      if (channels_ == 1) {
+        row[x] = photometric_ == 0 ? 255 - pixel[0] : pixel[0];
+      } else {
+        for (int c = 0; c < 3; ++c) {
+          row[3 * x + c] = pixel[c * bytes_per_sample_];
+        }
+      }
+    }
+  }
+
+  FILE* file_ = nullptr;
+  bool big_endian_ = false;
+  bool big_tiff_ = false;
+  bool tiled_ = false;
+  int photometric_ = -1;
+  int samples_ = 1;
+  int bytes_per_sample_ = 1;
+  int rows_per_strip_ = 0;
+  int tile_width_ = 0;
+  int tile_height_ = 0;
+  int num_tiles_x_ = 0;
+  int next_row_ = 0;
+  std::vector<uint64_t> offsets_;
+  std::vector<uint8_t> raw_;
+  std::vector<uint8_t> tile_rows_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Compressed TIFF
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef WITH_LIBTIFF
+
+// Decodes one strip or one row of tiles at a time, so that memory is bounded
+// by the strip or tile size for any compression that libtiff supports.
+class LibTiffDecoder : public StripDecoder {
+ public:
+  ~LibTiffDecoder() {
+    if (tiff_ != nullptr) {
+      TIFFClose(tiff_);
+    }
+  }
+
+  bool Open(const std::string& path, const bool /*as_rgb*/) override {
+    tiff_ = TIFFOpen(path.c_str(), "r");
+    if (tiff_ == nullptr) {
+      return false;
+    }
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint16_t photometric = 0;
+    if (!TIFFGetField(tiff_, TIFFTAG_IMAGEWIDTH, &width) ||
+        !TIFFGetField(tiff_, TIFFTAG_IMAGELENGTH, &height) ||
+        !TIFFGetField(tiff_, TIFFTAG_PHOTOMETRIC, &photometric)) {
+      return false;
+    }
+    uint16_t bits_per_sample = 1;
+    uint16_t samples = 1;
+    uint16_t planar_config = PLANARCONFIG_CONTIG;
+    uint16_t sample_format = SAMPLEFORMAT_UINT;
+    uint16_t compression = COMPRESSION_NONE;
+    TIFFGetFieldDefaulted(tiff_, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+    TIFFGetFieldDefaulted(tiff_, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetFieldDefaulted(tiff_, TIFFTAG_PLANARCONFIG, &planar_config);
+    TIFFGetFieldDefaulted(tiff_, TIFFTAG_SAMPLEFORMAT, &sample_format);
+    TIFFGetFieldDefaulted(tiff_, TIFFTAG_COMPRESSION, &compression);
+
+    // Only interleaved 8-bit and 16-bit greyscale and RGB images.
+    if ((planar_config != PLANARCONFIG_CONTIG && samples > 1) ||
+        sample_format != SAMPLEFORMAT_UINT ||
+        (bits_per_sample != 8 && bits_per_sample != 16) || width == 0 ||
+        height == 0 || width > (1 << 30) || height > (1 << 30)) {
+      return false;
+    }
+
+    // JPEG-compressed YCbCr images are converted to RGB by libtiff.
+    if (photometric == PHOTOMETRIC_YCBCR && compression == COMPRESSION_JPEG &&
+        bits_per_sample == 8) {
+      TIFFSetField(tiff_, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+      photometric = PHOTOMETRIC_RGB;
+    }
+    if ((photometric == PHOTOMETRIC_MINISWHITE ||
+         photometric == PHOTOMETRIC_MINISBLACK) &&
+        samples >= 1) {
+      channels_ = 1;
+    } else if (photometric == PHOTOMETRIC_RGB && samples >= 3) {
+      channels_ = 3;
+    } else {
+      return false;
+    }
+    invert_ = photometric == PHOTOMETRIC_MINISWHITE;
+
+    width_ = static_cast<int>(width);
+    height_ = static_cast<int>(height);
+    samples_ = samples;
+    bytes_per_sample_ = bits_per_sample / 8;
+    raw_row_size_ = static_cast<size_t>(width_) * samples_ * bytes_per_sample_;
+
+    tiled_ = TIFFIsTiled(tiff_) != 0;
+    if (tiled_) {
+      uint32_t tile_width = 0;
+      uint32_t tile_height = 0;
+      if (!TIFFGetField(tiff_, TIFFTAG_TILEWIDTH, &tile_width) ||
+          !TIFFGetField(tiff_, TIFFTAG_TILELENGTH, &tile_height) ||
+          tile_width == 0 || tile_height == 0 || tile_width > (1 << 30) ||
+          tile_height > (1 << 30)) {
+        return false;
+      }
+      tile_width_ = static_cast<int>(tile_width);
+      band_height_ = static_cast<int>(tile_height);
+      tile_.resize(static_cast<size_t>(TIFFTileSize(tiff_)));
+    } else {
+      uint32_t rows_per_strip = height;
+      TIFFGetFieldDefaulted(tiff_, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+      band_height_ = static_cast<int>(
+          std::max<uint32_t>(1, std::min(rows_per_strip, height)));
+    }
+    band_.resize(static_cast<size_t>(band_height_) * raw_row_size_);
+
+    return true;
+  }
+
+  bool ReadRows(const int num_rows, uint8_t* data) override {
+    const size_t row_size = static_cast<size_t>(width_) * channels_;
+    for (int y = 0; y < num_rows; ++y, ++next_row_) {
+      const int band = next_row_ / band_height_;
+      if (band != band_idx_ && !DecodeBand(band)) {
+        return false;
+      }
+      ConvertRow(band_.data() + (next_row_ % band_height_) * raw_row_size_,
+                 data + y * row_size);
+    }
+    return true;
+  }
+
+ private:
+  bool DecodeBand(const int band) {
+    band_idx_ = -1;
+    const int band_rows =
+        std::min(band_height_, height_ - band * band_height_);
+    if (!tiled_) {
+      const tmsize_t size = static_cast<tmsize_t>(band_rows * raw_row_size_);
+      if (TIFFReadEncodedStrip(tiff_, static_cast<uint32_t>(band),
+                               band_.data(), size) < size) {
+        return false;
+      }
+    } else {
+      const size_t pixel_size =
+          static_cast<size_t>(samples_) * bytes_per_sample_;
+      const size_t tile_row_size = tile_width_ * pixel_size;
+      if (tile_.size() < band_rows * tile_row_size) {
+        return false;
+      }
+      for (int x = 0; x < width_; x += tile_width_) {
+        if (TIFFReadTile(tiff_, tile_.data(), static_cast<uint32_t>(x),
+                         static_cast<uint32_t>(band * band_height_), 0,
+                         0) < 0) {
+          return false;
+        }
+        const size_t copy_size = std::min(tile_width_, width_ - x) * pixel_size;
+        for (int y = 0; y < band_rows; ++y) {
+          std::memcpy(band_.data() + y * raw_row_size_ + x * pixel_size,
+                      tile_.data() + y * tile_row_size, copy_size);
+        }
+      }
+    }
+    band_idx_ = band;
+    return true;
+  }
+
+  void ConvertRow(const uint8_t* raw, uint8_t* row) const {
+    const size_t pixel_size = static_cast<size_t>(samples_) * bytes_per_sample_;
+    for (int x = 0; x < width_; ++x) {
+      const uint8_t* pixel = raw + x * pixel_size;
+      for (int c = 0; c < channels_; ++c) {
+        uint8_t value;
+        if (bytes_per_sample_ == 2) {
+          // libtiff returns 16-bit samples in the byte order of the host.
+          uint16_t sample;
+          std::memcpy(&sample, pixel + 2 * c, 2);
+          value = static_cast<uint8_t>(sample >> 8);
+        } else {
+          value = pixel[c];
+        }
+        row[channels_ * x + c] = invert_ ? 255 - value : value;
+      }
+    }
+  }
+
+  TIFF* tiff_ = nullptr;
+  bool tiled_ = false;
+  bool invert_ = false;
+  int samples_ = 1;
+  int bytes_per_sample_ = 1;
+  int tile_width_ = 0;
+  int band_height_ = 0;
+  int band_idx_ = -1;
+  int next_row_ = 0;
+  size_t raw_row_size_ = 0;
+  std::vector<uint8_t> band_;
+  std::vector<uint8_t> tile_;
+};
+
+#endif  // WITH_LIBTIFF
+
+////////////////////////////////////////////////////////////////////////////////
+// JPEG
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef WITH_LIBJPEG
+
+struct JpegErrorManager {
+  jpeg_error_mgr manager;
+  jmp_buf jump_buffer;
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump_buffer, 1);
+}
+
+void JpegOutputMessage(j_common_ptr) {}
+
+// libjpeg only warns about a premature end of the data and pads the image,
+// which is treated as an error so that truncated files are not accepted.
+void JpegEmitMessage(j_common_ptr cinfo, int msg_level) {
+  if (msg_level < 0 && cinfo->err->msg_code == JWRN_JPEG_EOF) {
+    JpegErrorExit(cinfo);
+  }
+}
+
+// Functions calling into libjpeg must not hold objects with destructors,
+// since errors return through longjmp.
+class JpegDecoder : public StripDecoder {
+ public:
+  ~JpegDecoder() {
+    if (created_) {
+      jpeg_destroy_decompress(&cinfo_);
+    }
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const bool as_rgb) override {
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+      return false;
+    }
+    return Start(as_rgb);
+  }
+
+  bool ReadRows(const int num_rows, uint8_t* data) override {
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+    const size_t row_size = static_cast<size_t>(width_) * channels_;
+    for (int y = 0; y < num_rows; ++y) {
+      JSAMPROW row = data + y * row_size;
+      if (jpeg_read_scanlines(&cinfo_, &row, 1) != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  bool Start(const bool as_rgb) {
+    cinfo_.err = jpeg_std_error(&error_.manager);
+    error_.manager.error_exit = &JpegErrorExit;
+    error_.manager.output_message = &JpegOutputMessage;
+    error_.manager.emit_message = &JpegEmitMessage;
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+
+    jpeg_create_decompress(&cinfo_);
+    created_ = true;
+    jpeg_stdio_src(&cinfo_, file_);
+    if (jpeg_read_header(&cinfo_, TRUE) != JPEG_HEADER_OK) {
+      return false;
+    }
+    if (cinfo_.jpeg_color_space == JCS_CMYK ||
+        cinfo_.jpeg_color_space == JCS_YCCK) {
+      return false;
+    }
+    cinfo_.out_color_space = as_rgb ? JCS_RGB : JCS_GRAYSCALE;
+    jpeg_start_decompress(&cinfo_);
+
+    width_ = static_cast<int>(cinfo_.output_width);
+    height_ = static_cast<int>(cinfo_.output_height);
+    channels_ = cinfo_.output_components;
+    return channels_ == 1 || channels_ == 3;
+  }
+
+  FILE* file_ = nullptr;
+  bool created_ = false;
+  jpeg_decompress_struct cinfo_;
+  JpegErrorManager error_;
+};
+
+#endif  // WITH_LIBJPEG
+
+////////////////////////////////////////////////////////////////////////////////
+// PNG
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef WITH_LIBPNG
+
+// Functions calling into libpng must not hold objects with destructors,
+// since errors return through longjmp.
+class PngDecoder : public StripDecoder {
+ public:
+  ~PngDecoder() {
+    if (png_ != nullptr) {
+      png_destroy_read_struct(&png_, info_ != nullptr ? &info_ : nullptr,
+                              nullptr);
+    }
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const bool as_rgb) override {
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+      return false;
+    }
+    png_ = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr,
+                                  nullptr);
+    if (png_ == nullptr) {
+      return false;
+    }
+    info_ = png_create_info_struct(png_);
+    if (info_ == nullptr) {
+      return false;
+    }
+    return Start(as_rgb);
+  }
+
+  bool ReadRows(const int num_rows, uint8_t* data) override {
+    if (setjmp(png_jmpbuf(png_))) {
+      return false;
+    }
+    const size_t row_size = static_cast<size_t>(width_) * channels_;
+    for (int y = 0; y < num_rows; ++y) {
+      png_read_row(png_, data + y * row_size, nullptr);
+    }
+    return true;
+  }
+
+ private:
+  bool Start(const bool as_rgb) {
+    if (setjmp(png_jmpbuf(png_))) {
+      return false;
+    }
+
+    png_init_io(png_, file_);
+    png_read_info(png_, info_);
+
+    // Interlaced images cannot be decoded row by row.
+    if (png_get_interlace_type(png_, info_) != PNG_INTERLACE_NONE) {
+      return false;
+    }
+
+    const int color_type = png_get_color_type(png_, info_);
+    png_set_expand(png_);
+    png_set_strip_16(png_);
+    png_set_strip_alpha(png_);
+    const bool is_grey = (color_type & PNG_COLOR_MASK_COLOR) == 0;
+    if (is_grey && as_rgb) {
+      png_set_gray_to_rgb(png_);
+    } else if (!is_grey && !as_rgb) {
+      // Rec. 709 weights in units of 1/100000, as in Bitmap::CloneAsGrey.
+      png_set_rgb_to_gray_fixed(png_, 1, 21260, 71520);
+    }
+    png_read_update_info(png_, info_);
+
+    width_ = static_cast<int>(png_get_image_width(png_, info_));
+    height_ = static_cast<int>(png_get_image_height(png_, info_));
+    channels_ = png_get_channels(png_, info_);
+    return channels_ == 1 || channels_ == 3;
+  }
+
+  FILE* file_ = nullptr;
+  png_structp png_ = nullptr;
+  png_infop info_ = nullptr;
+};
+
+#endif  // WITH_LIBPNG
+
+////////////////////////////////////////////////////////////////////////////////
+// FreeImage fallback
+////////////////////////////////////////////////////////////////////////////////
+
+class FreeImageDecoder : public StripDecoder {
+ public:
+  bool Open(const std::string& path, const bool as_rgb) override {
+    if (!bitmap_.Read(path, as_rgb)) {
+      return false;
+    }
+    width_ = bitmap_.Width();
+    height_ = bitmap_.Height();
+    channels_ = bitmap_.Channels();
+    return true;
+  }
+
+  bool ReadRows(const int num_rows, uint8_t* data) override {
+    const size_t row_size = static_cast<size_t>(width_) * channels_;
+    for (int y = 0; y < num_rows; ++y, ++next_row_) {
+      const uint8_t* line =
+          FreeImage_GetScanLine(bitmap_.Data(), height_ - 1 - next_row_);
+      uint8_t* row = data + y * row_size;
+      if (channels_ == 1) {
+        std::memcpy(row, line, row_size);
+      } else {
+        for (int x = 0; x < width_; ++x) {
+          row[3 * x] = line[3 * x + FI_RGBA_RED];
+          row[3 * x + 1] = line[3 * x + FI_RGBA_GREEN];
+          row[3 * x + 2] = line[3 * x + FI_RGBA_BLUE];
+        }
+      }
+    }
+    return true;
+  }
+
+  bool IsStreaming() const override { return false; }
+
+ private:
+  Bitmap bitmap_;
+  int next_row_ = 0;
+};
+
+// Open the image with the first decoder that can stream it, or return null.
+std::unique_ptr<StripDecoder> OpenStreamingDecoder(const std::string& path,
+                                                   const bool as_rgb) {
+  std::vector<std::unique_ptr<StripDecoder>> decoders;
+  switch (DetectFileFormat(path)) {
+    case FileFormat::TIFF:
+      decoders.emplace_back(new TiffDecoder());
+#ifdef WITH_LIBTIFF
+      decoders.emplace_back(new LibTiffDecoder());
+#endif
+      break;
+    case FileFormat::PNM:
+      decoders.emplace_back(new PnmDecoder());
+      break;
+#ifdef WITH_LIBJPEG
+    case FileFormat::JPEG:
+      decoders.emplace_back(new JpegDecoder());
+      break;
+#endif
+#ifdef WITH_LIBPNG
+    case FileFormat::PNG:
+      decoders.emplace_back(new PngDecoder());
+      break;
+#endif
+    default:
+      break;
+  }
+
+  for (auto& decoder : decoders) {
+    if (decoder->Open(path, as_rgb)) {
+      return std::move(decoder);
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+StripReader::StripReader()
+    : width_(0), height_(0), channels_(0), next_row_(0), failed_(false) {}
+
+StripReader::~StripReader() {}
+
+bool StripReader::Open(const std::string& path,
+                       const StripReaderOptions& options) {
+  Close();
+  options_ = options;
+  options_.strip_height = std::max(1, options_.strip_height);
+
+  decoder_ = OpenStreamingDecoder(path, options_.as_rgb);
+  if (!decoder_) {
+    if (options_.require_streaming) {
+      return false;
+    }
+    decoder_.reset(new FreeImageDecoder());
+    if (!decoder_->Open(path, options_.as_rgb)) {
+      decoder_.reset();
+      return false;
+    }
+  }
+
+  width_ = decoder_->Width();
+  height_ = decoder_->Height();
+  channels_ = options_.as_rgb ? 3 : 1;
+  return true;
+}
+
+void StripReader::Close() {
+  decoder_.reset();
+  decoded_rows_.clear();
+  decoded_rows_.shrink_to_fit();
+  width_ = 0;
+  height_ = 0;
+  channels_ = 0;
+  next_row_ = 0;
+  failed_ = false;
+}
+
+bool StripReader::IsStreaming() const {
+  return decoder_ && decoder_->IsStreaming();
+}
+
+bool StripReader::Next(ImageStrip* strip) {
+  if (!decoder_ || next_row_ >= height_) {
+    return false;
+  }
+
+  const int num_rows = std::min(options_.strip_height, height_ - next_row_);
+  const size_t num_pixels = static_cast<size_t>(width_) * num_rows;
+  strip->y = next_row_;
+  strip->width = width_;
+  strip->height = num_rows;
+  strip->channels = channels_;
+  strip->data.resize(num_pixels * channels_);
+
+  if (decoder_->Channels() == channels_) {
+    if (!decoder_->ReadRows(num_rows, strip->data.data())) {
+      decoder_.reset();
+      failed_ = true;
+      return false;
+    }
+  } else {
+    decoded_rows_.resize(num_pixels * decoder_->Channels());
+    if (!decoder_->ReadRows(num_rows, decoded_rows_.data())) {
+      decoder_.reset();
+      failed_ = true;
+      return false;
+    }
+    uint8_t* data = strip->data.data();
+    if (channels_ == 3) {
+      for (size_t i = 0; i < num_pixels; ++i) {
+        data[3 * i] = data[3 * i + 1] = data[3 * i + 2] = decoded_rows_[i];
+      }
+    } else {
+      for (size_t i = 0; i < num_pixels; ++i) {
+        data[i] = RGBToGrey(&decoded_rows_[3 * i]);
+      }
+    }
+  }
+
+  next_row_ += num_rows;
+  return true;
+}
+
+bool ReadDownsampledImage(const std::string& path, const int factor,
+                          Bitmap* bitmap, const StripReaderOptions& options) {
+  StripReader reader;
+  if (factor <= 0 || !reader.Open(path, options)) {
+    return false;
+  }
+
+  const int channels = reader.Channels();
+  const int width = (reader.Width() + factor - 1) / factor;
+  const int height = (reader.Height() + factor - 1) / factor;
+  if (!bitmap->Allocate(width, height, channels == 3)) {
+    return false;
+  }
+
+  // Bitmaps store RGB values in the order of the FI_RGBA_* indices.
+  const int kChannelIdxs[3] = {FI_RGBA_RED, FI_RGBA_GREEN, FI_RGBA_BLUE};
+
+  const size_t row_size = static_cast<size_t>(width) * channels;
+  std::vector<uint32_t> sums(row_size, 0);
+  std::vector<uint32_t> counts(width, 0);
+
+  ImageStrip strip;
+  while (reader.Next(&strip)) {
+    for (int y = 0; y < strip.height; ++y) {
+      const int image_y = strip.y + y;
+      const uint8_t* row = strip.Row(y);
+      for (int x = 0; x < strip.width; ++x) {
+        const int output_x = x / factor;
+        for (int c = 0; c < channels; ++c) {
+          sums[output_x * channels + c] += row[x * channels + c];
+        }
+        counts[output_x] += 1;
+      }
+
+      if ((image_y + 1) % factor != 0 && image_y + 1 != reader.Height()) {
+        continue;
+      }
+
+      const int output_y = image_y / factor;
+      uint8_t* line =
+          FreeImage_GetScanLine(bitmap->Data(), height - 1 - output_y);
+      for (int x = 0; x < width; ++x) {
+        const uint32_t count = counts[x];
+        for (int c = 0; c < channels; ++c) {
+          const uint32_t value = (sums[x * channels + c] + count / 2) / count;
+          line[x * channels + (channels == 3 ? kChannelIdxs[c] : 0)] =
+              static_cast<uint8_t>(value);
+        }
+      }
+      std::fill(sums.begin(), sums.end(), 0);
+      std::fill(counts.begin(), counts.end(), 0);
+    }
+  }
+
+  return !reader.Failed() && reader.NextRow() == reader.Height();
+}
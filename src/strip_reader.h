@@ -0,0 +1,128 @@
+#ifndef COLMAP_SRC_UTIL_STRIP_READER_H_
+#define COLMAP_SRC_UTIL_STRIP_READER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bitmap.h"
+
+struct StripReaderOptions {
+  // Maximum number of rows per strip. For tiled TIFF images, multiples of
+  // the tile height avoid reading tiles repeatedly.
+  int strip_height = 256;
+
+  // Whether to convert the image to RGB or greyscale.
+  bool as_rgb = true;
+
+  // Whether to fail for images that cannot be decoded incrementally instead
+  // of decoding them completely in memory.
+  bool require_streaming = false;
+};
+
+// Horizontal strip of an image with interleaved 8-bit values in RGB order and
+// rows stored top-down without padding.
+struct ImageStrip {
+  // Index of the first row of the strip in the image.
+  int y = 0;
+
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+
+  std::vector<uint8_t> data;
+
+  inline const uint8_t* Row(const int row) const;
+  inline uint8_t* Row(const int row);
+};
+
+class StripDecoder;
+
+// Reads an image as a sequence of horizontal strips, so that images larger
+// than the available memory can be processed with memory bounded by the
+// strip size:
+//
+//    StripReader reader;
+//    if (reader.Open(path)) {
+//      ImageStrip strip;
+//      while (reader.Next(&strip)) {
+//        // Process rows `strip.y` to `strip.y + strip.height - 1`.
+//      }
+//    }
+//
+// Uncompressed TIFF and BigTIFF images with strips or tiles and binary PGM
+// and PPM images are decoded natively. Compressed TIFF images are decoded
+// strip by strip or tile by tile with libtiff, and JPEG and non-interlaced
+// PNG images row by row with libjpeg and libpng, if available at build time.
+// All other images are decoded completely with FreeImage and then split into
+// strips, in which case `IsStreaming` returns false, unless
+// `StripReaderOptions::require_streaming` is set.
+class StripReader {
+ public:
+  StripReader();
+  ~StripReader();
+
+  bool Open(const std::string& path,
+            const StripReaderOptions& options = StripReaderOptions());
+  void Close();
+
+  inline int Width() const;
+  inline int Height() const;
+  inline int Channels() const;
+
+  // Whether the image is decoded incrementally.
+  bool IsStreaming() const;
+
+  // Index of the first row of the next strip.
+  inline int NextRow() const;
+
+  // Read the next strip. Returns false after the last strip or on error.
+  bool Next(ImageStrip* strip);
+
+  // Whether decoding a strip failed, e.g. for a truncated or corrupt image,
+  // in which case `Next` returned false before the last strip.
+  inline bool Failed() const;
+
+ private:
+  StripReaderOptions options_;
+  std::unique_ptr<StripDecoder> decoder_;
+  std::vector<uint8_t> decoded_rows_;
+  int width_;
+  int height_;
+  int channels_;
+  int next_row_;
+  bool failed_;
+};
+
+// Downsample an image by an integer factor with a box filter while streaming
+// its strips, so that only a single strip and the output are kept in memory.
+// The output has size `ceil(width / factor) x ceil(height / factor)`.
+bool ReadDownsampledImage(const std::string& path, const int factor,
+                          Bitmap* bitmap,
+                          const StripReaderOptions& options =
+                              StripReaderOptions());
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+const uint8_t* ImageStrip::Row(const int row) const {
+  return data.data() + static_cast<size_t>(row) * width * channels;
+}
+
+uint8_t* ImageStrip::Row(const int row) {
+  return data.data() + static_cast<size_t>(row) * width * channels;
+}
+
+int StripReader::Width() const { return width_; }
+
+int StripReader::Height() const { return height_; }
+
+int StripReader::Channels() const { return channels_; }
+
+int StripReader::NextRow() const { return next_row_; }
+
+bool StripReader::Failed() const { return failed_; }
+
+#endif  // COLMAP_SRC_UTIL_STRIP_READER_H_
@@ -0,0 +1,542 @@
+#include "strip_writer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef WITH_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+#ifdef WITH_LIBPNG
+#include <png.h>
+#endif
+
+#include "misc.h"
+
+class StripEncoder {
+ public:
+  virtual ~StripEncoder() {}
+
+  virtual bool Open(const std::string& path, const int width,
+                    const int height, const int channels,
+                    const StripWriterOptions& options) = 0;
+
+  // Encode the next rows with `channels` values per pixel in RGB order.
+  virtual bool WriteRows(const int num_rows, const uint8_t* data) = 0;
+
+  // Finalize the image after all rows were written.
+  virtual bool Finish() = 0;
+
+  virtual bool IsStreaming() const { return true; }
+};
+
+namespace {
+
+enum class FileFormat { UNKNOWN, TIFF, PNM, JPEG, PNG };
+
+FileFormat DetectFileFormat(const std::string& path) {
+  if (HasFileExtension(path, ".tif") || HasFileExtension(path, ".tiff")) {
+    return FileFormat::TIFF;
+  }
+  if (HasFileExtension(path, ".pgm") || HasFileExtension(path, ".ppm") ||
+      HasFileExtension(path, ".pnm")) {
+    return FileFormat::PNM;
+  }
+  if (HasFileExtension(path, ".jpg") || HasFileExtension(path, ".jpeg")) {
+    return FileFormat::JPEG;
+  }
+  if (HasFileExtension(path, ".png")) {
+    return FileFormat::PNG;
+  }
+  return FileFormat::UNKNOWN;
+}
+
+// Close the file and report whether all buffered data was written.
+bool CloseFile(FILE** file) {
+  if (*file == nullptr) {
+    return false;
+  }
+  const bool success = ferror(*file) == 0 && fclose(*file) == 0;
+  *file = nullptr;
+  return success;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Binary PGM and PPM
+////////////////////////////////////////////////////////////////////////////////
+
+class PnmEncoder : public StripEncoder {
+ public:
+  ~PnmEncoder() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const int width, const int height,
+            const int channels, const StripWriterOptions&) override {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      return false;
+    }
+    row_size_ = static_cast<size_t>(width) * channels;
+    return fprintf(file_, "P%c\n%d %d\n255\n", channels == 1 ? '5' : '6',
+                   width, height) > 0;
+  }
+
+  bool WriteRows(const int num_rows, const uint8_t* data) override {
+    const size_t num_bytes = num_rows * row_size_;
+    return fwrite(data, 1, num_bytes, file_) == num_bytes;
+  }
+
+  bool Finish() override { return CloseFile(&file_); }
+
+ private:
+  FILE* file_ = nullptr;
+  size_t row_size_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Uncompressed TIFF and BigTIFF
+////////////////////////////////////////////////////////////////////////////////
+
+// Writes the header and a single image directory in front of the pixels, so
+// that rows can be appended without seeking. All rows are stored in a single
+// strip, which is read efficiently by `StripReader` and other readers.
+class TiffEncoder : public StripEncoder {
+ public:
+  ~TiffEncoder() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const int width, const int height,
+            const int channels, const StripWriterOptions&) override {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      return false;
+    }
+
+    row_size_ = static_cast<size_t>(width) * channels;
+    const uint64_t num_bytes = static_cast<uint64_t>(row_size_) * height;
+    big_tiff_ = num_bytes + kMaxHeaderSize > 0xFFFFFFFFull;
+
+    // Directory entries sorted by tag.
+    const uint16_t kShort = 3;
+    const uint16_t kLong = 4;
+    const uint16_t kLong8 = 16;
+    const uint16_t kOffsetType = big_tiff_ ? kLong8 : kLong;
+    const uint16_t kNumEntries = 10;
+    const size_t entry_size = big_tiff_ ? 20 : 12;
+    const size_t ifd_offset = big_tiff_ ? 16 : 8;
+    const size_t ifd_size =
+        (big_tiff_ ? 16 : 6) + kNumEntries * entry_size;
+    // Three bits per sample values do not fit inline in classic TIFF.
+    const bool external_bits = !big_tiff_ && channels == 3;
+    const uint64_t bits_offset = ifd_offset + ifd_size;
+    const uint64_t data_offset = bits_offset + (external_bits ? 6 : 0);
+
+    if (big_tiff_) {
+      Append("II", 2);
+      AppendValue(43, 2);
+      AppendValue(8, 2);
+      AppendValue(0, 2);
+      AppendValue(ifd_offset, 8);
+      AppendValue(kNumEntries, 8);
+    } else {
+      Append("II", 2);
+      AppendValue(42, 2);
+      AppendValue(ifd_offset, 4);
+      AppendValue(kNumEntries, 2);
+    }
+
+    AppendEntry(256, kLong, 1, width);
+    AppendEntry(257, kLong, 1, height);
+    if (channels == 1) {
+      AppendEntry(258, kShort, 1, 8);
+    } else if (external_bits) {
+      AppendEntry(258, kShort, 3, bits_offset);
+    } else {
+      AppendEntry(258, kShort, 3, 8 | (8 << 16) | (8ull << 32));
+    }
+    AppendEntry(259, kShort, 1, 1);
+    AppendEntry(262, kShort, 1, channels == 1 ? 1 : 2);
+    AppendEntry(273, kOffsetType, 1, data_offset);
+    AppendEntry(277, kShort, 1, channels);
+    AppendEntry(278, kLong, 1, height);
+    AppendEntry(279, kOffsetType, 1, num_bytes);
+    AppendEntry(284, kShort, 1, 1);
+    // No further directories.
+    AppendValue(0, big_tiff_ ? 8 : 4);
+
+    if (external_bits) {
+      for (int c = 0; c < 3; ++c) {
+        AppendValue(8, 2);
+      }
+    }
+
+    return fwrite(header_.data(), 1, header_.size(), file_) ==
+           header_.size();
+  }
+
+  bool WriteRows(const int num_rows, const uint8_t* data) override {
+    const size_t num_bytes = num_rows * row_size_;
+    return fwrite(data, 1, num_bytes, file_) == num_bytes;
+  }
+
+  bool Finish() override { return CloseFile(&file_); }
+
+ private:
+  static const uint64_t kMaxHeaderSize = 256;
+
+  void Append(const char* data, const size_t num_bytes) {
+    header_.insert(header_.end(), data, data + num_bytes);
+  }
+
+  // Append the value in little-endian byte order.
+  void AppendValue(const uint64_t value, const int num_bytes) {
+    for (int i = 0; i < num_bytes; ++i) {
+      header_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  // Append a directory entry, whose value is stored inline if it fits and
+  // otherwise `value` is the offset of the values.
+  void AppendEntry(const uint16_t tag, const uint16_t type,
+                   const uint64_t count, const uint64_t value) {
+    AppendValue(tag, 2);
+    AppendValue(type, 2);
+    AppendValue(count, big_tiff_ ? 8 : 4);
+    // Inline values are left-aligned in the value field.
+    const int value_size = type == 3 && count == 1 ? 2 : big_tiff_ ? 8 : 4;
+    const int field_size = big_tiff_ ? 8 : 4;
+    AppendValue(value, value_size);
+    AppendValue(0, field_size - value_size);
+  }
+
+  FILE* file_ = nullptr;
+  size_t row_size_ = 0;
+  bool big_tiff_ = false;
+  std::vector<uint8_t> header_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// JPEG
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef WITH_LIBJPEG
+
+struct JpegErrorManager {
+  jpeg_error_mgr manager;
+  jmp_buf jump_buffer;
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump_buffer, 1);
+}
+
+void JpegOutputMessage(j_common_ptr) {}
+
+// Functions calling into libjpeg must not hold objects with destructors,
+// since errors return through longjmp.
+class JpegEncoder : public StripEncoder {
+ public:
+  ~JpegEncoder() {
+    if (created_) {
+      jpeg_destroy_compress(&cinfo_);
+    }
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const int width, const int height,
+            const int channels, const StripWriterOptions& options) override {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      return false;
+    }
+    return Start(width, height, channels, options.jpeg_quality);
+  }
+
+  bool WriteRows(const int num_rows, const uint8_t* data) override {
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+    const size_t row_size =
+        static_cast<size_t>(cinfo_.image_width) * cinfo_.input_components;
+    for (int y = 0; y < num_rows; ++y) {
+      JSAMPROW row = const_cast<uint8_t*>(data + y * row_size);
+      if (jpeg_write_scanlines(&cinfo_, &row, 1) != 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Finish() override {
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+    jpeg_finish_compress(&cinfo_);
+    return CloseFile(&file_);
+  }
+
+ private:
+  bool Start(const int width, const int height, const int channels,
+             const int quality) {
+    cinfo_.err = jpeg_std_error(&error_.manager);
+    error_.manager.error_exit = &JpegErrorExit;
+    error_.manager.output_message = &JpegOutputMessage;
+    if (setjmp(error_.jump_buffer)) {
+      return false;
+    }
+
+    jpeg_create_compress(&cinfo_);
+    created_ = true;
+    jpeg_stdio_dest(&cinfo_, file_);
+    cinfo_.image_width = static_cast<JDIMENSION>(width);
+    cinfo_.image_height = static_cast<JDIMENSION>(height);
+    cinfo_.input_components = channels;
+    cinfo_.in_color_space = channels == 1 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&cinfo_);
+    jpeg_set_quality(&cinfo_, quality, TRUE);
+    jpeg_start_compress(&cinfo_, TRUE);
+    return true;
+  }
+
+  FILE* file_ = nullptr;
+  bool created_ = false;
+  jpeg_compress_struct cinfo_;
+  JpegErrorManager error_;
+};
+
+#endif  // WITH_LIBJPEG
+
+////////////////////////////////////////////////////////////////////////////////
+// PNG
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef WITH_LIBPNG
+
+// Functions calling into libpng must not hold objects with destructors,
+// since errors return through longjmp.
+class PngEncoder : public StripEncoder {
+ public:
+  ~PngEncoder() {
+    if (png_ != nullptr) {
+      png_destroy_write_struct(&png_, info_ != nullptr ? &info_ : nullptr);
+    }
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  bool Open(const std::string& path, const int width, const int height,
+            const int channels, const StripWriterOptions&) override {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      return false;
+    }
+    png_ = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr,
+                                   nullptr);
+    if (png_ == nullptr) {
+      return false;
+    }
+    info_ = png_create_info_struct(png_);
+    if (info_ == nullptr) {
+      return false;
+    }
+    row_size_ = static_cast<size_t>(width) * channels;
+    return Start(width, height, channels);
+  }
+
+  bool WriteRows(const int num_rows, const uint8_t* data) override {
+    if (setjmp(png_jmpbuf(png_))) {
+      return false;
+    }
+    for (int y = 0; y < num_rows; ++y) {
+      png_write_row(png_, data + y * row_size_);
+    }
+    return true;
+  }
+
+  bool Finish() override {
+    if (setjmp(png_jmpbuf(png_))) {
+      return false;
+    }
+    png_write_end(png_, nullptr);
+    return CloseFile(&file_);
+  }
+
+ private:
+  bool Start(const int width, const int height, const int channels) {
+    if (setjmp(png_jmpbuf(png_))) {
+      return false;
+    }
+    png_init_io(png_, file_);
+    png_set_IHDR(png_, info_, static_cast<png_uint_32>(width),
+                 static_cast<png_uint_32>(height), 8,
+                 channels == 1 ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png_, info_);
+    return true;
+  }
+
+  FILE* file_ = nullptr;
+  png_structp png_ = nullptr;
+  png_infop info_ = nullptr;
+  size_t row_size_ = 0;
+};
+
+#endif  // WITH_LIBPNG
+
+////////////////////////////////////////////////////////////////////////////////
+// FreeImage fallback
+////////////////////////////////////////////////////////////////////////////////
+
+class FreeImageEncoder : public StripEncoder {
+ public:
+  bool Open(const std::string& path, const int width, const int height,
+            const int channels, const StripWriterOptions& options) override {
+    path_ = path;
+    options_ = options;
+    return bitmap_.Allocate(width, height, channels == 3);
+  }
+
+  bool WriteRows(const int num_rows, const uint8_t* data) override {
+    const int width = bitmap_.Width();
+    const int height = bitmap_.Height();
+    const int channels = bitmap_.Channels();
+    const size_t row_size = static_cast<size_t>(width) * channels;
+    for (int y = 0; y < num_rows; ++y, ++next_row_) {
+      uint8_t* line =
+          FreeImage_GetScanLine(bitmap_.Data(), height - 1 - next_row_);
+      const uint8_t* row = data + y * row_size;
+      if (channels == 1) {
+        std::memcpy(line, row, row_size);
+      } else {
+        for (int x = 0; x < width; ++x) {
+          line[3 * x + FI_RGBA_RED] = row[3 * x];
+          line[3 * x + FI_RGBA_GREEN] = row[3 * x + 1];
+          line[3 * x + FI_RGBA_BLUE] = row[3 * x + 2];
+        }
+      }
+    }
+    return true;
+  }
+
+  bool Finish() override {
+    const FREE_IMAGE_FORMAT format =
+        FreeImage_GetFIFFromFilename(path_.c_str());
+    return bitmap_.Write(path_, format,
+                         format == FIF_JPEG ? options_.jpeg_quality : 0);
+  }
+
+  bool IsStreaming() const override { return false; }
+
+ private:
+  std::string path_;
+  StripWriterOptions options_;
+  Bitmap bitmap_;
+  int next_row_ = 0;
+};
+
+std::unique_ptr<StripEncoder> CreateStreamingEncoder(const FileFormat format) {
+  switch (format) {
+    case FileFormat::TIFF:
+      return std::unique_ptr<StripEncoder>(new TiffEncoder());
+    case FileFormat::PNM:
+      return std::unique_ptr<StripEncoder>(new PnmEncoder());
+#ifdef WITH_LIBJPEG
+    case FileFormat::JPEG:
+      return std::unique_ptr<StripEncoder>(new JpegEncoder());
+#endif
+#ifdef WITH_LIBPNG
+    case FileFormat::PNG:
+      return std::unique_ptr<StripEncoder>(new PngEncoder());
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+}  // namespace
+
+StripWriter::StripWriter()
+    : width_(0), height_(0), channels_(0), next_row_(0) {}
+
+StripWriter::~StripWriter() { Close(); }
+
+bool StripWriter::Open(const std::string& path, const int width,
+                       const int height, const int channels,
+                       const StripWriterOptions& options) {
+  Close();
+  if (width <= 0 || height <= 0 || (channels != 1 && channels != 3)) {
+    return false;
+  }
+
+  encoder_ = CreateStreamingEncoder(DetectFileFormat(path));
+  if (!encoder_) {
+    encoder_.reset(new FreeImageEncoder());
+  }
+  if (!encoder_->Open(path, width, height, channels, options)) {
+    encoder_.reset();
+    return false;
+  }
+
+  partial_path_ = encoder_->IsStreaming() ? path : "";
+  width_ = width;
+  height_ = height;
+  channels_ = channels;
+  next_row_ = 0;
+  return true;
+}
+
+bool StripWriter::Close() {
+  if (!encoder_) {
+    return false;
+  }
+  const bool success = next_row_ == height_ && encoder_->Finish();
+  encoder_.reset();
+  partial_path_.clear();
+  width_ = 0;
+  height_ = 0;
+  channels_ = 0;
+  next_row_ = 0;
+  return success;
+}
+
+void StripWriter::Abort() {
+  encoder_.reset();
+  if (!partial_path_.empty()) {
+    std::remove(partial_path_.c_str());
+    partial_path_.clear();
+  }
+  width_ = 0;
+  height_ = 0;
+  channels_ = 0;
+  next_row_ = 0;
+}
+
+bool StripWriter::IsStreaming() const {
+  return encoder_ && encoder_->IsStreaming();
+}
+
+bool StripWriter::Write(const ImageStrip& strip) {
+  if (!encoder_ || strip.y != next_row_ || strip.width != width_ ||
+      strip.channels != channels_ || strip.height < 0 ||
+      next_row_ + strip.height > height_) {
+    return false;
+  }
+  if (!encoder_->WriteRows(strip.height, strip.data.data())) {
+    encoder_.reset();
+    return false;
+  }
+  next_row_ += strip.height;
+  return true;
+}
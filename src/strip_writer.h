@@ -0,0 +1,88 @@
+#ifndef COLMAP_SRC_UTIL_STRIP_WRITER_H_
+#define COLMAP_SRC_UTIL_STRIP_WRITER_H_
+
+#include <memory>
+#include <string>
+
+#include "strip_reader.h"
+
+struct StripWriterOptions {
+  // Quality of JPEG images in the range [1, 100]. Superb quality is used by
+  // default to avoid artifacts, as in `Bitmap::Write`.
+  int jpeg_quality = 100;
+};
+
+class StripEncoder;
+
+// Writes an image as a sequence of horizontal strips from top to bottom, the
+// counterpart of `StripReader`:
+//
+//    StripWriter writer;
+//    if (writer.Open(path, width, height, channels)) {
+//      for (const ImageStrip& strip : strips) {
+//        writer.Write(strip);
+//      }
+//      writer.Close();
+//    }
+//
+// The format is chosen by the file extension. Uncompressed TIFF (BigTIFF for
+// images over 4GB), binary PGM and PPM images are encoded natively. JPEG and
+// PNG images are encoded row by row with libjpeg and libpng, if available at
+// build time. All other images are accumulated completely and then written
+// with FreeImage, in which case `IsStreaming` returns false.
+class StripWriter {
+ public:
+  StripWriter();
+  ~StripWriter();
+
+  // Start writing an image with 1 (grey) or 3 (RGB) channels.
+  bool Open(const std::string& path, const int width, const int height,
+            const int channels,
+            const StripWriterOptions& options = StripWriterOptions());
+
+  // Finish writing the image. Returns false if not all rows were written or
+  // the image could not be finalized. The writer is also closed on
+  // destruction, but then errors cannot be reported.
+  bool Close();
+
+  // Stop writing without finalizing the image and remove the incomplete file,
+  // e.g. after the input of the strips failed.
+  void Abort();
+
+  inline int Width() const;
+  inline int Height() const;
+  inline int Channels() const;
+
+  // Whether the image is encoded incrementally.
+  bool IsStreaming() const;
+
+  // Index of the next row to be written.
+  inline int NextRow() const;
+
+  // Append the next strip, which must start at `NextRow()` and have the same
+  // width and number of channels as the image.
+  bool Write(const ImageStrip& strip);
+
+ private:
+  std::unique_ptr<StripEncoder> encoder_;
+  // File created by a streaming encoder, which is removed by `Abort`.
+  std::string partial_path_;
+  int width_;
+  int height_;
+  int channels_;
+  int next_row_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+int StripWriter::Width() const { return width_; }
+
+int StripWriter::Height() const { return height_; }
+
+int StripWriter::Channels() const { return channels_; }
+
+int StripWriter::NextRow() const { return next_row_; }
+
+#endif  // COLMAP_SRC_UTIL_STRIP_WRITER_H_
@@ -0,0 +1,119 @@
+#include "threading.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+ThreadPool::ThreadPool(const int num_threads)
+    : stopped_(false), num_active_workers_(0) {
+  const int num_effective_threads = GetEffectiveNumThreads(num_threads);
+  for (int i = 0; i < num_effective_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerFunc, this);
+  }
+}
+
+ThreadPool::~ThreadPool() { Stop(); }
+
+void ThreadPool::Stop() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (stopped_) {
+      return;
+    }
+
+    stopped_ = true;
+
+    std::queue<std::function<void()>> empty_tasks;
+    std::swap(tasks_, empty_tasks);
+  }
+
+  task_condition_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+
+  finished_condition_.notify_all();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!tasks_.empty() || num_active_workers_ > 0) {
+    finished_condition_.wait(
+        lock, [this]() { return tasks_.empty() && num_active_workers_ == 0; });
+  }
+}
+
+void ThreadPool::WorkerFunc() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_condition_.wait(lock,
+                           [this] { return stopped_ || !tasks_.empty(); });
+      if (stopped_ && tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+      num_active_workers_ += 1;
+    }
+
+    task();
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      num_active_workers_ -= 1;
+    }
+
+    finished_condition_.notify_all();
+  }
+}
+
+int GetEffectiveNumThreads(const int num_threads) {
+  int num_effective_threads = num_threads;
+  if (num_threads <= 0) {
+    num_effective_threads = std::thread::hardware_concurrency();
+  }
+
+  if (num_effective_threads <= 0) {
+    num_effective_threads = 1;
+  }
+
+  return num_effective_threads;
+}
+
+void ParallelForRange(const size_t begin, const size_t end,
+                      const int num_threads, const size_t min_chunk,
+                      const std::function<void(size_t, size_t)>& func) {
+  if (begin >= end) {
+    return;
+  }
+
+  const size_t num_items = end - begin;
+  const size_t max_num_chunks =
+      std::max<size_t>(1, num_items / std::max<size_t>(1, min_chunk));
+  const size_t num_chunks = std::min<size_t>(
+      max_num_chunks, static_cast<size_t>(GetEffectiveNumThreads(num_threads)));
+
+  if (num_chunks <= 1) {
+    func(begin, end);
+    return;
+  }
+
+  const size_t chunk_size = (num_items + num_chunks - 1) / num_chunks;
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_chunks - 1);
+  for (size_t chunk_begin = begin + chunk_size; chunk_begin < end;
+       chunk_begin += chunk_size) {
+    const size_t chunk_end = std::min(end, chunk_begin + chunk_size);
+    threads.emplace_back(func, chunk_begin, chunk_end);
+  }
+
+  func(begin, std::min(end, begin + chunk_size));
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef COLMAP_SRC_UTIL_THREADING_H_
+#define COLMAP_SRC_UTIL_THREADING_H_
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// A thread pool class to submit generic tasks (functors) to a pool of workers:
+//
+//    ThreadPool thread_pool;
+//    thread_pool.AddTask([]() { /* Do some work */ });
+//    auto future = thread_pool.AddTask([]() { /* Do some work */ return 1; });
+//    const auto result = future.get();
+//    for (int i = 0; i < 10; ++i) {
+//      thread_pool.AddTask([](const int i) { /* Do some work */ });
+//    }
+//    thread_pool.Wait();
+//
+class ThreadPool {
+ public:
+  static const int kMaxNumThreads = -1;
+
+  explicit ThreadPool(const int num_threads = kMaxNumThreads);
+  ~ThreadPool();
+
+  inline size_t NumThreads() const;
+
+  // Add new task to the thread pool.
+  template <class func_t, class... args_t>
+  auto AddTask(func_t&& f, args_t&&... args)
+      -> std::future<typename std::result_of<func_t(args_t...)>::type>;
+
+  // Stop the execution of all workers. Tasks that have not started yet are
+  // discarded.
+  void Stop();
+
+  // Wait until tasks are finished.
+  void Wait();
+
+ private:
+  void WorkerFunc();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+
+  std::mutex mutex_;
+  std::condition_variable task_condition_;
+  std::condition_variable finished_condition_;
+
+  bool stopped_;
+  int num_active_workers_;
+};
+
+// Get the number of effective threads, i.e. if `num_threads <= 0`, the number
+// of available hardware threads is returned.
+int GetEffectiveNumThreads(const int num_threads);
+
+// Split the range [begin, end) into contiguous chunks of at least `min_chunk`
+// items and call `func(chunk_begin, chunk_end)` for every chunk on up to
+// `num_threads` threads. The calling thread processes the first chunk and the
+// function returns once all chunks are done.
+void ParallelForRange(const size_t begin, const size_t end,
+                      const int num_threads, const size_t min_chunk,
+                      const std::function<void(size_t, size_t)>& func);
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+size_t ThreadPool::NumThreads() const { return workers_.size(); }
+
+template <class func_t, class... args_t>
+auto ThreadPool::AddTask(func_t&& f, args_t&&... args)
+    -> std::future<typename std::result_of<func_t(args_t...)>::type> {
+  typedef typename std::result_of<func_t(args_t...)>::type return_t;
+
+  auto task = std::make_shared<std::packaged_task<return_t()>>(
+      std::bind(std::forward<func_t>(f), std::forward<args_t>(args)...));
+
+  std::future<return_t> result = task->get_future();
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopped_) {
+      throw std::runtime_error("Cannot add task to stopped thread pool.");
+    }
+    tasks_.emplace([task]() { (*task)(); });
+  }
+
+  task_condition_.notify_one();
+
+  return result;
+}
+
+#endif  // COLMAP_SRC_UTIL_THREADING_H_
@@ -0,0 +1,227 @@
+#include "two_view_geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <Eigen/Dense>
+
+namespace {
+
+// Translate the centroid of the points to the origin and scale them to an
+// average distance of sqrt(2) from it, see "In Defense of the Eight-Point
+// Algorithm", Hartley, 1997.
+Eigen::Matrix3d NormalizePoints(const std::vector<Eigen::Vector2d>& points,
+                                std::vector<Eigen::Vector2d>* normed_points) {
+  Eigen::Vector2d centroid = Eigen::Vector2d::Zero();
+  for (const auto& point : points) {
+    centroid += point;
+  }
+  centroid /= points.size();
+
+  double mean_dist = 0;
+  for (const auto& point : points) {
+    mean_dist += (point - centroid).norm();
+  }
+  mean_dist /= points.size();
+  const double scale = mean_dist > 0 ? std::sqrt(2.0) / mean_dist : 1.0;
+
+  normed_points->resize(points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    (*normed_points)[i] = scale * (points[i] - centroid);
+  }
+
+  Eigen::Matrix3d transform;
+  transform << scale, 0, -scale * centroid(0), 0, scale, -scale * centroid(1),
+      0, 0, 1;
+  return transform;
+}
+
+// Number of RANSAC trials to sample an all-inlier minimal sample with the
+// given confidence.
+int ComputeNumTrials(const double inlier_ratio, const double confidence,
+                     const int sample_size) {
+  const double prob_good_sample = std::pow(inlier_ratio, sample_size);
+  if (prob_good_sample <= 0) {
+    return std::numeric_limits<int>::max();
+  } else if (prob_good_sample >= 1) {
+    return 1;
+  }
+  const double num_trials =
+      std::log(1 - confidence) / std::log(1 - prob_good_sample);
+  return static_cast<int>(std::min<double>(std::ceil(num_trials),
+                                           std::numeric_limits<int>::max()));
+}
+
+}  // namespace
+
+bool EstimateFundamentalMatrix(const std::vector<Eigen::Vector2d>& points1,
+                               const std::vector<Eigen::Vector2d>& points2,
+                               Eigen::Matrix3d* F) {
+  if (points1.size() < 8 || points1.size() != points2.size()) {
+    return false;
+  }
+
+  std::vector<Eigen::Vector2d> normed_points1;
+  std::vector<Eigen::Vector2d> normed_points2;
+  const Eigen::Matrix3d transform1 = NormalizePoints(points1, &normed_points1);
+  const Eigen::Matrix3d transform2 = NormalizePoints(points2, &normed_points2);
+
+  // Every correspondence contributes one row to the constraint matrix.
+  Eigen::Matrix<double, Eigen::Dynamic, 9> A(points1.size(), 9);
+  for (size_t i = 0; i < points1.size(); ++i) {
+    const double x1 = normed_points1[i](0);
+    const double y1 = normed_points1[i](1);
+    const double x2 = normed_points2[i](0);
+    const double y2 = normed_points2[i](1);
+    A.row(i) << x2 * x1, x2 * y1, x2, y2 * x1, y2 * y1, y2, x1, y1, 1;
+  }
+
+  const Eigen::JacobiSVD<Eigen::Matrix<double, Eigen::Dynamic, 9>> svd(
+      A, Eigen::ComputeFullV);
+  const Eigen::Matrix<double, 9, 1> nullspace = svd.matrixV().col(8);
+  const Eigen::Matrix3d normed_F =
+      Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(
+          nullspace.data());
+
+  // Enforce the rank 2 constraint.
+  Eigen::JacobiSVD<Eigen::Matrix3d> F_svd(
+      normed_F, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  Eigen::Vector3d singular_values = F_svd.singularValues();
+  singular_values(2) = 0;
+  const Eigen::Matrix3d rank2_F = F_svd.matrixU() *
+                                  singular_values.asDiagonal() *
+                                  F_svd.matrixV().transpose();
+
+  *F = transform2.transpose() * rank2_F * transform1;
+  return std::isfinite(F->sum());
+}
+
+double ComputeSquaredSampsonError(const Eigen::Vector2d& point1,
+                                  const Eigen::Vector2d& point2,
+                                  const Eigen::Matrix3d& F) {
+  const Eigen::Vector3d Fx1 = F * point1.homogeneous();
+  const Eigen::Vector3d Ftx2 = F.transpose() * point2.homogeneous();
+  const double x2tFx1 = point2.homogeneous().dot(Fx1);
+  const double denominator = Fx1(0) * Fx1(0) + Fx1(1) * Fx1(1) +
+                             Ftx2(0) * Ftx2(0) + Ftx2(1) * Ftx2(1);
+  if (denominator <= 0) {
+    return std::numeric_limits<double>::max();
+  }
+  return x2tFx1 * x2tFx1 / denominator;
+}
+
+bool VerifyFeatureMatches(const FeatureKeypoints& keypoints1,
+                          const FeatureKeypoints& keypoints2,
+                          const FeatureMatches& matches,
+                          const SiftMatchOptions& match_options,
+                          FeatureMatches* inlier_matches,
+                          Eigen::Matrix3d* F) {
+  inlier_matches->clear();
+
+  const size_t kSampleSize = 8;
+  const size_t min_num_inliers = std::max<size_t>(
+      kSampleSize, static_cast<size_t>(match_options.min_num_inliers));
+  if (matches.size() < min_num_inliers) {
+    return false;
+  }
+
+  std::vector<Eigen::Vector2d> points1(matches.size());
+  std::vector<Eigen::Vector2d> points2(matches.size());
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const FeatureKeypoint& keypoint1 = keypoints1[matches[i].point2D_idx1];
+    const FeatureKeypoint& keypoint2 = keypoints2[matches[i].point2D_idx2];
+    points1[i] = Eigen::Vector2d(keypoint1.x, keypoint1.y);
+    points2[i] = Eigen::Vector2d(keypoint2.x, keypoint2.y);
+  }
+
+  const double max_squared_error =
+      match_options.max_error * match_options.max_error;
+  const auto FindInliers = [&](const Eigen::Matrix3d& model) {
+    std::vector<size_t> inlier_idxs;
+    for (size_t i = 0; i < matches.size(); ++i) {
+      if (ComputeSquaredSampsonError(points1[i], points2[i], model) <=
+          max_squared_error) {
+        inlier_idxs.push_back(i);
+      }
+    }
+    return inlier_idxs;
+  };
+
+  int max_num_trials = std::min(
+      match_options.max_num_trials,
+      std::max(match_options.min_num_trials,
+               ComputeNumTrials(match_options.min_inlier_ratio,
+                                match_options.confidence, kSampleSize)));
+
+  std::mt19937 random_engine(0);
+  std::vector<size_t> all_idxs(matches.size());
+  for (size_t i = 0; i < all_idxs.size(); ++i) {
+    all_idxs[i] = i;
+  }
+
+  Eigen::Matrix3d best_model = Eigen::Matrix3d::Zero();
+  std::vector<size_t> best_inlier_idxs;
+  std::vector<Eigen::Vector2d> sample1(kSampleSize);
+  std::vector<Eigen::Vector2d> sample2(kSampleSize);
+  for (int trial = 0; trial < max_num_trials; ++trial) {
+    // Partial Fisher-Yates shuffle to draw distinct matches.
+    for (size_t i = 0; i < kSampleSize; ++i) {
+      std::uniform_int_distribution<size_t> distribution(
+          i, all_idxs.size() - 1);
+      std::swap(all_idxs[i], all_idxs[distribution(random_engine)]);
+      sample1[i] = points1[all_idxs[i]];
+      sample2[i] = points2[all_idxs[i]];
+    }
+
+    Eigen::Matrix3d model;
+    if (!EstimateFundamentalMatrix(sample1, sample2, &model)) {
+      continue;
+    }
+
+    std::vector<size_t> inlier_idxs = FindInliers(model);
+    if (inlier_idxs.size() > best_inlier_idxs.size()) {
+      best_model = model;
+      best_inlier_idxs.swap(inlier_idxs);
+      const int num_trials = ComputeNumTrials(
+          static_cast<double>(best_inlier_idxs.size()) / matches.size(),
+          match_options.confidence, kSampleSize);
+      max_num_trials = std::min(
+          max_num_trials, std::max(match_options.min_num_trials, num_trials));
+    }
+  }
+
+  if (best_inlier_idxs.size() < min_num_inliers) {
+    return false;
+  }
+
+  // Refine the model on all inliers of the best minimal model and keep it,
+  // unless it explains fewer matches.
+  std::vector<Eigen::Vector2d> inlier_points1;
+  std::vector<Eigen::Vector2d> inlier_points2;
+  for (const size_t idx : best_inlier_idxs) {
+    inlier_points1.push_back(points1[idx]);
+    inlier_points2.push_back(points2[idx]);
+  }
+  Eigen::Matrix3d refined_model;
+  if (EstimateFundamentalMatrix(inlier_points1, inlier_points2,
+                                &refined_model)) {
+    std::vector<size_t> refined_inlier_idxs = FindInliers(refined_model);
+    if (refined_inlier_idxs.size() >= best_inlier_idxs.size()) {
+      best_model = refined_model;
+      best_inlier_idxs.swap(refined_inlier_idxs);
+    }
+  }
+
+  if (F != nullptr) {
+    *F = best_model;
+  }
+
+  inlier_matches->reserve(best_inlier_idxs.size());
+  for (const size_t idx : best_inlier_idxs) {
+    inlier_matches->push_back(matches[idx]);
+  }
+
+  return true;
+}
@@ -0,0 +1,33 @@
+#ifndef COLMAP_SRC_BASE_TWO_VIEW_GEOMETRY_H_
+#define COLMAP_SRC_BASE_TWO_VIEW_GEOMETRY_H_
+
+#include <Eigen/Core>
+
+#include "feature.h"
+#include "feature_matching.h"
+
+// Estimate the fundamental matrix from the given points with the normalized
+// 8-point algorithm, such that `x2' * F * x1 = 0`. At least 8 points are
+// required.
+bool EstimateFundamentalMatrix(const std::vector<Eigen::Vector2d>& points1,
+                               const std::vector<Eigen::Vector2d>& points2,
+                               Eigen::Matrix3d* F);
+
+// Squared Sampson distance of a correspondence to the epipolar geometry.
+double ComputeSquaredSampsonError(const Eigen::Vector2d& point1,
+                                  const Eigen::Vector2d& point2,
+                                  const Eigen::Matrix3d& F);
+
+// Geometrically verify the matches of an image pair by estimating the
+// fundamental matrix with RANSAC. The maximum epipolar error, confidence,
+// number of trials and minimum inlier ratio are taken from the options.
+// Returns true and the inlier matches if at least `min_num_inliers` matches
+// are consistent with the estimated geometry.
+bool VerifyFeatureMatches(const FeatureKeypoints& keypoints1,
+                          const FeatureKeypoints& keypoints2,
+                          const FeatureMatches& matches,
+                          const SiftMatchOptions& match_options,
+                          FeatureMatches* inlier_matches,
+                          Eigen::Matrix3d* F = nullptr);
+
+#endif  // COLMAP_SRC_BASE_TWO_VIEW_GEOMETRY_H_
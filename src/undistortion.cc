@@ -0,0 +1,166 @@
+#include "undistortion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "threading.h"
+
+namespace {
+
+const size_t kMinRowsPerThread = 16;
+const size_t kMinKeypointsPerThread = 256;
+
+}  // namespace
+
+Eigen::Vector2d CameraModel::Distort(const Eigen::Vector2d& point) const {
+  const double u = point(0);
+  const double v = point(1);
+  switch (type) {
+    case CameraModelType::RADIAL_TANGENTIAL: {
+      const double u2 = u * u;
+      const double v2 = v * v;
+      const double uv = u * v;
+      const double r2 = u2 + v2;
+      const double radial = 1.0 + r2 * (k1 + r2 * (k2 + r2 * k3));
+      return Eigen::Vector2d(
+          radial * u + 2.0 * p1 * uv + p2 * (r2 + 2.0 * u2),
+          radial * v + p1 * (r2 + 2.0 * v2) + 2.0 * p2 * uv);
+    }
+    case CameraModelType::FISHEYE: {
+      const double r = std::sqrt(u * u + v * v);
+      if (r < std::numeric_limits<double>::epsilon()) {
+        return point;
+      }
+      const double theta = std::atan(r);
+      const double theta2 = theta * theta;
+      const double theta_d =
+          theta *
+          (1.0 + theta2 * (k1 + theta2 * (k2 + theta2 * (k3 + theta2 * k4))));
+      return point * (theta_d / r);
+    }
+  }
+  return point;
+}
+
+Eigen::Vector2d CameraModel::Undistort(const Eigen::Vector2d& point) const {
+  // Newton iterations with a numerical Jacobian of the distortion.
+  const int kNumIterations = 100;
+  const double kMaxStepNorm = 1e-10;
+  const double kRelStepSize = 1e-6;
+
+  Eigen::Vector2d undistorted = point;
+  for (int i = 0; i < kNumIterations; ++i) {
+    const double step0 =
+        std::max(std::numeric_limits<double>::epsilon(),
+                 std::abs(kRelStepSize * undistorted(0)));
+    const double step1 =
+        std::max(std::numeric_limits<double>::epsilon(),
+                 std::abs(kRelStepSize * undistorted(1)));
+
+    const Eigen::Vector2d distorted = Distort(undistorted);
+    const Eigen::Vector2d distorted0 =
+        Distort(undistorted + Eigen::Vector2d(step0, 0));
+    const Eigen::Vector2d distorted1 =
+        Distort(undistorted + Eigen::Vector2d(0, step1));
+
+    Eigen::Matrix2d jacobian;
+    jacobian.col(0) = (distorted0 - distorted) / step0;
+    jacobian.col(1) = (distorted1 - distorted) / step1;
+
+    const Eigen::Vector2d step = jacobian.inverse() * (distorted - point);
+    undistorted -= step;
+    if (!step.allFinite() || step.squaredNorm() < kMaxStepNorm) {
+      break;
+    }
+  }
+  return undistorted;
+}
+
+Eigen::Vector2d CameraModel::ImageToWorld(const Eigen::Vector2d& point) const {
+  return Eigen::Vector2d((point(0) - principal_point_x) / focal_length_x,
+                         (point(1) - principal_point_y) / focal_length_y);
+}
+
+Eigen::Vector2d CameraModel::WorldToImage(const Eigen::Vector2d& point) const {
+  return Eigen::Vector2d(focal_length_x * point(0) + principal_point_x,
+                         focal_length_y * point(1) + principal_point_y);
+}
+
+Undistorter::Undistorter(const CameraModel& camera,
+                         const UndistortionOptions& options)
+    : distorted_camera_(camera), options_(options) {
+  const int width = options_.width > 0 ? options_.width : camera.width;
+  const int height = options_.height > 0 ? options_.height : camera.height;
+
+  undistorted_camera_.type = CameraModelType::RADIAL_TANGENTIAL;
+  undistorted_camera_.width = width;
+  undistorted_camera_.height = height;
+  undistorted_camera_.focal_length_x =
+      camera.focal_length_x * options_.focal_length_scale;
+  undistorted_camera_.focal_length_y =
+      camera.focal_length_y * options_.focal_length_scale;
+
+  if (width <= 0 || height <= 0 || camera.width <= 0 || camera.height <= 0) {
+    return;
+  }
+
+  undistorted_camera_.principal_point_x =
+      camera.principal_point_x * width / camera.width;
+  undistorted_camera_.principal_point_y =
+      camera.principal_point_y * height / camera.height;
+
+  // For every undistorted pixel center, find the distorted position. The
+  // offset of 0.5 converts between the keypoint and the sampler convention.
+  std::vector<float> map_x(static_cast<size_t>(width) * height);
+  std::vector<float> map_y(map_x.size());
+  ParallelForRange(
+      0, height, options_.warp_options.num_threads, kMinRowsPerThread,
+      [&](const size_t begin, const size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+          for (int x = 0; x < width; ++x) {
+            const Eigen::Vector2d world = undistorted_camera_.ImageToWorld(
+                Eigen::Vector2d(x + 0.5, y + 0.5));
+            const Eigen::Vector2d image = distorted_camera_.WorldToImage(
+                distorted_camera_.Distort(world));
+            const size_t idx = y * width + x;
+            map_x[idx] = static_cast<float>(image(0) - 0.5);
+            map_y[idx] = static_cast<float>(image(1) - 0.5);
+          }
+        }
+      });
+
+  BuildRemapTable(map_x.data(), map_y.data(), width, height, &remap_table_);
+}
+
+bool Undistorter::Undistort(const Bitmap& distorted,
+                            Bitmap* undistorted) const {
+  if (distorted.Width() != distorted_camera_.width ||
+      distorted.Height() != distorted_camera_.height) {
+    return false;
+  }
+  return Remap(distorted, remap_table_, undistorted, options_.warp_options);
+}
+
+void Undistorter::UndistortKeypoints(FeatureKeypoints* keypoints) const {
+  ParallelForRange(
+      0, keypoints->size(), options_.warp_options.num_threads,
+      kMinKeypointsPerThread, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          FeatureKeypoint& keypoint = (*keypoints)[i];
+          const Eigen::Vector2d point =
+              UndistortPoint(Eigen::Vector2d(keypoint.x, keypoint.y));
+          keypoint.x = static_cast<float>(point(0));
+          keypoint.y = static_cast<float>(point(1));
+        }
+      });
+}
+
+Eigen::Vector2d Undistorter::UndistortPoint(
+    const Eigen::Vector2d& point) const {
+  return undistorted_camera_.WorldToImage(
+      distorted_camera_.Undistort(distorted_camera_.ImageToWorld(point)));
+}
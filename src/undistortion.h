@@ -0,0 +1,111 @@
+#ifndef COLMAP_SRC_UTIL_UNDISTORTION_H_
+#define COLMAP_SRC_UTIL_UNDISTORTION_H_
+
+#include <Eigen/Core>
+
+#include "bitmap.h"
+#include "feature.h"
+#include "image_warp.h"
+
+enum class CameraModelType {
+  // Brown-Conrady model with radial coefficients k1, k2, k3 and tangential
+  // coefficients p1, p2, as used by OpenCV's `undistort`.
+  RADIAL_TANGENTIAL,
+  // Equidistant fisheye model with coefficients k1, k2, k3, k4 on the angle
+  // of incidence, as used by OpenCV's `fisheye` module.
+  FISHEYE,
+};
+
+// Intrinsics of a camera. Coordinates follow the convention of
+// `FeatureKeypoint`, i.e. the upper left pixel has the coordinate (0.5, 0.5),
+// so that the principal point of a centered camera is (width / 2, height / 2).
+struct CameraModel {
+  CameraModelType type = CameraModelType::RADIAL_TANGENTIAL;
+
+  int width = 0;
+  int height = 0;
+
+  double focal_length_x = 0.0;
+  double focal_length_y = 0.0;
+  double principal_point_x = 0.0;
+  double principal_point_y = 0.0;
+
+  double k1 = 0.0;
+  double k2 = 0.0;
+  double k3 = 0.0;
+  double k4 = 0.0;
+  double p1 = 0.0;
+  double p2 = 0.0;
+
+  // Apply the distortion to normalized image coordinates.
+  Eigen::Vector2d Distort(const Eigen::Vector2d& point) const;
+
+  // Invert `Distort` iteratively.
+  Eigen::Vector2d Undistort(const Eigen::Vector2d& point) const;
+
+  // Conversions between pixel and normalized image coordinates.
+  Eigen::Vector2d ImageToWorld(const Eigen::Vector2d& point) const;
+  Eigen::Vector2d WorldToImage(const Eigen::Vector2d& point) const;
+};
+
+struct UndistortionOptions {
+  // Size of the undistorted image. If zero, the size of the camera is used.
+  int width = 0;
+  int height = 0;
+
+  // Scale of the focal length of the undistorted pinhole camera relative to
+  // the distorted camera. Values below 1 keep more of the distorted image.
+  double focal_length_scale = 1.0;
+
+  // Sampling of the distorted image.
+  WarpOptions warp_options;
+};
+
+// Undistorts images and keypoints of a fixed camera. The remap table from
+// undistorted to distorted pixels is built once on construction, so that the
+// per-image cost is a single resampling pass:
+//
+//    Undistorter undistorter(camera);
+//    for (...) {
+//      undistorter.Undistort(distorted, &undistorted);
+//    }
+//
+class Undistorter {
+ public:
+  explicit Undistorter(const CameraModel& camera,
+                       const UndistortionOptions& options =
+                           UndistortionOptions());
+
+  // The undistorted camera is a distortion-free pinhole camera.
+  inline const CameraModel& DistortedCamera() const;
+  inline const CameraModel& UndistortedCamera() const;
+
+  // Undistort an image of the distorted camera's size. Returns false for
+  // images of the wrong size or high bit depth.
+  bool Undistort(const Bitmap& distorted, Bitmap* undistorted) const;
+
+  // Map keypoint locations from the distorted to the undistorted image.
+  // Scale and orientation are left unchanged.
+  void UndistortKeypoints(FeatureKeypoints* keypoints) const;
+  Eigen::Vector2d UndistortPoint(const Eigen::Vector2d& point) const;
+
+ private:
+  CameraModel distorted_camera_;
+  CameraModel undistorted_camera_;
+  UndistortionOptions options_;
+  RemapTable remap_table_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+const CameraModel& Undistorter::DistortedCamera() const {
+  return distorted_camera_;
+}
+
+const CameraModel& Undistorter::UndistortedCamera() const {
+  return undistorted_camera_;
+}
+
+#endif  // COLMAP_SRC_UTIL_UNDISTORTION_H_
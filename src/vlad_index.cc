@@ -0,0 +1,437 @@
+#include "vlad_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <random>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <Eigen/Eigenvalues>
+
+#include "VLFeat/kmeans.h"
+#include "VLFeat/vlad.h"
+#include "threading.h"
+
+namespace {
+
+const size_t kHeaderSize = 2 * sizeof(uint32_t);
+
+typedef std::pair<float, uint32_t> ScoredId;
+
+// Min-heap of the `k` best scores seen so far.
+typedef std::priority_queue<ScoredId, std::vector<ScoredId>,
+                            std::greater<ScoredId>>
+    TopKHeap;
+
+void PushTopK(const ScoredId& scored_id, const size_t k, TopKHeap* heap) {
+  if (heap->size() < k) {
+    heap->push(scored_id);
+  } else if (scored_id.first > heap->top().first) {
+    heap->pop();
+    heap->push(scored_id);
+  }
+}
+
+template <typename Matrix>
+bool WriteMatrix(FILE* file, const Matrix& matrix) {
+  const size_t size = static_cast<size_t>(matrix.size());
+  return fwrite(matrix.data(), sizeof(float), size, file) == size;
+}
+
+template <typename Matrix>
+bool ReadMatrix(FILE* file, Matrix* matrix) {
+  const size_t size = static_cast<size_t>(matrix->size());
+  return fread(matrix->data(), sizeof(float), size, file) == size;
+}
+
+}  // namespace
+
+bool VladEncoder::Train(const VladOptions& options,
+                        const DescriptorLoader& loader) {
+  centers_.resize(0, 0);
+  pca_mean_.resize(0);
+  pca_basis_.resize(0, 0);
+  power_ = static_cast<float>(options.power);
+
+  const size_t num_images = loader.NumImages();
+  const size_t num_train_images =
+      std::min(num_images, options.max_num_training_images);
+  if (num_train_images == 0 || options.num_clusters <= 0) {
+    return false;
+  }
+  std::vector<size_t> train_image_idxs(num_train_images);
+  for (size_t i = 0; i < num_train_images; ++i) {
+    train_image_idxs[i] = i * num_images / num_train_images;
+  }
+
+  // Sample the same number of RootSIFT descriptors from every image.
+  const size_t max_num_samples = std::max<size_t>(
+      1, options.max_num_training_descriptors / num_train_images);
+  std::vector<RowMajorMatrixXf> samples(num_train_images);
+  ParallelForRange(
+      0, num_train_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        for (size_t i = begin; i < end; ++i) {
+          if (!loader.Load(train_image_idxs[i], &descriptors) ||
+              descriptors.rows() == 0) {
+            continue;
+          }
+          const Eigen::MatrixXf root_descriptors =
+              L1RootNormalizeFeatureDescriptors(descriptors.cast<float>());
+          std::vector<Eigen::DenseIndex> rows(root_descriptors.rows());
+          std::iota(rows.begin(), rows.end(), 0);
+          std::mt19937 random_engine(static_cast<unsigned>(i));
+          std::shuffle(rows.begin(), rows.end(), random_engine);
+          rows.resize(std::min(rows.size(), max_num_samples));
+          samples[i].resize(rows.size(), root_descriptors.cols());
+          for (size_t j = 0; j < rows.size(); ++j) {
+            samples[i].row(j) = root_descriptors.row(rows[j]);
+          }
+        }
+      });
+
+  Eigen::DenseIndex num_samples = 0;
+  Eigen::DenseIndex dim = 0;
+  for (const auto& image_samples : samples) {
+    num_samples += image_samples.rows();
+    dim = std::max(dim, image_samples.cols());
+  }
+  RowMajorMatrixXf training_descriptors(num_samples, dim);
+  num_samples = 0;
+  for (const auto& image_samples : samples) {
+    if (image_samples.cols() == dim) {
+      training_descriptors.middleRows(num_samples, image_samples.rows()) =
+          image_samples;
+      num_samples += image_samples.rows();
+    }
+  }
+  samples.clear();
+  if (num_samples < options.num_clusters) {
+    return false;
+  }
+
+  VlKMeans* kmeans = vl_kmeans_new(VL_TYPE_FLOAT, VlDistanceL2);
+  vl_kmeans_set_algorithm(kmeans, VlKMeansElkan);
+  vl_kmeans_set_initialization(kmeans, VlKMeansPlusPlus);
+  vl_kmeans_set_max_num_iterations(kmeans, options.max_num_iterations);
+  vl_kmeans_cluster(kmeans, training_descriptors.data(), dim, num_samples,
+                    options.num_clusters);
+  centers_ = Eigen::Map<const RowMajorMatrixXf>(
+      static_cast<const float*>(vl_kmeans_get_centers(kmeans)),
+      options.num_clusters, dim);
+  vl_kmeans_delete(kmeans);
+
+  const Eigen::DenseIndex full_dim = centers_.size();
+  if (options.num_dimensions <= 0 || options.num_dimensions >= full_dim) {
+    return true;
+  }
+
+  // PCA of the full vectors of the training images, computed from the
+  // eigenvectors of their Gram matrix, which is much smaller than the
+  // covariance matrix of the vectors.
+  RowMajorMatrixXf vectors(num_train_images, full_dim);
+  ParallelForRange(
+      0, num_train_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        Eigen::VectorXf vector;
+        for (size_t i = begin; i < end; ++i) {
+          if (!loader.Load(train_image_idxs[i], &descriptors)) {
+            descriptors.resize(0, dim);
+          }
+          EncodeFull(descriptors, &vector);
+          vectors.row(i) = vector.transpose();
+        }
+      });
+
+  pca_mean_ = vectors.colwise().mean().transpose();
+  vectors.rowwise() -= pca_mean_.transpose();
+  const Eigen::MatrixXf gram = vectors * vectors.transpose();
+  const Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> eigen_solver(gram);
+
+  // Eigenvalues are in increasing order.
+  const Eigen::DenseIndex num_dimensions =
+      std::min<Eigen::DenseIndex>(options.num_dimensions, num_train_images);
+  pca_basis_.resize(num_dimensions, full_dim);
+  Eigen::DenseIndex num_components = 0;
+  for (Eigen::DenseIndex i = 0; i < num_dimensions; ++i) {
+    const Eigen::DenseIndex idx = gram.rows() - 1 - i;
+    const float eigenvalue = eigen_solver.eigenvalues()(idx);
+    if (eigenvalue <= 1e-6f * eigen_solver.eigenvalues().maxCoeff()) {
+      break;
+    }
+    pca_basis_.row(num_components) =
+        (vectors.transpose() * eigen_solver.eigenvectors().col(idx))
+            .transpose() /
+        std::sqrt(eigenvalue);
+    num_components += 1;
+  }
+  pca_basis_.conservativeResize(num_components, full_dim);
+
+  return num_components > 0;
+}
+
+bool VladEncoder::IsTrained() const { return centers_.size() > 0; }
+
+int VladEncoder::NumDimensions() const {
+  return static_cast<int>(pca_basis_.rows() > 0 ? pca_basis_.rows()
+                                                : centers_.size());
+}
+
+void VladEncoder::Encode(const FeatureDescriptors& descriptors,
+                         Eigen::VectorXf* vector) const {
+  EncodeFull(descriptors, vector);
+  if (pca_basis_.rows() == 0) {
+    return;
+  }
+
+  Eigen::VectorXf reduced_vector = pca_basis_ * (*vector - pca_mean_);
+  const float norm = reduced_vector.norm();
+  if (norm > 0) {
+    reduced_vector /= norm;
+  }
+  vector->swap(reduced_vector);
+}
+
+void VladEncoder::EncodeFull(const FeatureDescriptors& descriptors,
+                             Eigen::VectorXf* vector) const {
+  const Eigen::DenseIndex num_clusters = centers_.rows();
+  const Eigen::DenseIndex dim = centers_.cols();
+  vector->setZero(num_clusters * dim);
+  if (descriptors.rows() == 0 || descriptors.cols() != dim) {
+    return;
+  }
+
+  const RowMajorMatrixXf root_descriptors =
+      L1RootNormalizeFeatureDescriptors(descriptors.cast<float>());
+
+  // Hard assignment to the nearest center, i.e. the one maximizing
+  // `x' * c - |c|^2 / 2`.
+  const Eigen::VectorXf half_squared_norms =
+      0.5f * centers_.rowwise().squaredNorm();
+  const Eigen::MatrixXf scores = root_descriptors * centers_.transpose();
+  RowMajorMatrixXf assignments =
+      RowMajorMatrixXf::Zero(root_descriptors.rows(), num_clusters);
+  for (Eigen::DenseIndex i = 0; i < scores.rows(); ++i) {
+    Eigen::DenseIndex best_idx;
+    (scores.row(i) - half_squared_norms.transpose()).maxCoeff(&best_idx);
+    assignments(i, best_idx) = 1;
+  }
+
+  vl_vlad_encode(vector->data(), VL_TYPE_FLOAT, centers_.data(), dim,
+                 num_clusters, root_descriptors.data(),
+                 root_descriptors.rows(), assignments.data(),
+                 VL_VLAD_FLAG_NORMALIZE_COMPONENTS |
+                     VL_VLAD_FLAG_UNNORMALIZED);
+
+  // Signed power normalization reduces the influence of bursty components.
+  for (Eigen::DenseIndex i = 0; i < vector->size(); ++i) {
+    const float value = (*vector)(i);
+    (*vector)(i) = std::copysign(std::pow(std::abs(value), power_), value);
+  }
+  const float norm = vector->norm();
+  if (norm > 0) {
+    *vector /= norm;
+  }
+}
+
+bool VladEncoder::Write(const std::string& path) const {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  const uint32_t header[3] = {static_cast<uint32_t>(centers_.rows()),
+                              static_cast<uint32_t>(centers_.cols()),
+                              static_cast<uint32_t>(pca_basis_.rows())};
+  bool success = fwrite(header, sizeof(uint32_t), 3, file) == 3 &&
+                 fwrite(&power_, sizeof(float), 1, file) == 1 &&
+                 WriteMatrix(file, centers_);
+  if (pca_basis_.rows() > 0) {
+    success = success && WriteMatrix(file, pca_mean_) &&
+              WriteMatrix(file, pca_basis_);
+  }
+  success = fclose(file) == 0 && success;
+  return success;
+}
+
+bool VladEncoder::Read(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+
+  uint32_t header[3];
+  bool success = fread(header, sizeof(uint32_t), 3, file) == 3 &&
+                 fread(&power_, sizeof(float), 1, file) == 1;
+  if (success) {
+    const Eigen::DenseIndex full_dim =
+        static_cast<Eigen::DenseIndex>(header[0]) * header[1];
+    centers_.resize(header[0], header[1]);
+    pca_mean_.resize(header[2] > 0 ? full_dim : 0);
+    pca_basis_.resize(header[2], header[2] > 0 ? full_dim : 0);
+    success = ReadMatrix(file, &centers_) && ReadMatrix(file, &pca_mean_) &&
+              ReadMatrix(file, &pca_basis_);
+  }
+  fclose(file);
+
+  if (!success) {
+    centers_.resize(0, 0);
+    pca_mean_.resize(0);
+    pca_basis_.resize(0, 0);
+  }
+  return success;
+}
+
+VladIndexWriter::VladIndexWriter()
+    : file_(nullptr), num_dimensions_(0), num_vectors_(0), success_(false) {}
+
+VladIndexWriter::~VladIndexWriter() { Close(); }
+
+bool VladIndexWriter::Open(const std::string& path,
+                           const int num_dimensions) {
+  Close();
+  file_ = fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    return false;
+  }
+  num_dimensions_ = num_dimensions;
+  num_vectors_ = 0;
+  const uint32_t header[2] = {0, static_cast<uint32_t>(num_dimensions)};
+  success_ = fwrite(header, sizeof(uint32_t), 2, file_) == 2;
+  return success_;
+}
+
+bool VladIndexWriter::Add(const uint32_t image_id,
+                          const Eigen::VectorXf& vector) {
+  if (file_ == nullptr || vector.size() != num_dimensions_) {
+    return false;
+  }
+  success_ = success_ && fwrite(&image_id, sizeof(uint32_t), 1, file_) == 1 &&
+             fwrite(vector.data(), sizeof(float), num_dimensions_, file_) ==
+                 static_cast<size_t>(num_dimensions_);
+  num_vectors_ += 1;
+  return success_;
+}
+
+bool VladIndexWriter::Close() {
+  if (file_ == nullptr) {
+    return false;
+  }
+  bool success = success_ && fseek(file_, 0, SEEK_SET) == 0 &&
+                 fwrite(&num_vectors_, sizeof(uint32_t), 1, file_) == 1;
+  success = fclose(file_) == 0 && success;
+  file_ = nullptr;
+  return success;
+}
+
+bool VladIndex::Open(const std::string& path) {
+  Close();
+  if (!file_.Open(path) || file_.Size() < kHeaderSize) {
+    file_.Close();
+    return false;
+  }
+
+  uint32_t header[2];
+  memcpy(header, file_.Data(), kHeaderSize);
+  const size_t record_size = sizeof(uint32_t) + header[1] * sizeof(float);
+  if (file_.Size() != kHeaderSize + header[0] * record_size) {
+    file_.Close();
+    return false;
+  }
+
+  num_vectors_ = header[0];
+  num_dimensions_ = static_cast<int>(header[1]);
+  record_size_ = record_size;
+  return true;
+}
+
+void VladIndex::Close() {
+  file_.Close();
+  num_vectors_ = 0;
+  num_dimensions_ = 0;
+  record_size_ = 0;
+}
+
+size_t VladIndex::NumVectors() const { return num_vectors_; }
+
+int VladIndex::NumDimensions() const { return num_dimensions_; }
+
+uint32_t VladIndex::ImageId(const size_t idx) const {
+  uint32_t image_id;
+  memcpy(&image_id, Record(idx), sizeof(uint32_t));
+  return image_id;
+}
+
+const float* VladIndex::Vector(const size_t idx) const {
+  return reinterpret_cast<const float*>(Record(idx) + sizeof(uint32_t));
+}
+
+void VladIndex::Search(
+    const float* query, const int k, const int num_threads,
+    std::vector<std::pair<uint32_t, float>>* results) const {
+  results->clear();
+  if (k <= 0 || num_vectors_ == 0) {
+    return;
+  }
+
+  const size_t kMinChunkSize = 4096;
+  std::mutex mutex;
+  TopKHeap heap;
+  ParallelForRange(
+      0, num_vectors_, num_threads, kMinChunkSize,
+      [&](const size_t begin, const size_t end) {
+        TopKHeap chunk_heap;
+        for (size_t i = begin; i < end; ++i) {
+          PushTopK(ScoredId(DotProduct(query, Vector(i), num_dimensions_),
+                            static_cast<uint32_t>(i)),
+                   k, &chunk_heap);
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!chunk_heap.empty()) {
+          PushTopK(chunk_heap.top(), k, &heap);
+          chunk_heap.pop();
+        }
+      });
+
+  results->resize(heap.size());
+  for (size_t i = results->size(); i > 0; --i) {
+    (*results)[i - 1] =
+        std::make_pair(ImageId(heap.top().second), heap.top().first);
+    heap.pop();
+  }
+}
+
+const uint8_t* VladIndex::Record(const size_t idx) const {
+  return file_.Data() + kHeaderSize + idx * record_size_;
+}
+
+float DotProduct(const float* vector1, const float* vector2, const int size) {
+  int i = 0;
+  float sum = 0.0f;
+#ifdef __SSE2__
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (; i + 8 <= size; i += 8) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(vector1 + i),
+                                       _mm_loadu_ps(vector2 + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(vector1 + i + 4),
+                                       _mm_loadu_ps(vector2 + i + 4)));
+  }
+  float partial_sums[4];
+  _mm_storeu_ps(partial_sums, _mm_add_ps(acc0, acc1));
+  sum = partial_sums[0] + partial_sums[1] + partial_sums[2] + partial_sums[3];
+#endif
+  for (; i < size; ++i) {
+    sum += vector1[i] * vector2[i];
+  }
+  return sum;
+}
@@ -0,0 +1,136 @@
+#ifndef COLMAP_SRC_BASE_VLAD_INDEX_H_
+#define COLMAP_SRC_BASE_VLAD_INDEX_H_
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "exhaustive_matcher.h"
+#include "feature.h"
+#include "mapped_image.h"
+
+struct VladOptions {
+  // Number of k-means clusters of the codebook.
+  int num_clusters = 64;
+
+  // Dimension of the PCA-reduced vectors. If `num_dimensions <= 0` or not
+  // smaller than `num_clusters * 128`, the full vectors are kept.
+  int num_dimensions = 256;
+
+  // Exponent of the signed power normalization.
+  double power = 0.5;
+
+  // Maximum number of images to train the codebook and the PCA, and
+  // maximum number of descriptors sampled from them for the codebook.
+  size_t max_num_training_images = 1000;
+  size_t max_num_training_descriptors = 100000;
+
+  int max_num_iterations = 50;
+
+  // Number of threads to load and encode the training images. If
+  // `num_threads <= 0`, the number of hardware threads is used.
+  int num_threads = -1;
+};
+
+// Encodes the descriptors of an image into a single global vector, see
+// "Aggregating local descriptors into a compact image representation",
+// Jegou et al., CVPR 2010. The RootSIFT descriptors are assigned to their
+// nearest codebook center and the residuals are summed per center,
+// normalized per center, power-normalized, L2-normalized and reduced by
+// PCA to unit vectors, so that their dot product is a cosine similarity.
+class VladEncoder {
+ public:
+  // Train the codebook and the PCA on a uniform subset of the images.
+  bool Train(const VladOptions& options, const DescriptorLoader& loader);
+
+  bool IsTrained() const;
+  int NumDimensions() const;
+
+  // Encode the descriptors, where an image without descriptors is encoded
+  // as zero vector. Thread-safe.
+  void Encode(const FeatureDescriptors& descriptors,
+              Eigen::VectorXf* vector) const;
+
+  bool Write(const std::string& path) const;
+  bool Read(const std::string& path);
+
+ private:
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor>
+      RowMajorMatrixXf;
+
+  void EncodeFull(const FeatureDescriptors& descriptors,
+                  Eigen::VectorXf* vector) const;
+
+  float power_ = 0.5f;
+
+  // Cluster centers, one per row.
+  RowMajorMatrixXf centers_;
+
+  // Projection `pca_basis_ * (vector - pca_mean_)`, if reduced.
+  Eigen::VectorXf pca_mean_;
+  RowMajorMatrixXf pca_basis_;
+};
+
+// Appends vectors to a flat index file, which can be memory-mapped by
+// `VladIndex` for search without loading it. The file format is:
+//
+//    uint32 NUM_VECTORS uint32 DIM
+//    NUM_VECTORS x (uint32 IMAGE_ID, DIM x float VECTOR)
+//
+// with values stored in the byte order of the host. The number of vectors
+// is written on `Close`.
+class VladIndexWriter {
+ public:
+  VladIndexWriter();
+  ~VladIndexWriter();
+
+  bool Open(const std::string& path, const int num_dimensions);
+  bool Add(const uint32_t image_id, const Eigen::VectorXf& vector);
+  bool Close();
+
+ private:
+  FILE* file_;
+  int num_dimensions_;
+  uint32_t num_vectors_;
+  bool success_;
+};
+
+// Memory-mapped index of global image vectors with exact inner product
+// search, vectorized with SSE2 and parallelized over the vectors. A query
+// scans the whole index, i.e. about 1 GB per million 256-dimensional
+// vectors, and is bound by memory bandwidth, but needs no training and its
+// results are exact.
+class VladIndex {
+ public:
+  bool Open(const std::string& path);
+  void Close();
+
+  size_t NumVectors() const;
+  int NumDimensions() const;
+
+  uint32_t ImageId(const size_t idx) const;
+  const float* Vector(const size_t idx) const;
+
+  // Find the `k` vectors with the largest inner product with the query as
+  // pairs of image id and score, ordered by decreasing score. The vectors
+  // are scanned in parallel by `num_threads` threads.
+  void Search(const float* query, const int k, const int num_threads,
+              std::vector<std::pair<uint32_t, float>>* results) const;
+
+ private:
+  const uint8_t* Record(const size_t idx) const;
+
+  MappedFile file_;
+  size_t num_vectors_ = 0;
+  int num_dimensions_ = 0;
+  size_t record_size_ = 0;
+};
+
+// Inner product of two float vectors.
+float DotProduct(const float* vector1, const float* vector2, const int size);
+
+#endif  // COLMAP_SRC_BASE_VLAD_INDEX_H_
@@ -0,0 +1,313 @@
+#include "vocabulary_tree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <unordered_set>
+
+#include "VLFeat/hikmeans.h"
+#include "threading.h"
+
+VocabularyTree::VocabularyTree() : tree_(nullptr), num_words_(0) {}
+
+VocabularyTree::~VocabularyTree() {
+  if (tree_ != nullptr) {
+    vl_hikm_delete(tree_);
+  }
+}
+
+bool VocabularyTree::Build(const VocabularyTreeOptions& options,
+                           const FeatureDescriptors& training_descriptors) {
+  if (tree_ != nullptr) {
+    vl_hikm_delete(tree_);
+    tree_ = nullptr;
+  }
+  word_offsets_.clear();
+  num_words_ = 0;
+  inverted_file_.clear();
+  idf_weights_.clear();
+  image_idxs_.clear();
+  image_norms_.clear();
+
+  if (training_descriptors.rows() == 0 || options.branching <= 0 ||
+      options.depth <= 0) {
+    return false;
+  }
+
+  tree_ = vl_hikm_new(VL_IKM_ELKAN);
+  vl_hikm_set_max_niters(tree_, options.max_num_iterations);
+  vl_hikm_init(tree_, training_descriptors.cols(), options.branching,
+               options.depth);
+  vl_hikm_train(tree_, training_descriptors.data(),
+                training_descriptors.rows());
+
+  IndexNodes(vl_hikm_get_root(tree_));
+  inverted_file_.resize(num_words_);
+  idf_weights_.resize(num_words_, 0);
+
+  return true;
+}
+
+size_t VocabularyTree::NumWords() const { return num_words_; }
+
+size_t VocabularyTree::NumImages() const { return image_idxs_.size(); }
+
+void VocabularyTree::Quantize(const FeatureDescriptors& descriptors,
+                              WordHistogram* histogram) const {
+  histogram->clear();
+  if (tree_ == nullptr ||
+      static_cast<size_t>(descriptors.cols()) != vl_hikm_get_ndims(tree_)) {
+    return;
+  }
+
+  std::vector<uint32_t> word_ids(descriptors.rows());
+  for (FeatureDescriptors::Index i = 0; i < descriptors.rows(); ++i) {
+    word_ids[i] = QuantizeDescriptor(descriptors.data() +
+                                     i * descriptors.cols());
+  }
+  std::sort(word_ids.begin(), word_ids.end());
+
+  for (size_t i = 0; i < word_ids.size(); ++i) {
+    if (histogram->empty() || histogram->back().first != word_ids[i]) {
+      histogram->emplace_back(word_ids[i], 1.0f);
+    } else {
+      histogram->back().second += 1;
+    }
+  }
+}
+
+void VocabularyTree::Add(const size_t image_idx,
+                         const FeatureDescriptors& descriptors) {
+  WordHistogram histogram;
+  Quantize(descriptors, &histogram);
+  Add(image_idx, histogram);
+}
+
+void VocabularyTree::Add(const size_t image_idx,
+                         const WordHistogram& histogram) {
+  const uint32_t internal_idx = static_cast<uint32_t>(image_idxs_.size());
+  image_idxs_.push_back(image_idx);
+  image_norms_.push_back(0);
+  for (const auto& word : histogram) {
+    inverted_file_[word.first].emplace_back(internal_idx, word.second);
+  }
+}
+
+void VocabularyTree::Finalize() {
+  const float num_images = static_cast<float>(image_idxs_.size());
+  std::fill(image_norms_.begin(), image_norms_.end(), 0.0f);
+  for (uint32_t word_id = 0; word_id < num_words_; ++word_id) {
+    const auto& entries = inverted_file_[word_id];
+    if (entries.empty()) {
+      idf_weights_[word_id] = 0;
+      continue;
+    }
+    idf_weights_[word_id] = std::log(num_images / entries.size());
+    for (const auto& entry : entries) {
+      const float weight = entry.second * idf_weights_[word_id];
+      image_norms_[entry.first] += weight * weight;
+    }
+  }
+  for (auto& norm : image_norms_) {
+    norm = std::sqrt(norm);
+  }
+}
+
+void VocabularyTree::Query(
+    const FeatureDescriptors& descriptors, const int max_num_images,
+    std::vector<std::pair<size_t, float>>* image_scores) const {
+  WordHistogram histogram;
+  Quantize(descriptors, &histogram);
+  Query(histogram, max_num_images, image_scores);
+}
+
+void VocabularyTree::Query(
+    const WordHistogram& histogram, const int max_num_images,
+    std::vector<std::pair<size_t, float>>* image_scores) const {
+  image_scores->clear();
+  if (max_num_images <= 0) {
+    return;
+  }
+
+  // Accumulate the dot products over the inverted file of the query words.
+  std::vector<float> scores(image_idxs_.size(), 0);
+  float query_norm = 0;
+  for (const auto& word : histogram) {
+    const float idf_weight = idf_weights_[word.first];
+    const float query_weight = word.second * idf_weight;
+    if (query_weight == 0) {
+      continue;
+    }
+    query_norm += query_weight * query_weight;
+    for (const auto& entry : inverted_file_[word.first]) {
+      scores[entry.first] += query_weight * entry.second * idf_weight;
+    }
+  }
+  query_norm = std::sqrt(query_norm);
+  if (query_norm == 0) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < scores.size(); ++i) {
+    if (scores[i] > 0 && image_norms_[i] > 0) {
+      image_scores->emplace_back(image_idxs_[i],
+                                 scores[i] / (query_norm * image_norms_[i]));
+    }
+  }
+
+  const size_t num_images =
+      std::min(image_scores->size(), static_cast<size_t>(max_num_images));
+  std::partial_sort(image_scores->begin(), image_scores->begin() + num_images,
+                    image_scores->end(),
+                    [](const std::pair<size_t, float>& score1,
+                       const std::pair<size_t, float>& score2) {
+                      return score1.second > score2.second;
+                    });
+  image_scores->resize(num_images);
+}
+
+void VocabularyTree::IndexNodes(const VlHIKMNode* node) {
+  const uint32_t num_children =
+      static_cast<uint32_t>(vl_ikm_get_K(node->filter));
+  if (node->children == nullptr || num_children == 0) {
+    // Nodes whose cluster was empty during training form a single word.
+    word_offsets_[node] = num_words_;
+    num_words_ += std::max<uint32_t>(1, num_children);
+    return;
+  }
+  for (uint32_t k = 0; k < num_children; ++k) {
+    IndexNodes(node->children[k]);
+  }
+}
+
+uint32_t VocabularyTree::QuantizeDescriptor(const uint8_t* descriptor) const {
+  const VlHIKMNode* node = vl_hikm_get_root(tree_);
+  while (true) {
+    if (vl_ikm_get_K(node->filter) == 0) {
+      return word_offsets_.at(node);
+    }
+    vl_uint32 child_idx;
+    vl_ikm_push(node->filter, &child_idx, descriptor, 1);
+    if (node->children == nullptr) {
+      return word_offsets_.at(node) + child_idx;
+    }
+    node = node->children[child_idx];
+  }
+}
+
+bool RetrieveImagePairs(const ImageRetrievalOptions& options,
+                        const DescriptorLoader& loader,
+                        std::vector<std::pair<size_t, size_t>>* image_pairs) {
+  image_pairs->clear();
+
+  const size_t num_images = loader.NumImages();
+  if (num_images < 2) {
+    return true;
+  }
+
+  // Sample the same number of training descriptors from every image.
+  const size_t max_num_samples = std::max<size_t>(
+      1, options.tree_options.max_num_training_descriptors / num_images);
+  std::vector<FeatureDescriptors> samples(num_images);
+  std::vector<char> loaded(num_images, false);
+  ParallelForRange(
+      0, num_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        for (size_t image_idx = begin; image_idx < end; ++image_idx) {
+          if (!loader.Load(image_idx, &descriptors)) {
+            continue;
+          }
+          loaded[image_idx] = true;
+
+          std::vector<FeatureDescriptors::Index> rows(descriptors.rows());
+          std::iota(rows.begin(), rows.end(), 0);
+          std::mt19937 random_engine(static_cast<unsigned>(image_idx));
+          std::shuffle(rows.begin(), rows.end(), random_engine);
+          rows.resize(std::min(rows.size(), max_num_samples));
+
+          samples[image_idx].resize(rows.size(), descriptors.cols());
+          for (size_t i = 0; i < rows.size(); ++i) {
+            samples[image_idx].row(i) = descriptors.row(rows[i]);
+          }
+        }
+      });
+
+  size_t num_samples = 0;
+  FeatureDescriptors::Index dim = 0;
+  for (const auto& image_samples : samples) {
+    num_samples += image_samples.rows();
+    dim = std::max(dim, image_samples.cols());
+  }
+  FeatureDescriptors training_descriptors(num_samples, dim);
+  num_samples = 0;
+  for (const auto& image_samples : samples) {
+    if (image_samples.cols() == dim) {
+      training_descriptors.middleRows(num_samples, image_samples.rows()) =
+          image_samples;
+      num_samples += image_samples.rows();
+    }
+  }
+  training_descriptors.conservativeResize(num_samples, dim);
+  samples.clear();
+
+  VocabularyTree tree;
+  if (!tree.Build(options.tree_options, training_descriptors)) {
+    return false;
+  }
+
+  std::vector<VocabularyTree::WordHistogram> histograms(num_images);
+  ParallelForRange(
+      0, num_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        FeatureDescriptors descriptors;
+        for (size_t image_idx = begin; image_idx < end; ++image_idx) {
+          if (loaded[image_idx] && loader.Load(image_idx, &descriptors)) {
+            tree.Quantize(descriptors, &histograms[image_idx]);
+          }
+        }
+      });
+
+  for (size_t image_idx = 0; image_idx < num_images; ++image_idx) {
+    if (!histograms[image_idx].empty()) {
+      tree.Add(image_idx, histograms[image_idx]);
+    }
+  }
+  tree.Finalize();
+
+  // The best match of an image is usually the image itself.
+  std::vector<std::vector<std::pair<size_t, float>>> image_scores(
+      num_images);
+  ParallelForRange(
+      0, num_images, options.num_threads, 1,
+      [&](const size_t begin, const size_t end) {
+        for (size_t image_idx = begin; image_idx < end; ++image_idx) {
+          if (!histograms[image_idx].empty()) {
+            tree.Query(histograms[image_idx], options.num_neighbors + 1,
+                       &image_scores[image_idx]);
+          }
+        }
+      });
+
+  std::unordered_set<uint64_t> pair_ids;
+  for (size_t image_idx = 0; image_idx < num_images; ++image_idx) {
+    int num_neighbors = 0;
+    for (const auto& image_score : image_scores[image_idx]) {
+      if (image_score.first == image_idx) {
+        continue;
+      }
+      if (num_neighbors++ == options.num_neighbors) {
+        break;
+      }
+      const uint64_t min_idx = std::min(image_idx, image_score.first);
+      const uint64_t max_idx = std::max(image_idx, image_score.first);
+      if (pair_ids.insert((min_idx << 32) | max_idx).second) {
+        image_pairs->emplace_back(min_idx, max_idx);
+      }
+    }
+  }
+  std::sort(image_pairs->begin(), image_pairs->end());
+
+  return true;
+}
@@ -0,0 +1,117 @@
+#ifndef COLMAP_SRC_BASE_VOCABULARY_TREE_H_
+#define COLMAP_SRC_BASE_VOCABULARY_TREE_H_
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "exhaustive_matcher.h"
+#include "feature.h"
+
+struct _VlHIKMTree;
+struct _VlHIKMNode;
+
+struct VocabularyTreeOptions {
+  // Number of children per node and number of levels, which yields up to
+  // `branching^depth` visual words.
+  int branching = 10;
+  int depth = 4;
+
+  // Maximum number of k-means iterations per node.
+  int max_num_iterations = 30;
+
+  // Maximum number of descriptors to train the tree, sampled uniformly from
+  // all images.
+  size_t max_num_training_descriptors = 200000;
+};
+
+// Vocabulary tree of hierarchical integer k-means on the unsigned byte
+// descriptors with an inverted file and tf-idf scoring, see "Scalable
+// Recognition with a Vocabulary Tree", Nister and Stewenius, CVPR 2006:
+//
+//    VocabularyTree tree;
+//    tree.Build(options, training_descriptors);
+//    for (size_t i = 0; i < num_images; ++i) {
+//      tree.Add(i, descriptors[i]);
+//    }
+//    tree.Finalize();
+//    tree.Query(query_descriptors, 10, &image_scores);
+//
+// `Quantize` and `Query` are thread-safe, `Add` is not.
+class VocabularyTree {
+ public:
+  // Visual words of an image with their number of occurrences.
+  typedef std::vector<std::pair<uint32_t, float>> WordHistogram;
+
+  VocabularyTree();
+  ~VocabularyTree();
+
+  VocabularyTree(const VocabularyTree&) = delete;
+  VocabularyTree& operator=(const VocabularyTree&) = delete;
+
+  // Train the tree and clear the inverted file. Returns false if there are
+  // no training descriptors.
+  bool Build(const VocabularyTreeOptions& options,
+             const FeatureDescriptors& training_descriptors);
+
+  size_t NumWords() const;
+  size_t NumImages() const;
+
+  void Quantize(const FeatureDescriptors& descriptors,
+                WordHistogram* histogram) const;
+
+  void Add(const size_t image_idx, const FeatureDescriptors& descriptors);
+  void Add(const size_t image_idx, const WordHistogram& histogram);
+
+  // Compute the inverse document frequencies of the words and the norms of
+  // the image vectors. Must be called after adding images and before
+  // querying.
+  void Finalize();
+
+  // Find up to `max_num_images` indexed images ordered by decreasing cosine
+  // similarity of their tf-idf vectors.
+  void Query(const FeatureDescriptors& descriptors, const int max_num_images,
+             std::vector<std::pair<size_t, float>>* image_scores) const;
+  void Query(const WordHistogram& histogram, const int max_num_images,
+             std::vector<std::pair<size_t, float>>* image_scores) const;
+
+ private:
+  void IndexNodes(const _VlHIKMNode* node);
+  uint32_t QuantizeDescriptor(const uint8_t* descriptor) const;
+
+  _VlHIKMTree* tree_;
+
+  // First word of the nodes without children.
+  std::unordered_map<const _VlHIKMNode*, uint32_t> word_offsets_;
+  uint32_t num_words_;
+
+  // Entries of the inverted file per word as the internal image index and
+  // the term frequency.
+  std::vector<std::vector<std::pair<uint32_t, float>>> inverted_file_;
+  std::vector<float> idf_weights_;
+  std::vector<size_t> image_idxs_;
+  std::vector<float> image_norms_;
+};
+
+struct ImageRetrievalOptions {
+  VocabularyTreeOptions tree_options;
+
+  // Number of retrieved candidates per image.
+  int num_neighbors = 20;
+
+  // Number of threads to quantize and query images. If `num_threads <= 0`,
+  // the number of hardware threads is used.
+  int num_threads = -1;
+};
+
+// Select the image pairs to match by retrieving the most similar images of
+// every image with a vocabulary tree built from the images themselves. Every
+// descriptor set is loaded twice, once to sample the training descriptors
+// and once to index it. Returns each unordered pair once, with
+// `image_idx1 < image_idx2`, so that at most `num_neighbors * N` instead of
+// `N * (N - 1) / 2` pairs are matched.
+bool RetrieveImagePairs(const ImageRetrievalOptions& options,
+                        const DescriptorLoader& loader,
+                        std::vector<std::pair<size_t, size_t>>* image_pairs);
+
+#endif  // COLMAP_SRC_BASE_VOCABULARY_TREE_H_